@@ -0,0 +1,350 @@
+#include "Generator_OBJ_Mesh.h"
+#include <glcore\NCLDebug.h>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+
+Generator_OBJ_Mesh::Generator_OBJ_Mesh()
+	: m_Loaded(false)
+{
+	Transform = Matrix4();
+	SubDivisions = 0;
+	Scale = 1.0f;
+}
+
+Generator_OBJ_Mesh::Generator_OBJ_Mesh(const std::string& filename)
+	: Generator_OBJ_Mesh()
+{
+	m_Filename = filename;
+}
+
+void Generator_OBJ_Mesh::Generate(Sim_Generator_Output& out)
+{
+	if (!m_Loaded)
+	{
+		if (!LoadOBJ())
+		{
+			NCLERROR("Unable to load garment panel \"%s\", using a single quad instead", m_Filename.c_str());
+			LoadFallbackQuad();
+		}
+		m_Loaded = true;
+	}
+
+	std::vector<Edge> edges;
+	GenerateTopology(out, edges);
+	GeneratePositions(out, edges);
+	GenerateTangents(out, edges);
+}
+
+bool Generator_OBJ_Mesh::LoadOBJ()
+{
+	m_Vertices.clear();
+	m_VertTexCoords.clear();
+	m_Indices.clear();
+
+	std::ifstream f(m_Filename.c_str(), std::ios::in);
+	if (!f)
+		return false;
+
+	std::vector<Vector3> vertices;
+	std::vector<Vector2> tex_coords;
+	std::vector<int>	 vert_tex_idx;	//First texcoord referenced by each vertex (-1 if none)
+
+	//Resolves 1-based and negative (relative) OBJ indices, returns -1 if invalid/missing
+	auto resolve_idx = [](const std::string& str, size_t count) -> int
+	{
+		if (str.empty())
+			return -1;
+
+		int idx = atoi(str.c_str());
+		if (idx < 0)
+			idx += (int)count;
+		else
+			idx -= 1;
+
+		return (idx >= 0 && idx < (int)count) ? idx : -1;
+	};
+
+	std::string line;
+	while (std::getline(f, line))
+	{
+		std::istringstream ss(line);
+		std::string type;
+		ss >> type;
+
+		if (type == "v")
+		{
+			Vector3 v;
+			ss >> v.x >> v.y >> v.z;
+			vertices.push_back(v);
+			vert_tex_idx.push_back(-1);
+		}
+		else if (type == "vt")
+		{
+			Vector2 t;
+			ss >> t.x >> t.y;
+			tex_coords.push_back(t);
+		}
+		else if (type == "f")
+		{
+			//Polygons are fan triangulated (assumed convex)
+			std::vector<int> face;
+			std::string corner;
+			while (ss >> corner)
+			{
+				size_t slash = corner.find('/');
+				int vidx = resolve_idx(corner.substr(0, slash), vertices.size());
+				if (vidx < 0)
+					return false;
+
+				if (slash != std::string::npos && vert_tex_idx[vidx] < 0)
+				{
+					size_t slash2 = corner.find('/', slash + 1);
+					vert_tex_idx[vidx] = resolve_idx(corner.substr(slash + 1, slash2 - slash - 1), tex_coords.size());
+				}
+				face.push_back(vidx);
+			}
+
+			for (size_t i = 2; i < face.size(); ++i)
+			{
+				m_Indices.push_back(face[0]);
+				m_Indices.push_back(face[i - 1]);
+				m_Indices.push_back(face[i]);
+			}
+		}
+	}
+
+	if (vertices.size() < 3 || m_Indices.empty())
+		return false;
+
+	FlattenPanel(vertices);
+
+	//Texture coords come from the file if every vertex has one, otherwise the flattened panel bounds are used
+	bool has_tex_coords = true;
+	for (int idx : vert_tex_idx)
+		has_tex_coords &= (idx >= 0);
+
+	m_VertTexCoords.resize(m_Vertices.size());
+	if (has_tex_coords)
+	{
+		for (size_t i = 0; i < m_Vertices.size(); ++i)
+			m_VertTexCoords[i] = tex_coords[vert_tex_idx[i]];
+	}
+	else
+	{
+		Vector3 lower(FLT_MAX, FLT_MAX, 0.0f), upper(-FLT_MAX, -FLT_MAX, 0.0f);
+		for (const Vector3& v : m_Vertices)
+		{
+			lower.x = (v.x < lower.x) ? v.x : lower.x;
+			lower.y = (v.y < lower.y) ? v.y : lower.y;
+			upper.x = (v.x > upper.x) ? v.x : upper.x;
+			upper.y = (v.y > upper.y) ? v.y : upper.y;
+		}
+
+		float extent = (upper.x - lower.x > upper.y - lower.y) ? upper.x - lower.x : upper.y - lower.y;
+		float inv_extent = (extent > 0.0f) ? 1.0f / extent : 1.0f;
+		for (size_t i = 0; i < m_Vertices.size(); ++i)
+		{
+			//Matches the square grid, where v increases downwards
+			m_VertTexCoords[i] = Vector2(
+				(m_Vertices[i].x - lower.x) * inv_extent,
+				(upper.y - m_Vertices[i].y) * inv_extent);
+		}
+	}
+
+	return true;
+}
+
+void Generator_OBJ_Mesh::LoadFallbackQuad()
+{
+	m_Vertices = { Vector3(-0.5f, 0.5f, 0.0f), Vector3(0.5f, 0.5f, 0.0f), Vector3(0.5f, -0.5f, 0.0f), Vector3(-0.5f, -0.5f, 0.0f) };
+	m_VertTexCoords = { Vector2(0.0f, 0.0f), Vector2(1.0f, 0.0f), Vector2(1.0f, 1.0f), Vector2(0.0f, 1.0f) };
+	m_Indices = { 0, 2, 1, 0, 3, 2 };
+
+	for (Vector3& v : m_Vertices)
+		v = v * Scale;
+}
+
+void Generator_OBJ_Mesh::FlattenPanel(const std::vector<Vector3>& vertices)
+{
+	//The FE rest configuration is 2D, so project the panel onto its best fit plane
+	Vector3 normal(0.0f, 0.0f, 0.0f);
+	Vector3 centre(0.0f, 0.0f, 0.0f);
+	for (size_t i = 0; i < m_Indices.size(); i += 3)
+	{
+		const Vector3& a = vertices[m_Indices[i]];
+		const Vector3& b = vertices[m_Indices[i + 1]];
+		const Vector3& c = vertices[m_Indices[i + 2]];
+		normal += Vector3::Cross(b - a, c - a);
+	}
+	for (const Vector3& v : vertices)
+		centre += v;
+	centre = centre / (float)vertices.size();
+
+	if (normal.LengthSquared() < 1e-12f)
+		normal = Vector3(0.0f, 0.0f, 1.0f);
+	normal.Normalise();
+
+	//Keep the panels X axis as the weft direction where possible
+	Vector3 axis_u = Vector3(1.0f, 0.0f, 0.0f);
+	if (fabs(Vector3::Dot(axis_u, normal)) > 0.9f)
+		axis_u = Vector3(0.0f, 1.0f, 0.0f);
+	axis_u = axis_u - normal * Vector3::Dot(axis_u, normal);
+	axis_u.Normalise();
+	Vector3 axis_v = Vector3::Cross(normal, axis_u);
+
+	m_Vertices.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		Vector3 local = vertices[i] - centre;
+		m_Vertices[i] = Vector3(Vector3::Dot(local, axis_u), Vector3::Dot(local, axis_v), 0.0f) * Scale;
+	}
+}
+
+void Generator_OBJ_Mesh::GenerateTopology(Sim_Generator_Output& out, std::vector<Edge>& edges)
+{
+	uint num_corners = (uint)m_Vertices.size();
+	uint num_tris = (uint)m_Indices.size() / 3;
+
+	//Unique edges keyed on their (sorted) corner pair
+	std::unordered_map<unsigned long long, uint> edge_lookup;
+	edge_lookup.reserve(num_tris * 2);
+	edges.clear();
+	edges.reserve(num_tris * 2);
+
+	auto get_edge = [&](uint tri_idx, uint p, uint q, uint opposite) -> uint
+	{
+		uint a = (p < q) ? p : q;
+		uint b = (p < q) ? q : p;
+		unsigned long long key = ((unsigned long long)a << 32) | b;
+
+		auto itr = edge_lookup.find(key);
+		uint idx;
+		if (itr == edge_lookup.end())
+		{
+			idx = (uint)edges.size();
+			edge_lookup[key] = idx;
+
+			Edge e;
+			e.a = a;
+			e.b = b;
+			e.owner = tri_idx;
+			e.num_tris = 0;
+			e.across = Vector3(0.0f, 0.0f, 0.0f);
+			edges.push_back(e);
+		}
+		else
+		{
+			idx = itr->second;
+		}
+
+		edges[idx].num_tris++;
+		Vector3 dir = m_Vertices[opposite] - (m_Vertices[p] + m_Vertices[q]) * 0.5f;
+		if (edges[idx].owner == tri_idx)
+			edges[idx].across += dir;
+		else
+			edges[idx].across -= dir;
+
+		return idx;
+	};
+
+	out.Triangles.resize(num_tris);
+	for (uint i = 0; i < num_tris; ++i)
+	{
+		uint v1 = m_Indices[i * 3];
+		uint v2 = m_Indices[i * 3 + 1];
+		uint v3 = m_Indices[i * 3 + 2];
+
+		uint e12 = get_edge(i, v1, v2, v3);
+		uint e23 = get_edge(i, v2, v3, v1);
+		uint e31 = get_edge(i, v3, v1, v2);
+
+		FETriangle& tri = out.Triangles[i];
+		tri = FETriangle(v1, v2, v3, num_corners + e12, num_corners + e23, num_corners + e31);
+
+		//Corner tangents, stored pointing from the edge's 'a' corner (0) or 'b' corner (1) along the edge
+		auto corner_tan = [&](uint edge, uint from) { return edge * 3 + ((edges[edge].a == from) ? 0 : 1); };
+
+		tri.t12 = corner_tan(e12, v1);
+		tri.t13 = corner_tan(e31, v1);
+		tri.t21 = corner_tan(e12, v2);
+		tri.t23 = corner_tan(e23, v2);
+		tri.t31 = corner_tan(e31, v3);
+		tri.t32 = corner_tan(e23, v3);
+
+		//The 3rd vertex tangents are defined as pointing into the vertex
+		tri.t31_mult = -1.f;
+		tri.t32_mult = -1.f;
+
+		//Mid-edge tangents point towards the owning triangle's opposite vertex
+		tri.tab = e12 * 3 + 2;
+		tri.tbc = e23 * 3 + 2;
+		tri.tca = e31 * 3 + 2;
+
+		tri.tab_mult = (edges[e12].owner == i) ? 1.f : -1.f;
+		tri.tbc_mult = (edges[e23].owner == i) ? 1.f : -1.f;
+		tri.tca_mult = (edges[e31].owner == i) ? 1.f : -1.f;
+	}
+
+	out.NumVertices = num_corners + (uint)edges.size();
+	out.NumTangents = (uint)edges.size() * 3;
+	out.GridWidth = 0;
+}
+
+void Generator_OBJ_Mesh::GeneratePositions(Sim_Generator_Output& out, const std::vector<Edge>& edges)
+{
+	uint num_corners = (uint)m_Vertices.size();
+	uint num_total = out.NumVertices + out.NumTangents;
+
+	out.Phyxels.resize(num_total);
+	out.Phyxels_Initial.resize(num_total);
+	out.Phyxel_Descriptors.resize(out.NumVertices);
+	out.Actuators.clear();
+
+#pragma omp parallel for
+	for (int i = 0; i < (int)out.NumVertices; ++i)
+	{
+		FEVertDescriptor& desc = out.Phyxel_Descriptors[i];
+		desc.isStatic = false;
+
+		if (i < (int)num_corners)
+		{
+			desc.tCoord = m_VertTexCoords[i];
+			out.Phyxels_Initial[i] = m_Vertices[i];
+		}
+		else
+		{
+			const Edge& e = edges[i - num_corners];
+			desc.tCoord = (m_VertTexCoords[e.a] + m_VertTexCoords[e.b]) * 0.5f;
+			out.Phyxels_Initial[i] = (m_Vertices[e.a] + m_Vertices[e.b]) * 0.5f;
+		}
+
+		out.Phyxels[i] = Transform * out.Phyxels_Initial[i];
+	}
+}
+
+void Generator_OBJ_Mesh::GenerateTangents(Sim_Generator_Output& out, const std::vector<Edge>& edges)
+{
+	uint num_corners = (uint)m_Vertices.size();
+	Vector3* tangents_transformed = &out.Phyxels[out.NumVertices];
+	Vector3* tangents_initial = &out.Phyxels_Initial[out.NumVertices];
+
+#pragma omp parallel for
+	for (int i = 0; i < (int)edges.size(); ++i)
+	{
+		const Edge& e = edges[i];
+		uint mid = num_corners + i;
+
+		tangents_initial[i * 3] = out.Phyxels_Initial[e.b] - out.Phyxels_Initial[e.a];
+		tangents_initial[i * 3 + 1] = out.Phyxels_Initial[e.a] - out.Phyxels_Initial[e.b];
+
+		tangents_transformed[i * 3] = out.Phyxels[e.b] - out.Phyxels[e.a];
+		tangents_transformed[i * 3 + 1] = out.Phyxels[e.a] - out.Phyxels[e.b];
+
+		//Shared edges average both sides, which for symmetric pairs (e.g. grid quads) is just the owner's direction
+		Vector3 across = e.across / (float)e.num_tris;
+
+		tangents_initial[i * 3 + 2] = across;
+		tangents_transformed[i * 3 + 2] = (Transform * (out.Phyxels_Initial[mid] + across)) - out.Phyxels[mid];
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Sim_Generator.h"
+#include <string>
+
+//Builds a 6-noded (C0/C1) simulation mesh from an arbitrary triangulated panel stored as a Wavefront OBJ
+// - Corner phyxels are the OBJ vertices, followed by one mid-edge phyxel per unique edge
+// - Each unique edge owns three tangents: one at each end pointing along the edge and one at the mid-point pointing across it
+// - The panel is flattened into the XY plane (rest configuration), then placed in the world by the Transform
+class Generator_OBJ_Mesh : public Sim_Generator
+{
+public:
+	Generator_OBJ_Mesh();
+	Generator_OBJ_Mesh(const std::string& filename);
+
+	virtual void Generate(Sim_Generator_Output& out) override;
+
+	void SetFilename(const std::string& filename) { m_Filename = filename; m_Loaded = false; }
+	const std::string& GetFilename() const { return m_Filename; }
+
+	float Scale;	//Uniform scale applied to the flattened panel
+
+protected:
+	struct Edge
+	{
+		uint a, b;			//Corner phyxels (a < b)
+		uint owner;			//First triangle to reference the edge
+		uint num_tris;		//1 on the panel boundary, 2 inside
+		Vector3 across;		//Sum of mid-point -> opposite vertex directions (negated for the non-owner)
+	};
+
+	bool LoadOBJ();
+	void LoadFallbackQuad();
+	void FlattenPanel(const std::vector<Vector3>& vertices);
+
+	void GenerateTopology(Sim_Generator_Output& out, std::vector<Edge>& edges);
+	void GeneratePositions(Sim_Generator_Output& out, const std::vector<Edge>& edges);
+	void GenerateTangents(Sim_Generator_Output& out, const std::vector<Edge>& edges);
+
+	std::string				m_Filename;
+	bool					m_Loaded;
+
+	//Cached panel, so transform-only regeneration does not touch the file again
+	std::vector<Vector3>	m_Vertices;
+	std::vector<Vector2>	m_VertTexCoords;
+	std::vector<uint>		m_Indices;
+};
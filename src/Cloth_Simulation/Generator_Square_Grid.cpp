@@ -11,6 +11,7 @@ void Generator_Square_Grid::Generate(Sim_Generator_Output& out)
 	uint num_total = GetNumVertices() + GetNumTangents();
 	out.NumVertices = GetNumVertices();
 	out.NumTangents = GetNumTangents();
+	out.GridWidth = SubDivisions;
 
 	out.Phyxels.resize(num_total);
 	out.Phyxels_Initial.resize(num_total);
@@ -27,17 +27,19 @@ public:
 		const float time_to_destination = 3.f;
 		const Vector3 dir = Transform * Vector3(0, 0, -0.3f / time_to_destination);
 		
-		out.Actuators.push_back([=](float elapsedTime, Vector3* x, Vector3* dxdt)
+		//Output may be reordered after generation (see Sim_Reordering), so the mid point is looked up at runtime.
+		// Only values are captured, the generator and output may be gone by the time it runs.
+		out.Actuators.push_back([mid, dir, time_to_destination](float elapsedTime, const Sim_Generator_Output& config, Vector3* x, Vector3* dxdt)
 		{
-			uint mid = GetVertIdx((SubDivisions - 1) / 2, (SubDivisions - 1) / 2);
+			uint mid_idx = config.ReorderedIndex(mid);
 			if (elapsedTime < time_to_destination)
 			{
-				x[mid] = dir * elapsedTime;
-				dxdt[mid] = dir;
+				x[mid_idx] = dir * elapsedTime;
+				dxdt[mid_idx] = dir;
 			}
 			else
 			{
-				dxdt[mid] = Vector3(0.f, 0.f, 0.f);
+				dxdt[mid_idx] = Vector3(0.f, 0.f, 0.f);
 				//x[mid].y = 0.3f;
 			}		
 		});
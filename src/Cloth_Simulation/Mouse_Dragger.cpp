@@ -19,6 +19,22 @@ Mouse_Dragger::~Mouse_Dragger()
 	m_Sim = NULL;
 }
 
+uint Mouse_Dragger::GetHoverOriginalIdx() const
+{
+	if (m_Sim == NULL)
+		return UINT_MAX;
+
+	uint idx = m_HoverIdx;
+	if (m_DragTangents)
+		idx = (m_HoverIdx < m_TangentsDescriptors.size()) ? m_TangentsDescriptors[m_HoverIdx].tangent_idx : UINT_MAX;
+
+	const Sim_Generator_Output& config = m_Sim->BaseConfig();
+	if (idx >= config.NumVertices + config.NumTangents)
+		return UINT_MAX;
+
+	return config.OriginalIndex(idx);
+}
+
 void Mouse_Dragger::SetIsTangents(bool mode)
 { 
 	if (mode != m_DragTangents)
@@ -27,23 +43,44 @@ void Mouse_Dragger::SetIsTangents(bool mode)
 
 		if (m_IsDragging)
 		{
-			m_Sim->Simulation()->SetIsStatic(m_DragIdx, m_IsOrigStatic);
+			SetIsStatic(m_DragIdx, m_IsOrigStatic, false);
 			m_IsDragging = false;
 			m_HoverIdx = -1;
 		}
 		
-		using namespace std::placeholders;
-		if (m_DragTangents)
-		{
-			IsMouseOverPoint = std::bind(&Mouse_Dragger::IsMouseOverPoint_Tangent, this, _1, _2, _3);
-			UpdatePoint = std::bind(&Mouse_Dragger::UpdatePoint_Tangent, this, _1, _2);
-		}
-		else
-		{
-			IsMouseOverPoint = std::bind(&Mouse_Dragger::IsMouseOverPoint_Position, this, _1, _2, _3);
-			UpdatePoint = std::bind(&Mouse_Dragger::UpdatePoint_Position, this, _1, _2);
-		}
+		BindPickFunctions();
+	}
+}
+
+void Mouse_Dragger::SetPickSurface(bool mode)
+{
+	if (mode != m_PickSurface)
+	{
+		m_PickSurface = mode;
+		BindPickFunctions();
+	}
+}
+
+void Mouse_Dragger::BindPickFunctions()
+{
+	using namespace std::placeholders;
+	if (m_DragTangents)
+	{
+		IsMouseOverPoint = std::bind(&Mouse_Dragger::IsMouseOverPoint_Tangent, this, _1, _2, _3);
+		UpdatePoint = std::bind(&Mouse_Dragger::UpdatePoint_Tangent, this, _1, _2);
+	}
+	else if (m_PickSurface)
+	{
+		IsMouseOverPoint = std::bind(&Mouse_Dragger::IsMouseOverPoint_Surface, this, _1, _2, _3);
+		UpdatePoint = std::bind(&Mouse_Dragger::UpdatePoint_Position, this, _1, _2);
+	}
+	else
+	{
+		IsMouseOverPoint = std::bind(&Mouse_Dragger::IsMouseOverPoint_Position, this, _1, _2, _3);
+		UpdatePoint = std::bind(&Mouse_Dragger::UpdatePoint_Position, this, _1, _2);
 	}
+	m_PickTree.Clear();
+	m_PickTreeMode = -1;
 }
 
 void Mouse_Dragger::UpdateTangentDescriptors()
@@ -52,41 +89,78 @@ void Mouse_Dragger::UpdateTangentDescriptors()
 		return;
 
 	unsigned int num_phyxels = m_Sim->BaseConfig().NumVertices;
+	const Vector3* x = &m_Sim->Snapshot().x[0];
+	const std::vector<FETriangle>& triangles = m_Sim->BaseConfig().Triangles;
 
-	uint num_tangents = m_Sim->BaseConfig().NumTangents;
+	//Tangent i of each triangle is attached to tangent_verts[i]
+	const uint tangent_verts[9] = { 0, 0, 1, 1, 2, 2, 3, 4, 5 };
 
-	m_TangentsDescriptors.clear();
-
-	auto add_tangent = [&](const FETriangle& tri, uint tan_idx, uint vert_idx)
+	m_TangentsDescriptors.resize(triangles.size() * 9);
+	for (uint i = 0; i < (uint)triangles.size(); ++i)
 	{
-		uint tidx = tri.tangents[tan_idx];
+		const FETriangle& tri = triangles[i];
+		for (uint j = 0; j < 9; ++j)
+		{
+			Mouse_Dragger_TangentDescriptor& desc = m_TangentsDescriptors[i * 9 + j];
+			desc.phyxel_idx = tri.phyxels[tangent_verts[j]];
+			desc.tangent_idx = tri.tangents[j] + num_phyxels;
+			desc.tangent_mult = tri.tan_multipliers[j];
+			desc.tangent_position = x[desc.phyxel_idx] + (x[desc.tangent_idx] * desc.tangent_mult) * 0.25f;
+		}
+	}
 
-		Vector3 tan = m_Sim->Integrator()->X()[tidx + num_phyxels] * tri.tan_multipliers[tan_idx];
-		Vector3 pos = m_Sim->Integrator()->X()[tri.phyxels[vert_idx]];
+	m_PickTree.Clear();
+	m_PickTreeMode = -1;
+}
 
-		Mouse_Dragger_TangentDescriptor desc;
-		desc.phyxel_idx = tri.phyxels[vert_idx];
-		desc.tangent_idx = tri.tangents[tan_idx] + num_phyxels;
-		desc.tangent_mult = tri.tan_multipliers[tan_idx];
-		desc.tangent_position = m_Sim->Integrator()->X()[tri.phyxels[vert_idx]] + (m_Sim->Integrator()->X()[desc.tangent_idx] * desc.tangent_mult) * 0.25f;
+void Mouse_Dragger::UpdatePickTree()
+{
+	const Vector3* x = &m_Sim->Snapshot().x[0];
+	const Vector3 radius(MOUSE_DRAGGER_PICK_RADIUS, MOUSE_DRAGGER_PICK_RADIUS, MOUSE_DRAGGER_PICK_RADIUS);
+	int mode = m_DragTangents ? 1 : (m_PickSurface ? 2 : 0);
+	size_t old_size = m_PickBounds.size();
 
-		m_TangentsDescriptors.push_back(desc);
-	};
+	if (mode == 0)
+	{
+		uint num_phyxels = m_Sim->BaseConfig().NumVertices;
+		m_PickBounds.resize(num_phyxels);
+		for (uint i = 0; i < num_phyxels; ++i)
+		{
+			m_PickBounds[i].minPoints = x[i] - radius;
+			m_PickBounds[i].maxPoints = x[i] + radius;
+		}
+	}
+	else if (mode == 1)
+	{
+		m_PickBounds.resize(m_TangentsDescriptors.size());
+		for (uint i = 0; i < (uint)m_TangentsDescriptors.size(); ++i)
+		{
+			m_PickBounds[i].minPoints = m_TangentsDescriptors[i].tangent_position - radius;
+			m_PickBounds[i].maxPoints = m_TangentsDescriptors[i].tangent_position + radius;
+		}
+	}
+	else
+	{
+		const std::vector<FETriangle>& triangles = m_Sim->BaseConfig().Triangles;
+		m_PickBounds.resize(triangles.size());
+		for (uint i = 0; i < (uint)triangles.size(); ++i)
+		{
+			BoundingBox bounds;
+			for (int j = 0; j < 6; ++j)
+				bounds.ExpandToFit(x[triangles[i].phyxels[j]]);
+			m_PickBounds[i] = bounds;
+		}
+	}
 
-	for (auto& tri : m_Sim->BaseConfig().Triangles)
+	if (mode == m_PickTreeMode && old_size == m_PickBounds.size())
 	{
-		add_tangent(tri, 0, 0);
-		add_tangent(tri, 1, 0);
-		add_tangent(tri, 2, 1);
-		add_tangent(tri, 3, 1);
-		add_tangent(tri, 4, 2);
-		add_tangent(tri, 5, 2);
-
-		add_tangent(tri, 6, 3);
-		add_tangent(tri, 7, 4);
-		add_tangent(tri, 8, 5);
+		m_PickTree.Refit(m_PickBounds);
+	}
+	else
+	{
+		m_PickTree.Build(m_PickBounds);
+		m_PickTreeMode = mode;
 	}
-	
 }
 
 void Mouse_Dragger::RenderDragables()
@@ -95,14 +169,15 @@ void Mouse_Dragger::RenderDragables()
 		return;
 
 	unsigned int num_phyxels = m_Sim->BaseConfig().NumVertices;
+	const Sim_Snapshot& snapshot = m_Sim->Snapshot();
 	if (m_DragTangents)
 	{
 		for (uint i = 0; i < m_TangentsDescriptors.size(); ++i)
 		{
 			auto& dtan = m_TangentsDescriptors[i];
 
-			Vector3 tan = m_Sim->Integrator()->X()[dtan.tangent_idx] * dtan.tangent_mult;
-			Vector3 pos = m_Sim->Integrator()->X()[dtan.phyxel_idx];
+			Vector3 tan = snapshot.x[dtan.tangent_idx] * dtan.tangent_mult;
+			Vector3 pos = snapshot.x[dtan.phyxel_idx];
 			dtan.tangent_position = pos + tan * 0.25f;
 
 			NCLDebug::DrawThickLineNDT(pos, dtan.tangent_position, 0.02f, Vector4(1.0f, 0.f, 1.0f, 0.3f));
@@ -113,7 +188,7 @@ void Mouse_Dragger::RenderDragables()
 			}
 			else
 			{
-				if (m_Sim->Simulation()->GetIsStatic(dtan.tangent_idx))
+				if (snapshot.is_static[dtan.tangent_idx])
 					NCLDebug::DrawPointNDT(dtan.tangent_position, 0.02f, Vector4(0.0f, 0.0f, 0.0f, 0.9f));
 				else
 					NCLDebug::DrawPointNDT(dtan.tangent_position, 0.02f, Vector4(0.0f, 0.0f, 0.0f, 0.3f));
@@ -126,17 +201,20 @@ void Mouse_Dragger::RenderDragables()
 		{
 			if (i == m_HoverIdx)
 			{
-				NCLDebug::DrawPointNDT(m_Sim->Integrator()->X()[i], 0.02f, Vector4(1.f, 0.8f, 0.5f, 1.f));
+				NCLDebug::DrawPointNDT(snapshot.x[i], 0.02f, Vector4(1.f, 0.8f, 0.5f, 1.f));
 			}
 			else
 			{
-				if (m_Sim->Simulation()->GetIsStatic(i))
-					NCLDebug::DrawPointNDT(m_Sim->Integrator()->X()[i], 0.02f, Vector4(0.0f, 0.0f, 0.0f, 0.9f));
+				if (snapshot.is_static[i])
+					NCLDebug::DrawPointNDT(snapshot.x[i], 0.02f, Vector4(0.0f, 0.0f, 0.0f, 0.9f));
 				else
-					NCLDebug::DrawPointNDT(m_Sim->Integrator()->X()[i], 0.02f, Vector4(0.0f, 0.0f, 0.0f, 0.3f));
+					NCLDebug::DrawPointNDT(snapshot.x[i], 0.02f, Vector4(0.0f, 0.0f, 0.0f, 0.3f));
 			}
 		}
 	}
+
+	//After the tangent positions above have been updated
+	UpdatePickTree();
 }
 
 
@@ -167,9 +245,7 @@ bool Mouse_Dragger::OnUpdateMouseInput(bool hasFocus)
 
 		if (Input::IsMouseToggled(GLFW_MOUSE_BUTTON_RIGHT))
 		{
-			bool is_static = !m_Sim->Simulation()->GetIsStatic(idx);
-			m_Sim->Simulation()->SetIsStatic(idx, is_static);
-			m_Sim->Integrator()->DxDt()[idx] = Vector3(0.f, 0.f, 0.f);
+			SetIsStatic(idx, !m_Sim->Snapshot().is_static[idx], true);
 		}
 
 		if (Input::IsMouseDown(GLFW_MOUSE_BUTTON_LEFT))
@@ -179,12 +255,11 @@ bool Mouse_Dragger::OnUpdateMouseInput(bool hasFocus)
 
 			Vector3 new_pos = ray.GetPointOnRay(m_MouseRayDepth);
 			UpdatePoint(point_idx, new_pos);
-			m_Sim->Renderer()->BuildVertexBuffer(m_Sim->Integrator());
 		}
 		else if (m_IsDragging)
 		{
 			m_IsDragging = false;
-			m_Sim->Simulation()->SetIsStatic(idx, m_IsOrigStatic);
+			SetIsStatic(idx, m_IsOrigStatic, false);
 		}
 	}
 	else
@@ -195,23 +270,26 @@ bool Mouse_Dragger::OnUpdateMouseInput(bool hasFocus)
 	return m_IsDragging;
 }
 
+void Mouse_Dragger::SetIsStatic(uint idx, bool is_static, bool reset_velocity)
+{
+	m_Sim->QueueCommand([idx, is_static, reset_velocity](Sim_Manager* sim)
+	{
+		sim->Simulation()->SetIsStatic(idx, is_static);
+		if (reset_velocity)
+			sim->Integrator()->DxDt()[idx] = Vector3(0.f, 0.f, 0.f);
+	});
+}
+
 bool Mouse_Dragger::IsMouseOverPoint_Position(const Ray& ray, uint* out_idx, float* out_dist)
 {
-	float best_dist = FLT_MAX, current_dist;
-	uint best_idx = UINT_MAX;
+	const Vector3* x = &m_Sim->Snapshot().x[0];
 
-	uint numverts = m_Sim->BaseConfig().NumVertices;
-	for (uint i = 0; i < numverts; ++i)
-	{	
-		if (ray.intersectsSphere(m_Sim->Integrator()->X()[i], 0.02f, &current_dist))
-		{
-			if (current_dist < best_dist)
-			{
-				best_dist = current_dist;
-				best_idx = i;
-			}
-		}
-	}
+	uint best_idx;
+	float best_dist = m_PickTree.RayCast(ray.pos, ray.dir, [&](uint i, float max_dist)
+	{
+		float dist;
+		return ray.intersectsSphere(x[i], MOUSE_DRAGGER_PICK_RADIUS, &dist) ? dist : FLT_MAX;
+	}, &best_idx);
 
 	if (out_idx) *out_idx = best_idx;
 	if (out_dist) *out_dist = best_dist;
@@ -224,37 +302,98 @@ void Mouse_Dragger::UpdatePoint_Position(uint idx, const Vector3& position)
 	if (m_IsDragging)
 	{
 		Vector3 new_pos = position + m_ClickOffset;
-		
-		if (m_Drag2D)
-			new_pos.z = m_Sim->Integrator()->X()[idx].z;
+		bool drag_2d = m_Drag2D;
 
-		m_Sim->Integrator()->X()[idx] = new_pos;
+		m_Sim->QueueCommand([idx, new_pos, drag_2d](Sim_Manager* sim)
+		{
+			Vector3& x = sim->Integrator()->X()[idx];
+			x = Vector3(new_pos.x, new_pos.y, drag_2d ? x.z : new_pos.z);
+		});
 	}
 	else if (!Input::IsMouseHeld(GLFW_MOUSE_BUTTON_LEFT))
 	{
 		m_IsDragging = true;
 		m_DragIdx = idx;
 		
-		m_IsOrigStatic = m_Sim->Simulation()->GetIsStatic(idx);
-		m_ClickOffset = m_Sim->Integrator()->X()[idx] - position;
-		m_Sim->Simulation()->SetIsStatic(idx, true);
+		m_IsOrigStatic = (m_Sim->Snapshot().is_static[idx] != 0);
+		m_ClickOffset = m_Sim->Snapshot().x[idx] - position;
+		SetIsStatic(idx, true, false);
 	}
 }
 
 bool Mouse_Dragger::IsMouseOverPoint_Tangent(const Ray& ray, uint* out_idx, float* out_dist)
 {
-	float best_dist = FLT_MAX, current_dist;
-	uint best_idx = UINT_MAX;
+	uint best_idx;
+	float best_dist = m_PickTree.RayCast(ray.pos, ray.dir, [&](uint i, float max_dist)
+	{
+		float dist;
+		return ray.intersectsSphere(m_TangentsDescriptors[i].tangent_position, MOUSE_DRAGGER_PICK_RADIUS, &dist) ? dist : FLT_MAX;
+	}, &best_idx);
+
+	if (out_idx) *out_idx = best_idx;
+	if (out_dist) *out_dist = best_dist;
 
-	uint numverts = m_Sim->BaseConfig().NumVertices;
-	for (uint i = 0; i < m_TangentsDescriptors.size(); ++i)
+	return (best_idx < UINT_MAX);
+}
+
+//Moller-Trumbore, returns FLT_MAX for a miss
+static float RayTriangle(const Ray& ray, const Vector3& a, const Vector3& b, const Vector3& c)
+{
+	Vector3 e1 = b - a;
+	Vector3 e2 = c - a;
+	Vector3 p = Vector3::Cross(ray.dir, e2);
+	float det = Vector3::Dot(e1, p);
+	if (fabs(det) < 1E-12f)
+		return FLT_MAX;
+
+	float inv_det = 1.f / det;
+	Vector3 s = ray.pos - a;
+	float u = Vector3::Dot(s, p) * inv_det;
+	if (u < 0.f || u > 1.f)
+		return FLT_MAX;
+
+	Vector3 q = Vector3::Cross(s, e1);
+	float v = Vector3::Dot(ray.dir, q) * inv_det;
+	if (v < 0.f || u + v > 1.f)
+		return FLT_MAX;
+
+	float t = Vector3::Dot(e2, q) * inv_det;
+	return (t >= 0.f) ? t : FLT_MAX;
+}
+
+bool Mouse_Dragger::IsMouseOverPoint_Surface(const Ray& ray, uint* out_idx, float* out_dist)
+{
+	const Vector3* x = &m_Sim->Snapshot().x[0];
+	const std::vector<FETriangle>& triangles = m_Sim->BaseConfig().Triangles;
+
+	//Each element is hit tested as the four flat triangles between its corner and edge phyxels
+	uint best_tri;
+	float best_dist = m_PickTree.RayCast(ray.pos, ray.dir, [&](uint i, float max_dist)
+	{
+		const uint* p = triangles[i].phyxels;
+		float dist = RayTriangle(ray, x[p[0]], x[p[3]], x[p[5]]);
+		float d;
+		d = RayTriangle(ray, x[p[3]], x[p[1]], x[p[4]]);	dist = (d < dist) ? d : dist;
+		d = RayTriangle(ray, x[p[5]], x[p[4]], x[p[2]]);	dist = (d < dist) ? d : dist;
+		d = RayTriangle(ray, x[p[3]], x[p[4]], x[p[5]]);	dist = (d < dist) ? d : dist;
+		return dist;
+	}, &best_tri);
+
+	uint best_idx = UINT_MAX;
+	if (best_tri != UINT_MAX)
 	{
-		if (ray.intersectsSphere(m_TangentsDescriptors[i].tangent_position, 0.02f, &current_dist))
+		//Drag the phyxel of the element closest to the hit
+		Vector3 hit = ray.GetPointOnRay(best_dist);
+		float best_sq = FLT_MAX;
+		for (int j = 0; j < 6; ++j)
 		{
-			if (current_dist < best_dist)
+			uint idx = triangles[best_tri].phyxels[j];
+			Vector3 diff = x[idx] - hit;
+			float dist_sq = Vector3::Dot(diff, diff);
+			if (dist_sq < best_sq)
 			{
-				best_dist = current_dist;
-				best_idx = i;
+				best_sq = dist_sq;
+				best_idx = idx;
 			}
 		}
 	}
@@ -271,21 +410,30 @@ void Mouse_Dragger::UpdatePoint_Tangent(uint idx, const Vector3& position)
 
 	if (m_IsDragging)
 	{
-		Vector3 new_tan = (position + m_ClickOffset - m_Sim->Integrator()->X()[tangent.phyxel_idx]) * 4.f * tangent.tangent_mult;
+		//Relative to the phyxel where the command runs, it may have moved since the snapshot
+		Vector3 target = position + m_ClickOffset;
+		Mouse_Dragger_TangentDescriptor desc = tangent;
+		bool drag_2d = m_Drag2D;
 
-		if (m_Drag2D)
-			new_tan.z = m_Sim->Integrator()->X()[tangent.tangent_idx].z;
-		
-		m_Sim->Integrator()->X()[tangent.tangent_idx] = new_tan;
+		m_Sim->QueueCommand([desc, target, drag_2d](Sim_Manager* sim)
+		{
+			Vector3* x = sim->Integrator()->X();
+			Vector3 new_tan = (target - x[desc.phyxel_idx]) * 4.f * desc.tangent_mult;
+
+			if (drag_2d)
+				new_tan.z = x[desc.tangent_idx].z;
+
+			x[desc.tangent_idx] = new_tan;
+		});
 	}
 	else if (!Input::IsMouseHeld(GLFW_MOUSE_BUTTON_LEFT))
 	{
 		m_IsDragging = true;
 		m_DragIdx = idx;
 
-		m_IsOrigStatic = m_Sim->Simulation()->GetIsStatic(tangent.tangent_idx);
+		m_IsOrigStatic = (m_Sim->Snapshot().is_static[tangent.tangent_idx] != 0);
 		m_ClickOffset = tangent.tangent_position - position;
-		m_Sim->Simulation()->SetIsStatic(tangent.tangent_idx, true);
+		SetIsStatic(tangent.tangent_idx, true, false);
 	}
 }
 
@@ -1,7 +1,10 @@
 #pragma once
 #include "Sim_Manager.h"
+#include "Sim_BVH.h"
 #include <glcore\Input.h>
 
+#define MOUSE_DRAGGER_PICK_RADIUS 0.02f
+
 struct Mouse_Dragger_TangentDescriptor
 {
 	uint tangent_idx;
@@ -31,7 +34,14 @@ public:
 	bool& GetIsTangents() { return m_DragTangents; }
 	void SetIsTangents(bool mode);
 
+	//Vertex mode only, picks anywhere on the cloth and drags the closest phyxel of the hit element
+	bool& GetPickSurface() { return m_PickSurface; }
+	void SetPickSurface(bool mode);
+
 	bool& GetDrawControlPoints() { return m_DrawControlPoints; }
+
+	//Index of the hovered point in the generators numbering (UINT_MAX if nothing is hovered)
+	uint GetHoverOriginalIdx() const;
 protected:
 	std::function<bool(const Ray& ray, uint* best_idx, float* distance)> IsMouseOverPoint;
 	std::function<void(uint idx, const Vector3 position)> UpdatePoint;
@@ -43,8 +53,19 @@ protected:
 	bool IsMouseOverPoint_Tangent(const Ray& ray, uint* out_idx, float* out_dist);
 	void UpdatePoint_Tangent(uint idx, const Vector3& position);
 
+	bool IsMouseOverPoint_Surface(const Ray& ray, uint* out_idx, float* out_dist);
+
 	bool HandleMouseInputTangents(Sim_Manager* sim, const Matrix4& projView);
 
+	//Forwarded to the simulation through its command queue, optionally zeroing the velocity of the point
+	void SetIsStatic(uint idx, bool is_static, bool reset_velocity);
+
+	void BindPickFunctions();
+
+	//The picking tree covers the pickable primitives of the current mode, built when they change and
+	// refit once per rendered frame (RenderDragables)
+	void UpdatePickTree();
+
 	
 protected:
 	Sim_Manager* m_Sim;
@@ -54,6 +75,7 @@ protected:
 	bool m_IsOrigStatic = false;
 	bool m_DragTangents = false;
 	bool m_Drag2D = false;
+	bool m_PickSurface = false;
 	uint m_DragIdx = 0;
 	uint m_HoverIdx = 0;
 	float m_MouseRayDepth = 0.f;
@@ -61,4 +83,8 @@ protected:
 
 	
 	std::vector<Mouse_Dragger_TangentDescriptor> m_TangentsDescriptors;
+
+	Sim_BVH m_PickTree;
+	std::vector<BoundingBox> m_PickBounds;
+	int m_PickTreeMode = -1;		//0: Vertices, 1: Tangents, 2: Surface, -1: Invalid
 };
\ No newline at end of file
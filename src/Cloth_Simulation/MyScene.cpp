@@ -11,18 +11,27 @@
 
 #include "Generator_Square_Grid.h"
 #include "Generator_Square_Grid_BendTest.h"
+#include "Generator_OBJ_Mesh.h"
+#include "Sim_IntegratorBenchmark.h"
+#include "Sim_SchedulerBenchmark.h"
+#include "Sim_KernelBenchmark.h"
+#include "Sim_QuadratureValidation.h"
+#include "Sim_PBDConvergence.h"
+#include "Sim_ParameterSweep.h"
 
 #include <fstream>
 
 MyScene::MyScene(const std::string& friendly_name)
 	: Scene(friendly_name)
 	, m_Sim(NULL)
+	, m_Ground(NULL)
 	, m_SimTimestep(1.0f / 60.0f)
 	, m_SimPaused(true)
 	, m_glResetTexture(NULL)
 {
 	memset(m_glPlayTextures, 0, 4 * sizeof(GLuint));
 	m_GraphsVisible = true;
+	memset(&m_LastTelemetry, 0, sizeof(MPCG_Telemetry));
 }
 
 MyScene::~MyScene()
@@ -112,56 +121,209 @@ void MyScene::OnInitializeScene()
 	m_ClothUpdateMs = 0.0f;
 
 
-	m_Sim = new Sim_Manager("FE_Simulation");
-	//m_Sim->SetGenerator(new Generator_Square_Grid_BendTest());
-	this->AddGameObject(m_Sim);
-	SetSimulationSubdivisions();
-	m_MouseDragger.SetSimulation(m_Sim);
+	//Create Ground
+	m_Ground = CommonUtils::BuildCuboidObject("Ground", Vector3(0.0f, -1.001f, 0.0f), Vector3(20.0f, 1.0f, 20.0f), false, 0.0f, false, false, Vector4(0.4f, 0.8f, 1.f, 1.f));
+	this->AddGameObject(m_Ground);
 
 
-	//Create Ground
-	Object* ground = CommonUtils::BuildCuboidObject("Ground", Vector3(0.0f, -1.001f, 0.0f), Vector3(20.0f, 1.0f, 20.0f), false, 0.0f, false, false, Vector4(0.4f, 0.8f, 1.f, 1.f));
-	this->AddGameObject(ground);
+	CreateInstance();
+	SelectInstance(0);
+	SetSimulationSubdivisions();
 
 	ConfigureGraphObjects();
 	LoadCameraData();
 }
 
+void MyScene::OnCleanupScene()
+{
+	//The simulation thread updates the instances, so has to stop before they are deleted
+	SetThreaded(false);
+	Scene::OnCleanupScene();
+}
+
 void MyScene::SetSimulationSubdivisions()
 {
-	Generator_Square_Grid* gen = dynamic_cast<Generator_Square_Grid*>(m_Sim->Generator());
-	if (gen != NULL)
+	Sim_SimulationThread_Hold hold(m_SimThread);
+	for (int i = 0; i < (int)m_Instances.size(); ++i)
 	{
-		if (m_GeneratorInvalidated || gen->GetVisualSubdivisions() != m_SceneGridSize)
+		Sim_Manager* sim = m_Instances[i];
+		sim->Generator()->Transform = GetInstanceTransform(i);
+
+		Generator_Square_Grid* gen = dynamic_cast<Generator_Square_Grid*>(sim->Generator());
+		if (gen != NULL)
 		{
-			gen->SetVisualSubdivisions(m_SceneGridSize);
-			m_Sim->Generate();
-			m_MouseDragger.UpdateTangentDescriptors();
+			if (m_GeneratorInvalidated || gen->GetVisualSubdivisions() != m_SceneGridSize)
+			{
+				gen->SetVisualSubdivisions(m_SceneGridSize);
+				sim->Generate();
+			}
+			else
+			{
+				//Keep track of static vertices (by original index, in case the ordering changes)
+				std::vector<uint> static_phyxels; static_phyxels.reserve(30);
+
+				uint num_total = sim->BaseConfig().NumVertices + sim->BaseConfig().NumTangents;
+				for (unsigned int j = 0; j < num_total; ++j)
+				{
+					if (sim->Simulation()->GetIsStatic(j))
+						static_phyxels.push_back(sim->BaseConfig().OriginalIndex(j));
+				}
+
+				sim->Generate(); //Only effects rotation
+
+				for (unsigned int j = 0; j < static_phyxels.size(); ++j)
+				{
+					sim->Simulation()->SetIsStatic(sim->BaseConfig().ReorderedIndex(static_phyxels[j]), true);
+				}
+			}
 		}
-		else
+		else if (m_GeneratorInvalidated)
 		{
-			//Keep track of static vertices
-			std::vector<uint> static_phyxels; static_phyxels.reserve(30);
+			//Non-grid generators have no subdivision control, so just regenerate
+			sim->Generate();
+		}
+	}
 
-			uint num_total = m_Sim->BaseConfig().NumVertices + m_Sim->BaseConfig().NumTangents;
-			for (unsigned int i = 0; i < num_total; ++i)
-			{
-				if (m_Sim->Simulation()->GetIsStatic(i))
-					static_phyxels.push_back(i);
-			}
+	m_MouseDragger.UpdateTangentDescriptors();
+	ConfigureGraphObjects();
+	m_GeneratorInvalidated = false;
+}
+
+Sim_Manager* MyScene::CreateInstance()
+{
+	int idx = (int)m_Instances.size();
+	Sim_Manager* sim = new Sim_Manager((idx == 0) ? "FE_Simulation" : "FE_Simulation_" + std::to_string(idx));
+	sim->SetGenerator(CreateGenerator(idx));
+
+	//New instances start from the selected instances setup, but keep their own material and pins
+	if (m_Sim != NULL)
+	{
+		sim->SetReorderMode(m_Sim->GetReorderMode());
+		sim->SetSimType(m_Sim->GetSimType());
+		sim->Integrator()->SetIntegrationType(m_Sim->Integrator()->GetIntergrationType());
+		sim->Integrator()->SetSubTimestep(m_Sim->Integrator()->GetSubTimestep());
+		sim->Integrator()->SetGravity(m_Sim->Integrator()->GetGravity());
+		sim->SetCollisionsEnabled(m_Sim->GetCollisionsEnabled());
+		sim->SetSelfCollisionsEnabled(m_Sim->GetSelfCollisionsEnabled());
+		sim->SetSolverSettings(m_Sim->GetSolverSettings());
+	}
+	sim->SetThreaded(m_SimThreaded);
+
+	if (m_Ground != NULL)
+		sim->AddObstacle(m_Ground, Sim_Collision_Shape_Cuboid);
+
+	this->AddGameObject(sim);
+	m_Instances.push_back(sim);
+	return sim;
+}
+
+Sim_Generator* MyScene::CreateGenerator(int instance_idx)
+{
+	Sim_Generator* gen = NULL;
+	switch (m_GeneratorType)
+	{
+	case 1:
+		gen = new Generator_Square_Grid_BendTest();
+		break;
+	case 2:
+		gen = new Generator_OBJ_Mesh(MESHDIR"GarmentPanel.obj");
+		break;
+	default:
+		gen = new Generator_Square_Grid();
+		break;
+	}
+	gen->Transform = GetInstanceTransform(instance_idx);
+	gen->SubDivisions = m_SceneGridSize * 2 + 1;
+	return gen;
+}
+
+Matrix4 MyScene::GetInstanceTransform(int instance_idx)
+{
+	//Alternate either side of the first instance, so existing instances never move as more are added
+	float side = (instance_idx % 2 == 1) ? 1.f : -1.f;
+	float offset = side * ((instance_idx + 1) / 2) * CLOTH_INSTANCE_SPACING;
+	return Matrix4::Translation(Vector3(offset, 0.f, 0.f)) * m_GeneratorRotation;
+}
+
+void MyScene::SetNumInstances(int num_instances)
+{
+	num_instances = (num_instances < 1) ? 1 : ((num_instances > MAX_CLOTH_INSTANCES) ? MAX_CLOTH_INSTANCES : num_instances);
+	Sim_SimulationThread_Hold hold(m_SimThread);
+
+	while ((int)m_Instances.size() < num_instances)
+		CreateInstance();
+
+	m_NumInstances = num_instances;
+	for (int i = 0; i < (int)m_Instances.size(); ++i)
+		m_Instances[i]->SetActive(i < m_NumInstances);
 
-			m_Sim->Generate(); //Only effects rotation
+	if (m_SelectedInstance >= m_NumInstances)
+		SelectInstance(m_NumInstances - 1);
+}
+
+void MyScene::SelectInstance(int instance_idx)
+{
+	m_SelectedInstance = instance_idx;
+	m_Sim = m_Instances[instance_idx];
+	m_MouseDragger.SetSimulation(m_Sim);
+	ConfigureGraphObjects();
+}
+
+void MyScene::UpdateInstances(float dt)
+{
+	//Instances share no data, so each is one task on the pool
+	m_InstanceTasks.resize(m_NumInstances);
+	for (int i = 0; i < m_NumInstances; ++i)
+	{
+		Sim_Manager* sim = m_Instances[i];
+		m_InstanceTasks[i] = [sim, dt]() { sim->UpdateSimulation(dt); };
+	}
+	m_ThreadPool.Run(m_InstanceTasks);
+}
 
-			for (unsigned int i = 0; i < static_phyxels.size(); ++i)
+void MyScene::StepInstances(int num_substeps)
+{
+	float dt = m_Sim->Integrator()->GetSubTimestep();
+	for (int i = 0; i < num_substeps; ++i)
+	{
+		if (m_SimThreaded)
+			m_SimThread.RequestStep(dt);
+		else
+			UpdateInstances(dt);
+	}
+}
+
+void MyScene::SetThreaded(bool threaded)
+{
+	if (threaded == m_SimThreaded)
+		return;
+
+	m_SimThreaded = threaded;
+	if (threaded)
+	{
+		for (int i = 0; i < (int)m_Instances.size(); ++i)
+			m_Instances[i]->SetThreaded(true);
+
+		m_SimThread.SetPaused(m_SimPaused);
+		m_SimThread.Start([this](float dt)
+		{
+			if (dt > 0.0f)
 			{
-				m_Sim->Simulation()->SetIsStatic(static_phyxels[i], true);
+				UpdateInstances(dt);
 			}
-		}
-		
-		
-		ConfigureGraphObjects();
-		m_GeneratorInvalidated = false;
-		
+			else
+			{
+				for (int i = 0; i < m_NumInstances; ++i)
+					m_Instances[i]->UpdateCommands();
+			}
+		}, m_SimTimestep);
+	}
+	else
+	{
+		m_SimThread.Stop();
+
+		for (int i = 0; i < (int)m_Instances.size(); ++i)
+			m_Instances[i]->SetThreaded(false);
 	}
 }
 
@@ -169,16 +331,46 @@ void MyScene::SetSimulationSubdivisions()
 void MyScene::OnUpdateScene(float dt)
 {
 	UpdateSimulationGraphs();
+	PollSolverTelemetry();
 	HandleSimulationOptions_ImGui();
 
-	if (!m_SimPaused)
-		m_Sim->Integrator()->UpdateSimulation(m_SimTimestep);
+	if (m_SimThreaded)
+	{
+		if (m_SimThread.GetPaused() != m_SimPaused)
+			m_SimThread.SetPaused(m_SimPaused);
+	}
+	else if (!m_SimPaused)
+	{
+		UpdateInstances(m_SimTimestep);
+	}
 
 	m_MouseDragger.RenderDragables();
 
 	Scene::OnUpdateScene(dt);
 }
 
+void MyScene::PollSolverTelemetry()
+{
+	if (m_Sim->Simulation() == NULL)
+		return;
+
+	MPCG<SparseRowMatrix<Matrix3>>* solver = m_Sim->Simulation()->Solver();
+	if (solver == NULL)
+		return;
+
+	MPCG_Telemetry records[64];
+	uint num_read;
+	while ((num_read = m_TelemetryReader.Poll(solver->GetTelemetry(), records, 64)) > 0)
+	{
+		for (uint i = 0; i < num_read; ++i)
+			m_NumUnconvergedSolves += records[i].hit_max_iterations ? 1 : 0;
+
+		m_LastTelemetry = records[num_read - 1];
+	}
+
+	m_TelemetryCSV.Poll(solver->GetTelemetry());
+}
+
 #define _BEGIN_TABLE_ ImGui::Indent(16.0f); ImGui::Columns(2); 
 #define _END_TABLE_ ImGui::Columns(1); ImGui::Unindent(16.0f);
 #define _ROW_START_(x, ...) ImGui::PushID(x); ImGui::Text(x, __VA_ARGS__); ImGui::NextColumn(); ImGui::PushItemWidth(-1);
@@ -220,7 +412,85 @@ void MyScene::HandleSimulationOptions_ImGui()
 		return;
 	}
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.f, 0.f));
-	
+
+	if (ImGui::CollapsingHeader("Instances", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		_BEGIN_TABLE_;
+		{
+			_ROW_START_("Cloth Instances");
+			int num_instances = m_NumInstances;
+			if (ImGui::SliderInt("##numinstances", &num_instances, 1, MAX_CLOTH_INSTANCES))
+				SetNumInstances(num_instances);
+			_ROW_END_;
+
+			_ROW_START_("Selected Instance");
+			int selected_instance = m_SelectedInstance;
+			if (ImGui::SliderInt("##selectedinstance", &selected_instance, 0, m_NumInstances - 1))
+				SelectInstance(selected_instance);
+			_ROW_END_;
+
+			_ROW_START_("Thread Pool");
+			ImGui::Text("%d threads, %d loop threads per task", m_ThreadPool.GetNumThreads(), m_ThreadPool.GetLoopThreadsPerTask());
+			_ROW_END_;
+
+			_ROW_START_("Pool Utilization");
+			ImGui::Text("%.0f%% of %.2fms", (m_SimPaused) ? 0.0f : m_ThreadPool.GetUtilization() * 100.0f, (m_SimPaused) ? 0.0f : m_ThreadPool.GetWallMilliSeconds());
+			_ROW_END_;
+
+			_ROW_START_("Threaded Simulation");
+			bool threaded = m_SimThreaded;
+			if (ImGui::Checkbox("##threadedsimulation", &threaded))
+				SetThreaded(threaded);
+			if (m_SimThreaded)
+			{
+				ImGui::SameLine();
+				ImGui::Text("%.2fms per update", (m_SimPaused) ? 0.0f : m_SimThread.GetUpdateMilliSeconds());
+			}
+			_ROW_END_;
+
+			TaskScheduler* scheduler = TaskScheduler::Instance();
+			_ROW_START_("Loop Scheduler");
+			int backend = scheduler->GetBackend();
+			if (ImGui::Combo("##LoopScheduler", &backend, "Work Stealing\0OpenMP\0"))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				scheduler->SetBackend((TaskScheduler_Backend)backend);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Benchmark##LoopScheduler"))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				Sim_SchedulerBenchmark::RunAll();
+			}
+			_ROW_END_;
+
+			_ROW_START_("Loop Grain Size");
+			_SIZING_FOR_RESET_;
+			int grain_size = scheduler->GetDefaultGrainSize();
+			bool grain_size_changed = ImGui::InputInt("##LoopGrainSize", &grain_size, 16, 128);
+			ImGui::SameLine();
+			if (_RESET_BUTTON_)
+			{
+				grain_size = TASKSCHEDULER_DEFAULT_GRAIN_SIZE;
+				grain_size_changed = true;
+			}
+			if (grain_size_changed)
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				scheduler->SetDefaultGrainSize(grain_size);
+			}
+			_ROW_END_;
+
+			for (int i = 0; i < m_NumInstances && i < (int)m_ThreadPool.GetNumTasks(); ++i)
+			{
+				_ROW_START_("Instance %d%s", i, (i == m_SelectedInstance) ? " (selected)" : "");
+				ImGui::Text("%.2fms, %d elements", (m_SimPaused) ? 0.0f : m_ThreadPool.GetTaskMilliSeconds(i), (int)m_Instances[i]->BaseConfig().Triangles.size());
+				_ROW_END_;
+			}
+		}
+		_END_TABLE_;
+	}
+
 	if (ImGui::CollapsingHeader("Simulation", ImGuiTreeNodeFlags_DefaultOpen))
 	{	
 		float total_time = (m_SimPaused) ? 0.0f : m_Sim->Integrator()->GetTotalTimer().GetTimedMilliSeconds();
@@ -236,27 +506,63 @@ void MyScene::HandleSimulationOptions_ImGui()
 		{
 			_SIZING_FOR_RESET_;
 			_ROW_START_("Simulation Method");
-			static int simulation_type = m_Sim->GetSimType();
+			int simulation_type = m_Sim->GetSimType();
 			ImGui::Combo("##SimulationType", &simulation_type, "FE 6 Noded C0\0FE 6 Noded C1\0FE 6 Noded C1 V2\0PBD 3 Noded C0");
 			ImGui::SameLine();
-			if (_RESET_BUTTON_) m_Sim->SetSimType(Sim_Type_FE6NodedC1);
+			if (_RESET_BUTTON_) simulation_type = Sim_Type_FE6NodedC1;
 			_ROW_END_;
 
 			_ROW_START_("Integration Method");
 			_SIZING_FOR_RESET_;
-			static int integration_type = m_Sim->Integrator()->GetIntergrationType();
-			ImGui::Combo("##IntegrationMethod", &integration_type, "Explicit Euler\0Runge Kutta 2\0Runge Kutta 4");
+			int integration_type = m_Sim->Integrator()->GetIntergrationType();
+			ImGui::Combo("##IntegrationMethod", &integration_type, "Explicit Euler\0Runge Kutta 2\0Runge Kutta 4\0Implicit (Backward Euler)");
+			ImGui::SameLine();
+			if (_RESET_BUTTON_) integration_type = Sim_Integrator_Type_RK2;
+			_ROW_END_;
+
+			_ROW_START_("Integrator Engine");
+			int engine = m_Sim->Integrator()->GetEngine();
+			if (ImGui::Combo("##IntegratorEngine", &engine, "Dynamic (std::function)\0Static (policy)\0"))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_Sim->Integrator()->SetEngine((Sim_Integrator_Engine)engine);
+			}
 			ImGui::SameLine();
-			if (_RESET_BUTTON_) m_Sim->Integrator()->SetIntegrationType(Sim_Integrator_Type_RK2);
+			if (ImGui::Button("Benchmark##IntegratorEngine"))
+				Sim_IntegratorBenchmark::RunAll();
 			_ROW_END_;
 
 			_ROW_START_("Simulation timestep");
 			_SIZING_FOR_RESET_;
-			ImGui::DragFloat("##UpdatesPerRender", &m_Sim->Integrator()->GetSubTimestep(), 0.000001f, 0.0001f, 1.f / 60.f, "%.5fms", 1.0f);
+			float sub_timestep = m_Sim->Integrator()->GetSubTimestep();
+			bool sub_timestep_changed = ImGui::DragFloat("##UpdatesPerRender", &sub_timestep, 0.000001f, 0.0001f, 1.f / 60.f, "%.5fms", 1.0f);
 			ImGui::SameLine();
-			if (_RESET_BUTTON_) m_Sim->Integrator()->SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+			if (_RESET_BUTTON_)
+			{
+				sub_timestep = DEFAULT_SUB_TIMESTEP;
+				sub_timestep_changed = true;
+			}
+			if (sub_timestep_changed)
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_Sim->Integrator()->SetSubTimestep(sub_timestep);
+			}
 			_ROW_END_;
 	
+			_ROW_START_("Adaptive Timestep");
+			bool adaptive_timestep = m_Sim->Integrator()->GetAdaptiveTimestep();
+			if (ImGui::Checkbox("##adaptivetimestep", &adaptive_timestep))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_Sim->Integrator()->SetAdaptiveTimestep(adaptive_timestep);
+			}
+			if (adaptive_timestep)
+			{
+				ImGui::SameLine();
+				ImGui::Text("%d rejected", m_Sim->Integrator()->GetNumRejectedSteps());
+			}
+			_ROW_END_;
+
 			_ROW_START_("Updates Per Render");
 			ImGui::Text("~ %.1f", (m_SimTimestep / m_Sim->Integrator()->GetSubTimestep()));
 			_ROW_END_;
@@ -273,24 +579,310 @@ void MyScene::HandleSimulationOptions_ImGui()
 			ImGui::Text("%.2fms x %d", single_solve_time, num_solver_calls);
 			_ROW_END_;
 
+			MPCG<SparseRowMatrix<Matrix3>>* solver = m_Sim->Simulation()->Solver();
+			if (solver != NULL)
+			{
+				MPCG_Settings solver_settings = m_Sim->GetSolverSettings();
+				bool solver_settings_changed = false;
+
+				_ROW_START_("Solver Precision");
+				solver_settings_changed |= ImGui::Combo("##SolverPrecision", (int*)&solver_settings.precision, "Single\0Mixed (double accumulation)\0Double (validation)\0");
+				_ROW_END_;
+
+				_ROW_START_("Solver Tolerance");
+				_SIZING_FOR_RESET_;
+				solver_settings_changed |= ImGui::InputFloat("##SolverTolerance", &solver_settings.tolerance, 0.f, 0.f, 7, ImGuiInputTextFlags_EnterReturnsTrue);
+				ImGui::SameLine();
+				if (_RESET_BUTTON_)
+				{
+					solver_settings.tolerance = MPCG_DEFAULT_TOLERANCE;
+					solver_settings_changed = true;
+				}
+				_ROW_END_;
+
+				_ROW_START_("Solver Max Iterations");
+				_SIZING_FOR_RESET_;
+				int max_iterations = (int)solver_settings.max_iterations;
+				solver_settings_changed |= ImGui::InputInt("##SolverMaxIterations", &max_iterations, 10, 100);
+				ImGui::SameLine();
+				if (_RESET_BUTTON_)
+				{
+					max_iterations = MPCG_DEFAULT_MAX_ITERATIONS;
+					solver_settings_changed = true;
+				}
+				solver_settings.max_iterations = (max_iterations > 1) ? (uint)max_iterations : 1;
+				_ROW_END_;
+
+				if (solver_settings_changed && solver_settings.tolerance > 0.f)
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					m_Sim->SetSolverSettings(solver_settings);
+				}
+
+				//Upper block storage is only offered if the elements K_T is symmetric
+				_ROW_START_("Matrix Storage");
+				bool symmetric_available = m_Sim->Simulation()->GetSymmetricStorageAvailable();
+				int storage = m_Sim->Simulation()->GetMatrixFree() ? 2 : (m_Sim->Simulation()->GetSymmetricStorage() ? 1 : 0);
+				bool storage_changed;
+				if (symmetric_available)
+				{
+					storage_changed = ImGui::Combo("##MatrixStorage", &storage, "Full\0Symmetric (upper blocks)\0Matrix-free (gauss points)\0");
+				}
+				else
+				{
+					int item = storage / 2;
+					storage_changed = ImGui::Combo("##MatrixStorage", &item, "Full\0Matrix-free (gauss points)\0");
+					storage = item * 2;
+				}
+				if (storage_changed)
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					m_Sim->Simulation()->SetMatrixFree(storage == 2);
+					m_Sim->Simulation()->SetSymmetricStorage(storage == 1);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Benchmark##MatrixStorage"))
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					Sim_KernelBenchmark::RunAll(m_Sim->GetSimType());
+				}
+				_ROW_END_;
+
+				_ROW_START_("Solver Iterations");
+				ImGui::Text("%.1f avg", (m_SimPaused) ? 0.0f : solver->GetAverageIterations());
+				_ROW_END_;
+
+				_ROW_START_("Last Solve");
+				ImGui::Text("%d its, error %.1e -> %.1e, %.2fms", m_LastTelemetry.iterations, m_LastTelemetry.initial_error, m_LastTelemetry.final_error, m_LastTelemetry.total_ms);
+				_ROW_END_;
+
+				_ROW_START_("Unconverged Solves");
+				if (m_NumUnconvergedSolves > 0)
+					ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%d hit the iteration limit", m_NumUnconvergedSolves);
+				else
+					ImGui::Text("None");
+				ImGui::SameLine();
+				if (_RESET_BUTTON_) m_NumUnconvergedSolves = 0;
+				_ROW_END_;
+
+				_ROW_START_("Record Solver Telemetry");
+				bool recording = m_TelemetryCSV.IsOpen();
+				if (ImGui::Checkbox("##recordtelemetry", &recording))
+				{
+					if (!recording)
+						m_TelemetryCSV.Close();
+					else if (!m_TelemetryCSV.Open("solver_telemetry.csv"))
+						NCLDebug::Log(Vector3(1.0f, 0.0f, 0.0f), "Unable to open solver_telemetry.csv");
+				}
+				if (recording)
+				{
+					ImGui::SameLine();
+					ImGui::Text("solver_telemetry.csv");
+				}
+				_ROW_END_;
+			}
+
+			Sim_FEQuadrature_Settings* quadrature = m_Sim->Simulation()->Quadrature();
+			if (quadrature != NULL)
+			{
+				_ROW_START_("Quadrature");
+				int rule = quadrature->rule;
+				if (ImGui::Combo("##Quadrature", &rule, "3 Point\0" "6 Point\0" "7 Point\0" "12 Point\0"))
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					quadrature->rule = (Sim_FEQuadrature_Rule)rule;
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Validate##Quadrature"))
+					Sim_QuadratureValidation::RunAll();
+				_ROW_END_;
+
+				_ROW_START_("Adaptive Quadrature");
+				bool adaptive_quadrature = quadrature->adaptive;
+				if (ImGui::Checkbox("##adaptivequadrature", &adaptive_quadrature))
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					quadrature->adaptive = adaptive_quadrature;
+				}
+				if (adaptive_quadrature)
+				{
+					ImGui::SameLine();
+					ImGui::Text("%d low order", quadrature->num_low_order);
+				}
+				_ROW_END_;
+			}
+
+			if (m_Sim->GetSimType() == Sim_Type_PBD3NodedC0)
+			{
+				Sim_PBD* pbd = static_cast<Sim_PBD*>(m_Sim->Simulation());
+
+				_ROW_START_("PBD Solver Steps");
+				_SIZING_FOR_RESET_;
+				int solver_steps = pbd->GetSolverSteps();
+				bool solver_steps_changed = ImGui::InputInt("##PBDSolverSteps", &solver_steps, 1, 5);
+				ImGui::SameLine();
+				if (_RESET_BUTTON_)
+				{
+					solver_steps = DEFAULT_PBD_SOLVER_STEPS;
+					solver_steps_changed = true;
+				}
+				if (solver_steps_changed)
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					pbd->SetSolverSteps(solver_steps);
+				}
+				_ROW_END_;
+
+				_ROW_START_("Long Range Attachments");
+				bool lra = pbd->GetUseLongRangeAttachments();
+				if (ImGui::Checkbox("##longrangeattachments", &lra))
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					pbd->SetUseLongRangeAttachments(lra);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Measure##PBDConvergence"))
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					Sim_PBDConvergence::RunAll();
+				}
+				_ROW_END_;
+			}
+
+			Sim_FEAssembly_Settings* assembly = m_Sim->Simulation()->Assembly();
+			if (assembly != NULL)
+			{
+				_ROW_START_("Incremental Assembly");
+				bool incremental = assembly->incremental;
+				if (ImGui::Checkbox("##incrementalassembly", &incremental))
+				{
+					Sim_SimulationThread_Hold hold(m_SimThread);
+					assembly->incremental = incremental;
+				}
+				if (incremental)
+				{
+					ImGui::SameLine();
+					ImGui::Text("%.0f%% reused", (assembly->num_elements > 0) ? 100.0f * assembly->num_reused / assembly->num_elements : 0.0f);
+				}
+				_ROW_END_;
+
+				if (incremental)
+				{
+					_ROW_START_("Reuse Threshold");
+					float threshold = assembly->displacement_threshold;
+					if (ImGui::DragFloat("##reusethreshold", &threshold, 0.0001f, 0.0f, 0.05f, "%.4fm", 1.0f))
+					{
+						Sim_SimulationThread_Hold hold(m_SimThread);
+						assembly->displacement_threshold = threshold;
+					}
+					_ROW_END_;
+				}
+			}
+
 			_ROW_START_("Show Profiling Graphs");
 			ImGui::Checkbox("##profilinggraphs", &m_GraphsVisible);
 			m_GraphObject->SetVisibility(m_GraphsVisible);
 			m_GraphObjectSolver->SetVisibility(m_GraphsVisible);
 			_ROW_END_;
 
+			bool collisions = m_Sim->GetCollisionsEnabled();
+			_ROW_START_("Collisions");
+			if (ImGui::Checkbox("##collisions", &collisions))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_Sim->SetCollisionsEnabled(collisions);
+			}
+			if (collisions)
+			{
+				Sim_Collision* collision = m_Sim->Collision();
+				ImGui::SameLine();
+				ImGui::Text("%d pairs, %d contacts, %.2fms", collision->GetNumPairs(), collision->GetNumContacts(), (m_SimPaused) ? 0.0f : collision->GetTimer().GetTimedMilliSeconds());
+			}
+			_ROW_END_;
+
+			bool self_collisions = m_Sim->GetSelfCollisionsEnabled();
+			_ROW_START_("Self Collisions");
+			if (ImGui::Checkbox("##selfcollisions", &self_collisions))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_Sim->SetSelfCollisionsEnabled(self_collisions);
+			}
+			if (self_collisions)
+			{
+				Sim_SelfCollision* self_collision = m_Sim->SelfCollision();
+				ImGui::SameLine();
+				ImGui::Text("%d pairs, %.2fms", self_collision->GetNumPairs(), (m_SimPaused) ? 0.0f : self_collision->GetTimer().GetTimedMilliSeconds());
+			}
+			_ROW_END_;
+
 			static bool gavityEnabled = true;
 			_ROW_START_("Gravity");
-			ImGui::Checkbox("##gravity", &gavityEnabled);
-			m_Sim->Integrator()->SetGravity(gavityEnabled ? Vector3(0.f, -9.81f, 0.f) : Vector3(0.f, 0.f, 0.f));
+			if (ImGui::Checkbox("##gravity", &gavityEnabled))
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				for (int i = 0; i < (int)m_Instances.size(); ++i)
+					m_Instances[i]->Integrator()->SetGravity(gavityEnabled ? Vector3(0.f, -9.81f, 0.f) : Vector3(0.f, 0.f, 0.f));
+			}
+			_ROW_END_;
+
+			//Material of the selected instance, applying it resets the cloth
+			Sim_Material material = m_Sim->GetMaterial();
+			bool material_changed = false;
+
+			_ROW_START_("Youngs Modulus");
+			material_changed |= ImGui::InputFloat("##youngsmodulus", &material.youngs_modulus, 0.f, 0.f, 1, ImGuiInputTextFlags_EnterReturnsTrue);
+			_ROW_END_;
+
+			_ROW_START_("Poisson Ratio");
+			material_changed |= ImGui::InputFloat("##poissonratio", &material.poisson_ratio, 0.f, 0.f, 3, ImGuiInputTextFlags_EnterReturnsTrue);
+			_ROW_END_;
+
+			_ROW_START_("Density (kg/m^2)");
+			material_changed |= ImGui::InputFloat("##density", &material.density, 0.f, 0.f, 3, ImGuiInputTextFlags_EnterReturnsTrue);
+			_ROW_END_;
+
+			if (material_changed && material.youngs_modulus > 0.f && material.poisson_ratio >= 0.f && material.poisson_ratio < 0.5f && material.density > 0.f)
+			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_Sim->SetMaterial(material);
+				m_MouseDragger.UpdateTangentDescriptors();
+			}
+
+			//Headless runs of the selected instances setup, varying the stiffness and solver tolerance
+			_ROW_START_("Parameter Sweep");
+			if (ImGui::Button("Run##ParameterSweep"))
+			{
+				Sim_ParameterSweep_Config base;
+				base.sim_type = m_Sim->GetSimType();
+				base.integrator = m_Sim->Integrator()->GetIntergrationType();
+				base.sub_timestep = m_Sim->Integrator()->GetSubTimestep();
+				base.grid_size = m_SceneGridSize;
+				base.bend_test = (m_GeneratorType == 1);
+				base.material = m_Sim->GetMaterial();
+				base.solver = m_Sim->GetSolverSettings();
+
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				Sim_ParameterSweep::RunDefault(base);
+			}
 			_ROW_END_;
 
 			if (integration_type != m_Sim->Integrator()->GetIntergrationType())
 			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
+
+				//Implicit integration is stable at frame sized steps, explicit ones are not
+				bool was_implicit = (m_Sim->Integrator()->GetIntergrationType() == Sim_Integrator_Type_Implicit);
+				bool is_implicit = (integration_type == Sim_Integrator_Type_Implicit);
+				if (is_implicit && !was_implicit)
+					m_Sim->Integrator()->SetSubTimestep(DEFAULT_IMPLICIT_SUB_TIMESTEP);
+				else if (was_implicit && !is_implicit)
+					m_Sim->Integrator()->SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+
 				m_Sim->Integrator()->SetIntegrationType((Sim_Integrator_Type)integration_type);
 			}
 			if (simulation_type != m_Sim->GetSimType())
 			{
+				Sim_SimulationThread_Hold hold(m_SimThread);
 				m_Sim->SetSimType((Sim_Type)simulation_type);
 			}
 		}
@@ -310,12 +902,12 @@ void MyScene::HandleSimulationOptions_ImGui()
 
 		_BEGIN_TABLE_;
 		{
-			static int generator_type = 0;
 			_ROW_START_("Generate");
-			if (ImGui::Button("GENERATE", ImVec2(150, 16)) && gen != NULL)
+			if (ImGui::Button("GENERATE", ImVec2(150, 16)))
 			{
-				gen->Transform = Matrix4::Rotation(rotation.x, Vector3(rotation.y, rotation.z, rotation.w));
+				m_GeneratorRotation = Matrix4::Rotation(rotation.x, Vector3(rotation.y, rotation.z, rotation.w));
 				m_SceneGridSize = grid_size;
+				m_GeneratorInvalidated |= (gen == NULL);
 				SetSimulationSubdivisions();
 			}
 			_ROW_END_;
@@ -323,31 +915,45 @@ void MyScene::HandleSimulationOptions_ImGui()
 			_ROW_START_("Generator Scheme");
 			_SIZING_FOR_RESET_;
 			auto update_generator_type = [&]() {
-				Sim_Generator* gen = NULL;
-				switch (generator_type)
-				{
-				case 0:
-					gen = new Generator_Square_Grid();
-					break;
-				case 1:
-					gen = new Generator_Square_Grid_BendTest();
-					break;
-				}
-				gen->Transform = Matrix4::Rotation(rotation.x, Vector3(rotation.y, rotation.z, rotation.w));
-				gen->SubDivisions = grid_size * 2 + 1;
-				m_Sim->SetGenerator(gen);
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				m_GeneratorRotation = Matrix4::Rotation(rotation.x, Vector3(rotation.y, rotation.z, rotation.w));
+				m_SceneGridSize = grid_size;
+				for (int i = 0; i < (int)m_Instances.size(); ++i)
+					m_Instances[i]->SetGenerator(CreateGenerator(i));
+				m_MouseDragger.UpdateTangentDescriptors();
+				ConfigureGraphObjects();
 				m_GeneratorInvalidated = true;
 			};
 
-			if (ImGui::Combo("##genscheme", &generator_type, "Square Grid\0Square Grid Bending Test")) update_generator_type();
+			if (ImGui::Combo("##genscheme", &m_GeneratorType, "Square Grid\0Square Grid Bending Test\0Garment Panel (OBJ)")) update_generator_type();
 			ImGui::SameLine();
 			if (_RESET_BUTTON_)
 			{
-				generator_type = 0;
+				m_GeneratorType = 0;
 				update_generator_type();
 			}
 			_ROW_END_;
 
+			_ROW_START_("Phyxel Ordering");
+			_SIZING_FOR_RESET_;
+			int reorder_mode = m_Sim->GetReorderMode();
+			auto update_reorder_mode = [&]() {
+				Sim_SimulationThread_Hold hold(m_SimThread);
+				for (int i = 0; i < (int)m_Instances.size(); ++i)
+					m_Instances[i]->SetReorderMode((Sim_Reorder_Mode)reorder_mode);
+				m_MouseDragger.UpdateTangentDescriptors();
+				ConfigureGraphObjects();
+			};
+
+			if (ImGui::Combo("##reordermode", &reorder_mode, "None\0Reverse Cuthill-McKee\0Morton (Z-Order)")) update_reorder_mode();
+			ImGui::SameLine();
+			if (_RESET_BUTTON_)
+			{
+				reorder_mode = Sim_Reorder_RCM;
+				update_reorder_mode();
+			}
+			_ROW_END_;
+
 			_ROW_START_("Grid Subdivisions");
 			_SIZING_FOR_RESET_;
 			ImGui::SliderInt("##SimulationSubdivisions", &grid_size, 1, 10);
@@ -405,8 +1011,7 @@ void MyScene::HandleSimulationOptions_ImGui()
 				m_SimPaused = true;
 				Window::GetVideoEncoder()->EndEncoding();
 
-				for (int i = 0; i < 5; ++i)
-					m_Sim->Integrator()->UpdateSimulation(m_Sim->Integrator()->GetSubTimestep());
+				StepInstances(5);
 			}		
 
 			_ROW_END_;
@@ -460,7 +1065,7 @@ void MyScene::HandleSimulationOptions_ImGui()
 		_BEGIN_TABLE_;
 		{
 			static int is2DMode = (int)m_MouseDragger.GetIs2DMode();
-			static int isTangents = (int)m_MouseDragger.GetIsTangents();
+			static int isTangents = m_MouseDragger.GetIsTangents() ? 1 : (m_MouseDragger.GetPickSurface() ? 2 : 0);
 
 
 
@@ -470,8 +1075,17 @@ void MyScene::HandleSimulationOptions_ImGui()
 			_ROW_END_;
 
 			_ROW_START_("Drag Type");
-			ImGui::Combo("##dragtype", &isTangents, "Vertices\0Tangents");
-			m_MouseDragger.SetIsTangents(isTangents ? true : false);
+			ImGui::Combo("##dragtype", &isTangents, "Vertices\0Tangents\0Surface");
+			m_MouseDragger.SetIsTangents(isTangents == 1);
+			m_MouseDragger.SetPickSurface(isTangents == 2);
+			_ROW_END_;
+
+			_ROW_START_("Hovered Index");
+			uint hover_idx = m_MouseDragger.GetHoverOriginalIdx();
+			if (hover_idx != UINT_MAX)
+				ImGui::Text("%d", hover_idx);
+			else
+				ImGui::Text("-");
 			_ROW_END_;
 
 			
@@ -599,8 +1213,7 @@ void MyScene::HandleSimulationOptions()
 
 	if (Input::IsKeyToggled(GLFW_KEY_R))
 	{
-		for (int i = 0; i < 5; ++i)
-			m_Sim->Integrator()->UpdateSimulation(m_Sim->Integrator()->GetSubTimestep());
+		StepInstances(5);
 	}
 
 
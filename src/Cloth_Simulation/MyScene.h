@@ -9,6 +9,9 @@
 
 #include "GraphObject.h"
 #include "Sim_Manager.h"
+#include "Sim_ThreadPool.h"
+#include "Sim_SimulationThread.h"
+#include "Sim_SolverTelemetry.h"
 #include "Mouse_Dragger.h"
 
 
@@ -17,6 +20,8 @@
 #include "Sim_PBD.h"
 
 #define MAX_HUD_VISIBILITY_TYPES 4
+#define MAX_CLOTH_INSTANCES 16
+#define CLOTH_INSTANCE_SPACING 1.5f
 #define CLOTHVIDEODIR "../../media/clothvideos/"
 
 class MyScene : public Scene
@@ -28,13 +33,27 @@ public:
 	void ConfigureGraphObjects();
 	void SetSimulationSubdivisions();
 
+	//Cloth instances, each with its own generator, material and pins
+	Sim_Manager* CreateInstance();
+	Sim_Generator* CreateGenerator(int instance_idx);
+	Matrix4 GetInstanceTransform(int instance_idx);
+	void SetNumInstances(int num_instances);
+	void SelectInstance(int instance_idx);
+	void UpdateInstances(float dt);
+	void StepInstances(int num_substeps);
+
+	//Threaded mode runs the instances continuously on m_SimThread, rendering the latest published state
+	void SetThreaded(bool threaded);
+
 	void OnInitializeScene()					override;
+	void OnCleanupScene()						override;
 	void OnUpdateScene(float dt)				override;
 	void OnSceneResize(int width, int height)	override;
 
 	void HandleSimulationOptions_ImGui();
 	void HandleSimulationOptions();
 	void UpdateSimulationGraphs();
+	void PollSolverTelemetry();
 
 	void SaveCameraData();
 	void LoadCameraData();
@@ -42,11 +61,22 @@ public:
 	GLuint   m_glResetTexture;
 	GLuint   m_glPlayTextures[4];
 
-	Sim_Manager*		m_Sim;
+	Sim_Manager*		m_Sim;				//Selected instance, target of the options and the mouse dragger
 	Mouse_Dragger		m_MouseDragger;
 	int m_SceneGridSize = 1;
+	int m_GeneratorType = 0;
+	Matrix4 m_GeneratorRotation;
 	bool m_GeneratorInvalidated = false;
 
+	std::vector<Sim_Manager*>	m_Instances;		//Only the first m_NumInstances are simulated and rendered
+	std::vector<std::function<void()>> m_InstanceTasks;
+	Sim_ThreadPool		m_ThreadPool;
+	int m_NumInstances = 1;
+	int m_SelectedInstance = 0;
+	Sim_SimulationThread	m_SimThread;
+	bool m_SimThreaded = false;
+	Object*				m_Ground;
+
 	float m_SimTimestep;
 	bool m_SimPaused;
 
@@ -55,4 +85,10 @@ public:
 	GraphObject*	m_GraphObjectSolver;
 
 	bool m_GraphsVisible;
+
+	//Selected instances solver, polled every frame (lock-free, so also while the simulation thread is solving)
+	Sim_TelemetryReader	m_TelemetryReader;
+	Sim_TelemetryCSV	m_TelemetryCSV;
+	MPCG_Telemetry		m_LastTelemetry;
+	uint				m_NumUnconvergedSolves = 0;
 };
\ No newline at end of file
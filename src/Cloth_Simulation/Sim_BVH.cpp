@@ -0,0 +1,101 @@
+#include "Sim_BVH.h"
+#include <algorithm>
+
+Sim_BVH::Sim_BVH()
+{
+}
+
+void Sim_BVH::Clear()
+{
+	m_Nodes.clear();
+	m_Primitives.clear();
+}
+
+void Sim_BVH::Build(const std::vector<BoundingBox>& primitive_bounds, uint max_leaf_size)
+{
+	Clear();
+
+	uint num_primitives = (uint)primitive_bounds.size();
+	if (num_primitives == 0)
+		return;
+
+	std::vector<Vector3> centroids(num_primitives);
+	m_Primitives.resize(num_primitives);
+	for (uint i = 0; i < num_primitives; ++i)
+	{
+		centroids[i] = (primitive_bounds[i].minPoints + primitive_bounds[i].maxPoints) * 0.5f;
+		m_Primitives[i] = i;
+	}
+
+	max_leaf_size = (max_leaf_size > 0) ? max_leaf_size : 1;
+	m_Nodes.reserve(2 * num_primitives);
+	m_Nodes.push_back(Node());
+	BuildNode(0, 0, num_primitives, primitive_bounds, centroids, max_leaf_size);
+}
+
+void Sim_BVH::BuildNode(uint node_idx, uint first, uint count, const std::vector<BoundingBox>& primitive_bounds, std::vector<Vector3>& centroids, uint max_leaf_size)
+{
+	BoundingBox bounds, centroid_bounds;
+	for (uint i = first; i < first + count; ++i)
+	{
+		uint prim = m_Primitives[i];
+		bounds.ExpandToFit(primitive_bounds[prim].minPoints);
+		bounds.ExpandToFit(primitive_bounds[prim].maxPoints);
+		centroid_bounds.ExpandToFit(centroids[prim]);
+	}
+	m_Nodes[node_idx].bounds = bounds;
+
+	if (count <= max_leaf_size)
+	{
+		m_Nodes[node_idx].first = first;
+		m_Nodes[node_idx].count = count;
+		return;
+	}
+
+	//Median split along the longest axis of the centroids
+	Vector3 extent = centroid_bounds.maxPoints - centroid_bounds.minPoints;
+	int axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+	uint half = count / 2;
+	std::nth_element(m_Primitives.begin() + first, m_Primitives.begin() + first + half, m_Primitives.begin() + first + count,
+		[&](uint a, uint b) { return (&centroids[a].x)[axis] < (&centroids[b].x)[axis]; });
+
+	//Both children are allocated together so the right child is always left + 1
+	uint left = (uint)m_Nodes.size();
+	m_Nodes.push_back(Node());
+	m_Nodes.push_back(Node());
+	m_Nodes[node_idx].first = left;
+	m_Nodes[node_idx].count = 0;
+
+	BuildNode(left, first, half, primitive_bounds, centroids, max_leaf_size);
+	BuildNode(left + 1, first + half, count - half, primitive_bounds, centroids, max_leaf_size);
+}
+
+void Sim_BVH::Refit(const std::vector<BoundingBox>& primitive_bounds)
+{
+	//Children are stored after their parents, so walking backwards visits them first
+	for (int i = (int)m_Nodes.size() - 1; i >= 0; --i)
+	{
+		Node& node = m_Nodes[i];
+		BoundingBox bounds;
+		if (node.count > 0)
+		{
+			for (uint j = node.first; j < node.first + node.count; ++j)
+			{
+				const BoundingBox& prim = primitive_bounds[m_Primitives[j]];
+				bounds.ExpandToFit(prim.minPoints);
+				bounds.ExpandToFit(prim.maxPoints);
+			}
+		}
+		else
+		{
+			const BoundingBox& left = m_Nodes[node.first].bounds;
+			const BoundingBox& right = m_Nodes[node.first + 1].bounds;
+			bounds.ExpandToFit(left.minPoints);
+			bounds.ExpandToFit(left.maxPoints);
+			bounds.ExpandToFit(right.minPoints);
+			bounds.ExpandToFit(right.maxPoints);
+		}
+		node.bounds = bounds;
+	}
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <glcore\BoundingBox.h>
+#include <glcore\Vector3.h>
+#include "SimulationDefines.h"
+#include <vector>
+#include <cfloat>
+#include <climits>
+
+inline bool Sim_BVH_Overlap(const BoundingBox& a, const BoundingBox& b)
+{
+	return a.minPoints.x <= b.maxPoints.x && a.maxPoints.x >= b.minPoints.x
+		&& a.minPoints.y <= b.maxPoints.y && a.maxPoints.y >= b.minPoints.y
+		&& a.minPoints.z <= b.maxPoints.z && a.maxPoints.z >= b.minPoints.z;
+}
+
+//Slab test, t_enter is the distance along the ray the box is entered (0 if the origin is inside)
+inline bool Sim_BVH_RayBox(const BoundingBox& box, const Vector3& origin, const Vector3& inv_dir, float max_t, float* t_enter)
+{
+	float t0 = 0.f, t1 = max_t;
+	for (int i = 0; i < 3; ++i)
+	{
+		float ta = ((&box.minPoints.x)[i] - (&origin.x)[i]) * (&inv_dir.x)[i];
+		float tb = ((&box.maxPoints.x)[i] - (&origin.x)[i]) * (&inv_dir.x)[i];
+		if (ta > tb) { float tmp = ta; ta = tb; tb = tmp; }
+		t0 = (ta > t0) ? ta : t0;
+		t1 = (tb < t1) ? tb : t1;
+		if (t0 > t1)
+			return false;
+	}
+	*t_enter = t0;
+	return true;
+}
+
+//Axis aligned bounding volume hierarchy over a fixed set of primitives
+// - Build splits at the median centroid of the longest axis, it only has to be called when the primitives change
+// - Refit recomputes the boxes bottom up for the same tree, called every time the primitives move
+// - Primitives are referenced by index into the bounds array passed to Build/Refit
+class Sim_BVH
+{
+public:
+	struct Node
+	{
+		BoundingBox bounds;
+		uint		first;		//Leaf: first entry in the primitive list, Internal: left child (right is first + 1)
+		uint		count;		//Primitives in the leaf, 0 for internal nodes
+	};
+
+	Sim_BVH();
+
+	void Build(const std::vector<BoundingBox>& primitive_bounds, uint max_leaf_size = 2);
+	void Refit(const std::vector<BoundingBox>& primitive_bounds);
+	void Clear();
+
+	inline bool IsEmpty() const { return m_Nodes.empty(); }
+	inline const BoundingBox& GetBounds() const { return m_Nodes[0].bounds; }
+
+	//Calls callback(primitive) for every primitive whose leaf box overlaps the given box
+	template<class Callback>
+	void Query(const BoundingBox& box, const std::vector<BoundingBox>& primitive_bounds, Callback callback) const;
+
+	//Nearest hit along the ray, hit(primitive, max_dist) returns the primitives hit distance or FLT_MAX for a miss
+	// - Children are visited nearest first and any node further away than the best hit so far is skipped
+	// - Returns the best distance (FLT_MAX if nothing was hit) and the primitive in out_primitive
+	template<class Callback>
+	float RayCast(const Vector3& origin, const Vector3& dir, Callback hit, uint* out_primitive) const;
+
+	//Calls callback(primitive_a, primitive_b) for every overlapping pair of primitives between the two trees
+	template<class Callback>
+	static void QueryPairs(const Sim_BVH& a, const std::vector<BoundingBox>& bounds_a, const Sim_BVH& b, const std::vector<BoundingBox>& bounds_b, Callback callback);
+
+protected:
+	void BuildNode(uint node_idx, uint first, uint count, const std::vector<BoundingBox>& primitive_bounds, std::vector<Vector3>& centroids, uint max_leaf_size);
+
+	std::vector<Node> m_Nodes;			//Children are always stored after their parent
+	std::vector<uint> m_Primitives;		//Leaf order
+};
+
+template<class Callback>
+void Sim_BVH::Query(const BoundingBox& box, const std::vector<BoundingBox>& primitive_bounds, Callback callback) const
+{
+	if (m_Nodes.empty())
+		return;
+
+	uint stack[64];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		const Node& node = m_Nodes[stack[--stack_size]];
+		if (!Sim_BVH_Overlap(node.bounds, box))
+			continue;
+
+		if (node.count > 0)
+		{
+			for (uint i = node.first; i < node.first + node.count; ++i)
+			{
+				uint prim = m_Primitives[i];
+				if (Sim_BVH_Overlap(primitive_bounds[prim], box))
+					callback(prim);
+			}
+		}
+		else
+		{
+			stack[stack_size++] = node.first;
+			stack[stack_size++] = node.first + 1;
+		}
+	}
+}
+
+template<class Callback>
+float Sim_BVH::RayCast(const Vector3& origin, const Vector3& dir, Callback hit, uint* out_primitive) const
+{
+	float best_dist = FLT_MAX;
+	uint best_prim = UINT_MAX;
+
+	float t;
+	Vector3 inv_dir(1.f / dir.x, 1.f / dir.y, 1.f / dir.z);
+	if (m_Nodes.empty() || !Sim_BVH_RayBox(m_Nodes[0].bounds, origin, inv_dir, best_dist, &t))
+	{
+		if (out_primitive) *out_primitive = best_prim;
+		return best_dist;
+	}
+
+	uint stack[64];
+	float stack_t[64];
+	int stack_size = 1;
+	stack[0] = 0;
+	stack_t[0] = t;
+
+	while (stack_size > 0)
+	{
+		--stack_size;
+		if (stack_t[stack_size] >= best_dist)
+			continue;
+
+		const Node& node = m_Nodes[stack[stack_size]];
+		if (node.count > 0)
+		{
+			for (uint i = node.first; i < node.first + node.count; ++i)
+			{
+				uint prim = m_Primitives[i];
+				float dist = hit(prim, best_dist);
+				if (dist < best_dist)
+				{
+					best_dist = dist;
+					best_prim = prim;
+				}
+			}
+			continue;
+		}
+
+		float t_left, t_right;
+		bool hit_left = Sim_BVH_RayBox(m_Nodes[node.first].bounds, origin, inv_dir, best_dist, &t_left);
+		bool hit_right = Sim_BVH_RayBox(m_Nodes[node.first + 1].bounds, origin, inv_dir, best_dist, &t_right);
+
+		//Push the further child first so the nearer one is popped next
+		if (hit_left && hit_right && t_left < t_right)
+		{
+			stack[stack_size] = node.first + 1;	stack_t[stack_size++] = t_right;
+			stack[stack_size] = node.first;		stack_t[stack_size++] = t_left;
+		}
+		else
+		{
+			if (hit_left)	{ stack[stack_size] = node.first;		stack_t[stack_size++] = t_left; }
+			if (hit_right)	{ stack[stack_size] = node.first + 1;	stack_t[stack_size++] = t_right; }
+		}
+	}
+
+	if (out_primitive) *out_primitive = best_prim;
+	return best_dist;
+}
+
+template<class Callback>
+void Sim_BVH::QueryPairs(const Sim_BVH& a, const std::vector<BoundingBox>& bounds_a, const Sim_BVH& b, const std::vector<BoundingBox>& bounds_b, Callback callback)
+{
+	if (a.m_Nodes.empty() || b.m_Nodes.empty())
+		return;
+
+	//Simultaneous descent, always splitting the internal node with the larger box
+	uint stack[128][2];
+	int stack_size = 1;
+	stack[0][0] = 0;
+	stack[0][1] = 0;
+
+	while (stack_size > 0)
+	{
+		--stack_size;
+		uint ia = stack[stack_size][0], ib = stack[stack_size][1];
+		const Node& na = a.m_Nodes[ia];
+		const Node& nb = b.m_Nodes[ib];
+
+		if (!Sim_BVH_Overlap(na.bounds, nb.bounds))
+			continue;
+
+		if (na.count > 0 && nb.count > 0)
+		{
+			for (uint i = na.first; i < na.first + na.count; ++i)
+			{
+				uint prim_a = a.m_Primitives[i];
+				for (uint j = nb.first; j < nb.first + nb.count; ++j)
+				{
+					uint prim_b = b.m_Primitives[j];
+					if (Sim_BVH_Overlap(bounds_a[prim_a], bounds_b[prim_b]))
+						callback(prim_a, prim_b);
+				}
+			}
+			continue;
+		}
+
+		Vector3 ea = na.bounds.maxPoints - na.bounds.minPoints;
+		Vector3 eb = nb.bounds.maxPoints - nb.bounds.minPoints;
+		bool split_a = (nb.count > 0) || (na.count == 0 && Vector3::Dot(ea, ea) >= Vector3::Dot(eb, eb));
+
+		if (split_a)
+		{
+			stack[stack_size][0] = na.first;		stack[stack_size++][1] = ib;
+			stack[stack_size][0] = na.first + 1;	stack[stack_size++][1] = ib;
+		}
+		else
+		{
+			stack[stack_size][0] = ia;	stack[stack_size++][1] = nb.first;
+			stack[stack_size][0] = ia;	stack[stack_size++][1] = nb.first + 1;
+		}
+	}
+}
@@ -0,0 +1,416 @@
+#include "Sim_Benchmark.h"
+#include "Sim_FESimulation.h"
+#include "Sim_SolverTelemetry.h"
+#include <glcore\TaskScheduler.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+
+//Sits between the integrator and the simulation, forwarding every call and accumulating the assembly/solve
+// time of each. The simulations reset their sub timers at the start of every step (or batch), so they only
+// ever hold the last call of a frame. Iterations come from the solvers telemetry, one record per solve.
+class Sim_BenchmarkProbe : public Sim_Integratable
+{
+public:
+	Sim_BenchmarkProbe(Sim_Simulation* sim) : m_Sim(sim)
+	{
+		if (m_Sim->Solver() != NULL)
+			m_Telemetry.Attach(m_Sim->Solver()->GetTelemetry());
+		ResetFrame();
+	}
+
+	void ResetFrame()
+	{
+		assembly_ms = 0.0f;
+		solve_ms = 0.0f;
+		solves = 0;
+		iterations = 0.0f;
+		iteration_limit_hits = 0;
+	}
+
+	virtual bool StepSimulation(float dt, const Vector3& gravity, const Vector3* in_x, const Vector3* in_dxdt, Vector3* out_dxdt) override
+	{
+		m_CallTimer.BeginTiming();
+		bool success = m_Sim->StepSimulation(dt, gravity, in_x, in_dxdt, out_dxdt);
+		EndCall(true, true);
+		return success;
+	}
+
+	virtual bool SupportsImplicit() override { return m_Sim->SupportsImplicit(); }
+
+	virtual float BuildImplicitSystem(float dt, const Vector3& gravity, const Vector3* x0, const Vector3* v0, const Vector3* v) override
+	{
+		m_CallTimer.BeginTiming();
+		float residual = m_Sim->BuildImplicitSystem(dt, gravity, x0, v0, v);
+		EndCall(true, false);
+		return residual;
+	}
+
+	virtual bool SolveImplicitSystem(const Vector3* guess, Vector3* out_v) override
+	{
+		m_CallTimer.BeginTiming();
+		bool success = m_Sim->SolveImplicitSystem(guess, out_v);
+		EndCall(false, true);
+		return success;
+	}
+
+	virtual bool SupportsBatchedSubsteps() override { return m_Sim->SupportsBatchedSubsteps(); }
+
+	virtual int AdvanceSubsteps(int num_substeps, float dt, const Vector3& gravity, Vector3* x, Vector3* dxdt, const Sim_Integrator_SubstepCallback& on_substep) override
+	{
+		m_CallTimer.BeginTiming();
+		int completed = m_Sim->AdvanceSubsteps(num_substeps, dt, gravity, x, dxdt, on_substep);
+		EndCall(true, completed > 0);
+		return completed;
+	}
+
+	float	assembly_ms;
+	float	solve_ms;
+	uint	solves;
+	float	iterations;		//Sum over the solves
+	uint	iteration_limit_hits;
+
+protected:
+	void EndCall(bool assembled, bool solved)
+	{
+		m_CallTimer.EndTiming();
+
+		MPCG<SparseRowMatrix<Matrix3>>* solver = m_Sim->Solver();
+		if (solver == NULL)
+		{
+			//No assembly/solve split, the whole step counts as the solve
+			solve_ms += m_CallTimer.GetTimedMilliSeconds();
+			return;
+		}
+
+		if (assembled)
+			assembly_ms += m_Sim->GetSubProfiler(Sim_FESimulation_SubTimer_BuildMatrices).GetTimedMilliSeconds();
+
+		if (solved)
+		{
+			//Solver timer also covers clearing the solvers memory before the assembly
+			solve_ms += m_Sim->GetSubProfiler(Sim_FESimulation_SubTimer_Solver).GetTimedMilliSeconds();
+
+			MPCG_Telemetry records[64];
+			uint num_read;
+			while ((num_read = m_Telemetry.Poll(solver->GetTelemetry(), records, 64)) > 0)
+			{
+				for (uint i = 0; i < num_read; ++i)
+				{
+					solves++;
+					iterations += (float)records[i].iterations;
+					iteration_limit_hits += records[i].hit_max_iterations ? 1 : 0;
+				}
+			}
+		}
+	}
+
+protected:
+	Sim_Simulation*		m_Sim;
+	ProfilingTimer		m_CallTimer;
+	Sim_TelemetryReader	m_Telemetry;
+};
+
+static const char* g_BenchmarkSimTypeNames[] = { "FE6NodedC0", "FE6NodedC1", "FE6NodedC1_v2", "PBD3NodedC0" };
+static const char* g_BenchmarkIntegratorNames[] = { "Explicit", "RK2", "RK4", "Implicit" };
+
+void Sim_Benchmark::GetReferenceScenes(std::vector<Sim_Benchmark_Scene>& out_scenes)
+{
+	out_scenes.clear();
+
+	auto add_scene = [&](const char* group, Sim_Type sim_type, Sim_Integrator_Type integrator, uint grid_size, bool bend_test)
+	{
+		Sim_Benchmark_Scene scene;
+		scene.name = std::string(group) + "/" + g_BenchmarkSimTypeNames[sim_type] + "/" + g_BenchmarkIntegratorNames[integrator] + "/" + std::to_string(grid_size);
+		scene.sim_type = sim_type;
+		scene.integrator = integrator;
+		scene.grid_size = grid_size;
+		scene.bend_test = bend_test;
+		out_scenes.push_back(scene);
+	};
+
+	//Scaling, at the default (explicit) integrator
+	for (int type = 0; type < Sim_Type_NULL; ++type)
+	{
+		for (uint grid_size = 1; grid_size <= 10; ++grid_size)
+			add_scene("grid", (Sim_Type)type, Sim_Integrator_Type_Explicit, grid_size, false);
+	}
+
+	for (int type = 0; type < Sim_Type_NULL; ++type)
+		add_scene("bend", (Sim_Type)type, Sim_Integrator_Type_Explicit, 2, true);
+
+	for (int integrator = Sim_Integrator_Type_Explicit; integrator <= Sim_Integrator_Type_Implicit; ++integrator)
+		add_scene("integrator", Sim_Type_FE6NodedC1, (Sim_Integrator_Type)integrator, 2, false);
+}
+
+Sim_Benchmark_Stat Sim_Benchmark::ComputeStat(std::vector<float>& samples)
+{
+	Sim_Benchmark_Stat stat;
+	if (samples.empty())
+		return stat;
+
+	std::sort(samples.begin(), samples.end());
+	const size_t n = samples.size();
+	stat.median = (n % 2 == 1) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) * 0.5f;
+
+	//Nearest rank
+	size_t p95_rank = (size_t)ceilf(0.95f * (float)n);
+	stat.p95 = samples[(p95_rank > 0) ? p95_rank - 1 : 0];
+	return stat;
+}
+
+Sim_Benchmark_Result Sim_Benchmark::RunScene(const Sim_Benchmark_Scene& scene, uint num_frames, uint warmup_frames)
+{
+	Sim_Benchmark_Result result;
+	result.scene = scene;
+	result.num_frames = num_frames;
+	result.solves = 0;
+	result.iteration_limit_hits = 0;
+	result.diverged = false;
+
+	Sim_Generator_Output config;
+	Sim_Simulation* sim = Sim_Manager::CreateHeadlessSimulation(scene.sim_type, scene.grid_size, scene.bend_test, config);
+	if (sim == NULL)
+	{
+		result.diverged = true;
+		return result;
+	}
+
+	Sim_BenchmarkProbe probe(sim);
+
+	Sim_Integrator integrator;
+	integrator.Initialize(&probe, config);
+	integrator.SetIntegrationType(scene.integrator);
+	integrator.SetSubTimestep((scene.integrator == Sim_Integrator_Type_Implicit) ? DEFAULT_IMPLICIT_SUB_TIMESTEP : DEFAULT_SUB_TIMESTEP);
+
+	std::vector<Sim_RenderVertex> vertices(sim->GetNumTris() * Sim_Renderer::GetNumVertsPerTri(SIM_RENDERER_DEFAULT_SUBDIVISIONS));
+	ProfilingTimer tessellation_timer;
+
+	std::vector<float> frame_ms, assembly_ms, solve_ms, tessellation_ms, iterations;
+	frame_ms.reserve(num_frames);
+	assembly_ms.reserve(num_frames);
+	solve_ms.reserve(num_frames);
+	tessellation_ms.reserve(num_frames);
+	iterations.reserve(num_frames);
+
+	const float frame_timestep = 1.0f / 60.0f;
+	for (uint frame = 0; frame < warmup_frames + num_frames; ++frame)
+	{
+		probe.ResetFrame();
+		integrator.UpdateSimulation(frame_timestep);
+
+		//Default render settings, stress colours with lighting
+		tessellation_timer.BeginTiming();
+		Sim_Renderer::Tessellate(sim, integrator.X(), SIM_RENDERER_DEFAULT_SUBDIVISIONS, Sim_RenderMode_Stress, Sim_RenderExtraInfo_None, true, vertices.empty() ? NULL : &vertices[0]);
+		tessellation_timer.EndTiming();
+
+		if (frame < warmup_frames)
+			continue;
+
+		frame_ms.push_back(integrator.GetTotalTimer().GetTimedMilliSeconds());
+		assembly_ms.push_back(probe.assembly_ms);
+		solve_ms.push_back(probe.solve_ms);
+		tessellation_ms.push_back(tessellation_timer.GetTimedMilliSeconds());
+		if (probe.solves > 0)
+			iterations.push_back(probe.iterations / (float)probe.solves);
+		result.solves += probe.solves;
+		result.iteration_limit_hits += probe.iteration_limit_hits;
+	}
+
+	result.frame_ms = ComputeStat(frame_ms);
+	result.assembly_ms = ComputeStat(assembly_ms);
+	result.solve_ms = ComputeStat(solve_ms);
+	result.tessellation_ms = ComputeStat(tessellation_ms);
+	result.iterations = ComputeStat(iterations);
+
+	const Vector3* x = integrator.X();
+	for (uint i = 0; i < config.NumVertices; ++i)
+	{
+		if (!std::isfinite(x[i].x) || !std::isfinite(x[i].y) || !std::isfinite(x[i].z))
+		{
+			result.diverged = true;
+			break;
+		}
+	}
+
+	delete sim;
+	return result;
+}
+
+bool Sim_Benchmark::WriteJSON(const std::string& filename, const std::vector<Sim_Benchmark_Result>& results)
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+		return false;
+
+	TaskScheduler* scheduler = TaskScheduler::Instance();
+
+	auto write_stat = [&](const char* name, const Sim_Benchmark_Stat& stat)
+	{
+		file << ", \"" << name << "\": {\"median\": " << stat.median << ", \"p95\": " << stat.p95 << "}";
+	};
+
+	file << std::setprecision(6);
+	file << "{\n";
+#ifdef _DEBUG
+	file << "\"build\": \"Debug\",\n";
+#else
+	file << "\"build\": \"Release\",\n";
+#endif
+	file << "\"threads\": " << scheduler->GetNumThreads() << ",\n";
+	file << "\"scheduler\": \"" << ((scheduler->GetBackend() == TaskScheduler_Backend_OpenMP) ? "OpenMP" : "WorkStealing") << "\",\n";
+	file << "\"render_subdivisions\": " << SIM_RENDERER_DEFAULT_SUBDIVISIONS << ",\n";
+	file << "\"scenes\": [\n";
+
+	//One scene per line, CompareToBaseline reads them back line by line
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Sim_Benchmark_Result& r = results[i];
+		file << "{\"name\": \"" << r.scene.name << "\""
+			<< ", \"sim_type\": \"" << g_BenchmarkSimTypeNames[r.scene.sim_type] << "\""
+			<< ", \"integrator\": \"" << g_BenchmarkIntegratorNames[r.scene.integrator] << "\""
+			<< ", \"grid_size\": " << r.scene.grid_size
+			<< ", \"bend_test\": " << (r.scene.bend_test ? "true" : "false")
+			<< ", \"frames\": " << r.num_frames;
+		write_stat("frame_ms", r.frame_ms);
+		write_stat("assembly_ms", r.assembly_ms);
+		write_stat("solve_ms", r.solve_ms);
+		write_stat("tessellation_ms", r.tessellation_ms);
+		file << ", \"solves\": " << r.solves;
+		write_stat("iterations", r.iterations);
+		file << ", \"iteration_limit_hits\": " << r.iteration_limit_hits;
+		file << ", \"diverged\": " << (r.diverged ? "true" : "false") << "}";
+		file << ((i + 1 < results.size()) ? ",\n" : "\n");
+	}
+
+	file << "]\n}\n";
+	return file.good();
+}
+
+int Sim_Benchmark::CompareToBaseline(const std::string& baseline_filename, const std::vector<Sim_Benchmark_Result>& results, float threshold)
+{
+	std::ifstream file(baseline_filename);
+	if (!file.is_open())
+		return -1;
+
+	//Only what WriteJSON writes needs to be understood, the name and frame median of each scene line
+	const std::string name_key = "{\"name\": \"";
+	const std::string median_key = "\"frame_ms\": {\"median\": ";
+
+	std::map<std::string, float> baseline;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t name_start = line.find(name_key);
+		size_t median_start = line.find(median_key);
+		if (name_start == std::string::npos || median_start == std::string::npos)
+			continue;
+
+		name_start += name_key.size();
+		size_t name_end = line.find('"', name_start);
+		if (name_end == std::string::npos)
+			continue;
+
+		baseline[line.substr(name_start, name_end - name_start)] = (float)atof(line.c_str() + median_start + median_key.size());
+	}
+
+	//A diverged scene or one without a usable baseline can't be shown to be fine, so both fail rather than being skipped
+	int num_failures = 0;
+	for (const Sim_Benchmark_Result& r : results)
+	{
+		if (r.diverged || !std::isfinite(r.frame_ms.median))
+		{
+			num_failures++;
+			printf("  DIVERGED   %-36s\n", r.scene.name.c_str());
+			continue;
+		}
+
+		auto itr = baseline.find(r.scene.name);
+		if (itr == baseline.end() || !std::isfinite(itr->second) || itr->second <= 0.0f)
+		{
+			num_failures++;
+			printf("  MISSING    %-36s no baseline frame time\n", r.scene.name.c_str());
+			continue;
+		}
+
+		float change = r.frame_ms.median / itr->second - 1.0f;
+		if (change > threshold)
+		{
+			num_failures++;
+			printf("  REGRESSION %-36s %9.3fms -> %9.3fms (+%.0f%%)\n", r.scene.name.c_str(), itr->second, r.frame_ms.median, change * 100.0f);
+		}
+	}
+	return num_failures;
+}
+
+int Sim_Benchmark::RunCommandLine(int argc, char** argv)
+{
+	std::string output_filename, baseline_filename, filter;
+	float threshold = SIM_BENCHMARK_DEFAULT_THRESHOLD;
+	uint num_frames = SIM_BENCHMARK_DEFAULT_FRAMES;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool has_value = (i + 1 < argc);
+		if (strcmp(argv[i], "-benchmark") == 0 && has_value)
+			output_filename = argv[++i];
+		else if (strcmp(argv[i], "-baseline") == 0 && has_value)
+			baseline_filename = argv[++i];
+		else if (strcmp(argv[i], "-threshold") == 0 && has_value)
+			threshold = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-frames") == 0 && has_value)
+			num_frames = (uint)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-filter") == 0 && has_value)
+			filter = argv[++i];
+		else
+		{
+			printf("Unknown or incomplete benchmark argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (output_filename.empty() || num_frames == 0)
+	{
+		printf("Usage: -benchmark <out.json> [-baseline <in.json>] [-threshold <fraction>] [-frames <n>] [-filter <text>]\n");
+		return 1;
+	}
+
+	std::vector<Sim_Benchmark_Scene> scenes;
+	GetReferenceScenes(scenes);
+
+	std::vector<Sim_Benchmark_Result> results;
+	for (const Sim_Benchmark_Scene& scene : scenes)
+	{
+		if (!filter.empty() && scene.name.find(filter) == std::string::npos)
+			continue;
+
+		results.push_back(RunScene(scene, num_frames));
+		const Sim_Benchmark_Result& r = results.back();
+		printf("%-36s frame %9.3fms (p95 %9.3fms)  assembly %8.3fms  solve %8.3fms  tessellation %7.3fms  iterations %6.1f (%d at limit)%s\n",
+			scene.name.c_str(), r.frame_ms.median, r.frame_ms.p95, r.assembly_ms.median, r.solve_ms.median, r.tessellation_ms.median, r.iterations.median,
+			r.iteration_limit_hits, r.diverged ? "  DIVERGED" : "");
+	}
+
+	if (!WriteJSON(output_filename, results))
+	{
+		printf("Unable to write %s\n", output_filename.c_str());
+		return 1;
+	}
+	printf("%d scenes written to %s\n", (int)results.size(), output_filename.c_str());
+
+	if (baseline_filename.empty())
+		return 0;
+
+	int num_failures = CompareToBaseline(baseline_filename, results, threshold);
+	if (num_failures < 0)
+	{
+		printf("Unable to read baseline %s\n", baseline_filename.c_str());
+		return 1;
+	}
+
+	printf("%d scenes failed against %s (threshold +%.0f%%)\n", num_failures, baseline_filename.c_str(), threshold * 100.0f);
+	return (num_failures > 0) ? 2 : 0;
+}
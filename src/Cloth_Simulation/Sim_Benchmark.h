@@ -0,0 +1,71 @@
+#pragma once
+#include "Sim_Manager.h"
+#include <string>
+#include <vector>
+
+#define SIM_BENCHMARK_DEFAULT_FRAMES		60
+#define SIM_BENCHMARK_DEFAULT_WARMUP_FRAMES	5
+#define SIM_BENCHMARK_DEFAULT_THRESHOLD		0.1f	//Slowdown of a scenes median frame time counted as a regression
+
+//One reference scene, simulated from rest (pinned along the top unless it is the bend test) for a fixed
+// number of 1/60th second frames
+struct Sim_Benchmark_Scene
+{
+	std::string			name;
+	Sim_Type			sim_type;
+	Sim_Integrator_Type	integrator;
+	uint				grid_size;		//Generator visual subdivisions
+	bool				bend_test;
+};
+
+struct Sim_Benchmark_Stat
+{
+	Sim_Benchmark_Stat() : median(0.0f), p95(0.0f) {}
+
+	float median;
+	float p95;
+};
+
+//Per frame samples, warm up frames are not included
+struct Sim_Benchmark_Result
+{
+	Sim_Benchmark_Scene scene;
+	uint				num_frames;
+
+	Sim_Benchmark_Stat	frame_ms;			//Whole integrator update
+	Sim_Benchmark_Stat	assembly_ms;		//Building the matrices, zero for simulations without a solver
+	Sim_Benchmark_Stat	solve_ms;			//MPCG, or the whole step for simulations without a solver
+	Sim_Benchmark_Stat	tessellation_ms;	//Sim_Renderer::Tessellate at the default render settings
+
+	uint				solves;				//Over all frames
+	Sim_Benchmark_Stat	iterations;			//Average MPCG iterations per solve of each frame
+	uint				iteration_limit_hits;	//Solves stopped by the iteration limit rather than the tolerance
+	bool				diverged;			//Non finite positions at the end
+};
+
+//Fixed set of reference scenes run headless, so builds can be compared and regressions caught
+// - Assembly and solve are accumulated over every call the integrator makes into the simulation
+//   (the simulations own sub timers only hold the last call)
+// - Results are written as JSON, one scene per line, which is also the baseline format for regression checks
+class Sim_Benchmark
+{
+public:
+	//Every Sim_Type on square grids 1-10, the bend test with every Sim_Type and every integrator on the default C1 cloth
+	static void GetReferenceScenes(std::vector<Sim_Benchmark_Scene>& out_scenes);
+
+	static Sim_Benchmark_Result RunScene(const Sim_Benchmark_Scene& scene, uint num_frames = SIM_BENCHMARK_DEFAULT_FRAMES, uint warmup_frames = SIM_BENCHMARK_DEFAULT_WARMUP_FRAMES);
+
+	static bool WriteJSON(const std::string& filename, const std::vector<Sim_Benchmark_Result>& results);
+
+	//Compares median frame times against a previous WriteJSON output, baseline scenes that weren't run are skipped
+	// - Returns the number of failed scenes, or -1 if the baseline could not be read. A scene fails if it is slower than the
+	//   baseline by more than threshold (fraction), diverged, or has no finite baseline frame time to compare against
+	static int CompareToBaseline(const std::string& baseline_filename, const std::vector<Sim_Benchmark_Result>& results, float threshold);
+
+	//Headless entry point for 'Cloth_Simulation.exe -benchmark <out.json> [-baseline <in.json>] [-threshold <fraction>] [-frames <n>] [-filter <text>]'
+	// - Returns the process exit code, non-zero if any scene failed the baseline comparison or the results could not be written
+	static int RunCommandLine(int argc, char** argv);
+
+protected:
+	static Sim_Benchmark_Stat ComputeStat(std::vector<float>& samples);
+};
@@ -0,0 +1,346 @@
+#include "Sim_Collision.h"
+#include "Sim_Manager.h"
+#include <cfloat>
+
+Sim_Collision::Sim_Collision()
+	: m_Enabled(true)
+	, m_Thickness(DEFAULT_COLLISION_THICKNESS)
+	, m_Friction(DEFAULT_COLLISION_FRICTION)
+	, m_Simulation(NULL)
+	, m_NumPhyxels(0)
+	, m_ObstacleTreeValid(false)
+	, m_ElementTreeValid(false)
+	, m_NumPairs(0)
+	, m_NumContacts(0)
+{
+	m_Timer.SetAlias("Collisions");
+}
+
+Sim_Collision::~Sim_Collision()
+{
+	ClearObstacles();
+}
+
+void Sim_Collision::AddObstacle(Object* obj, Sim_Collision_Shape shape)
+{
+	Obstacle obstacle;
+	obstacle.object = obj;
+	obstacle.shape = shape;
+	m_Obstacles.push_back(obstacle);
+	m_ObstacleTreeValid = false;
+}
+
+void Sim_Collision::RemoveObstacle(Object* obj)
+{
+	for (auto itr = m_Obstacles.begin(); itr != m_Obstacles.end(); ++itr)
+	{
+		if (itr->object == obj)
+		{
+			m_Obstacles.erase(itr);
+			m_ObstacleTreeValid = false;
+			return;
+		}
+	}
+}
+
+void Sim_Collision::ClearObstacles()
+{
+	m_Obstacles.clear();
+	m_ObstacleBounds.clear();
+	m_ObstacleTree.Clear();
+	m_ObstacleTreeValid = false;
+}
+
+void Sim_Collision::Initialize(const Sim_Generator_Output& config, Sim_Simulation* sim)
+{
+	m_Simulation = sim;
+	m_NumPhyxels = config.NumVertices;
+
+	//Tangent dofs (C1) are left alone, only the phyxel positions are collided
+	uint num_elements = (uint)config.Triangles.size();
+	m_ElementPhyxels.resize(num_elements * 6);
+	for (uint i = 0; i < num_elements; ++i)
+	{
+		for (uint j = 0; j < 6; ++j)
+		{
+			uint idx = config.Triangles[i].phyxels[j];
+			m_ElementPhyxels[i * 6 + j] = (idx < m_NumPhyxels) ? idx : config.Triangles[i].phyxels[0];
+		}
+	}
+
+	m_PrevX.resize(m_NumPhyxels);
+	if (m_NumPhyxels > 0)
+		memcpy(&m_PrevX[0], &config.Phyxels[0], m_NumPhyxels * sizeof(Vector3));
+
+	m_ElementBounds.resize(num_elements);
+	m_ElementTree.Clear();
+	m_ElementTreeValid = false;
+	m_Pairs.clear();
+	m_NumPairs = 0;
+	m_NumContacts = 0;
+}
+
+void Sim_Collision::ResolveCollisions(Vector3* x, Vector3* dxdt, std::vector<uint>* modified)
+{
+	m_NumPairs = 0;
+	m_NumContacts = 0;
+
+	if (!m_Enabled || m_Obstacles.empty() || m_ElementBounds.empty())
+	{
+		//Keep the start of the sub-step current, or the first sweep after enabling (or adding an obstacle)
+		// would run from wherever the phyxels were back then
+		if (!m_PrevX.empty())
+			memcpy(&m_PrevX[0], x, m_NumPhyxels * sizeof(Vector3));
+		return;
+	}
+
+	m_Timer.BeginTiming();
+
+	UpdateObstacles();
+	UpdateElements(x);
+
+	//Broad phase
+	m_Pairs.clear();
+	Sim_BVH::QueryPairs(m_ElementTree, m_ElementBounds, m_ObstacleTree, m_ObstacleBounds,
+		[&](uint element, uint obstacle) { m_Pairs.push_back(element); m_Pairs.push_back(obstacle); });
+	m_NumPairs = (uint)m_Pairs.size() / 2;
+
+	//Narrow phase, phyxels shared between elements are only pushed out by the first pair that finds them
+	// as they lie on the surface (not inside) for any later test against the same obstacle
+	const Vector3* prev_x = &m_PrevX[0];
+	for (uint i = 0; i < m_NumPairs; ++i)
+	{
+		const uint* phyxels = &m_ElementPhyxels[m_Pairs[i * 2] * 6];
+		const Obstacle& obstacle = m_Obstacles[m_Pairs[i * 2 + 1]];
+		for (uint j = 0; j < 6; ++j)
+		{
+			if (ResolvePhyxel(obstacle, phyxels[j], prev_x, x, dxdt))
+			{
+				m_NumContacts++;
+				if (modified != NULL)
+					modified->push_back(phyxels[j]);
+			}
+		}
+	}
+
+	memcpy(&m_PrevX[0], x, m_NumPhyxels * sizeof(Vector3));
+
+	m_Timer.EndTimingAdditive();
+}
+
+void Sim_Collision::UpdateObstacles()
+{
+	uint num_obstacles = (uint)m_Obstacles.size();
+	m_ObstacleBounds.resize(num_obstacles);
+
+	for (uint i = 0; i < num_obstacles; ++i)
+	{
+		Obstacle& obstacle = m_Obstacles[i];
+		const Matrix4& transform = obstacle.object->GetLocalTransform();
+
+		obstacle.centre = transform.GetPositionVector();
+		for (int j = 0; j < 3; ++j)
+		{
+			Vector3 col(transform.values[j * 4 + 0], transform.values[j * 4 + 1], transform.values[j * 4 + 2]);
+			float len = col.Length();
+			(&obstacle.half_dims.x)[j] = len;
+			obstacle.axes.SetCol(j, (len > 0.f) ? col / len : Vector3(0.f, 0.f, 0.f));
+		}
+
+		Vector3 extent;
+		if (obstacle.shape == Sim_Collision_Shape_Sphere)
+		{
+			extent = Vector3(obstacle.half_dims.x, obstacle.half_dims.x, obstacle.half_dims.x);
+		}
+		else
+		{
+			//Box of the rotated cuboid
+			for (int j = 0; j < 3; ++j)
+			{
+				(&extent.x)[j] = fabs(obstacle.axes(j, 0)) * obstacle.half_dims.x
+					+ fabs(obstacle.axes(j, 1)) * obstacle.half_dims.y
+					+ fabs(obstacle.axes(j, 2)) * obstacle.half_dims.z;
+			}
+		}
+
+		m_ObstacleBounds[i].minPoints = obstacle.centre - extent;
+		m_ObstacleBounds[i].maxPoints = obstacle.centre + extent;
+	}
+
+	if (m_ObstacleTreeValid)
+	{
+		m_ObstacleTree.Refit(m_ObstacleBounds);
+	}
+	else
+	{
+		m_ObstacleTree.Build(m_ObstacleBounds);
+		m_ObstacleTreeValid = true;
+	}
+}
+
+void Sim_Collision::UpdateElements(const Vector3* x)
+{
+	Vector3 thickness(m_Thickness, m_Thickness, m_Thickness);
+	const Vector3* prev_x = &m_PrevX[0];
+
+	//Swept box over the start and end of the sub-step
+#pragma omp parallel for
+	for (int i = 0; i < (int)m_ElementBounds.size(); ++i)
+	{
+		const uint* phyxels = &m_ElementPhyxels[i * 6];
+		BoundingBox bounds;
+		for (int j = 0; j < 6; ++j)
+		{
+			bounds.ExpandToFit(prev_x[phyxels[j]]);
+			bounds.ExpandToFit(x[phyxels[j]]);
+		}
+		bounds.minPoints = bounds.minPoints - thickness;
+		bounds.maxPoints = bounds.maxPoints + thickness;
+		m_ElementBounds[i] = bounds;
+	}
+
+	if (m_ElementTreeValid)
+	{
+		m_ElementTree.Refit(m_ElementBounds);
+	}
+	else
+	{
+		m_ElementTree.Build(m_ElementBounds);
+		m_ElementTreeValid = true;
+	}
+}
+
+bool Sim_Collision::ResolvePhyxel(const Obstacle& obstacle, uint idx, const Vector3* prev_x, Vector3* x, Vector3* dxdt)
+{
+	Vector3& pos = x[idx];
+	Vector3 diff = pos - obstacle.centre;
+	Vector3 normal;
+	float depth;
+
+	if (obstacle.shape == Sim_Collision_Shape_Sphere)
+	{
+		float radius = obstacle.half_dims.x + m_Thickness;
+		float dist_sq = Vector3::Dot(diff, diff);
+		if (dist_sq >= radius * radius)
+			return ResolveTunnelling(obstacle, idx, prev_x, x, dxdt);
+
+		float dist = sqrtf(dist_sq);
+		normal = (dist > 1E-6f) ? diff / dist : Vector3(0.f, 1.f, 0.f);
+		depth = radius - dist;
+	}
+	else
+	{
+		//Push out through the closest face
+		depth = FLT_MAX;
+		for (int j = 0; j < 3; ++j)
+		{
+			const Vector3& axis = obstacle.axes.GetCol(j);
+			float local = Vector3::Dot(axis, diff);
+			float face_depth = (&obstacle.half_dims.x)[j] + m_Thickness - fabs(local);
+			if (face_depth <= 0.f)
+				return ResolveTunnelling(obstacle, idx, prev_x, x, dxdt);
+
+			if (face_depth < depth)
+			{
+				depth = face_depth;
+				normal = (local < 0.f) ? -axis : axis;
+			}
+		}
+	}
+
+	if (m_Simulation != NULL && m_Simulation->GetIsStatic(idx))
+		return false;
+
+	pos += normal * depth;
+	RemoveInwardVelocity(normal, dxdt[idx]);
+	return true;
+}
+
+bool Sim_Collision::ResolveTunnelling(const Obstacle& obstacle, uint idx, const Vector3* prev_x, Vector3* x, Vector3* dxdt)
+{
+	//The phyxel ended the sub-step outside, test the segment it moved along for having passed through
+	// - The obstacle is taken at its current transform for the whole sub-step
+	// - Only entries from outside count, so a phyxel left on the surface by an earlier pair is not hit again
+	const Vector3 start = prev_x[idx] - obstacle.centre;
+	const Vector3 dir = x[idx] - prev_x[idx];
+	float t_enter;
+	Vector3 normal;
+
+	if (obstacle.shape == Sim_Collision_Shape_Sphere)
+	{
+		//|start + t * dir| = radius
+		float radius = obstacle.half_dims.x + m_Thickness;
+		float a = Vector3::Dot(dir, dir);
+		float b = Vector3::Dot(start, dir);
+		float c = Vector3::Dot(start, start) - radius * radius;
+		if (c <= 0.f || b >= 0.f || a < 1E-12f)
+			return false;
+
+		float discriminant = b * b - a * c;
+		if (discriminant <= 0.f)
+			return false;
+
+		t_enter = (-b - sqrtf(discriminant)) / a;
+		normal = (start + dir * t_enter) / radius;
+	}
+	else
+	{
+		//Slabs of the inflated cuboid, the segment enters through the face it crosses last
+		t_enter = -FLT_MAX;
+		float t_exit = FLT_MAX;
+		for (int j = 0; j < 3; ++j)
+		{
+			const Vector3& axis = obstacle.axes.GetCol(j);
+			float half_dim = (&obstacle.half_dims.x)[j] + m_Thickness;
+			float local_start = Vector3::Dot(axis, start);
+			float local_dir = Vector3::Dot(axis, dir);
+
+			if (fabs(local_dir) < 1E-12f)
+			{
+				if (fabs(local_start) >= half_dim)
+					return false;
+				continue;
+			}
+
+			float t0 = (-half_dim - local_start) / local_dir;
+			float t1 = (half_dim - local_start) / local_dir;
+			if (t0 > t1)
+			{
+				float tmp = t0; t0 = t1; t1 = tmp;
+			}
+
+			if (t0 > t_enter)
+			{
+				t_enter = t0;
+				normal = (local_dir > 0.f) ? -axis : axis;
+			}
+			t_exit = (t1 < t_exit) ? t1 : t_exit;
+		}
+
+		if (t_enter > t_exit)
+			return false;
+	}
+
+	if (t_enter <= 0.f || t_enter >= 1.f)
+		return false;
+
+	if (m_Simulation != NULL && m_Simulation->GetIsStatic(idx))
+		return false;
+
+	x[idx] = prev_x[idx] + dir * t_enter;
+	RemoveInwardVelocity(normal, dxdt[idx]);
+	return true;
+}
+
+void Sim_Collision::RemoveInwardVelocity(const Vector3& normal, Vector3& vel)
+{
+	//Friction takes up to friction * |vn| off the tangential velocity
+	float vn = Vector3::Dot(vel, normal);
+	if (vn < 0.f)
+	{
+		Vector3 vt = vel - normal * vn;
+		float vt_len = vt.Length();
+		float scale = (vt_len > 1E-6f) ? 1.f + m_Friction * vn / vt_len : 0.f;
+		vel = vt * ((scale > 0.f) ? scale : 0.f);
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glcore\Object.h>
+#include <glcore\Matrix3.h>
+#include <glcore\Vector3.h>
+#include "Sim_BVH.h"
+#include "Sim_Generator.h"
+#include "ProfilingTimer.h"
+#include "SimulationDefines.h"
+#include <vector>
+
+class Sim_Simulation;
+
+#define DEFAULT_COLLISION_THICKNESS 0.005f		//Distance (m) kept between the cloth and obstacle surfaces
+#define DEFAULT_COLLISION_FRICTION 0.3f
+
+//Shape of the unit mesh the obstacles local transform is applied to (see CommonUtils::Build*Object)
+enum Sim_Collision_Shape
+{
+	Sim_Collision_Shape_Sphere = 0,		//Unit radius, uniform scale only
+	Sim_Collision_Shape_Cuboid = 1		//Unit half dimensions
+};
+
+//Cloth vs scene object collisions, run after every sub-step through the integrators sub-step callback
+// - Broad phase: a BVH over the obstacles is tested against a BVH over the swept element boxes (positions at the
+//   start and end of the sub-step), both trees are built once and only refit per sub-step
+// - Narrow phase: phyxels of the overlapping elements are projected out of the obstacle and their
+//   inward velocity removed (with coulomb friction on the tangential part). Phyxels that end the sub-step
+//   outside are tested along their path from the start of it, and moved back to where they entered if they
+//   passed through (thin or fast obstacles)
+// - Obstacles are read from their local transform, world matrices are only built at render time so the
+//   objects are expected to be children of the scene root
+class Sim_Collision
+{
+public:
+	Sim_Collision();
+	~Sim_Collision();
+
+	void AddObstacle(Object* obj, Sim_Collision_Shape shape);
+	void RemoveObstacle(Object* obj);
+	void ClearObstacles();
+	uint GetNumObstacles() const { return (uint)m_Obstacles.size(); }
+
+	void Initialize(const Sim_Generator_Output& configuration, Sim_Simulation* sim);
+	//Phyxels moved are appended to modified if given (see Sim_Integrator_SubstepCallback)
+	void ResolveCollisions(Vector3* x, Vector3* dxdt, std::vector<uint>* modified = NULL);
+
+	bool GetEnabled() const { return m_Enabled; }
+	void SetEnabled(bool enabled) { m_Enabled = enabled; }
+	float& GetThickness() { return m_Thickness; }
+	float& GetFriction() { return m_Friction; }
+
+	//Stats of the last sub-step
+	uint GetNumPairs() const { return m_NumPairs; }
+	uint GetNumContacts() const { return m_NumContacts; }
+
+	//Additive over all sub-steps, reset by the caller
+	ProfilingTimer& GetTimer() { return m_Timer; }
+
+protected:
+	struct Obstacle
+	{
+		Object*				object;
+		Sim_Collision_Shape	shape;
+		Vector3				centre;
+		Matrix3				axes;			//Orthonormal columns
+		Vector3				half_dims;		//Sphere radius in x
+	};
+
+	void UpdateObstacles();
+	void UpdateElements(const Vector3* x);
+	bool ResolvePhyxel(const Obstacle& obstacle, uint idx, const Vector3* prev_x, Vector3* x, Vector3* dxdt);
+	bool ResolveTunnelling(const Obstacle& obstacle, uint idx, const Vector3* prev_x, Vector3* x, Vector3* dxdt);
+	void RemoveInwardVelocity(const Vector3& normal, Vector3& vel);
+
+protected:
+	bool	m_Enabled;
+	float	m_Thickness;
+	float	m_Friction;
+
+	Sim_Simulation*				m_Simulation;
+	uint						m_NumPhyxels;
+	std::vector<uint>			m_ElementPhyxels;	//6 phyxels per triangle
+	std::vector<Vector3>		m_PrevX;			//Phyxel positions at the end of the last sub-step, also updated while disabled
+
+	std::vector<Obstacle>		m_Obstacles;
+	std::vector<BoundingBox>	m_ObstacleBounds;
+	std::vector<BoundingBox>	m_ElementBounds;
+	Sim_BVH						m_ObstacleTree;
+	Sim_BVH						m_ElementTree;
+	bool						m_ObstacleTreeValid;
+	bool						m_ElementTreeValid;
+
+	std::vector<uint>			m_Pairs;			//Element, obstacle
+
+	uint			m_NumPairs;
+	uint			m_NumContacts;
+	ProfilingTimer	m_Timer;
+};
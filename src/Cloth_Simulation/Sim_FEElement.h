@@ -0,0 +1,321 @@
+#pragma once
+
+#include "mpcg.h"
+#include "EigenDefines.h"
+#include "SimulationDefines.h"
+
+#include <glcore\Vector3.h>
+#include <glcore\Matrix3.h>
+
+//Compile time description of the 6 noded triangular elements shared by all FE simulations
+// - Element traits give the node count, how each node maps onto the X array (phyxels then tangents)
+//   and the natural coordinate shape function derivatives
+// - Quadrature rules give the integration points (area coordinates) and weights
+// - Sim_FEKernel<Element, Quadrature> is the corotated assembly of a single element, every matrix size
+//   is known at compile time so Eigen keeps everything on the stack and the node/gauss loops unroll
+// New element variants only need to provide a traits struct to get the same assembly path
+
+typedef Eigen::Matrix<float, 2, 2> JaMatrix;
+
+enum Sim_FEQuadrature_Rule
+{
+	Sim_FEQuadrature_Rule_Dunavant3 = 0,
+	Sim_FEQuadrature_Rule_Dunavant6,
+	Sim_FEQuadrature_Rule_Dunavant7,
+	Sim_FEQuadrature_Rule_Dunavant12,
+	Sim_FEQuadrature_Rule_MAX
+};
+
+//Runtime quadrature selection of a simulation
+// - Adaptive integration picks the rule per element from the strain measured in its previous assembly,
+//   elements with small or near uniform strain use the (cheaper) low order rule
+// - The 3 point rule under-integrates the C1 element (hourglass modes), see Sim_QuadratureValidation
+struct Sim_FEQuadrature_Settings
+{
+	Sim_FEQuadrature_Settings()
+		: rule(Sim_FEQuadrature_Rule_Dunavant12)
+		, adaptive(false)
+		, low_order_rule(Sim_FEQuadrature_Rule_Dunavant7)
+		, strain_threshold(1E-3f)
+		, uniformity_threshold(0.05f)
+		, num_low_order(0)
+	{}
+
+	Sim_FEQuadrature_Rule rule;
+	bool adaptive;
+	Sim_FEQuadrature_Rule low_order_rule;
+	float strain_threshold;			//Largest strain (norm) still considered small
+	float uniformity_threshold;		//Largest deviation from the element mean strain, relative to the largest strain
+	uint num_low_order;				//Elements integrated with the low order rule in the last assembly
+};
+
+//Incremental assembly, elements whose displacements barely changed since they were last built keep their
+// cached K_T (forces get a first order update) and their blocks in the global matrix are left as they are
+// - Rebuilt elements patch the global matrix with the difference to their cached K_T
+struct Sim_FEAssembly_Settings
+{
+	Sim_FEAssembly_Settings()
+		: incremental(false)
+		, displacement_threshold(5E-3f)
+		, full_rebuild_interval(100)
+		, num_reused(0)
+		, num_elements(0)
+	{}
+
+	bool incremental;
+	float displacement_threshold;	//Largest change of any displacement component (m) before the element is rebuilt
+	uint full_rebuild_interval;		//Assemblies between full rebuilds, clears the round off left by patching
+	uint num_reused;				//Elements taken from the cache in the last assembly
+	uint num_elements;
+};
+
+//Strain distribution over an elements gauss points, used to drive adaptive quadrature
+struct Sim_FEElementStrain
+{
+	float max_strain;
+	float deviation;
+};
+
+//Tangent stiffness of one gauss point, in the compact form the matrix-free operator keeps instead of K_T
+// - Acts on g = [dX; dY], the natural coordinate derivatives sum_n dN_n * p_n of the (node scaled) values p
+// - material is tf E B_nl with B_nl's rest frame gradient folded in, 3x6 row major, giving the stress rate of g
+// - frame (rows x and y of the current frame) and ja_inv (J^-1, row major) take a stress back through B_0^T
+// - geometric is tf J^-T S J^-1 (xx, xy, yy) for the stress S, applied to each component of g
+struct Sim_FEPointStiffness
+{
+	float material[18];
+	float frame[6];
+	float ja_inv[4];
+	float geometric[3];
+};
+#define SIM_FEPOINT_NUM_FLOATS 31
+
+//Symmetric Dunavant rules, points are area coordinates and weights sum to one
+// - 3 point, exact up to degree 2
+struct Sim_FEQuadrature_Dunavant3
+{
+	static const int NumPoints = 3;
+
+	static inline const float* Points()
+	{
+		static const float points[NumPoints * 3] = {
+			0.666666666666667f, 0.166666666666667f, 0.166666666666667f,
+			0.166666666666667f, 0.666666666666667f, 0.166666666666667f,
+			0.166666666666667f, 0.166666666666667f, 0.666666666666667f,
+		};
+		return points;
+	}
+
+	static inline const float* Weights()
+	{
+		static const float weights[NumPoints] = {
+			0.333333333333333f, 0.333333333333333f, 0.333333333333333f,
+		};
+		return weights;
+	}
+
+	static inline Vector3 Point(int i) { const float* p = &Points()[i * 3]; return Vector3(p[0], p[1], p[2]); }
+	static inline float Weight(int i) { return Weights()[i]; }
+};
+
+// - 6 point, exact up to degree 4
+struct Sim_FEQuadrature_Dunavant6
+{
+	static const int NumPoints = 6;
+
+	static inline const float* Points()
+	{
+		static const float points[NumPoints * 3] = {
+			0.108103018168070f, 0.445948490915965f, 0.445948490915965f,
+			0.445948490915965f, 0.108103018168070f, 0.445948490915965f,
+			0.445948490915965f, 0.445948490915965f, 0.108103018168070f,
+
+			0.816847572980459f, 0.091576213509771f, 0.091576213509771f,
+			0.091576213509771f, 0.816847572980459f, 0.091576213509771f,
+			0.091576213509771f, 0.091576213509771f, 0.816847572980459f,
+		};
+		return points;
+	}
+
+	static inline const float* Weights()
+	{
+		static const float weights[NumPoints] = {
+			0.223381589678011f, 0.223381589678011f, 0.223381589678011f,
+			0.109951743655322f, 0.109951743655322f, 0.109951743655322f,
+		};
+		return weights;
+	}
+
+	static inline Vector3 Point(int i) { const float* p = &Points()[i * 3]; return Vector3(p[0], p[1], p[2]); }
+	static inline float Weight(int i) { return Weights()[i]; }
+};
+
+// - 7 point, exact up to degree 5
+struct Sim_FEQuadrature_Dunavant7
+{
+	static const int NumPoints = 7;
+
+	static inline const float* Points()
+	{
+		static const float points[NumPoints * 3] = {
+			0.333333333333333f, 0.333333333333333f, 0.333333333333333f,
+
+			0.059715871789770f, 0.470142064105115f, 0.470142064105115f,
+			0.470142064105115f, 0.059715871789770f, 0.470142064105115f,
+			0.470142064105115f, 0.470142064105115f, 0.059715871789770f,
+
+			0.797426985353087f, 0.101286507323456f, 0.101286507323456f,
+			0.101286507323456f, 0.797426985353087f, 0.101286507323456f,
+			0.101286507323456f, 0.101286507323456f, 0.797426985353087f,
+		};
+		return points;
+	}
+
+	static inline const float* Weights()
+	{
+		static const float weights[NumPoints] = {
+			0.225000000000000f,
+			0.132394152788506f, 0.132394152788506f, 0.132394152788506f,
+			0.125939180544827f, 0.125939180544827f, 0.125939180544827f,
+		};
+		return weights;
+	}
+
+	static inline Vector3 Point(int i) { const float* p = &Points()[i * 3]; return Vector3(p[0], p[1], p[2]); }
+	static inline float Weight(int i) { return Weights()[i]; }
+};
+
+// - 12 point, exact up to degree 6
+struct Sim_FEQuadrature_Dunavant12
+{
+	static const int NumPoints = 12;
+
+	static inline const float* Points()
+	{
+		static const float points[NumPoints * 3] = {
+			0.873821971016996f, 0.063089014491502f, 0.063089014491502f,
+			0.063089014491502f, 0.063089014491502f, 0.873821971016996f,
+			0.063089014491502f, 0.873821971016996f, 0.063089014491502f,
+
+			0.501426509658179f, 0.249286745170910f, 0.249286745170910f,
+			0.249286745170910f, 0.249286745170910f, 0.501426509658179f,
+			0.249286745170910f, 0.501426509658179f, 0.249286745170910f,
+
+			0.636502499121399f, 0.310352451033784f, 0.053145049844817f,
+			0.636502499121399f, 0.053145049844817f, 0.310352451033784f,
+			0.310352451033784f, 0.636502499121399f, 0.053145049844817f,
+			0.310352451033784f, 0.053145049844817f, 0.636502499121399f,
+			0.053145049844817f, 0.310352451033784f, 0.636502499121399f,
+			0.053145049844817f, 0.636502499121399f, 0.310352451033784f,
+		};
+		return points;
+	}
+
+	static inline const float* Weights()
+	{
+		static const float weights[NumPoints] = {
+			0.050844906370207f, 0.050844906370207f, 0.050844906370207f,
+			0.116786275726379f, 0.116786275726379f, 0.116786275726379f,
+			0.082851075618374f, 0.082851075618374f, 0.082851075618374f,
+			0.082851075618374f, 0.082851075618374f, 0.082851075618374f,
+		};
+		return weights;
+	}
+
+	static inline Vector3 Point(int i) { const float* p = &Points()[i * 3]; return Vector3(p[0], p[1], p[2]); }
+	static inline float Weight(int i) { return Weights()[i]; }
+};
+
+//Quadratic (C0) element, the 6 phyxels only
+struct Sim_FEElement_C0
+{
+	static const int NumPhyxels = 6;
+	static const int NumTangents = 0;
+	static const int NumNodes = NumPhyxels + NumTangents;
+
+	static inline float PhyxelMassDampening() { return 1.f; }
+	static inline float TangentMassDampening() { return 1.f; }
+	static inline float TangentMass() { return 0.f; }
+
+	static inline uint DofIndex(const FETriangle& tri, int node, uint num_phyxels) { return tri.phyxels[node]; }
+
+	//Symmetric storage keeps only the upper triangle of K, which needs B_0^T E B_nl to be symmetric. B_0 is
+	// evaluated at the current nodes and B_nl at the rest nodes, so it isn't
+	static const bool SymmetricTangent = false;
+
+	//Shape derivatives split into the part every element shares at a gauss point and a per node scale
+	static inline void NaturalShapeDerivatives(const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn);
+	static inline float NodeScale(const FETriangle& tri, int node) { return 1.f; }
+	static inline void ShapeDerivatives(const FETriangle& tri, const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn);
+};
+
+//Quartic (C1) element, the 6 phyxels followed by the 9 edge/mid-point tangents
+struct Sim_FEElement_C1
+{
+	static const int NumPhyxels = 6;
+	static const int NumTangents = 9;
+	static const int NumNodes = NumPhyxels + NumTangents;
+
+	//Small amount of numerical dampening on the mass diagonal, the tangents need (a lot) more to stay stable
+	static inline float PhyxelMassDampening() { return 1.f + 1E-6f; }
+	static inline float TangentMassDampening() { return 1.f + 1E-3f; }
+	static inline float TangentMass() { return 0.0002f; }
+
+	//Same kernel as C0, so K_T isn't symmetric either
+	static const bool SymmetricTangent = false;
+
+	static inline uint DofIndex(const FETriangle& tri, int node, uint num_phyxels)
+	{
+		return (node < NumPhyxels) ? tri.phyxels[node] : num_phyxels + tri.tangents[node - NumPhyxels];
+	}
+
+	//Tangents are scaled by their edge multipliers
+	static inline void NaturalShapeDerivatives(const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn);
+	static inline float NodeScale(const FETriangle& tri, int node)
+	{
+		return (node < NumPhyxels) ? 1.f : tri.tan_multipliers[node - NumPhyxels];
+	}
+	static inline void ShapeDerivatives(const FETriangle& tri, const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn);
+};
+
+template<class Element, class Quadrature = Sim_FEQuadrature_Dunavant12>
+class Sim_FEKernel
+{
+public:
+	static const int NumNodes = Element::NumNodes;
+	static const int NumDofs = NumNodes * 3;
+
+	typedef Eigen::Matrix<float, 2, NumNodes>		DNMatrix;
+	typedef Eigen::Matrix<float, 3, NumDofs>		BMatrix;
+	typedef Eigen::Matrix<float, 6, NumDofs>		GMatrix;
+	typedef Eigen::Matrix<float, NumDofs, 1>		DofVector;
+	typedef Eigen::Matrix<float, NumDofs, NumDofs>	DofMatrix;
+
+	//Copies the elements nodes out of the X array (or the rest positions) into element order
+	static inline void Gather(const FETriangle& tri, uint num_phyxels, const Vector3* x, Vector3* out_nodes);
+	static inline void Displacements(const Vector3* nodes, const Vector3* rest_nodes, DofVector& out_d);
+
+	//Local frame (rows: x, y, normal) and jacobian at a gauss point
+	static inline void CalcRotation(const FETriangle& tri, const Vector3* nodes, const Vector3& gp, Mat33& out_rot, JaMatrix& out_ja, DNMatrix& out_dn);
+
+	//Green-Lagrange strain-displacement matrix, the non-linear part is skipped if linear_only is set (zero displacements)
+	static inline void CalcBMatrix(const FETriangle& tri, const Vector3* nodes, const Vector3& gp, const DofVector& displacements, bool linear_only, BMatrix& out_b, JaMatrix& out_ja, GMatrix& out_g);
+
+	//Tangent stiffness (material + geometric) and internal force of one element, optionally with its strain distribution
+	// - upper_only only forms the node blocks on and above the diagonal (the rest of out_k is left zero)
+	static inline void ComputeElement(const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const DofVector& displacements, const Mat33& E, DofMatrix& out_k, DofVector& out_force, bool upper_only = false, Sim_FEElementStrain* out_strain = NULL);
+
+	//Matrix-free form of ComputeElement, out_points (Quadrature::NumPoints entries) stand in for K_T
+	static inline void ComputePoints(const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const DofVector& displacements, const Mat33& E, Sim_FEPointStiffness* out_points, DofVector& out_force);
+
+	//Adds the elements contribution to the global system: B -= f dt, A += K dt^2
+	// - upper_only scatters the upper node blocks into a matrix with symmetric storage
+	static inline void Scatter(const FETriangle& tri, uint num_phyxels, const DofMatrix& k, const DofVector& force, float dt, bool upper_only, MPCG<SparseRowMatrix<Matrix3>>& solver);
+
+	//Only the force part of Scatter (B -= f dt), for assemblies that keep the element matrices themselves
+	static inline void ScatterForce(const FETriangle& tri, uint num_phyxels, const DofVector& force, float dt, Vector3* b);
+
+	static inline void StressStrain(const FETriangle& tri, const Vector3* rest_nodes, const DofVector& displacements, const Vector3& gp, const Mat33& E, Vec3& out_stress, Vec3& out_strain);
+};
+
+#include "Sim_FEElement.inl"
@@ -0,0 +1,480 @@
+#include "Sim_FEElement.h"
+
+inline void Sim_FEElement_C0::NaturalShapeDerivatives(const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn)
+{
+	out_dn(0, 0) = 4 * gp.x - 1.f;
+	out_dn(0, 1) = 0.0f;
+	out_dn(0, 2) = -4 * gp.z + 1.f;
+	out_dn(0, 3) = 4 * gp.y;
+	out_dn(0, 4) = -4 * gp.y;
+	out_dn(0, 5) = 4 * (gp.z - gp.x);
+
+	out_dn(1, 0) = 0.f;
+	out_dn(1, 1) = 4 * gp.y - 1.f;
+	out_dn(1, 2) = -4 * gp.z + 1.f;
+	out_dn(1, 3) = 4 * gp.x;
+	out_dn(1, 4) = 4 * (gp.z - gp.y);
+	out_dn(1, 5) = -4 * gp.x;
+}
+
+inline void Sim_FEElement_C0::ShapeDerivatives(const FETriangle& tri, const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn)
+{
+	NaturalShapeDerivatives(gp, out_dn);
+}
+
+inline void Sim_FEElement_C1::NaturalShapeDerivatives(const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn)
+{
+	Vector3 gp2 = gp * gp;
+	Vector3 gp3 = gp * gp * gp;
+
+	float gxy = gp.x * gp.y;
+	float gx2y = gp2.x * gp.y;
+	float gxy2 = gp.x * gp2.y;
+
+	//Build natural coordinate basis vectors
+	float coeffs_x[]
+	{
+		-10 * gp.x + 42 * gp2.x - 32 * gp3.x + 6 * (2 * gxy - 3 * gx2y - 2 * gxy2),
+		6 * (gp2.y - gp3.y - 2 * gxy2),
+		0,
+		-16 * gp.y + 48 * (2 * gxy + gp2.y) - 32 * (3 * gx2y + gp3.y) - 96 * gxy2,
+		0,
+		-16 * gp.z + 48 * (2 * gp.x*gp.z + gp2.z) - 32 * (gp3.z + 3 * gp.z*gp2.x) - 96 * gp.x*gp2.z,
+
+		0.5 * (-gp.y + 2 * gxy + 3 * gp2.y) + 3 * gx2y - 4 * gxy2 - gp3.y,
+		0.5 * (-gp.z + 2 * gp.x*gp.z + 3 * gp2.z) + 3 * gp2.x*gp.z - 4 * gp.x*gp2.z - gp3.z,
+		0.5 * (-gp.y + 6 * gxy + gp2.y) - 3 * gx2y - 4 * gxy2 + gp3.y,
+		0,
+		0.5 * (gp.z - 6 * gp.x*gp.z - gp2.z) + 3 * gp2.x*gp.z - gp3.z + 4 * gp.x*gp2.z,
+		0,
+
+		-4 * gp.y + 12 * (2 * gxy + gp2.y) - 8 * (3 * gx2y + 4 * gxy2 + gp3.y),
+		0,
+		-4 * gp.z + 12 * (2 * gp.x * gp.z + gp2.z) - 8 * (3 * gp2.x * gp.z + 4 * gp.x * gp2.z + gp3.z)
+	};
+	float coeffs_y[]
+	{
+		6 * (gp2.x - gp3.x - 2 * gx2y),
+		-10 * gp.y + 42 * gp2.y - 32 * gp3.y + 6 * (2 * gxy - 3 * gxy2 - 2 * gx2y),
+		6 * (gp2.z - gp3.z - 2 * gp.y*gp2.z),
+		-16 * gp.x + 48 * (gp2.x + 2 * gxy) - 32 * (gp3.x + 3 * gxy2) - 96 * gx2y,
+		-16 * gp.z + 48 * (2 * gp.y*gp.z + gp2.z) - 32 * (gp3.z + 3 * gp.z*gp2.y) - 96 * gp.y*gp2.z,
+		0,
+
+		0.5 * (-gp.x + gp2.x + 6 * gxy) + gp3.x - 4 * gx2y - 3 * gxy2,
+		0,
+		0.5 * (-gp.x + 3 * gp2.x + 2 * gxy) - gp3.x - 4 * gx2y + 3 * gxy2,
+		0.5 * (-gp.z + 2 * gp.y*gp.z + 3 * gp2.z) + 3 * gp2.y*gp.z - 4 * gp.y*gp2.z - gp3.z,
+		0,
+		0.5 * (gp.z - 6 * gp.y*gp.z - gp2.z) + 3 * gp2.y*gp.z - gp3.z + 4 * gp.y*gp2.z,
+
+		-4 * gp.x + 12 * (gp2.x + 2 * gxy) - 8 * (gp3.x + 4 * gx2y + 3 * gxy2),
+		-4 * gp.z + 12 * (2 * gp.y * gp.z + gp2.z) - 8 * (3 * gp2.y * gp.z + 4 * gp.y * gp2.z + gp3.z),
+		0
+	};
+	float coeffs_z[]
+	{
+		0,
+		0,
+		-10 * gp.z + 42 * gp2.z - 32 * gp3.z + 6 * (2 * gp.y*gp.z - 3 * gp.y*gp2.z - 2 * gp2.y*gp.z),
+		0,
+		-16 * gp.y + 48 * (gp2.y + 2 * gp.z * gp.y) - 32 * (3 * gp2.z*gp.y + gp3.y) - 96 * gp2.y*gp.z,
+		-16 * gp.x + 48 * (gp2.x + 2 * gp.z * gp.x) - 32 * (3 * gp2.z*gp.x + gp3.x) - 96 * gp2.x*gp.z,
+
+		0,
+		0.5 * (-gp.x + gp2.x + 6 * gp.x*gp.z) + gp3.x - 4 * gp2.x*gp.z - 3 * gp.x*gp2.z,
+		0,
+		0.5 * (-gp.y + gp2.y + 6 * gp.y*gp.z) + gp3.y - 4 * gp2.y*gp.z - 3 * gp.y*gp2.z,
+		0.5 * (gp.x - 3 * gp2.x - 2 * gp.x*gp.z) + gp3.x - 3 * gp.x*gp2.z + 4 * gp2.x*gp.z,
+		0.5 * (gp.y - 3 * gp2.y - 2 * gp.y*gp.z) + gp3.y - 3 * gp.y*gp2.z + 4 * gp2.y*gp.z,
+
+		0,
+		-4 * gp.y + 12 * (gp2.y + 2 * gp.y * gp.z) - 8 * (gp3.y + 4 * gp2.y * gp.z + 3 * gp.y * gp2.z),
+		-4 * gp.x + 12 * (gp2.x + 2 * gp.x * gp.z) - 8 * (gp3.x + 4 * gp2.x * gp.z + 3 * gp.x * gp2.z)
+	};
+
+	for (int i = 0; i < NumNodes; ++i)
+	{
+		out_dn(0, i) = coeffs_x[i] - coeffs_z[i];
+		out_dn(1, i) = coeffs_y[i] - coeffs_z[i];
+	}
+}
+
+inline void Sim_FEElement_C1::ShapeDerivatives(const FETriangle& tri, const Vector3& gp, Eigen::Matrix<float, 2, NumNodes>& out_dn)
+{
+	NaturalShapeDerivatives(gp, out_dn);
+
+	for (int i = 0; i < NumTangents; ++i)
+	{
+		out_dn(0, NumPhyxels + i) *= tri.tan_multipliers[i];
+		out_dn(1, NumPhyxels + i) *= tri.tan_multipliers[i];
+	}
+}
+
+
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::Gather(const FETriangle& tri, uint num_phyxels, const Vector3* x, Vector3* out_nodes)
+{
+	for (int i = 0; i < NumNodes; ++i)
+	{
+		out_nodes[i] = x[Element::DofIndex(tri, i, num_phyxels)];
+	}
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::Displacements(const Vector3* nodes, const Vector3* rest_nodes, DofVector& out_d)
+{
+	for (int i = 0; i < NumNodes; ++i)
+	{
+		Vector3 d = nodes[i] - rest_nodes[i];
+		out_d(i * 3 + 0) = d.x; out_d(i * 3 + 1) = d.y; out_d(i * 3 + 2) = d.z;
+	}
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::CalcRotation(const FETriangle& tri, const Vector3* nodes, const Vector3& gp, Mat33& out_rot, JaMatrix& out_ja, DNMatrix& out_dn)
+{
+	Element::ShapeDerivatives(tri, gp, out_dn);
+
+	//Compute pure deformation in XZ and YZ axis
+	Vector3 dir_xz(0.f, 0.f, 0.f), dir_yz(0.f, 0.f, 0.f);
+	for (int i = 0; i < NumNodes; ++i)
+	{
+		dir_xz += nodes[i] * out_dn(0, i);
+		dir_yz += nodes[i] * out_dn(1, i);
+	}
+
+	//Build the Rotation Matrix
+	Vector3 V_z = Vector3::Cross(dir_xz, dir_yz);  V_z.Normalise();
+
+	Vector3 V_x = Vector3::Cross(dir_yz, V_z);
+	V_x.Normalise();
+
+	Vector3 V_y = Vector3::Cross(V_z, V_x);
+	V_y.Normalise();
+
+	out_rot(0, 0) = V_x.x; out_rot(0, 1) = V_x.y; out_rot(0, 2) = V_x.z;
+	out_rot(1, 0) = V_y.x; out_rot(1, 1) = V_y.y; out_rot(1, 2) = V_y.z;
+	out_rot(2, 0) = V_z.x; out_rot(2, 1) = V_z.y; out_rot(2, 2) = V_z.z;
+
+	//Build the Jacobian Matrix
+	out_ja(0, 0) = Vector3::Dot(dir_xz, V_x);
+	out_ja(0, 1) = Vector3::Dot(dir_xz, V_y);
+	out_ja(1, 0) = Vector3::Dot(dir_yz, V_x);
+	out_ja(1, 1) = Vector3::Dot(dir_yz, V_y);
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::CalcBMatrix(const FETriangle& tri, const Vector3* nodes, const Vector3& gp, const DofVector& displacements, bool linear_only, BMatrix& out_b, JaMatrix& out_ja, GMatrix& out_g)
+{
+	DNMatrix DN, a;
+	Mat33 T;
+
+	CalcRotation(tri, nodes, gp, T, out_ja, DN);
+
+	Mat22 Ja_inv = out_ja.inverse();
+	a = Ja_inv * DN;
+
+	for (int i = 0; i < NumNodes; ++i)
+	{
+		out_b(0, i * 3) = T(0, 0) * a(0, i);
+		out_b(0, i * 3 + 1) = T(0, 1) * a(0, i);
+		out_b(0, i * 3 + 2) = T(0, 2) * a(0, i);
+
+		out_b(1, i * 3) = T(1, 0) * a(1, i);
+		out_b(1, i * 3 + 1) = T(1, 1) * a(1, i);
+		out_b(1, i * 3 + 2) = T(1, 2) * a(1, i);
+
+		out_b(2, i * 3) = T(0, 0) * a(1, i) + T(1, 0) * a(0, i);
+		out_b(2, i * 3 + 1) = T(0, 1) * a(1, i) + T(1, 1) * a(0, i);
+		out_b(2, i * 3 + 2) = T(0, 2) * a(1, i) + T(1, 2) * a(0, i);
+	}
+
+	//Build G Matrix
+	for (int n = 0; n < NumNodes; ++n)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			out_g(i, n * 3) = T(i, 0) * a(0, n);
+			out_g(i, n * 3 + 1) = T(i, 1) * a(0, n);
+			out_g(i, n * 3 + 2) = T(i, 2) * a(0, n);
+		}
+
+		for (int i = 3; i < 6; ++i)
+		{
+			out_g(i, n * 3) = T(i - 3, 0) * a(1, n);
+			out_g(i, n * 3 + 1) = T(i - 3, 1) * a(1, n);
+			out_g(i, n * 3 + 2) = T(i - 3, 2) * a(1, n);
+		}
+	}
+
+	if (linear_only)
+		return;
+
+	//Find displacement dependant terms of local Bmatrix
+	Eigen::Matrix<float, 6, 1> delta = out_g * displacements;
+
+	Eigen::Matrix<float, 3, 6> derivatives;
+	derivatives.setZero();
+	derivatives(0, 0) = delta[0];
+	derivatives(0, 1) = delta[1];
+	derivatives(0, 2) = delta[2];
+	derivatives(1, 3) = delta[3];
+	derivatives(1, 4) = delta[4];
+	derivatives(1, 5) = delta[5];
+
+	derivatives(2, 0) = delta[3];
+	derivatives(2, 1) = delta[4];
+	derivatives(2, 2) = delta[5];
+	derivatives(2, 3) = delta[0];
+	derivatives(2, 4) = delta[1];
+	derivatives(2, 5) = delta[2];
+
+	BMatrix B_nl = 0.5 * derivatives * out_g;
+	out_b += B_nl;
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::ComputeElement(const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const DofVector& displacements, const Mat33& E, DofMatrix& out_k, DofVector& out_force, bool upper_only, Sim_FEElementStrain* out_strain)
+{
+	BMatrix B_nl, B_0;
+	JaMatrix Ja;
+	GMatrix G;
+	DofMatrix K_S;
+	Eigen::Matrix<float, 6, 6> M; M.setZero();
+	Vec3 strains[Quadrature::NumPoints];
+
+	out_k.setZero();
+	out_force.setZero();
+	if (!upper_only)
+		K_S.setZero();
+
+	for (int j = 0; j < Quadrature::NumPoints; ++j)
+	{
+		const Vector3 gp = Quadrature::Point(j);
+
+		CalcBMatrix(tri, rest_nodes, gp, displacements, false, B_nl, Ja, G);
+
+		Vec3 strain = B_nl * displacements;
+		Vec3 stress = E * strain;
+		strains[j] = strain;
+
+		CalcBMatrix(tri, nodes, gp, displacements, true, B_0, Ja, G);
+
+		float area = Ja.determinant() * 0.5f;
+		if (area < 0)
+		{
+			printf("ERROR:: Element %d:%d has a negative area!!!\n", tri_idx, j);
+		}
+
+		float tfactor = Quadrature::Weight(j) * area;
+
+		M(0, 0) = stress.x();
+		M(1, 1) = stress.x();
+		M(2, 2) = stress.x();
+
+		M(0, 3) = stress.z();
+		M(1, 4) = stress.z();
+		M(2, 5) = stress.z();
+		M(3, 0) = stress.z();
+		M(4, 1) = stress.z();
+		M(5, 2) = stress.z();
+
+		M(3, 3) = stress.y();
+		M(4, 4) = stress.y();
+		M(5, 5) = stress.y();
+
+		if (upper_only)
+		{
+			//Only node blocks on/above the diagonal are formed, which is exact only for elements whose
+			// B_0^T E B_nl is symmetric (Element::SymmetricTangent). The geometric term always is.
+			// Both terms are stacked into one K += L^T R, each block column then only needs its top rows.
+			Eigen::Matrix<float, 9, NumDofs> L, R;
+			L << B_0, G;
+			R << E * B_nl * tfactor, M * G * tfactor;
+
+			for (int n = 0; n < NumNodes; ++n)
+			{
+				out_k.block(0, n * 3, n * 3 + 3, 3).noalias() += L.leftCols(n * 3 + 3).transpose().lazyProduct(R.template middleCols<3>(n * 3));
+			}
+		}
+		else
+		{
+			out_k += B_0.transpose() * E * B_nl * tfactor;
+			K_S += G.transpose() * M * G * tfactor;
+		}
+
+		out_force += B_0.transpose() * stress * tfactor;
+	}
+
+	if (!upper_only)
+		out_k += K_S;
+
+	if (out_strain != NULL)
+	{
+		Vec3 mean = Vec3::Zero();
+		for (int j = 0; j < Quadrature::NumPoints; ++j)
+			mean += strains[j];
+		mean /= (float)Quadrature::NumPoints;
+
+		out_strain->max_strain = 0.f;
+		out_strain->deviation = 0.f;
+		for (int j = 0; j < Quadrature::NumPoints; ++j)
+		{
+			float s = strains[j].norm();
+			float d = (strains[j] - mean).norm();
+			out_strain->max_strain = (s > out_strain->max_strain) ? s : out_strain->max_strain;
+			out_strain->deviation = (d > out_strain->deviation) ? d : out_strain->deviation;
+		}
+	}
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::ComputePoints(const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const DofVector& displacements, const Mat33& E, Sim_FEPointStiffness* out_points, DofVector& out_force)
+{
+	Mat33 T_rest, T;
+	JaMatrix Ja_rest, Ja;
+	DNMatrix DN;
+	Eigen::Matrix<float, 6, 6> G_rest;
+	Eigen::Matrix<float, 6, 1> g_d, delta;
+	Eigen::Matrix<float, 3, 6> C, Q;
+
+	out_force.setZero();
+
+	for (int j = 0; j < Quadrature::NumPoints; ++j)
+	{
+		const Vector3 gp = Quadrature::Point(j);
+		Sim_FEPointStiffness& point = out_points[j];
+
+		CalcRotation(tri, rest_nodes, gp, T_rest, Ja_rest, DN);
+		CalcRotation(tri, nodes, gp, T, Ja, DN);
+		const Mat22 Ja_rest_inv = Ja_rest.inverse();
+		const Mat22 Ja_inv = Ja.inverse();
+
+		//Rest frame gradients, CalcBMatrix's G is G_rest applied to the natural derivatives of each node
+		for (int a = 0; a < 2; ++a)
+		{
+			for (int b = 0; b < 2; ++b)
+				G_rest.block<3, 3>(a * 3, b * 3) = T_rest * Ja_rest_inv(a, b);
+		}
+
+		g_d.setZero();
+		for (int n = 0; n < NumNodes; ++n)
+		{
+			g_d.segment<3>(0) += displacements.template segment<3>(n * 3) * DN(0, n);
+			g_d.segment<3>(3) += displacements.template segment<3>(n * 3) * DN(1, n);
+		}
+		delta = G_rest * g_d;
+
+		//B_nl = C G_rest, the linear strain rows plus half the displacement dependant terms
+		C.setZero();
+		C(0, 0) = 1.f;
+		C(1, 4) = 1.f;
+		C(2, 1) = 1.f;
+		C(2, 3) = 1.f;
+		C.block<1, 3>(0, 0) += 0.5f * delta.segment<3>(0).transpose();
+		C.block<1, 3>(1, 3) += 0.5f * delta.segment<3>(3).transpose();
+		C.block<1, 3>(2, 0) += 0.5f * delta.segment<3>(3).transpose();
+		C.block<1, 3>(2, 3) += 0.5f * delta.segment<3>(0).transpose();
+
+		Vec3 strain = C * delta;
+		Vec3 stress = E * strain;
+
+		float area = Ja.determinant() * 0.5f;
+		if (area < 0)
+		{
+			printf("ERROR:: Element %d:%d has a negative area!!!\n", tri_idx, j);
+		}
+
+		float tfactor = Quadrature::Weight(j) * area;
+
+		Q = E * C * G_rest * tfactor;
+		for (int r = 0; r < 3; ++r)
+		{
+			for (int c = 0; c < 6; ++c)
+				point.material[r * 6 + c] = Q(r, c);
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			point.frame[c] = T(0, c);
+			point.frame[3 + c] = T(1, c);
+		}
+
+		point.ja_inv[0] = Ja_inv(0, 0); point.ja_inv[1] = Ja_inv(0, 1);
+		point.ja_inv[2] = Ja_inv(1, 0); point.ja_inv[3] = Ja_inv(1, 1);
+
+		Mat22 S;
+		S(0, 0) = stress.x(); S(0, 1) = stress.z();
+		S(1, 0) = stress.z(); S(1, 1) = stress.y();
+		Mat22 geometric = Ja_inv.transpose() * S * Ja_inv * tfactor;
+		point.geometric[0] = geometric(0, 0);
+		point.geometric[1] = geometric(0, 1);
+		point.geometric[2] = geometric(1, 1);
+
+		//Force B_0^T stress tf, taken back through the current frame and jacobian to each nodes derivatives
+		Vec3 s = stress * tfactor;
+		Vec3 hx = T.row(0).transpose() * s.x() + T.row(1).transpose() * s.z();
+		Vec3 hy = T.row(0).transpose() * s.z() + T.row(1).transpose() * s.y();
+		Vec3 h_dx = hx * Ja_inv(0, 0) + hy * Ja_inv(1, 0);
+		Vec3 h_dy = hx * Ja_inv(0, 1) + hy * Ja_inv(1, 1);
+		for (int n = 0; n < NumNodes; ++n)
+			out_force.template segment<3>(n * 3) += h_dx * DN(0, n) + h_dy * DN(1, n);
+	}
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::Scatter(const FETriangle& tri, uint num_phyxels, const DofMatrix& k, const DofVector& force, float dt, bool upper_only, MPCG<SparseRowMatrix<Matrix3>>& solver)
+{
+	uint idx[NumNodes];
+	for (int j = 0; j < NumNodes; ++j)
+		idx[j] = Element::DofIndex(tri, j, num_phyxels);
+
+	ScatterForce(tri, num_phyxels, force, dt, &solver.m_B[0]);
+
+	for (int j = 0; j < NumNodes; ++j)
+	{
+		for (int l = upper_only ? j : 0; l < NumNodes; ++l)
+		{
+			Matrix3 submtx;
+			submtx._11 = k(j * 3 + 0, l * 3 + 0);
+			submtx._12 = k(j * 3 + 0, l * 3 + 1);
+			submtx._13 = k(j * 3 + 0, l * 3 + 2);
+			submtx._21 = k(j * 3 + 1, l * 3 + 0);
+			submtx._22 = k(j * 3 + 1, l * 3 + 1);
+			submtx._23 = k(j * 3 + 1, l * 3 + 2);
+			submtx._31 = k(j * 3 + 2, l * 3 + 0);
+			submtx._32 = k(j * 3 + 2, l * 3 + 1);
+			submtx._33 = k(j * 3 + 2, l * 3 + 2);
+
+			//Element order is not global order, blocks that land in the lower triangle are stored transposed
+			if (upper_only && idx[l] < idx[j])
+				solver.m_A(idx[l], idx[j]) += Matrix3::Transpose(submtx) * dt * dt;
+			else
+				solver.m_A(idx[j], idx[l]) += submtx * dt * dt;
+		}
+	}
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::ScatterForce(const FETriangle& tri, uint num_phyxels, const DofVector& force, float dt, Vector3* b)
+{
+	for (int j = 0; j < NumNodes; ++j)
+	{
+		b[Element::DofIndex(tri, j, num_phyxels)] -= Vector3(force(j * 3), force(j * 3 + 1), force(j * 3 + 2)) * dt;
+	}
+}
+
+template<class Element, class Quadrature>
+inline void Sim_FEKernel<Element, Quadrature>::StressStrain(const FETriangle& tri, const Vector3* rest_nodes, const DofVector& displacements, const Vector3& gp, const Mat33& E, Vec3& out_stress, Vec3& out_strain)
+{
+	BMatrix B_nl;
+	JaMatrix Ja;
+	GMatrix G;
+
+	CalcBMatrix(tri, rest_nodes, gp, displacements, false, B_nl, Ja, G);
+
+	out_strain = B_nl * displacements;
+	out_stress = E * out_strain;
+}
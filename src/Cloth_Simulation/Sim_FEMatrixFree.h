@@ -0,0 +1,80 @@
+#pragma once
+
+#include "mpcg.h"
+#include "Sim_FEElement.h"
+#include "EigenDefines.h"
+#include "SimulationDefines.h"
+
+#include <glcore\Matrix3.h>
+#include <glcore\Vector3.h>
+#include <vector>
+
+//Elements per batch, the lane count the multiply kernel is written for (8 floats fill an AVX register)
+#define SIM_FEMATRIXFREE_BATCH 8
+#define SIM_FEMATRIXFREE_GRAIN_SIZE 4		//Batches per task of the multiply
+
+//Matrix-free A = M + dt^2 K for the finite element simulations
+// - The assembly hands each elements gauss point stiffness (Sim_FEPointStiffness) to SetElementPoints instead
+//   of scattering K_T into the global block matrix, and Multiply recomputes K p from them. A C1 element keeps
+//   31 floats per point (372 for the 12 point rule) instead of the 2025 of its dense K_T.
+// - The shape derivatives at each gauss point are shared by all elements, only the per node scales (the
+//   C1 tangent multipliers) are kept per element
+// - Elements are coloured so no two elements of a colour share a dof, then packed into batches of
+//   SIM_FEMATRIXFREE_BATCH. Everything in a batch is stored lane by lane (structure of arrays) so the kernel
+//   runs across the elements of a batch, and each batch scatters straight into out without atomics.
+//   Colours run one after another, their batches are split over the TaskScheduler.
+// - Only one quadrature rule is kept for all elements, adaptive quadrature is not used in matrix-free mode
+template<class Element>
+class Sim_FEMatrixFree_Operator : public MPCG_Operator
+{
+public:
+	typedef Sim_FEKernel<Element> Kernel;
+	static const int NumNodes = Element::NumNodes;
+	static const int BatchSize = SIM_FEMATRIXFREE_BATCH;
+
+	Sim_FEMatrixFree_Operator();
+	virtual ~Sim_FEMatrixFree_Operator();
+
+	//mass is the diagonal of A (one entry per dof), it is read on every multiply and must outlive the operator
+	void Initialize(const std::vector<FETriangle>& triangles, uint num_phyxels, uint num_dofs, const std::vector<float>* mass);
+	void Release();
+
+	//Rule the element points are given at. Returns true if it changed, which clears every element.
+	bool SetQuadrature(Sim_FEQuadrature_Rule rule);
+
+	//Elements are kept unscaled, the dt^2 Kernel::Scatter applies to the global matrix is applied in Multiply
+	// so a new dt doesn't invalidate them. points holds one entry per point of the current rule.
+	void SetElementPoints(uint idx, const Sim_FEPointStiffness* points);
+	inline void SetTimestep(float dt) { m_StiffnessScale = dt * dt; }
+
+	//K p of a single element (no dt^2), e.g. to extrapolate its force
+	void MultiplyElement(uint idx, const typename Kernel::DofVector& p, typename Kernel::DofVector& out) const;
+
+	virtual void Multiply(const std::vector<Vector3>& x, std::vector<Vector3>& out) override;
+
+protected:
+	template<class Quadrature>
+	void SetShapeDerivatives();
+
+	void ColourElements(const std::vector<uint>& element_dofs, std::vector<uint>& out_order);
+
+	//kp += K p for the first Lanes lanes of a batch, p and kp hold NumNodes * 3 rows of BatchSize lanes
+	template<int Lanes>
+	void ApplyPoints(const float* points, const float* p, float* kp) const;
+
+	uint						m_NumDofs;
+	uint						m_NumElements;
+	uint						m_NumBatches;
+	Sim_FEQuadrature_Rule		m_Rule;
+	uint						m_NumPoints;
+	std::vector<float>			m_ShapeDerivatives;	//Natural dN/dxi then dN/deta of every node, per point of m_Rule
+	std::vector<uint>			m_Dofs;				//Per batch, NumNodes rows of BatchSize global dof indices
+	std::vector<float>			m_Scales;			//Per batch, NumNodes rows of BatchSize node scales (0 in unused lanes)
+	std::vector<float>			m_Points;			//Per batch and point, SIM_FEPOINT_NUM_FLOATS rows of BatchSize lanes
+	std::vector<uint>			m_ElementSlots;		//Batch * BatchSize + lane of each element
+	std::vector<uint>			m_ColourBatches;	//Start of each colour in the batches, num colours + 1 entries
+	float						m_StiffnessScale;	//dt^2
+	const std::vector<float>*	m_Mass;
+};
+
+#include "Sim_FEMatrixFree.inl"
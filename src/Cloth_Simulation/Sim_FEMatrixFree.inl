@@ -0,0 +1,368 @@
+#include "Sim_FEMatrixFree.h"
+
+template<class Element>
+Sim_FEMatrixFree_Operator<Element>::Sim_FEMatrixFree_Operator()
+	: m_NumDofs(0)
+	, m_NumElements(0)
+	, m_NumBatches(0)
+	, m_Rule(Sim_FEQuadrature_Rule_MAX)
+	, m_NumPoints(0)
+	, m_StiffnessScale(0.0f)
+	, m_Mass(NULL)
+{
+}
+
+template<class Element>
+Sim_FEMatrixFree_Operator<Element>::~Sim_FEMatrixFree_Operator()
+{
+	Release();
+}
+
+template<class Element>
+void Sim_FEMatrixFree_Operator<Element>::Initialize(const std::vector<FETriangle>& triangles, uint num_phyxels, uint num_dofs, const std::vector<float>* mass)
+{
+	m_NumDofs = num_dofs;
+	m_NumElements = (uint)triangles.size();
+	m_Mass = mass;
+
+	std::vector<uint> element_dofs(m_NumElements * NumNodes);
+	for (uint i = 0; i < m_NumElements; ++i)
+	{
+		for (int j = 0; j < NumNodes; ++j)
+			element_dofs[i * NumNodes + j] = Element::DofIndex(triangles[i], j, num_phyxels);
+	}
+
+	std::vector<uint> order;
+	ColourElements(element_dofs, order);
+
+	//Lay the batches out lane by lane, unused lanes repeat the first elements dofs with a zero scale
+	m_Dofs.resize(m_NumBatches * NumNodes * BatchSize);
+	m_Scales.resize(m_NumBatches * NumNodes * BatchSize);
+	m_ElementSlots.resize(m_NumElements);
+
+	for (uint b = 0; b < m_NumBatches; ++b)
+	{
+		uint* dofs = &m_Dofs[b * NumNodes * BatchSize];
+		float* scales = &m_Scales[b * NumNodes * BatchSize];
+		for (int l = 0; l < BatchSize; ++l)
+		{
+			const uint slot = b * BatchSize + l;
+			const uint i = order[slot];
+			const bool used = (i != UINT_MAX);
+			const uint src = used ? i : order[b * BatchSize];
+
+			for (int j = 0; j < NumNodes; ++j)
+			{
+				dofs[j * BatchSize + l] = element_dofs[src * NumNodes + j];
+				scales[j * BatchSize + l] = used ? Element::NodeScale(triangles[src], j) : 0.0f;
+			}
+
+			if (used)
+				m_ElementSlots[i] = slot;
+		}
+	}
+
+	//Points are (re)allocated on the first SetQuadrature
+	m_Rule = Sim_FEQuadrature_Rule_MAX;
+	m_NumPoints = 0;
+	std::vector<float>().swap(m_Points);
+}
+
+template<class Element>
+void Sim_FEMatrixFree_Operator<Element>::ColourElements(const std::vector<uint>& element_dofs, std::vector<uint>& out_order)
+{
+	//Greedy colouring in element order, an element takes the first colour none of its dofs has been given yet
+	std::vector<std::vector<uint>> dof_colours(m_NumDofs);
+	std::vector<uint> element_colour(m_NumElements);
+	std::vector<uint> taken;	//Per colour, the last element (+1) that found it in use
+	uint num_colours = 0;
+
+	for (uint i = 0; i < m_NumElements; ++i)
+	{
+		const uint* dofs = &element_dofs[i * NumNodes];
+		for (int j = 0; j < NumNodes; ++j)
+		{
+			for (uint c : dof_colours[dofs[j]])
+				taken[c] = i + 1;
+		}
+
+		uint colour = 0;
+		while (colour < num_colours && taken[colour] == i + 1)
+			colour++;
+
+		if (colour == num_colours)
+		{
+			num_colours++;
+			taken.push_back(0);
+		}
+
+		element_colour[i] = colour;
+		for (int j = 0; j < NumNodes; ++j)
+			dof_colours[dofs[j]].push_back(colour);
+	}
+
+	//Each colour is rounded up to whole batches, keeping element order within a colour
+	std::vector<uint> colour_size(num_colours, 0);
+	for (uint i = 0; i < m_NumElements; ++i)
+		colour_size[element_colour[i]]++;
+
+	m_ColourBatches.assign(num_colours + 1, 0);
+	for (uint c = 0; c < num_colours; ++c)
+		m_ColourBatches[c + 1] = m_ColourBatches[c] + (colour_size[c] + BatchSize - 1) / BatchSize;
+	m_NumBatches = m_ColourBatches[num_colours];
+
+	std::vector<uint> next(num_colours);
+	for (uint c = 0; c < num_colours; ++c)
+		next[c] = m_ColourBatches[c] * BatchSize;
+
+	out_order.assign(m_NumBatches * BatchSize, UINT_MAX);
+	for (uint i = 0; i < m_NumElements; ++i)
+		out_order[next[element_colour[i]]++] = i;
+}
+
+template<class Element>
+void Sim_FEMatrixFree_Operator<Element>::Release()
+{
+	//Swapping actually frees the memory, clear() would keep it
+	std::vector<float>().swap(m_ShapeDerivatives);
+	std::vector<uint>().swap(m_Dofs);
+	std::vector<float>().swap(m_Scales);
+	std::vector<float>().swap(m_Points);
+	std::vector<uint>().swap(m_ElementSlots);
+	std::vector<uint>().swap(m_ColourBatches);
+
+	m_NumDofs = 0;
+	m_NumElements = 0;
+	m_NumBatches = 0;
+	m_Rule = Sim_FEQuadrature_Rule_MAX;
+	m_NumPoints = 0;
+	m_Mass = NULL;
+}
+
+template<class Element>
+bool Sim_FEMatrixFree_Operator<Element>::SetQuadrature(Sim_FEQuadrature_Rule rule)
+{
+	if (rule == m_Rule)
+		return false;
+
+	switch (rule)
+	{
+	case Sim_FEQuadrature_Rule_Dunavant3:
+		SetShapeDerivatives<Sim_FEQuadrature_Dunavant3>();
+		break;
+	case Sim_FEQuadrature_Rule_Dunavant6:
+		SetShapeDerivatives<Sim_FEQuadrature_Dunavant6>();
+		break;
+	case Sim_FEQuadrature_Rule_Dunavant7:
+		SetShapeDerivatives<Sim_FEQuadrature_Dunavant7>();
+		break;
+	default:
+		SetShapeDerivatives<Sim_FEQuadrature_Dunavant12>();
+		break;
+	}
+
+	m_Rule = rule;
+	m_Points.assign(m_NumBatches * m_NumPoints * SIM_FEPOINT_NUM_FLOATS * BatchSize, 0.0f);
+	return true;
+}
+
+template<class Element>
+template<class Quadrature>
+void Sim_FEMatrixFree_Operator<Element>::SetShapeDerivatives()
+{
+	Eigen::Matrix<float, 2, NumNodes> dn;
+
+	m_NumPoints = Quadrature::NumPoints;
+	m_ShapeDerivatives.resize(m_NumPoints * 2 * NumNodes);
+	for (uint q = 0; q < m_NumPoints; ++q)
+	{
+		Element::NaturalShapeDerivatives(Quadrature::Point(q), dn);
+		for (int j = 0; j < NumNodes; ++j)
+		{
+			m_ShapeDerivatives[q * 2 * NumNodes + j] = dn(0, j);
+			m_ShapeDerivatives[q * 2 * NumNodes + NumNodes + j] = dn(1, j);
+		}
+	}
+}
+
+template<class Element>
+void Sim_FEMatrixFree_Operator<Element>::SetElementPoints(uint idx, const Sim_FEPointStiffness* points)
+{
+	const uint slot = m_ElementSlots[idx];
+	const uint batch = slot / BatchSize;
+	const uint lane = slot % BatchSize;
+	static_assert(sizeof(Sim_FEPointStiffness) == SIM_FEPOINT_NUM_FLOATS * sizeof(float), "Points are copied as plain floats");
+
+	float* dst = &m_Points[batch * m_NumPoints * SIM_FEPOINT_NUM_FLOATS * BatchSize + lane];
+	for (uint q = 0; q < m_NumPoints; ++q)
+	{
+		const float* src = (const float*)&points[q];
+		for (int k = 0; k < SIM_FEPOINT_NUM_FLOATS; ++k, dst += BatchSize)
+			*dst = src[k];
+	}
+}
+
+template<class Element>
+template<int Lanes>
+void Sim_FEMatrixFree_Operator<Element>::ApplyPoints(const float* points, const float* p, float* kp) const
+{
+	const int B = BatchSize;
+
+	for (uint q = 0; q < m_NumPoints; ++q, points += SIM_FEPOINT_NUM_FLOATS * B)
+	{
+		const float* dn_x = &m_ShapeDerivatives[q * 2 * NumNodes];
+		const float* dn_y = dn_x + NumNodes;
+
+		//g = natural derivatives of p
+		float g[6][Lanes];
+		for (int c = 0; c < 6; ++c)
+			for (int l = 0; l < Lanes; ++l)
+				g[c][l] = 0.0f;
+
+		for (int j = 0; j < NumNodes; ++j)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				const float* pj = &p[(j * 3 + c) * B];
+				for (int l = 0; l < Lanes; ++l)
+				{
+					g[c][l] += dn_x[j] * pj[l];
+					g[3 + c][l] += dn_y[j] * pj[l];
+				}
+			}
+		}
+
+		//Stress rate s = material g
+		float s[3][Lanes];
+		for (int r = 0; r < 3; ++r)
+		{
+			for (int l = 0; l < Lanes; ++l)
+				s[r][l] = 0.0f;
+			for (int c = 0; c < 6; ++c)
+			{
+				const float* m = &points[(r * 6 + c) * B];
+				for (int l = 0; l < Lanes; ++l)
+					s[r][l] += m[l] * g[c][l];
+			}
+		}
+
+		//Back through B_0^T (frame then J^-T) plus the geometric term, h is the result per natural derivative
+		// - Offsets follow the member order of Sim_FEPointStiffness
+		const float* frame = &points[18 * B];
+		const float* ja_inv = &points[24 * B];
+		const float* geometric = &points[28 * B];
+
+		float h_x[3][Lanes], h_y[3][Lanes];
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int l = 0; l < Lanes; ++l)
+			{
+				const float fx = frame[c * B + l];
+				const float fy = frame[(3 + c) * B + l];
+				const float hx = s[0][l] * fx + s[2][l] * fy;
+				const float hy = s[2][l] * fx + s[1][l] * fy;
+
+				h_x[c][l] = ja_inv[0 * B + l] * hx + ja_inv[2 * B + l] * hy
+					+ geometric[0 * B + l] * g[c][l] + geometric[1 * B + l] * g[3 + c][l];
+				h_y[c][l] = ja_inv[1 * B + l] * hx + ja_inv[3 * B + l] * hy
+					+ geometric[1 * B + l] * g[c][l] + geometric[2 * B + l] * g[3 + c][l];
+			}
+		}
+
+		for (int j = 0; j < NumNodes; ++j)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				float* kpj = &kp[(j * 3 + c) * B];
+				for (int l = 0; l < Lanes; ++l)
+					kpj[l] += dn_x[j] * h_x[c][l] + dn_y[j] * h_y[c][l];
+			}
+		}
+	}
+}
+
+template<class Element>
+void Sim_FEMatrixFree_Operator<Element>::MultiplyElement(uint idx, const typename Kernel::DofVector& p, typename Kernel::DofVector& out) const
+{
+	const uint slot = m_ElementSlots[idx];
+	const uint batch = slot / BatchSize;
+	const uint lane = slot % BatchSize;
+	const float* scales = &m_Scales[batch * NumNodes * BatchSize + lane];
+
+	//Run the batch kernel on one lane, in the batch layout
+	float p_lane[NumNodes * 3 * BatchSize], kp_lane[NumNodes * 3 * BatchSize];
+	for (int j = 0; j < NumNodes; ++j)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			p_lane[(j * 3 + c) * BatchSize] = p(j * 3 + c) * scales[j * BatchSize];
+			kp_lane[(j * 3 + c) * BatchSize] = 0.0f;
+		}
+	}
+
+	ApplyPoints<1>(&m_Points[batch * m_NumPoints * SIM_FEPOINT_NUM_FLOATS * BatchSize + lane], p_lane, kp_lane);
+
+	for (int j = 0; j < NumNodes; ++j)
+	{
+		for (int c = 0; c < 3; ++c)
+			out(j * 3 + c) = kp_lane[(j * 3 + c) * BatchSize] * scales[j * BatchSize];
+	}
+}
+
+template<class Element>
+void Sim_FEMatrixFree_Operator<Element>::Multiply(const std::vector<Vector3>& x, std::vector<Vector3>& out)
+{
+	const int len = (int)m_NumDofs;
+	const uint num_colours = (uint)m_ColourBatches.size() - 1;
+	const float* mass = &(*m_Mass)[0];
+	const float scale = m_StiffnessScale;
+
+	TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+	{
+		for (int row = first; row < last; ++row)
+		{
+			out[row] = x[row] * mass[row];
+		}
+	});
+
+	//Gather - multiply - scatter, one colour at a time. Batches of a colour never share a dof, so any split
+	// of them between threads gives the same result.
+	for (uint c = 0; c < num_colours; ++c)
+	{
+		TaskScheduler::Instance()->ParallelFor((int)m_ColourBatches[c], (int)m_ColourBatches[c + 1], SIM_FEMATRIXFREE_GRAIN_SIZE, [&](int first, int last)
+		{
+			float p[NumNodes * 3 * BatchSize], kp[NumNodes * 3 * BatchSize];
+
+			for (int b = first; b < last; ++b)
+			{
+				const uint* dofs = &m_Dofs[b * NumNodes * BatchSize];
+				const float* scales = &m_Scales[b * NumNodes * BatchSize];
+
+				for (int j = 0; j < NumNodes; ++j)
+				{
+					for (int l = 0; l < BatchSize; ++l)
+					{
+						const Vector3& xj = x[dofs[j * BatchSize + l]];
+						const float sj = scales[j * BatchSize + l];
+						p[(j * 3 + 0) * BatchSize + l] = xj.x * sj;
+						p[(j * 3 + 1) * BatchSize + l] = xj.y * sj;
+						p[(j * 3 + 2) * BatchSize + l] = xj.z * sj;
+					}
+				}
+				memset(kp, 0, sizeof(kp));
+
+				ApplyPoints<BatchSize>(&m_Points[b * m_NumPoints * SIM_FEPOINT_NUM_FLOATS * BatchSize], p, kp);
+
+				//Unused lanes have a zero scale and add nothing
+				for (int j = 0; j < NumNodes; ++j)
+				{
+					for (int l = 0; l < BatchSize; ++l)
+					{
+						const float sj = scales[j * BatchSize + l] * scale;
+						out[dofs[j * BatchSize + l]] += Vector3(kp[(j * 3 + 0) * BatchSize + l], kp[(j * 3 + 1) * BatchSize + l], kp[(j * 3 + 2) * BatchSize + l]) * sj;
+					}
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "mpcg.h"
+#include "Sim_Multigrid.h"
+#include "Sim_FEElement.h"
+#include "Sim_FEMatrixFree.h"
+
+#include "EigenDefines.h"
+#include "SimulationDefines.h"
+
+#include <glcore\Matrix3.h>
+#include <glcore\Vector3.h>
+#include <glcore\Vector2.h>
+#include "ProfilingTimer.h"
+
+#include "Sim_Renderer.h"
+#include "Sim_Integrator.h"
+#include "Sim_Manager.h"
+
+enum Sim_FESimulation_SubTimer
+{
+	Sim_FESimulation_SubTimer_Rotations = 0,
+	Sim_FESimulation_SubTimer_BuildMatrices,
+	Sim_FESimulation_SubTimer_Solver,
+	Sim_FESimulation_SubTimer_MAX
+};
+
+//Corotated finite element cloth, shared by all 6 noded element types
+// - Element is a traits struct from Sim_FEElement.h (node count, dof layout and shape functions)
+// - Solves for phyxels and, if the element has them, tangents (X array order: phyxels then tangents)
+// - Subclasses only need to provide the visual interpolation (GetVertexWsPos)
+template<class Element>
+class Sim_FESimulation : public Sim_Simulation, Sim_Rendererable, Sim_Integratable
+{
+public:
+	typedef Sim_FEKernel<Element> Kernel;
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	Sim_FESimulation();
+	virtual ~Sim_FESimulation();
+
+	//Simulation
+	virtual void Initialize(const Sim_Generator_Output& configuration) override;
+	virtual MPCG<SparseRowMatrix<Matrix3>>*  Solver() override { return &m_Solver; }
+	virtual Sim_FEQuadrature_Settings* Quadrature() override { return &m_Quadrature; }
+	virtual Sim_FEAssembly_Settings* Assembly() override { return &m_Assembly; }
+
+	virtual bool GetSymmetricStorageAvailable() override { return Element::SymmetricTangent; }
+	virtual bool GetSymmetricStorage() override { return m_SymmetricStorage; }
+	virtual void SetSymmetricStorage(bool symmetric) override;
+	virtual bool GetMatrixFree() override { return m_MatrixFree; }
+	virtual void SetMatrixFree(bool matrix_free) override;
+
+	virtual bool GetIsStatic(uint idx) override { return (idx < m_PhyxelIsStatic.size()) ? m_PhyxelIsStatic[idx] : false; }
+	virtual void SetIsStatic(uint idx, bool is_static) override
+	{
+		m_PhyxelIsStatic[idx] = is_static;
+		UpdateConstraints();
+	}
+
+	virtual const Sim_Material& GetMaterial() override { return m_Material; }
+	virtual void SetMaterial(const Sim_Material& material) override { m_Material = material; }
+
+	virtual ProfilingTimer& GetTotalTimer() override { return m_ProfilingTotalTime; }
+
+	virtual int GetNumSubProfilers() override { return Sim_FESimulation_SubTimer_MAX; }
+	virtual const ProfilingTimer& GetSubProfiler(int idx) override { return m_ProfilingSubTimers[idx]; }
+
+
+	//Integratable
+	virtual bool StepSimulation(float dt, const Vector3& gravity, const Vector3* in_x, const Vector3* in_dxdt, Vector3* out_dxdt) override;
+	virtual bool SupportsImplicit() override { return true; }
+	virtual float BuildImplicitSystem(float dt, const Vector3& gravity, const Vector3* x0, const Vector3* v0, const Vector3* v) override;
+	virtual bool SolveImplicitSystem(const Vector3* guess, Vector3* out_v) override;
+	virtual bool SupportsBatchedSubsteps() override { return true; }
+	virtual int AdvanceSubsteps(int num_substeps, float dt, const Vector3& gravity, Vector3* x, Vector3* dxdt, const Sim_Integrator_SubstepCallback& on_substep) override;
+
+	void UpdateConstraints();
+
+	//Rendering
+	virtual int GetNumTris() override { return m_NumTriangles; }
+	virtual void GetVertexRotation(int triidx, const Vector3& gauss_point, const Vector3* positions, const Vector3& wspos, Matrix3& out_rotation) override;
+	virtual void GetVertexStressStrain(int triidx, const Vector3& gauss_point, const Vector3* positions, const Vector3& wspos, Vector3& out_stress, Vector3& out_strain) override;
+
+protected:
+	void SetGravity(const Vector3& gravity);
+	void BuildElasticityMatrix();
+	void BuildMatrixPattern();
+	void SimpleCorotatedBuildAMatrix(float dt, const Vector3* positions, const Vector3* velocities);
+
+	//Dispatches to the kernel instantiated for the given rule
+	void ComputeElement(Sim_FEQuadrature_Rule rule, const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const typename Kernel::DofVector& displacements,
+		typename Kernel::DofMatrix& out_k, typename Kernel::DofVector& out_force, Sim_FEElementStrain* out_strain);
+	void ComputePoints(Sim_FEQuadrature_Rule rule, const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const typename Kernel::DofVector& displacements,
+		Sim_FEPointStiffness* out_points, typename Kernel::DofVector& out_force);
+
+protected:
+	Mat33 E; //Elasticity Matrix!!
+	Sim_Material m_Material;
+
+	uint m_NumDofs;						//Phyxels + tangents (if the element uses them)
+	uint m_NumPhyxels, m_NumTangents;
+	uint m_NumTriangles;
+
+	//Per dof data (phyxels then tangents)
+	std::vector<Vector3>		m_PhyxelsPosInitial;
+	std::vector<Vector3>		m_PhyxelForces;
+	std::vector<bool>			m_PhyxelIsStatic;
+	std::vector<float>			m_PhyxelsMass;
+	std::vector<Vector2>		m_PhyxelTexCoords;
+
+	//Implicit integration
+	std::vector<float>			m_ImplicitMass;		//Per dof mass as it appears on the diagonal of A
+	std::vector<Vector3>		m_ImplicitX, m_ImplicitV, m_ImplicitAV;
+
+	//Structural Data
+	std::vector<FETriangle> m_Triangles;
+
+	//Quadrature
+	Sim_FEQuadrature_Settings	m_Quadrature;
+	std::vector<bool>			m_ElementLowOrder;	//Adaptive quadrature choice for the next assembly
+
+	//Incremental assembly
+	// - K_T is only cached with a global A, the matrix-free operator still holds each elements points
+	struct ElementCache
+	{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		typename Kernel::DofVector force;
+		typename Kernel::DofVector d;		//Displacements K_T and force were computed at
+	};
+	Sim_FEAssembly_Settings		m_Assembly;
+	std::vector<ElementCache, Eigen::aligned_allocator<ElementCache>> m_ElementCache;
+	std::vector<typename Kernel::DofMatrix, Eigen::aligned_allocator<typename Kernel::DofMatrix>> m_ElementCacheK;	//K_T as it was last scattered
+	bool						m_ElementCacheValid;	//Global A (or the operator) holds exactly the cached K_T
+	float						m_ElementCacheDt;		//dt the stiffness part of A is scaled by (dt^2)
+	uint						m_NumIncrementalBuilds;	//Since the last full build
+
+	bool						   m_SymmetricStorage;	//Only the upper triangle of K_T is formed and stored
+	bool						   m_MatrixFree;		//Elements are applied from their gauss points, no global A
+	MPCG<SparseRowMatrix<Matrix3>> m_Solver;	//Solver
+	Sim_FEMatrixFree_Operator<Element> m_Operator;	//Solver operator in matrix-free mode
+	Sim_Multigrid_Preconditioner   m_Multigrid;	//Solver preconditioner (regular grids only, needs the global A)
+	bool						   m_MultigridAvailable;
+
+	//Profiling
+	ProfilingTimer	  m_ProfilingTotalTime;
+	ProfilingTimer    m_ProfilingSubTimers[Sim_FESimulation_SubTimer_MAX];
+};
+
+#include "Sim_FESimulation.inl"
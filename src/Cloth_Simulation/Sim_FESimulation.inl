@@ -0,0 +1,616 @@
+#include "Sim_FESimulation.h"
+#include <glcore\NCLDebug.h>
+
+template<class Element>
+Sim_FESimulation<Element>::Sim_FESimulation() : Sim_Rendererable()
+{
+	m_NumDofs = 0;
+	m_NumPhyxels = 0;
+	m_NumTangents = 0;
+	m_NumTriangles = 0;
+	m_SymmetricStorage = false;
+	m_MatrixFree = false;
+	m_MultigridAvailable = false;
+	m_ElementCacheValid = false;
+	m_ElementCacheDt = 0.0f;
+	m_NumIncrementalBuilds = 0;
+
+	m_ProfilingTotalTime.SetAlias("Total Time");
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Rotations].SetAlias("Geb Rotation");
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].SetAlias("Gen Matrix");
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].SetAlias("Solver");
+
+	BuildElasticityMatrix();
+}
+
+template<class Element>
+Sim_FESimulation<Element>::~Sim_FESimulation()
+{
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::BuildElasticityMatrix()
+{
+	const float Y = m_Material.youngs_modulus;	//Youngs Modulus
+	const float v = m_Material.poisson_ratio;	//Poisson coefficient
+	E.setZero();
+	E(0, 0) = 1.0f;
+	E(1, 0) = v;
+	E(0, 1) = v;
+	E(1, 1) = 1.0f;
+	E(2, 2) = (1.0f - v) * 0.5f;
+	E *= Y / (1.0f - v * v);
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::Initialize(const Sim_Generator_Output& configuration)
+{
+	BuildElasticityMatrix();
+
+	//Gen Vertices
+	m_NumPhyxels = configuration.NumVertices;
+	m_NumTangents = configuration.NumTangents;
+	m_NumDofs = (Element::NumTangents > 0) ? m_NumPhyxels + m_NumTangents : m_NumPhyxels;
+
+	m_Solver.AllocateMemory(m_NumDofs);
+
+	//A transform-only regenerate keeps the same topology, so the existing matrix layout can be reused
+	bool same_topology = m_Solver.m_A.m_Rows.size() == m_NumDofs && m_Solver.m_A.is_symmetric() == m_SymmetricStorage
+		&& m_Triangles.size() == configuration.Triangles.size() && !m_Triangles.empty()
+		&& memcmp(&m_Triangles[0], &configuration.Triangles[0], m_Triangles.size() * sizeof(FETriangle)) == 0;
+	m_MultigridAvailable = m_Multigrid.Initialize(configuration, m_NumDofs);
+	m_Solver.SetPreconditioner((m_MultigridAvailable && !m_MatrixFree) ? &m_Multigrid : NULL);
+
+
+	m_PhyxelsPosInitial.resize(m_NumDofs);
+	m_PhyxelForces.resize(m_NumDofs);
+	m_PhyxelIsStatic.resize(m_NumDofs);
+	m_PhyxelsMass.resize(m_NumDofs);
+	m_ImplicitMass.resize(m_NumDofs);
+	m_PhyxelTexCoords.resize(m_NumPhyxels);
+
+	memcpy(&m_PhyxelsPosInitial[0], &configuration.Phyxels_Initial[0], m_NumDofs * sizeof(Vector3));
+
+	for (uint i = 0; i < m_NumPhyxels; ++i)
+	{
+		const FEVertDescriptor& v = configuration.Phyxel_Descriptors[i];
+		m_PhyxelIsStatic[i] = v.isStatic;
+		m_PhyxelTexCoords[i] = v.tCoord;
+	}
+
+	for (uint i = m_NumPhyxels; i < m_NumDofs; ++i)
+		m_PhyxelIsStatic[i] = false;
+
+	memset(&m_PhyxelForces[0], 0, m_NumDofs * sizeof(Vector3));
+
+
+	//Populate Triangles
+	m_NumTriangles = configuration.Triangles.size();
+	m_Triangles.resize(m_NumTriangles);
+	memcpy(&m_Triangles[0], &configuration.Triangles[0], m_NumTriangles * sizeof(FETriangle));
+
+	//Every element starts on the full rule until its strain has been measured
+	m_ElementLowOrder.assign(m_NumTriangles, false);
+	m_ElementCacheValid = false;
+
+	float totalArea = 0.0f;
+	for (uint i = 0; i < m_NumTriangles; ++i)
+	{
+		//Simple area estimation (ONLY WORKS IF TRIANGLE HAS STRAIGHT EDGES AT REST!!!!)
+		Vector3 a = m_PhyxelsPosInitial[m_Triangles[i].v1];
+		Vector3 b = m_PhyxelsPosInitial[m_Triangles[i].v2];
+		Vector3 c = m_PhyxelsPosInitial[m_Triangles[i].v3];
+
+		Vector3 e1 = a - c;
+		Vector3 e2 = b - c;
+
+		totalArea += 0.5f * abs(e1.x * e2.y - e1.y * e2.x);
+	}
+
+	float uniform_mass = (totalArea * m_Material.density) / m_NumPhyxels;
+	for (uint i = 0; i < m_NumPhyxels; ++i)
+	{
+		m_PhyxelsMass[i] = uniform_mass;
+		m_ImplicitMass[i] = uniform_mass * Element::PhyxelMassDampening();
+	}
+	for (uint i = m_NumPhyxels; i < m_NumDofs; ++i)
+	{
+		m_PhyxelsMass[i] = Element::TangentMass();
+		m_ImplicitMass[i] = Element::TangentMass() * Element::TangentMassDampening();
+	}
+
+	if (!same_topology)
+		BuildMatrixPattern();
+
+	m_Solver.ResetMemory();
+	m_Solver.m_A.zero_memory();
+	UpdateConstraints();
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::BuildMatrixPattern()
+{
+	//The cached element matrices no longer match what is stored
+	m_ElementCacheValid = false;
+
+	//Matrix-free solves replace the global matrix, and with it the multigrid that is built from it
+	if (m_MatrixFree)
+	{
+		m_Solver.m_A.clean_memory();
+		m_Operator.Initialize(m_Triangles, m_NumPhyxels, m_NumDofs, &m_ImplicitMass);
+		m_Solver.SetOperator(&m_Operator);
+		m_Solver.SetPreconditioner(NULL);
+		return;
+	}
+	m_Operator.Release();
+	m_Solver.SetOperator(NULL);
+	m_Solver.SetPreconditioner(m_MultigridAvailable ? &m_Multigrid : NULL);
+
+	//Build Global Matrix sparsity pattern from the topology, each element couples all of its nodes
+	const int num_nodes = Element::NumNodes;
+	std::vector<uint> element_dofs(m_NumTriangles * num_nodes);
+#pragma omp parallel for
+	for (int i = 0; i < (int)m_NumTriangles; ++i)
+	{
+		for (int j = 0; j < num_nodes; ++j)
+			element_dofs[i * num_nodes + j] = Element::DofIndex(m_Triangles[i], j, m_NumPhyxels);
+	}
+	m_Solver.m_A.resize(m_NumDofs);
+	m_Solver.m_A.build_pattern(element_dofs, num_nodes, m_SymmetricStorage);
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::SetSymmetricStorage(bool symmetric)
+{
+	//Storing half of a non-symmetric K_T solves a different (symmetrised) system, which diverges for C0
+	if (symmetric && !Element::SymmetricTangent)
+	{
+		NCLDebug::Log(Vector3(1.0f, 0.4f, 0.4f), "Symmetric storage is unavailable, the elements tangent stiffness is not symmetric");
+		symmetric = false;
+	}
+
+	if (symmetric == m_SymmetricStorage)
+		return;
+
+	m_SymmetricStorage = symmetric;
+	if (m_NumTriangles > 0)
+	{
+		BuildMatrixPattern();
+		m_Solver.m_A.zero_memory();
+	}
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::SetMatrixFree(bool matrix_free)
+{
+	if (matrix_free == m_MatrixFree)
+		return;
+
+	m_MatrixFree = matrix_free;
+	if (m_NumTriangles > 0)
+	{
+		BuildMatrixPattern();
+		m_Solver.m_A.zero_memory();
+	}
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::UpdateConstraints()
+{
+	TaskScheduler::Instance()->ParallelFor(0, (int)m_NumDofs, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			if (m_PhyxelIsStatic[i])
+			{
+				m_Solver.m_Constraints[i] = Matrix3::ZeroMatrix;
+			}
+			else
+			{
+				m_Solver.m_Constraints[i] = Matrix3::Identity;
+			}
+		}
+	});
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::SetGravity(const Vector3& gravity)
+{
+	Vector3 sub_grav = gravity / m_NumPhyxels;
+	TaskScheduler::Instance()->ParallelFor(0, (int)m_NumPhyxels, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			m_PhyxelForces[i] = sub_grav;
+		}
+	});
+}
+
+template<class Element>
+bool Sim_FESimulation<Element>::StepSimulation(float dt, const Vector3& gravity, const Vector3* in_x, const Vector3* in_dxdt, Vector3* out_dxdt)
+{
+	m_ProfilingTotalTime.BeginTiming();
+	for (int i = 0; i < Sim_FESimulation_SubTimer_MAX; ++i)
+	{
+		m_ProfilingSubTimers[i].ResetTotalMs();
+	}
+	m_Solver.ResetProfilingData();
+
+	SetGravity(gravity);
+
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].BeginTiming();
+	m_Solver.ResetMemory();
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].EndTimingAdditive();
+
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].BeginTiming();
+	SimpleCorotatedBuildAMatrix(dt, in_x, in_dxdt);
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].EndTimingAdditive();
+
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].BeginTiming();
+	m_Solver.SolveWithGuess(in_dxdt);
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].EndTimingAdditive();
+
+	m_ProfilingTotalTime.EndTimingAdditive();
+
+	memcpy(out_dxdt, &m_Solver.m_X[0], m_NumDofs * sizeof(Vector3));
+	return true;
+}
+
+template<class Element>
+int Sim_FESimulation<Element>::AdvanceSubsteps(int num_substeps, float dt, const Vector3& gravity, Vector3* x, Vector3* dxdt, const Sim_Integrator_SubstepCallback& on_substep)
+{
+	m_ProfilingTotalTime.BeginTiming();
+	for (int i = 0; i < Sim_FESimulation_SubTimer_MAX; ++i)
+	{
+		m_ProfilingSubTimers[i].ResetTotalMs();
+	}
+	m_Solver.ResetProfilingData();
+
+	//Forces are only read by the assembly, so gravity is set once for the batch
+	SetGravity(gravity);
+
+	//The solvers result vector holds the velocity for the whole batch, each solve is warm started
+	// from the last one in place and it is only copied back out once at the end
+	//Only the solved dofs are advanced, tangents (if the element has none) are left untouched as in StepSimulation
+	Vector3* v = &m_Solver.m_X[0];
+	memcpy(v, dxdt, m_NumDofs * sizeof(Vector3));
+
+	for (int step = 0; step < num_substeps; ++step)
+	{
+		m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].BeginTiming();
+		m_Solver.ResetMemory();
+		m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].EndTimingAdditive();
+
+		m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].BeginTiming();
+		SimpleCorotatedBuildAMatrix(dt, x, v);
+		m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].EndTimingAdditive();
+
+		m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].BeginTiming();
+		m_Solver.SolveWithPreviousResult();
+		m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].EndTimingAdditive();
+
+		TaskScheduler::Instance()->ParallelFor(0, (int)m_NumDofs, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				x[i] += v[i] * dt;
+			}
+		});
+
+		//Run on the batch velocity, so any change it makes is what the next solve starts from
+		if (on_substep)
+			on_substep(dt, x, v, NULL);
+	}
+
+	memcpy(dxdt, v, m_NumDofs * sizeof(Vector3));
+
+	m_ProfilingTotalTime.EndTimingAdditive();
+	return num_substeps;
+}
+
+template<class Element>
+float Sim_FESimulation<Element>::BuildImplicitSystem(float dt, const Vector3& gravity, const Vector3* x0, const Vector3* v0, const Vector3* v)
+{
+	m_ProfilingTotalTime.BeginTiming();
+	for (int i = 0; i < Sim_FESimulation_SubTimer_MAX; ++i)
+	{
+		m_ProfilingSubTimers[i].ResetTotalMs();
+	}
+	m_Solver.ResetProfilingData();
+
+	SetGravity(gravity);
+
+	m_ImplicitX.resize(m_NumDofs);
+	m_ImplicitV.resize(m_NumDofs);
+	m_ImplicitAV.resize(m_NumDofs);
+	TaskScheduler::Instance()->ParallelFor(0, (int)m_NumDofs, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			m_ImplicitX[i] = x0[i] + v[i] * dt;
+			m_ImplicitV[i] = v[i];
+		}
+	});
+
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].BeginTiming();
+	m_Solver.ResetMemory();
+	SimpleCorotatedBuildAMatrix(dt, &m_ImplicitX[0], v0);
+
+	//A = M + dt^2 K(x) and B = M v0 + dt f(x), so the backward euler residual is M v - B
+	// and the newton step solves A v' = B + dt^2 K v = B + A v - M v
+	m_Solver.MultiplyA(m_ImplicitAV, m_ImplicitV);
+
+	float residual_sq = TaskScheduler::Instance()->ParallelReduce(0, (int)m_NumDofs, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int i = first; i < last; ++i)
+		{
+			Vector3 residual = m_Solver.m_Constraints[i] * (m_ImplicitV[i] * m_ImplicitMass[i] - m_Solver.m_B[i]);
+			partial += residual.LengthSquared();
+
+			m_Solver.m_B[i] += m_ImplicitAV[i] - m_ImplicitV[i] * m_ImplicitMass[i];
+		}
+		return partial;
+	});
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_BuildMatrices].EndTimingAdditive();
+
+	m_ProfilingTotalTime.EndTimingAdditive();
+	return sqrtf(residual_sq);
+}
+
+template<class Element>
+bool Sim_FESimulation<Element>::SolveImplicitSystem(const Vector3* guess, Vector3* out_v)
+{
+	m_ProfilingTotalTime.BeginTiming();
+	//CG needs a symmetric A, the newton system is only symmetric if the elements K_T is (Element::SymmetricTangent)
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].BeginTiming();
+	if (Element::SymmetricTangent)
+		m_Solver.SolveWithGuess(guess);
+	else
+		m_Solver.SolveNonSymmetricWithGuess(guess);
+	m_ProfilingSubTimers[Sim_FESimulation_SubTimer_Solver].EndTimingAdditive();
+	m_ProfilingTotalTime.EndTimingAdditive();
+
+	memcpy(out_v, &m_Solver.m_X[0], m_NumDofs * sizeof(Vector3));
+	return true;
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::SimpleCorotatedBuildAMatrix(float dt, const Vector3* positions, const Vector3* velocities)
+{
+	//Incremental builds patch the matrix left by the last build, everything else starts from zero
+	// - The cached element matrices are unscaled, so a different dt (e.g. adaptive stepping) keeps them
+	// - A new rule clears the operators points, so the cached elements are gone
+	const bool caching = m_Assembly.incremental;
+	if (m_MatrixFree)
+	{
+		m_Operator.SetTimestep(dt);
+		if (m_Operator.SetQuadrature(m_Quadrature.rule))
+			m_ElementCacheValid = false;
+	}
+
+	const bool incremental = caching && m_ElementCacheValid
+		&& m_NumIncrementalBuilds < m_Assembly.full_rebuild_interval;
+
+	if (incremental)
+	{
+		m_NumIncrementalBuilds++;
+
+		//A = M + dt^2 K of the last build, only its stiffness part is rescaled to the new dt
+		if (!m_MatrixFree && dt != m_ElementCacheDt)
+		{
+			const float scale = (dt * dt) / (m_ElementCacheDt * m_ElementCacheDt);
+			TaskScheduler::Instance()->ParallelFor(0, (int)m_NumDofs, 0, [&](int first, int last)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					const Matrix3 mass = Matrix3::Identity * (m_ImplicitMass[i] * (1.f - scale));
+					for (auto& item : m_Solver.m_A.m_Rows[i])
+					{
+						item.value = item.value * scale;
+						if (item.column == (uint)i)
+							item.value += mass;
+					}
+				}
+			});
+		}
+	}
+	else
+	{
+		m_Solver.m_A.zero_memory();
+		m_NumIncrementalBuilds = 0;
+		if (caching)
+		{
+			m_ElementCache.resize(m_NumTriangles);
+			if (m_MatrixFree)
+				decltype(m_ElementCacheK)().swap(m_ElementCacheK);
+			else
+				m_ElementCacheK.resize(m_NumTriangles);
+		}
+	}
+
+	//Mass (with dampening) on the diagonal, momentum + external forces in B
+	// - The matrix-free operator reads the mass straight from m_ImplicitMass
+	// - Patched matrices still hold it from the last full build
+	TaskScheduler::Instance()->ParallelFor(0, (int)m_NumDofs, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			if (!m_MatrixFree && !incremental)
+				m_Solver.m_A(i, i) = Matrix3::Identity * m_ImplicitMass[i];
+			m_Solver.m_B[i] = (velocities != NULL)
+				? velocities[i] * m_PhyxelsMass[i] + m_PhyxelForces[i] * dt
+				: m_PhyxelForces[i] * dt;
+		}
+	});
+
+	Vector3 rest_nodes[Kernel::NumNodes], nodes[Kernel::NumNodes];
+	typename Kernel::DofVector d_g, force, d_delta, k_delta;
+	typename Kernel::DofMatrix K_T, K_diff;
+	Sim_FEPointStiffness points[Sim_FEQuadrature_Dunavant12::NumPoints];
+	Sim_FEElementStrain strain;
+
+	//The operator keeps a single rule for every element
+	const bool adaptive = m_Quadrature.adaptive && !m_MatrixFree;
+	const bool upper_only = m_SymmetricStorage;
+	uint num_low_order = 0, num_reused = 0;
+
+	for (uint i = 0; i < m_NumTriangles; ++i)
+	{
+		const FETriangle& tri = m_Triangles[i];
+
+		Kernel::Gather(tri, m_NumPhyxels, &m_PhyxelsPosInitial[0], rest_nodes);
+		Kernel::Gather(tri, m_NumPhyxels, positions, nodes);
+		Kernel::Displacements(nodes, rest_nodes, d_g);
+
+		if (incremental)
+		{
+			//Barely moved, the cached K_T is already in A and the force is extrapolated from it
+			ElementCache& cache = m_ElementCache[i];
+			d_delta = d_g - cache.d;
+			if (d_delta.cwiseAbs().maxCoeff() < m_Assembly.displacement_threshold)
+			{
+				force = cache.force;
+				if (m_MatrixFree)
+				{
+					m_Operator.MultiplyElement(i, d_delta, k_delta);
+					force += k_delta;
+				}
+				else if (upper_only)
+					force.noalias() += m_ElementCacheK[i].template selfadjointView<Eigen::Upper>() * d_delta;
+				else
+					force.noalias() += m_ElementCacheK[i] * d_delta;
+
+				Kernel::ScatterForce(tri, m_NumPhyxels, force, dt, &m_Solver.m_B[0]);
+				num_reused++;
+				continue;
+			}
+		}
+
+		if (m_MatrixFree)
+		{
+			ComputePoints(m_Quadrature.rule, tri, i, rest_nodes, nodes, d_g, points, force);
+		}
+		else if (adaptive)
+		{
+			bool low_order = m_ElementLowOrder[i];
+			ComputeElement(low_order ? m_Quadrature.low_order_rule : m_Quadrature.rule, tri, i, rest_nodes, nodes, d_g, K_T, force, &strain);
+
+			//Pick the rule for the next assembly, strain changes little between sub-steps
+			m_ElementLowOrder[i] = (strain.max_strain < m_Quadrature.strain_threshold)
+				|| (strain.deviation < m_Quadrature.uniformity_threshold * strain.max_strain);
+			num_low_order += low_order ? 1 : 0;
+		}
+		else
+		{
+			ComputeElement(m_Quadrature.rule, tri, i, rest_nodes, nodes, d_g, K_T, force, NULL);
+		}
+
+		//Convert Eigen Matrices back to global A Matrix + B Vectors for global solver
+		if (m_MatrixFree)
+		{
+			Kernel::ScatterForce(tri, m_NumPhyxels, force, dt, &m_Solver.m_B[0]);
+			m_Operator.SetElementPoints(i, points);
+		}
+		else if (incremental)
+		{
+			K_diff = K_T - m_ElementCacheK[i];
+			Kernel::Scatter(tri, m_NumPhyxels, K_diff, force, dt, upper_only, m_Solver);
+		}
+		else
+		{
+			Kernel::Scatter(tri, m_NumPhyxels, K_T, force, dt, upper_only, m_Solver);
+		}
+
+		if (caching)
+		{
+			ElementCache& cache = m_ElementCache[i];
+			cache.force = force;
+			cache.d = d_g;
+			if (!m_MatrixFree)
+				m_ElementCacheK[i] = K_T;
+		}
+	}
+	m_Quadrature.num_low_order = num_low_order;
+
+	m_ElementCacheValid = caching;
+	m_ElementCacheDt = dt;
+	m_Assembly.num_reused = num_reused;
+	m_Assembly.num_elements = m_NumTriangles;
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::ComputeElement(Sim_FEQuadrature_Rule rule, const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const typename Kernel::DofVector& displacements,
+	typename Kernel::DofMatrix& out_k, typename Kernel::DofVector& out_force, Sim_FEElementStrain* out_strain)
+{
+	const bool upper_only = m_SymmetricStorage;
+
+	switch (rule)
+	{
+	case Sim_FEQuadrature_Rule_Dunavant3:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant3>::ComputeElement(tri, tri_idx, rest_nodes, nodes, displacements, E, out_k, out_force, upper_only, out_strain);
+		break;
+	case Sim_FEQuadrature_Rule_Dunavant6:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant6>::ComputeElement(tri, tri_idx, rest_nodes, nodes, displacements, E, out_k, out_force, upper_only, out_strain);
+		break;
+	case Sim_FEQuadrature_Rule_Dunavant7:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant7>::ComputeElement(tri, tri_idx, rest_nodes, nodes, displacements, E, out_k, out_force, upper_only, out_strain);
+		break;
+	default:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant12>::ComputeElement(tri, tri_idx, rest_nodes, nodes, displacements, E, out_k, out_force, upper_only, out_strain);
+		break;
+	}
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::ComputePoints(Sim_FEQuadrature_Rule rule, const FETriangle& tri, uint tri_idx, const Vector3* rest_nodes, const Vector3* nodes, const typename Kernel::DofVector& displacements,
+	Sim_FEPointStiffness* out_points, typename Kernel::DofVector& out_force)
+{
+	switch (rule)
+	{
+	case Sim_FEQuadrature_Rule_Dunavant3:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant3>::ComputePoints(tri, tri_idx, rest_nodes, nodes, displacements, E, out_points, out_force);
+		break;
+	case Sim_FEQuadrature_Rule_Dunavant6:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant6>::ComputePoints(tri, tri_idx, rest_nodes, nodes, displacements, E, out_points, out_force);
+		break;
+	case Sim_FEQuadrature_Rule_Dunavant7:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant7>::ComputePoints(tri, tri_idx, rest_nodes, nodes, displacements, E, out_points, out_force);
+		break;
+	default:
+		Sim_FEKernel<Element, Sim_FEQuadrature_Dunavant12>::ComputePoints(tri, tri_idx, rest_nodes, nodes, displacements, E, out_points, out_force);
+		break;
+	}
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::GetVertexRotation(int triidx, const Vector3& gp, const Vector3* positions, const Vector3& wspos, Matrix3& out_rotation)
+{
+	Vector3 nodes[Kernel::NumNodes];
+	typename Kernel::DNMatrix Dn;
+	Mat33 rot;
+	JaMatrix Ja;
+
+	const FETriangle& t = m_Triangles[triidx];
+	Kernel::Gather(t, m_NumPhyxels, positions, nodes);
+	Kernel::CalcRotation(t, nodes, gp, rot, Ja, Dn);
+
+	memcpy(&out_rotation._11, &rot, sizeof(Matrix3));
+}
+
+template<class Element>
+void Sim_FESimulation<Element>::GetVertexStressStrain(int triidx, const Vector3& gp, const Vector3* positions, const Vector3& wspos, Vector3& out_stress, Vector3& out_strain)
+{
+	Vector3 rest_nodes[Kernel::NumNodes], nodes[Kernel::NumNodes];
+	typename Kernel::DofVector d_g;
+	Vec3 stress, strain;
+
+	const FETriangle& t = m_Triangles[triidx];
+	Kernel::Gather(t, m_NumPhyxels, &m_PhyxelsPosInitial[0], rest_nodes);
+	Kernel::Gather(t, m_NumPhyxels, positions, nodes);
+	Kernel::Displacements(nodes, rest_nodes, d_g);
+	Kernel::StressStrain(t, rest_nodes, d_g, gp, E, stress, strain);
+
+	memcpy(&out_stress.x, &stress, sizeof(Vector3));
+	memcpy(&out_strain.x, &strain, sizeof(Vector3));
+}
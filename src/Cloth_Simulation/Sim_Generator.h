@@ -2,12 +2,19 @@
 #include "SimulationDefines.h"
 #include <functional>
 
+struct Sim_Generator_Output;
+
+//Moves phyxels directly before each sub-step. Indices into x/dxdt should be looked up through config
+// (ReorderedIndex) on every call rather than captured, the output may be reordered or copied after generation.
+typedef std::function<void(float elapsed, const Sim_Generator_Output& config, Vector3* x, Vector3* dxdt)> Sim_Generator_Actuator;
+
 struct Sim_Generator_Output
 {
 	void Release()
 	{
 		NumVertices = 0;
 		NumTangents = 0;
+		GridWidth = 0;
 
 		Triangles.clear();
 		Phyxel_Descriptors.clear();
@@ -16,6 +23,9 @@ struct Sim_Generator_Output
 		Phyxels_Initial.clear();
 
 		Actuators.clear();
+
+		OriginalIdx.clear();
+		ReorderedIdx.clear();
 	}
 
 	void CopyFrom(const Sim_Generator_Output& rhs)
@@ -25,6 +35,7 @@ struct Sim_Generator_Output
 			Release();
 			NumVertices = rhs.NumVertices;
 			NumTangents = rhs.NumTangents;
+			GridWidth = rhs.GridWidth;
 
 			Triangles.resize(rhs.Triangles.size());
 			Phyxel_Descriptors.resize(rhs.Phyxel_Descriptors.size());
@@ -39,16 +50,28 @@ struct Sim_Generator_Output
 
 			for (int i = 0; i < rhs.Actuators.size(); ++i)
 				Actuators[i] = rhs.Actuators[i];
+
+			OriginalIdx = rhs.OriginalIdx;
+			ReorderedIdx = rhs.ReorderedIdx;
 		}
 	}
 	uint NumVertices, NumTangents;
+	uint GridWidth;		//Phyxels form a row-major GridWidth x GridWidth grid, 0 for unstructured meshes
 
 	std::vector<FETriangle> Triangles;
 	std::vector<FEVertDescriptor> Phyxel_Descriptors;
 	std::vector<Vector3> Phyxels;
 	std::vector<Vector3> Phyxels_Initial;
 
-	std::vector<std::function<void(float elapsed, Vector3* x, Vector3* dxdt)>> Actuators;
+	std::vector<Sim_Generator_Actuator> Actuators;
+
+	//Permutation applied after generation (see Sim_Reordering), indices are into the full X array
+	// - Empty if the generators numbering is used as is
+	std::vector<uint> OriginalIdx;		//Current index -> generator index
+	std::vector<uint> ReorderedIdx;		//Generator index -> current index
+
+	inline uint OriginalIndex(uint idx) const { return OriginalIdx.empty() ? idx : OriginalIdx[idx]; }
+	inline uint ReorderedIndex(uint idx) const { return ReorderedIdx.empty() ? idx : ReorderedIdx[idx]; }
 };
 
 class Sim_Generator
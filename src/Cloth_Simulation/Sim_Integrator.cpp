@@ -1,27 +1,41 @@
 #include "Sim_Integrator.h"
+#include "Sim_IntegratorPolicies.h"
 #include <glcore\NCLDebug.h>
+#include <glcore\TaskScheduler.h>
+#include <cfloat>
 
 Sim_Integrator::Sim_Integrator()
 	: m_X(NULL)
 	, m_DxDt(NULL)
 	, m_DxDt_Tmp(NULL)
 	, m_X_Tmp(NULL)
+	, m_X_Rollback(NULL)
+	, m_DxDt_Rollback(NULL)
+	, m_Configuration(NULL)
 	, m_Actuators(NULL)
 {
 	m_SubTimestep = DEFAULT_SUB_TIMESTEP;
+	m_AdaptiveTimestep = false;
+	m_AdaptiveTolerance = DEFAULT_ADAPTIVE_TOLERANCE;
+	m_NumRejectedSteps = 0;
+	m_MaxNewtonIterations = 4;
+	m_NewtonTolerance = 0.001f;
+	m_NumNewtonIterations = 0;
 
 	m_ProfilingTotalTime.SetAlias("Total Time");
 	m_NumSolverCalls = 0;
 
 	m_Gravity = Vector3(0.f, -9.81f, 0.f);
 
-	m_IntegrationType = Sim_Integrator_Type_Explicit;
-	m_FuncInitMem = std::bind(&Sim_Integrator::InitializeMemExplicit, this);
-	m_FuncIntegrate = std::bind(&Sim_Integrator::IntegrateExplicit, this);
+	m_Engine = Sim_Integrator_Engine_Static;
+	m_IntegrationType = Sim_Integrator_Type_RK2;
+	m_FuncInitMem = std::bind(&Sim_Integrator::InitializeMemRK2, this);
+	m_FuncIntegrate = std::bind(&Sim_Integrator::IntegrateRK2, this);
 }
 
 Sim_Integrator::~Sim_Integrator()
 {
+	m_Configuration = NULL;
 	m_Actuators = NULL;
 
 	if (m_X != NULL)
@@ -31,6 +45,13 @@ Sim_Integrator::~Sim_Integrator()
 		m_X = NULL;
 	}
 
+	if (m_X_Rollback != NULL)
+	{
+		delete[] m_X_Rollback;
+		delete[] m_DxDt_Rollback;
+		m_X_Rollback = NULL;
+	}
+
 	if (m_X_Tmp != NULL)
 	{
 		delete[] m_X_Tmp;
@@ -66,6 +87,11 @@ void Sim_Integrator::SetIntegrationType(Sim_Integrator_Type type)
 			m_FuncInitMem = std::bind(&Sim_Integrator::InitializeMemRK4, this);
 			m_FuncIntegrate = std::bind(&Sim_Integrator::IntegrateRK4, this);
 			break;
+
+		case Sim_Integrator_Type_Implicit:
+			m_FuncInitMem = std::bind(&Sim_Integrator::InitializeMemImplicit, this);
+			m_FuncIntegrate = std::bind(&Sim_Integrator::IntegrateImplicit, this);
+			break;
 		}
 
 		InitIntegrationTypeMem();
@@ -91,54 +117,257 @@ void Sim_Integrator::Initialize(Sim_Integratable* sim, const Sim_Generator_Outpu
 	m_TimeAccum = 0.f;
 	m_TimeElapsedTotal = 0.f;
 	m_NumTotal = config.Phyxels.size();
+	m_NumPhyxels = config.NumVertices;
 	
+	m_Configuration = &config;
 	m_Actuators = &config.Actuators;
 
 	if (m_X != NULL) delete[] m_X;
 	if (m_DxDt != NULL) delete[] m_DxDt;
+	if (m_X_Rollback != NULL) delete[] m_X_Rollback;
+	if (m_DxDt_Rollback != NULL) delete[] m_DxDt_Rollback;
 	
 
 	m_X = new Vector3[m_NumTotal];
 	m_DxDt = new Vector3[m_NumTotal];
+	m_X_Rollback = new Vector3[m_NumTotal];
+	m_DxDt_Rollback = new Vector3[m_NumTotal];
 	
 	memset(m_DxDt, 0, m_NumTotal * sizeof(Vector3));
 	memcpy(m_X, &config.Phyxels[0], m_NumTotal * sizeof(Vector3));
 
-	auto new_type = Sim_Integrator_Type_Explicit;
-	new_type = Sim_Integrator_Type_RK2;
-	//new_type = Sim_Integrator_Type_RK4;
-	if (new_type != m_IntegrationType)
-	{
-		SetIntegrationType(new_type);
-	}
-	else
-	{
-		InitIntegrationTypeMem();
-	}
+	//Integration type (and the sub timestep chosen for it) is kept across resets
+	InitIntegrationTypeMem();
 }
 
 void Sim_Integrator::UpdateSimulation(float real_timestep)
 {
 	m_NumSolverCalls = 0;
+	m_NumRejectedSteps = 0;
+	m_NumNewtonIterations = 0;
 
 	m_ProfilingTotalTime.BeginTiming();
 	m_TimeAccum += real_timestep;
+	if (m_AdaptiveTimestep)
+		UpdateSimulationAdaptive();
+	else
+		UpdateSimulationFixed();
+	m_ProfilingTotalTime.EndTiming();
+
+	if (m_CallbackOnStepComplete)
+		m_CallbackOnStepComplete(this);
+}
+
+void Sim_Integrator::UpdateSimulationFixed()
+{
+	if (m_Engine == Sim_Integrator_Engine_Static)
+	{
+		switch (m_IntegrationType)
+		{
+		case Sim_Integrator_Type_Explicit:
+			if (m_Sim->SupportsBatchedSubsteps())
+				UpdateSimulationBatched();
+			else
+				UpdateSimulationStatic<Sim_IntegratorPolicy_Explicit>();
+			return;
+		case Sim_Integrator_Type_RK2:
+			UpdateSimulationStatic<Sim_IntegratorPolicy_RK2>();
+			return;
+		case Sim_Integrator_Type_RK4:
+			UpdateSimulationStatic<Sim_IntegratorPolicy_RK4>();
+			return;
+		default:
+			break;
+		}
+	}
+
 	for (; m_TimeAccum - m_SubTimestep >= 0.f; m_TimeAccum -= m_SubTimestep)
 	{
 		if (m_Actuators != NULL)
 		{
 			for (int i = 0; i < m_Actuators->size(); ++i)
-				(*m_Actuators)[i](m_TimeElapsedTotal, m_X, m_DxDt);
+				(*m_Actuators)[i](m_TimeElapsedTotal, *m_Configuration, m_X, m_DxDt);
 		}
 
 		m_FuncIntegrate();
 
+		if (m_CallbackOnSubstepComplete)
+			m_CallbackOnSubstepComplete(m_SubTimestep, m_X, m_DxDt, NULL);
+
 		m_TimeElapsedTotal += m_SubTimestep;
 	}
-	m_ProfilingTotalTime.EndTiming();
+}
 
-	if (m_CallbackOnStepComplete)
-		m_CallbackOnStepComplete(this);
+template <class Policy>
+void Sim_Integrator::UpdateSimulationStatic()
+{
+	Sim_IntegratorState state;
+	state.sim = m_Sim;
+	state.gravity = m_Gravity;
+	state.dt = m_SubTimestep;
+	state.num_total = (int)m_NumTotal;
+	state.x = m_X;
+	state.dxdt = m_DxDt;
+	state.x_tmp = m_X_Tmp;
+	state.dxdt_tmp = m_DxDt_Tmp;
+
+	const bool has_actuators = (m_Actuators != NULL && !m_Actuators->empty());
+	const bool has_substep_callback = (bool)m_CallbackOnSubstepComplete;
+	bool prepared = false;
+
+	for (; m_TimeAccum - m_SubTimestep >= 0.f; m_TimeAccum -= m_SubTimestep)
+	{
+		if (has_actuators)
+		{
+			for (size_t i = 0; i < m_Actuators->size(); ++i)
+				(*m_Actuators)[i](m_TimeElapsedTotal, *m_Configuration, state.x, state.dxdt);
+			prepared = false;
+		}
+
+		if (!prepared)
+			Policy::Begin(state);
+
+		//Next sub-steps stage positions can be built in the final update pass, unless an actuator will move X first
+		bool prepare_next = !has_actuators && (m_TimeAccum - 2.f * m_SubTimestep >= 0.f);
+		prepared = Policy::Step(state, prepare_next) && prepare_next;
+
+		//The callback only moves the few phyxels in contact, so those are re-staged rather than the whole state
+		if (has_substep_callback)
+		{
+			m_SubstepModified.clear();
+			m_CallbackOnSubstepComplete(m_SubTimestep, state.x, state.dxdt, prepared ? &m_SubstepModified : NULL);
+			if (prepared && !m_SubstepModified.empty())
+				Policy::Restage(state, &m_SubstepModified[0], (uint)m_SubstepModified.size());
+		}
+
+		m_NumSolverCalls += Policy::NumStages;
+		m_TimeElapsedTotal += m_SubTimestep;
+	}
+
+	//Policies swap velocity buffers locally
+	m_DxDt = state.dxdt;
+	m_DxDt_Tmp = state.dxdt_tmp;
+}
+
+void Sim_Integrator::UpdateSimulationBatched()
+{
+	const bool has_actuators = (m_Actuators != NULL && !m_Actuators->empty());
+
+	while (m_TimeAccum - m_SubTimestep >= 0.f)
+	{
+		//Actuators run before every sub-step so they split the batch, otherwise take as many sub-steps as the
+		// fixed loop would (same float sequence), the sub-step callback is run by the simulation inside the batch
+		int num_substeps = 1;
+		if (has_actuators)
+		{
+			for (size_t i = 0; i < m_Actuators->size(); ++i)
+				(*m_Actuators)[i](m_TimeElapsedTotal, *m_Configuration, m_X, m_DxDt);
+		}
+		else
+		{
+			for (float accum = m_TimeAccum - m_SubTimestep; accum - m_SubTimestep >= 0.f; accum -= m_SubTimestep)
+				num_substeps++;
+		}
+
+		//As a failed StepSimulation, the time of an exploded batch is still consumed
+		m_NumSolverCalls += m_Sim->AdvanceSubsteps(num_substeps, m_SubTimestep, m_Gravity, m_X, m_DxDt, m_CallbackOnSubstepComplete);
+
+		for (int i = 0; i < num_substeps; ++i)
+		{
+			m_TimeAccum -= m_SubTimestep;
+			m_TimeElapsedTotal += m_SubTimestep;
+		}
+	}
+}
+
+void Sim_Integrator::UpdateSimulationAdaptive()
+{
+	const int max_rejections = 16;
+	bool gave_up = false;
+
+	float timestep = m_SubTimestep;
+	timestep = (timestep > max_timestep) ? max_timestep : timestep;
+	timestep = (timestep < min_timestep) ? min_timestep : timestep;
+
+	while (m_TimeAccum >= min_timestep && m_NumRejectedSteps < max_rejections)
+	{
+		//Never step past the real time available, the remainder is carried over to the next update
+		m_SubTimestep = (timestep < m_TimeAccum) ? timestep : m_TimeAccum;
+
+		memcpy(m_X_Rollback, m_X, m_NumTotal * sizeof(Vector3));
+		memcpy(m_DxDt_Rollback, m_DxDt, m_NumTotal * sizeof(Vector3));
+
+		if (m_Actuators != NULL)
+		{
+			for (int i = 0; i < m_Actuators->size(); ++i)
+				(*m_Actuators)[i](m_TimeElapsedTotal, *m_Configuration, m_X, m_DxDt);
+		}
+
+		bool success = m_FuncIntegrate();
+		float error = success ? EstimateStepError(m_DxDt_Rollback, m_DxDt, m_SubTimestep) : FLT_MAX;
+
+		//A failed or exploded (NaN) step is never kept, an inaccurate one only while it can still be made smaller
+		bool failed = !(error < FLT_MAX);
+		if (failed || (error > m_AdaptiveTolerance && m_SubTimestep > min_timestep))
+		{
+			memcpy(m_X, m_X_Rollback, m_NumTotal * sizeof(Vector3));
+			memcpy(m_DxDt, m_DxDt_Rollback, m_NumTotal * sizeof(Vector3));
+			m_NumRejectedSteps++;
+
+			//Can't go any smaller, stop here and wait for the next update rather than retry the same step
+			if (m_SubTimestep <= min_timestep)
+			{
+				gave_up = true;
+				break;
+			}
+
+			float scale = (error < FLT_MAX) ? 0.9f * sqrtf(m_AdaptiveTolerance / error) : 0.25f;
+			scale = (scale < 0.25f) ? 0.25f : scale;
+			scale = (scale > 0.9f) ? 0.9f : scale;
+			timestep = m_SubTimestep * scale;
+			timestep = (timestep < min_timestep) ? min_timestep : timestep;
+			continue;
+		}
+
+		if (m_CallbackOnSubstepComplete)
+			m_CallbackOnSubstepComplete(m_SubTimestep, m_X, m_DxDt, NULL);
+
+		m_TimeAccum -= m_SubTimestep;
+		m_TimeElapsedTotal += m_SubTimestep;
+
+		//Local error is O(dt^2), grow cautiously so the next step is not immediately rejected
+		float scale = (error > 0.f) ? 0.9f * sqrtf(m_AdaptiveTolerance / error) : 2.f;
+		scale = (scale > 2.f) ? 2.f : scale;
+		scale = (scale < 0.5f) ? 0.5f : scale;
+		timestep = timestep * scale;
+		timestep = (timestep > max_timestep) ? max_timestep : timestep;
+		timestep = (timestep < min_timestep) ? min_timestep : timestep;
+	}
+
+	//Time not stepped through after giving up is dropped, carrying it over would only grow the backlog every update
+	if (gave_up || m_NumRejectedSteps >= max_rejections)
+		m_TimeAccum = 0.f;
+
+	m_SubTimestep = timestep;
+}
+
+float Sim_Integrator::EstimateStepError(const Vector3* dxdt_old, const Vector3* dxdt_new, float dt)
+{
+	//Embedded estimate: the difference between the euler position update (x + dt * v_new) and
+	// the trapezoidal one (x + dt * (v_old + v_new) / 2) at no extra solver cost
+	// - NaNs are kept by the combine, so a blown up step is always rejected
+	auto max_nan = [](float a, float b) { return (b > a || b != b) ? b : a; };
+	float max_dv_sq = TaskScheduler::Instance()->ParallelReduce(0, (int)m_NumPhyxels, 0, 0.f, [&](int first, int last)
+	{
+		float local_max = 0.f;
+		for (int i = first; i < last; ++i)
+		{
+			local_max = max_nan(local_max, (dxdt_new[i] - dxdt_old[i]).LengthSquared());
+		}
+		return local_max;
+	}, max_nan);
+
+	return 0.5f * dt * sqrtf(max_dv_sq);
 }
 
 
@@ -159,14 +388,17 @@ bool Sim_Integrator::IntegrateExplicit()
 	{
 		std::swap(m_DxDt, m_DxDt_Tmp);
 
-#pragma omp parallel for
-		for (int i = 0; i < m_NumTotal; ++i)
+		TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 		{
-			m_X[i] += m_DxDt[i] * m_SubTimestep;
-		}
+			for (int i = first; i < last; ++i)
+			{
+				m_X[i] += m_DxDt[i] * m_SubTimestep;
+			}
+		});
+		return true;
 	}
 
-	return true;
+	return false;
 }
 
 #pragma endregion //EXPLICIT_INTEGRATION
@@ -187,26 +419,25 @@ void Sim_Integrator::InitializeMemRK2()
 bool Sim_Integrator::IntegrateRK2()
 {
 	const float half_timestep = m_SubTimestep * 0.5f;
-	
-#pragma omp parallel for
-	for (int i = 0; i < m_NumTotal; ++i)
-	{
-		m_X_Tmp[i] = m_X[i] + m_DxDt[i] * half_timestep;		
-	}
 
+	//Solved at the start of the sub-step, the simulations solve for the velocity implicitly (M + dt^2 K) so
+	// restarting that solve from the midpoint positions diverges
 	m_NumSolverCalls++;
 	if (m_Sim->StepSimulation(half_timestep, m_Gravity, m_X, m_DxDt, m_DxDt_Tmp))
 	{
 		std::swap(m_DxDt, m_DxDt_Tmp);
 
-#pragma omp parallel for
-		for (int i = 0; i < m_NumTotal; ++i)
+		TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 		{
-			m_X[i] += m_DxDt[i] * m_SubTimestep;
-		}
+			for (int i = first; i < last; ++i)
+			{
+				m_X[i] += m_DxDt[i] * m_SubTimestep;
+			}
+		});
+		return true;
 	}
 
-	return true;
+	return false;
 }
 
 #pragma endregion RK2_INTEGRATION
@@ -233,39 +464,143 @@ bool Sim_Integrator::IntegrateRK4()
 	Vector3* k4 = &m_DxDt_Tmp[m_NumTotal * 2];
 
 
-#pragma omp parallel for
-	for (int i = 0; i < m_NumTotal; ++i)
+	TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 	{
-		m_X_Tmp[i] = m_X[i] + k1[i] * half_timestep;
-	}
+		for (int i = first; i < last; ++i)
+		{
+			m_X_Tmp[i] = m_X[i] + k1[i] * half_timestep;
+		}
+	});
 	m_NumSolverCalls++;
-	m_Sim->StepSimulation(half_timestep, m_Gravity, m_X_Tmp, k1, k2);
+	bool success = m_Sim->StepSimulation(half_timestep, m_Gravity, m_X_Tmp, k1, k2);
 
-#pragma omp parallel for
-	for (int i = 0; i < m_NumTotal; ++i)
+	TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 	{
+		for (int i = first; i < last; ++i)
+		{
 
-		m_X_Tmp[i] = m_X[i] + k2[i] * half_timestep;
-	}
+			m_X_Tmp[i] = m_X[i] + k2[i] * half_timestep;
+		}
+	});
 	m_NumSolverCalls++;
-	m_Sim->StepSimulation(half_timestep, m_Gravity, m_X_Tmp, k2, k3);
+	success &= m_Sim->StepSimulation(half_timestep, m_Gravity, m_X_Tmp, k2, k3);
 
-#pragma omp parallel for
-	for (int i = 0; i < m_NumTotal; ++i)
+	TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 	{
-		m_X_Tmp[i] = m_X[i] + k3[i] * m_SubTimestep;
-	}
+		for (int i = first; i < last; ++i)
+		{
+			m_X_Tmp[i] = m_X[i] + k3[i] * m_SubTimestep;
+		}
+	});
 	m_NumSolverCalls++;
-	m_Sim->StepSimulation(m_SubTimestep, m_Gravity, m_X_Tmp, k3, k4);
+	success &= m_Sim->StepSimulation(m_SubTimestep, m_Gravity, m_X_Tmp, k3, k4);
 
-#pragma omp parallel for
-	for (int i = 0; i < m_NumTotal; ++i)
+	TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 	{
-		m_DxDt[i] = (k1[i] + (k2[i] + k3[i]) * 2.f + k4[i]) / 6.f;
-		m_X[i] += m_DxDt[i] * m_SubTimestep;
+		for (int i = first; i < last; ++i)
+		{
+			m_DxDt[i] = (k1[i] + (k2[i] + k3[i]) * 2.f + k4[i]) / 6.f;
+			m_X[i] += m_DxDt[i] * m_SubTimestep;
+		}
+	});
+
+	return success;
+}
+
+#pragma endregion RK4_INTEGRATION
+
+
+
+#pragma region IMPLICIT_INTEGRATION
+
+void Sim_Integrator::InitializeMemImplicit()
+{
+	//Current iterate, newton solution and line search trial velocities
+	m_DxDt_Tmp = new Vector3[m_NumTotal * 3];
+	memset(m_DxDt_Tmp, 0, m_NumTotal * 3 * sizeof(Vector3));
+}
+
+bool Sim_Integrator::IntegrateImplicit()
+{
+	Vector3* v = m_DxDt_Tmp;
+	Vector3* v_newton = &m_DxDt_Tmp[m_NumTotal];
+	Vector3* v_trial = &m_DxDt_Tmp[m_NumTotal * 2];
+
+	//Simulations without newton support still get a linearly implicit step
+	if (!m_Sim->SupportsImplicit())
+	{
+		m_NumSolverCalls++;
+		if (!m_Sim->StepSimulation(m_SubTimestep, m_Gravity, m_X, m_DxDt, v))
+			return false;
+
+		memcpy(m_DxDt, v, m_NumTotal * sizeof(Vector3));
+
+		TaskScheduler::Instance()->ParallelFor(0, (int)m_NumTotal, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				m_X[i] += m_DxDt[i] * m_SubTimestep;
+			}
+		});
+		return true;
+	}
+
+	const float min_step_length = 1.f / 16.f;
+	const float sufficient_decrease = 0.0001f;
+
+	//Start from the previous velocity, i.e. assume the motion continues
+	memcpy(v, m_DxDt, m_NumTotal * sizeof(Vector3));
+	memcpy(v_newton, m_DxDt, m_NumTotal * sizeof(Vector3));
+
+	float residual = m_Sim->BuildImplicitSystem(m_SubTimestep, m_Gravity, m_X, m_DxDt, v);
+	const float target = residual * m_NewtonTolerance;
+
+	for (int itr = 0; itr < m_MaxNewtonIterations && residual > target; ++itr)
+	{
+		m_NumSolverCalls++;
+		m_NumNewtonIterations++;
+		if (!m_Sim->SolveImplicitSystem(v, v_newton))
+			return false;
+
+		//Backtracking line search on the residual norm, the trial that is accepted
+		// leaves its linearization built for the next newton step
+		float step_length = 1.f;
+		float trial_residual;
+		for (;;)
+		{
+			TaskScheduler::Instance()->ParallelFor(0, (int)m_NumTotal, 0, [&](int first, int last)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					v_trial[i] = v[i] + (v_newton[i] - v[i]) * step_length;
+				}
+			});
+
+			trial_residual = m_Sim->BuildImplicitSystem(m_SubTimestep, m_Gravity, m_X, m_DxDt, v_trial);
+			if (trial_residual <= (1.f - sufficient_decrease * step_length) * residual || step_length <= min_step_length)
+				break;
+
+			step_length *= 0.5f;
+		}
+
+		if (trial_residual != trial_residual)
+			return false;
+
+		std::swap(v, v_trial);
+		residual = trial_residual;
 	}
 
+	memcpy(m_DxDt, v, m_NumTotal * sizeof(Vector3));
+
+	TaskScheduler::Instance()->ParallelFor(0, (int)m_NumTotal, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			m_X[i] += m_DxDt[i] * m_SubTimestep;
+		}
+	});
+
 	return true;
 }
 
-#pragma endregion RK4_INTEGRATION
\ No newline at end of file
+#pragma endregion IMPLICIT_INTEGRATION
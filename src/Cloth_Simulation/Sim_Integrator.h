@@ -1,24 +1,54 @@
 #pragma once
 #include <glcore\Vector3.h>
 #include <functional>
+#include <vector>
 #include "SimulationDefines.h"
 #include "Sim_Generator.h"
 #include "ProfilingTimer.h"
 
 #define DEFAULT_SUB_TIMESTEP 0.0005f//(1.f / 920.f)
+#define DEFAULT_ADAPTIVE_TOLERANCE 0.00001f	//Max local position error (m) per sub-step
 
 enum Sim_Integrator_Type
 {
 	Sim_Integrator_Type_Explicit = 0,
 	Sim_Integrator_Type_RK2 = 1,
-	Sim_Integrator_Type_RK4 = 2
+	Sim_Integrator_Type_RK4 = 2,
+	Sim_Integrator_Type_Implicit = 3		//Backward euler, newton iterations with line search
 };
 
+#define DEFAULT_IMPLICIT_SUB_TIMESTEP (1.f / 60.f)
+
+enum Sim_Integrator_Engine
+{
+	Sim_Integrator_Engine_Dynamic = 0,		//Scheme bound through std::function, called per sub-step
+	Sim_Integrator_Engine_Static = 1		//Scheme compiled into the sub-step loop (see Sim_IntegratorPolicies.h)
+};
+
+//Run after every completed sub-step with the sub-step size and the (modifiable) state, e.g. for collision response
+// - If 'modified' is given the index of every phyxel moved is appended to it, so a caller that has already
+//   staged the next sub-step only needs to re-stage those
+typedef std::function<void(float dt, Vector3* x, Vector3* dxdt, std::vector<uint>* modified)> Sim_Integrator_SubstepCallback;
+
 class Sim_Integratable
 {
 public:
 	//Returns true if successful or false for explosion
 	virtual bool StepSimulation(float dt, const Vector3& gravity, const Vector3* in_x, const Vector3* in_dxdt, Vector3* out_dxdt) = 0;
+
+	//Implicit (backward euler) support, falls back to StepSimulation if not implemented
+	// - BuildImplicitSystem linearizes M(v - v0) - dt * f(x0 + dt * v) = 0 about v and returns the residual norm
+	// - SolveImplicitSystem solves the system from the last build, giving the next newton iterate of v
+	virtual bool SupportsImplicit() { return false; }
+	virtual float BuildImplicitSystem(float dt, const Vector3& gravity, const Vector3* x0, const Vector3* v0, const Vector3* v) { return 0.f; }
+	virtual bool SolveImplicitSystem(const Vector3* guess, Vector3* out_v) { return false; }
+
+	//Batched sub-stepping for the explicit scheme, advances x and dxdt in place by num_substeps steps of
+	// dxdt = StepSimulation(dt, x, dxdt), x += dxdt * dt so per-call setup is paid once per batch
+	// - on_substep (if bound) is run inside the batch after every sub-step, with the velocity the next sub-step starts from
+	// - Returns the number of sub-steps completed, fewer than num_substeps if the simulation exploded
+	virtual bool SupportsBatchedSubsteps() { return false; }
+	virtual int AdvanceSubsteps(int num_substeps, float dt, const Vector3& gravity, Vector3* x, Vector3* dxdt, const Sim_Integrator_SubstepCallback& on_substep) { return 0; }
 };
 
 class Sim_Integrator
@@ -33,6 +63,24 @@ public:
 	void SetSubTimestep(float sub_timestep) { m_SubTimestep = sub_timestep; }
 	float& GetSubTimestep() { return m_SubTimestep; }
 
+	//Adaptive mode grows/shrinks the sub-timestep between min_timestep and max_timestep based on
+	// an embedded error estimate, rejecting (and rolling back) steps that fail or exceed the tolerance
+	bool& GetAdaptiveTimestep() { return m_AdaptiveTimestep; }
+	void SetAdaptiveTimestep(bool adaptive) { m_AdaptiveTimestep = adaptive; }
+	float& GetAdaptiveTolerance() { return m_AdaptiveTolerance; }
+	void SetAdaptiveTolerance(float tolerance) { m_AdaptiveTolerance = tolerance; }
+	int GetNumRejectedSteps() { return m_NumRejectedSteps; }
+
+	//Implicit integration, newton stops once the residual drops by the given factor
+	int& GetMaxNewtonIterations() { return m_MaxNewtonIterations; }
+	float& GetNewtonTolerance() { return m_NewtonTolerance; }
+	int GetNumNewtonIterations() { return m_NumNewtonIterations; }
+
+	//Static engine covers explicit/RK2/RK4 fixed sub-stepping (explicit is batched if the simulation supports it),
+	// everything else runs through the dynamic path
+	Sim_Integrator_Engine& GetEngine() { return m_Engine; }
+	void SetEngine(Sim_Integrator_Engine engine) { m_Engine = engine; }
+
 	Sim_Integrator_Type& GetIntergrationType() { return m_IntegrationType; }
 	void SetIntegrationType(Sim_Integrator_Type type);
 	float& GetElapsedTime() { return m_TimeElapsedTotal; }
@@ -40,6 +88,11 @@ public:
 
 	void SetOnStepCompleteCallback(const std::function<void(Sim_Integrator*)>& callback) { m_CallbackOnStepComplete = callback; }
 
+	//Called after every completed sub-step, e.g. for collision response
+	// - Batched stepping runs it inside the batch and the static engine keeps staging the next sub-step in
+	//   the update pass, re-staging only the phyxels the callback reports as moved
+	void SetOnSubstepCompleteCallback(const Sim_Integrator_SubstepCallback& callback) { m_CallbackOnSubstepComplete = callback; }
+
 	ProfilingTimer& GetTotalTimer() { return m_ProfilingTotalTime; }
 
 	Vector3* X() { return m_X; }
@@ -51,6 +104,12 @@ public:
 protected:
 	void InitIntegrationTypeMem();
 
+	void UpdateSimulationFixed();
+	template <class Policy> void UpdateSimulationStatic();
+	void UpdateSimulationBatched();
+	void UpdateSimulationAdaptive();
+	float EstimateStepError(const Vector3* dxdt_old, const Vector3* dxdt_new, float dt);
+
 	void InitializeMemExplicit();
 	bool IntegrateExplicit();
 
@@ -61,8 +120,13 @@ protected:
 	void InitializeMemRK4();
 	bool IntegrateRK4();
 
+	void InitializeMemImplicit();
+	bool IntegrateImplicit();
+
 protected:
 	std::function<void(Sim_Integrator*)> m_CallbackOnStepComplete;
+	Sim_Integrator_SubstepCallback m_CallbackOnSubstepComplete;
+	std::vector<uint> m_SubstepModified;
 	std::function<void()> m_FuncInitMem;
 	std::function<bool()> m_FuncIntegrate;
 
@@ -70,20 +134,35 @@ protected:
 
 	float m_SubTimestep;
 	float m_TimeAccum;
+
+	bool  m_AdaptiveTimestep;
+	float m_AdaptiveTolerance;
+	int   m_NumRejectedSteps;
+
+	int   m_MaxNewtonIterations;
+	float m_NewtonTolerance;
+	int   m_NumNewtonIterations;
 	float m_TimeElapsedTotal;
 	Sim_Integratable* m_Sim;
 
 	Sim_Integrator_Type m_IntegrationType;
+	Sim_Integrator_Engine m_Engine;
 
 	unsigned int m_NumTotal;
+	unsigned int m_NumPhyxels;
 	Vector3* m_X;
 	Vector3* m_DxDt;
 
+	//State at the start of the current sub-step, restored if the adaptive step is rejected
+	Vector3* m_X_Rollback;
+	Vector3* m_DxDt_Rollback;
+
 	Vector3* m_X_Tmp;
 	Vector3* m_DxDt_Tmp;	
 
 	int m_NumSolverCalls;
 	ProfilingTimer m_ProfilingTotalTime;
 
-	const std::vector<std::function<void(float elapsed, Vector3* x, Vector3* dxdt)>>* m_Actuators;
+	const Sim_Generator_Output* m_Configuration;
+	const std::vector<Sim_Generator_Actuator>* m_Actuators;
 };
\ No newline at end of file
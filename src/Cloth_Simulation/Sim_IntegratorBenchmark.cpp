@@ -0,0 +1,64 @@
+#include "Sim_IntegratorBenchmark.h"
+#include <glcore\NCLDebug.h>
+
+class Sim_NullIntegratable : public Sim_Integratable
+{
+public:
+	Sim_NullIntegratable(uint num_dofs) : m_NumDofs(num_dofs) {}
+
+	virtual bool StepSimulation(float dt, const Vector3& gravity, const Vector3* in_x, const Vector3* in_dxdt, Vector3* out_dxdt) override
+	{
+		memcpy(out_dxdt, in_dxdt, m_NumDofs * sizeof(Vector3));
+		return true;
+	}
+
+protected:
+	uint m_NumDofs;
+};
+
+float Sim_IntegratorBenchmark::TimeEngine(Sim_Integrator_Engine engine, Sim_Integrator_Type type, const Sim_Generator_Output& config, uint num_substeps)
+{
+	Sim_NullIntegratable sim((uint)config.Phyxels.size());
+
+	Sim_Integrator integrator;
+	integrator.Initialize(&sim, config);
+	integrator.SetIntegrationType(type);
+	integrator.SetEngine(engine);
+	integrator.SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+
+	//Warm up (page in buffers, spin up the omp thread pool)
+	integrator.UpdateSimulation(DEFAULT_SUB_TIMESTEP * 8.5f);
+
+	//Single update so the whole batch goes through one call, as a real frame would
+	integrator.UpdateSimulation(DEFAULT_SUB_TIMESTEP * (num_substeps + 0.5f));
+
+	return integrator.GetTotalTimer().GetTimedMilliSeconds() * 1000.f / (float)num_substeps;
+}
+
+Sim_IntegratorBenchmark::Result Sim_IntegratorBenchmark::Run(Sim_Integrator_Type type, uint num_dofs, uint num_substeps)
+{
+	Sim_Generator_Output config;
+	config.Release();
+	config.NumVertices = num_dofs;
+	config.Phyxels.resize(num_dofs, Vector3(0.f, 0.f, 0.f));
+	config.Phyxels_Initial = config.Phyxels;
+
+	Result result;
+	result.dynamic_us = TimeEngine(Sim_Integrator_Engine_Dynamic, type, config, num_substeps);
+	result.static_us = TimeEngine(Sim_Integrator_Engine_Static, type, config, num_substeps);
+	return result;
+}
+
+void Sim_IntegratorBenchmark::RunAll(uint num_dofs, uint num_substeps)
+{
+	const char* names[] = { "Explicit", "RK2", "RK4" };
+	const Sim_Integrator_Type types[] = { Sim_Integrator_Type_Explicit, Sim_Integrator_Type_RK2, Sim_Integrator_Type_RK4 };
+
+	NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "Integrator overhead (%d dofs, %d sub-steps):", num_dofs, num_substeps);
+	for (int i = 0; i < 3; ++i)
+	{
+		Result r = Run(types[i], num_dofs, num_substeps);
+		float speedup = (r.static_us > 0.f) ? r.dynamic_us / r.static_us : 0.f;
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    %-8s dynamic: %7.2fus  static: %7.2fus  (x%4.2f)", names[i], r.dynamic_us, r.static_us, speedup);
+	}
+}
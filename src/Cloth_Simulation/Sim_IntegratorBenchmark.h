@@ -0,0 +1,22 @@
+#pragma once
+#include "Sim_Integrator.h"
+
+//Measures the integrators own per sub-step cost (dispatch, stage loops, actuator checks) by driving
+// both engines with a simulation that does no work beyond copying the velocities through
+class Sim_IntegratorBenchmark
+{
+public:
+	struct Result
+	{
+		float dynamic_us;		//Average microseconds per sub-step
+		float static_us;
+	};
+
+	static Result Run(Sim_Integrator_Type type, uint num_dofs, uint num_substeps);
+
+	//Runs explicit/RK2/RK4 and writes the results to the debug log
+	static void RunAll(uint num_dofs = 10000, uint num_substeps = 2000);
+
+protected:
+	static float TimeEngine(Sim_Integrator_Engine engine, Sim_Integrator_Type type, const Sim_Generator_Output& config, uint num_substeps);
+};
@@ -0,0 +1,183 @@
+#pragma once
+#include "Sim_Integrator.h"
+#include <glcore\TaskScheduler.h>
+#include <algorithm>
+
+//Statically dispatched integration schemes used by Sim_Integrator_Engine_Static
+// - The scheme is picked once per UpdateSimulation call and the sub-step loop is compiled per policy,
+//   so there is no std::function call (or possible heap allocated binding) per sub-step
+// - Each policy provides:
+//		Begin(state)				- Stage positions for the first solve of a sub-step
+//		Step(state, prepare_next)	- One full sub-step, if prepare_next is set the final update loop also
+//									  performs Begin() for the following sub-step (one pass over X instead of two)
+//		Restage(state, idx, n)		- Redo the staging of a prepared sub-step for the n phyxels in idx, after the
+//									  sub-step callback has moved them
+// - Buffers are the integrators own (m_X, m_DxDt, m_X_Tmp, m_DxDt_Tmp) so engines can be switched at any time
+
+struct Sim_IntegratorState
+{
+	Sim_Integratable* sim;
+	Vector3 gravity;
+	float dt;
+	int num_total;
+
+	Vector3* x;
+	Vector3* dxdt;
+	Vector3* x_tmp;
+	Vector3* dxdt_tmp;
+};
+
+struct Sim_IntegratorPolicy_Explicit
+{
+	static const int NumStages = 1;
+
+	static inline void Begin(Sim_IntegratorState& s) {}
+	static inline void Restage(Sim_IntegratorState& s, const uint* idx, uint n) {}
+
+	static inline bool Step(Sim_IntegratorState& s, bool prepare_next)
+	{
+		if (!s.sim->StepSimulation(s.dt, s.gravity, s.x, s.dxdt, s.dxdt_tmp))
+			return false;
+
+		std::swap(s.dxdt, s.dxdt_tmp);
+
+		const float dt = s.dt;
+		Vector3* x = s.x;
+		const Vector3* dxdt = s.dxdt;
+
+		TaskScheduler::Instance()->ParallelFor(0, s.num_total, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				x[i] += dxdt[i] * dt;
+			}
+		});
+		return true;
+	}
+};
+
+struct Sim_IntegratorPolicy_RK2
+{
+	static const int NumStages = 1;
+
+	//Solved at the start of the sub-step (see Sim_Integrator::IntegrateRK2), so there is nothing to stage
+	static inline void Begin(Sim_IntegratorState& s) {}
+	static inline void Restage(Sim_IntegratorState& s, const uint* idx, uint n) {}
+
+	static inline bool Step(Sim_IntegratorState& s, bool prepare_next)
+	{
+		const float dt = s.dt;
+		const float half_timestep = dt * 0.5f;
+
+		if (!s.sim->StepSimulation(half_timestep, s.gravity, s.x, s.dxdt, s.dxdt_tmp))
+			return false;
+
+		std::swap(s.dxdt, s.dxdt_tmp);
+
+		Vector3* x = s.x;
+		const Vector3* dxdt = s.dxdt;
+
+		TaskScheduler::Instance()->ParallelFor(0, s.num_total, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				x[i] += dxdt[i] * dt;
+			}
+		});
+		return true;
+	}
+};
+
+struct Sim_IntegratorPolicy_RK4
+{
+	static const int NumStages = 3;
+
+	static inline void Begin(Sim_IntegratorState& s)
+	{
+		const float half_timestep = s.dt * 0.5f;
+		const Vector3* x = s.x;
+		const Vector3* dxdt = s.dxdt;
+		Vector3* x_tmp = s.x_tmp;
+
+		TaskScheduler::Instance()->ParallelFor(0, s.num_total, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				x_tmp[i] = x[i] + dxdt[i] * half_timestep;
+			}
+		});
+	}
+
+	static inline void Restage(Sim_IntegratorState& s, const uint* idx, uint n)
+	{
+		const float half_timestep = s.dt * 0.5f;
+		for (uint j = 0; j < n; ++j)
+		{
+			uint i = idx[j];
+			s.x_tmp[i] = s.x[i] + s.dxdt[i] * half_timestep;
+		}
+	}
+
+	static inline bool Step(Sim_IntegratorState& s, bool prepare_next)
+	{
+		const int n = s.num_total;
+		const float dt = s.dt;
+		const float half_timestep = dt * 0.5f;
+
+		Vector3* x = s.x;
+		Vector3* x_tmp = s.x_tmp;
+		Vector3* k1 = s.dxdt;
+		Vector3* k2 = s.dxdt_tmp;
+		Vector3* k3 = &s.dxdt_tmp[n];
+		Vector3* k4 = &s.dxdt_tmp[n * 2];
+
+		bool success = s.sim->StepSimulation(half_timestep, s.gravity, x_tmp, k1, k2);
+
+		TaskScheduler::Instance()->ParallelFor(0, n, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				x_tmp[i] = x[i] + k2[i] * half_timestep;
+			}
+		});
+		success &= s.sim->StepSimulation(half_timestep, s.gravity, x_tmp, k2, k3);
+
+		TaskScheduler::Instance()->ParallelFor(0, n, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				x_tmp[i] = x[i] + k3[i] * dt;
+			}
+		});
+		success &= s.sim->StepSimulation(dt, s.gravity, x_tmp, k3, k4);
+
+		//As the legacy path, the combined update is applied even if a stage failed
+		if (success && prepare_next)
+		{
+			TaskScheduler::Instance()->ParallelFor(0, n, 0, [&](int first, int last)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					Vector3 v = (k1[i] + (k2[i] + k3[i]) * 2.f + k4[i]) / 6.f;
+					Vector3 xi = x[i] + v * dt;
+					k1[i] = v;
+					x[i] = xi;
+					x_tmp[i] = xi + v * half_timestep;
+				}
+			});
+		}
+		else
+		{
+			TaskScheduler::Instance()->ParallelFor(0, n, 0, [&](int first, int last)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					k1[i] = (k1[i] + (k2[i] + k3[i]) * 2.f + k4[i]) / 6.f;
+					x[i] += k1[i] * dt;
+				}
+			});
+		}
+
+		return success;
+	}
+};
@@ -0,0 +1,256 @@
+#include "Sim_KernelBenchmark.h"
+#include <glcore\NCLDebug.h>
+#include <glcore\TaskScheduler.h>
+
+#define SIM_KERNELBENCHMARK_MIN_MS		20.0f	//Each kernel is repeated until at least this long has been timed
+#define SIM_KERNELBENCHMARK_MIN_CALLS	3
+
+float Sim_KernelBenchmark::TimeKernel(const std::function<void()>& kernel)
+{
+	//Warm up (page in buffers, wake the workers/omp threads)
+	kernel();
+
+	ProfilingTimer timer;
+	timer.BeginTiming();
+
+	uint num_calls = 0;
+	float elapsed_ms = 0.0f;
+	do
+	{
+		kernel();
+		num_calls++;
+
+		timer.EndTiming();
+		elapsed_ms = timer.GetTimedMilliSeconds();
+	} while (elapsed_ms < SIM_KERNELBENCHMARK_MIN_MS || num_calls < SIM_KERNELBENCHMARK_MIN_CALLS);
+
+	return elapsed_ms * 1000.0f / (float)num_calls;
+}
+
+Sim_KernelBenchmark::Kernel Sim_KernelBenchmark::MakeKernel(float us, double flops, double bytes)
+{
+	Kernel kernel;
+	kernel.us = us;
+	kernel.gflops = (us > 0.0f) ? (float)(flops / (us * 1e3)) : 0.0f;
+	kernel.gbs = (us > 0.0f) ? (float)(bytes / (us * 1e3)) : 0.0f;
+	return kernel;
+}
+
+float Sim_KernelBenchmark::MeasureStreamBandwidth(uint num_floats)
+{
+	std::vector<float> a(num_floats, 0.0f), b(num_floats, 1.0f), c(num_floats, 2.0f);
+	float* pa = &a[0];
+	const float* pb = &b[0];
+	const float* pc = &c[0];
+	const float scalar = 3.0f;
+
+	//Same threading as the vector passes of the solver
+	float us = TimeKernel([&]()
+	{
+		TaskScheduler::Instance()->ParallelFor(0, (int)num_floats, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				pa[i] = pb[i] + scalar * pc[i];
+			}
+		});
+	});
+
+	//As STREAM, write allocate traffic is not counted
+	return MakeKernel(us, 2.0 * num_floats, 3.0 * sizeof(float) * num_floats).gbs;
+}
+
+Sim_KernelBenchmark::Result Sim_KernelBenchmark::Run(Sim_Type type, uint grid_size, bool symmetric_storage)
+{
+	Result result;
+	memset(&result, 0, sizeof(Result));
+
+	//Pinned along the top as the default scene, so the constraints are representative
+	Sim_Generator_Output config;
+	Sim_Simulation* sim = Sim_Manager::CreateHeadlessSimulation(type, grid_size, false, config, [&](Sim_Simulation* s)
+	{
+		s->SetSymmetricStorage(symmetric_storage);
+	});
+	if (sim == NULL || sim->Solver() == NULL)
+	{
+		if (sim) delete sim;
+		return result;
+	}
+
+	//One sub-step assembles A, B, the constraints and preconditioner
+	Sim_Integrator integrator;
+	integrator.Initialize(sim, config);
+	integrator.SetIntegrationType(Sim_Integrator_Type_Explicit);
+	integrator.SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+	integrator.UpdateSimulation(DEFAULT_SUB_TIMESTEP * 1.5f);
+
+	MPCG<SparseRowMatrix<Matrix3>>* solver = sim->Solver();
+	SparseRowMatrix<Matrix3>& A = solver->m_A;
+	const std::vector<Matrix3>& constraints = solver->m_Constraints;
+	const std::vector<Matrix3>& precondition = solver->m_PreCondition;
+	const int n = (int)A.m_Rows.size();
+
+	uint num_diagonal = 0;
+	for (int row = 0; row < n; ++row)
+	{
+		result.num_blocks += (uint)A.m_Rows[row].size();
+		for (const SparseRowMatrixItem<Matrix3>& item : A.m_Rows[row])
+			num_diagonal += (item.column == (uint)row) ? 1 : 0;
+	}
+	result.num_rows = (uint)n;
+
+	const double full_blocks = A.is_symmetric() ? 2.0 * result.num_blocks - num_diagonal : (double)result.num_blocks;
+	const double block_bytes = (double)result.num_blocks * sizeof(SparseRowMatrixItem<Matrix3>);
+	const double m3 = sizeof(Matrix3), v3 = sizeof(Vector3);
+
+	//Vectors as the solver would see them mid-solve, B stands in for anything non-zero
+	std::vector<Vector3> x(solver->m_B), r(solver->m_B), z(n), p(solver->m_B), ap(n);
+
+	//out = S A u, Dot(u, out)
+	float spmv_us = TimeKernel([&]() { A.SolveAMultU(ap, constraints, p); });
+
+	//Symmetric storage writes A u to a temporary and back, and each parts halo is cleared, written and added on
+	const double halo = A.is_symmetric() ? (double)A.num_halo_rows() : 0.0;
+	const double symmetric_flops = 3.0 * halo;
+	const double symmetric_bytes = A.is_symmetric() ? 2.0 * v3 * (n + halo) : 0.0;
+
+	result.spmv = MakeKernel(spmv_us,
+		18.0 * full_blocks + 21.0 * n + symmetric_flops,
+		block_bytes + n * (m3 + 2.0 * v3) + symmetric_bytes);
+
+	//Two products per block ((I - S)x is formed on the fly) and the preconditioned residual per row
+	// - Symmetric storage forms (I - S)x up front and runs two full products, reading the blocks twice
+	const double residual_flops = 57.0 * full_blocks + 102.0 * n + 2.0 * symmetric_flops;
+	const double residual_bytes = block_bytes + n * (2.0 * m3 + 4.0 * v3)
+		+ (A.is_symmetric() ? block_bytes + 2.0 * v3 * n + 2.0 * symmetric_bytes : 0.0);
+	result.residual = MakeKernel(TimeKernel([&]()
+		{
+			float r0z0, beta;
+			A.SolveAMultX(r, z, r0z0, beta, constraints, precondition, solver->m_B, x);
+		}),
+		residual_flops, residual_bytes);
+
+	//The per iteration vector passes, same loops as MPCG::Solve_Algorithm
+	const float alpha = 1e-3f, change = 0.5f;
+	result.update = MakeKernel(TimeKernel([&]()
+		{
+			TaskScheduler::Instance()->ParallelReduce(0, n, 0, 0.f, [&](int first, int last)
+			{
+				float partial = 0.f;
+				for (int row = first; row < last; ++row)
+				{
+					x[row] += p[row] * alpha;
+					r[row] -= ap[row] * alpha;
+
+					partial += Vector3::Dot(r[row], precondition[row] * r[row]);
+				}
+				return partial;
+			});
+		}),
+		33.0 * n,
+		n * (m3 + 6.0 * v3));
+
+	result.precondition = MakeKernel(TimeKernel([&]()
+		{
+			TaskScheduler::Instance()->ParallelReduce(0, n, 0, 0.f, [&](int first, int last)
+			{
+				float partial = 0.f;
+				for (int row = first; row < last; ++row)
+				{
+					InplaceMatrix3MultVector3(&z[row], precondition[row], r[row]);
+					partial += Vector3::Dot(z[row], r[row]);
+				}
+				return partial;
+			});
+		}),
+		21.0 * n,
+		n * (m3 + 2.0 * v3));
+
+	result.direction = MakeKernel(TimeKernel([&]()
+		{
+			TaskScheduler::Instance()->ParallelFor(0, n, 0, [&](int first, int last)
+			{
+				for (int row = first; row < last; ++row)
+				{
+					Vector3 temp = (z[row] + p[row] * change);
+					InplaceMatrix3MultVector3(&p[row], constraints[row], temp);
+				}
+			});
+		}),
+		21.0 * n,
+		n * (m3 + 3.0 * v3));
+
+	//Whole solve, the multigrid is only timed. Without it the rates follow from the kernels above and the iterations taken.
+	std::vector<Vector3> guess(n, Vector3(0.0f, 0.0f, 0.0f));
+	MPCG_Preconditioner<SparseRowMatrix<Matrix3>>* multigrid = solver->GetPreconditioner();
+	if (multigrid != NULL)
+	{
+		result.multigrid_us = TimeKernel([&]() { solver->SolveWithGuess(&guess[0]); });
+		result.multigrid_iterations = solver->GetIterations();
+		solver->SetPreconditioner(NULL);
+	}
+
+	float solve_us = TimeKernel([&]() { solver->SolveWithGuess(&guess[0]); });
+	result.solve_iterations = solver->GetIterations();
+	solver->SetPreconditioner(multigrid);
+
+	const double iteration_flops = 18.0 * full_blocks + symmetric_flops + (21.0 + 33.0 + 21.0 + 21.0) * n;
+	const double iteration_bytes = block_bytes + symmetric_bytes + n * (4.0 * m3 + 13.0 * v3);
+	result.solve = MakeKernel(solve_us,
+		residual_flops + iteration_flops * result.solve_iterations,
+		residual_bytes + iteration_bytes * result.solve_iterations);
+
+	delete sim;
+	return result;
+}
+
+void Sim_KernelBenchmark::RunAll(Sim_Type type, uint max_grid_size)
+{
+	const char* sim_type_names[] = { "FE6NodedC0", "FE6NodedC1", "FE6NodedC1_v2", "PBD3NodedC0" };
+	if (type >= Sim_Type_NULL)
+		return;
+
+	float stream_gbs = MeasureStreamBandwidth();
+	TaskScheduler* scheduler = TaskScheduler::Instance();
+	NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "Solver kernels (%s, %d threads), stream triad %.2f GB/s:", sim_type_names[type], scheduler->GetNumThreads(), stream_gbs);
+
+	auto log_kernel = [&](const char* name, const Kernel& k)
+	{
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "        %-12s %10.2fus  %6.2f GFLOP/s  %6.2f GB/s (%3.0f%% of stream)",
+			name, k.us, k.gflops, k.gbs, (stream_gbs > 0.0f) ? 100.0f * k.gbs / stream_gbs : 0.0f);
+	};
+
+	//Upper triangle storage is only measured for elements whose tangent stiffness is symmetric
+	Sim_Simulation* probe = Sim_Manager::CreateSimulation(type);
+	const int num_storages = (probe != NULL && probe->GetSymmetricStorageAvailable()) ? 2 : 1;
+	delete probe;
+	if (num_storages == 1)
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    full storage only, the tangent stiffness is not symmetric");
+
+	for (uint grid_size = 1; grid_size <= max_grid_size; grid_size *= 2)
+	{
+		for (int symmetric = 0; symmetric < num_storages; ++symmetric)
+		{
+			Result r = Run(type, grid_size, symmetric != 0);
+			if (r.num_rows == 0)
+			{
+				NCLDebug::Log(Vector3(1.0f, 0.0f, 0.0f), "    %s has no system matrix", sim_type_names[type]);
+				return;
+			}
+
+			NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    %2dx%-2d %-9s  %d rows, %d blocks", grid_size, grid_size, symmetric ? "symmetric" : "full", r.num_rows, r.num_blocks);
+			log_kernel("SpMV", r.spmv);
+			log_kernel("Residual", r.residual);
+			log_kernel("Update", r.update);
+			log_kernel("Precondition", r.precondition);
+			log_kernel("Direction", r.direction);
+			NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "        %-12s %10.2fus  %6.2f GFLOP/s  %6.2f GB/s (%3.0f%% of stream), %d iterations, multigrid off",
+				"Solve", r.solve.us, r.solve.gflops, r.solve.gbs, (stream_gbs > 0.0f) ? 100.0f * r.solve.gbs / stream_gbs : 0.0f, r.solve_iterations);
+			if (r.multigrid_iterations > 0)
+			{
+				NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "        %-12s %10.2fus  (V-cycles not modelled), %d iterations",
+					"Solve (MG)", r.multigrid_us, r.multigrid_iterations);
+			}
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "Sim_Manager.h"
+#include <functional>
+
+//Times the solvers kernels in isolation on system matrices assembled by the simulations themselves, so
+// they can be compared against the machines streaming bandwidth (how far from roofline they are)
+// - FLOP counts are nominal, for the single precision path and the full matrix (symmetric storage does the
+//   same useful work from half the blocks), so GFLOP/s is comparable between layouts
+// - Bytes are the compulsory traffic, every stored block and vector touched exactly once. Small matrices
+//   fit in cache and can exceed the streaming bandwidth.
+// - Symmetric storage also counts the vectors its products go through (A u is formed whole before the
+//   constraints are applied) and the per part halos of MultiplySymmetric
+class Sim_KernelBenchmark
+{
+public:
+	struct Kernel
+	{
+		float us;			//Per call
+		float gflops;
+		float gbs;
+	};
+
+	struct Result
+	{
+		uint	num_rows;			//3x3 block rows
+		uint	num_blocks;			//Stored blocks, the upper triangle only for symmetric storage
+
+		Kernel	spmv;				//SolveAMultU, as MPCG::MultiplyA each iteration
+		Kernel	residual;			//SolveAMultX, the initial residual of each solve
+		Kernel	update;				//x += p alpha, r -= Ap alpha and the error estimate
+		Kernel	precondition;		//z = M^-1 r and Dot(z, r)
+		Kernel	direction;			//p = S (z + p change)
+
+		//Whole MPCG solve from a zero guess at the solvers default settings with the multigrid preconditioner
+		// detached, so the solve is exactly the kernels above and the gap to their rates is solver overhead
+		Kernel	solve;
+		uint	solve_iterations;
+
+		//The same solve with the simulations multigrid, time only (the V-cycles are not modelled). 0 if it has none.
+		float	multigrid_us;
+		uint	multigrid_iterations;
+	};
+
+	//Streaming triad (a = b + s c) over arrays well outside of the caches, in GB/s
+	static float MeasureStreamBandwidth(uint num_floats = 1 << 23);
+
+	static Result Run(Sim_Type type, uint grid_size, bool symmetric_storage);
+
+	//Runs grid sizes 1 to max_grid_size (doubling) with full and, where available, symmetric storage and writes the results to the debug log
+	static void RunAll(Sim_Type type = Sim_Type_FE6NodedC1, uint max_grid_size = 16);
+
+protected:
+	static float TimeKernel(const std::function<void()>& kernel);	//Average microseconds per call
+	static Kernel MakeKernel(float us, double flops, double bytes);
+};
@@ -4,20 +4,30 @@
 #include "Sim_6NodedC1_v2.h"
 #include "Sim_PBD.h"
 #include "Generator_Square_Grid.h"
+#include "Generator_Square_Grid_BendTest.h"
 
 Sim_Manager::Sim_Manager(const std::string& friendly_name) 
 	: Object(friendly_name)
 	, m_Renderer(NULL)
 	, m_Integrator(NULL)
 	, m_Simulation(NULL)
+	, m_Collision(NULL)
+	, m_SelfCollision(NULL)
+	, m_ReorderMode(Sim_Reorder_RCM)
+	, m_Active(true)
+	, m_Threaded(false)
 {
 	m_Renderer = new Sim_Renderer();
 	m_Integrator = new Sim_Integrator();
+	m_Collision = new Sim_Collision();
+	m_SelfCollision = new Sim_SelfCollision();
 	m_Generator = new Generator_Square_Grid();
 	m_Generator->Generate(m_BaseConfiguration);
+	Sim_Reordering::Apply(m_BaseConfiguration, m_ReorderMode);
 	m_SimType = Sim_Type_NULL;
 
-	m_Integrator->SetOnStepCompleteCallback(std::bind(&Sim_Renderer::BuildVertexBuffer, m_Renderer, std::placeholders::_1));
+	//The vertex buffer upload needs the GL context, so the rebuild waits for OnUpdateObject to pick up the snapshot
+	m_Integrator->SetOnStepCompleteCallback([this](Sim_Integrator*) { PublishSnapshot(); });
 
 	SetSimType(Sim_Type_FE6NodedC1);
 
@@ -41,6 +51,16 @@ Sim_Manager::~Sim_Manager()
 		delete m_Simulation;
 		m_Simulation = NULL;
 	}
+	if (m_Collision)
+	{
+		delete m_Collision;
+		m_Collision = NULL;
+	}
+	if (m_SelfCollision)
+	{
+		delete m_SelfCollision;
+		m_SelfCollision = NULL;
+	}
 }
 
 void Sim_Manager::SetSimType(Sim_Type type)
@@ -53,30 +73,66 @@ void Sim_Manager::SetSimType(Sim_Type type)
 		m_SimType = Sim_Type_NULL;
 	}
 
+	m_Simulation = CreateSimulation(type);
+	m_SimType = type;
+
+	if (m_Simulation != NULL)
+	{
+		m_Simulation->SetMaterial(m_Material);
+		if (m_Simulation->Solver() != NULL)
+			m_Simulation->Solver()->SetSettings(m_SolverSettings);
+	}
+
+	Reset();
+}
+
+Sim_Simulation* Sim_Manager::CreateSimulation(Sim_Type type)
+{
 	switch (type)
 	{
 	case Sim_Type_FE6NodedC0:
-		m_Simulation = new Sim_6NodedC0();
-		break;
+		return new Sim_6NodedC0();
 
 	case Sim_Type_FE6NodedC1:
-		m_Simulation =  new Sim_6NodedC1();
-		break;
+		return new Sim_6NodedC1();
 
 	case Sim_Type_FE6NodedC1_v2:
-		m_Simulation = new Sim_6NodedC1_v2();
-		break;
+		return new Sim_6NodedC1_v2();
 
 	case Sim_Type_PBD3NodedC0:
-		m_Simulation = new Sim_PBD();
-		break;
+		return new Sim_PBD();
 
 	default:
-		m_Simulation = NULL;
+		return NULL;
 	}
-	m_SimType = type;
+}
 
-	Reset();
+Sim_Simulation* Sim_Manager::CreateHeadlessSimulation(Sim_Type type, uint grid_size, bool bend_test, Sim_Generator_Output& out_config,
+	const std::function<void(Sim_Simulation*)>& configure)
+{
+	Sim_Simulation* sim = CreateSimulation(type);
+	if (sim == NULL)
+		return NULL;
+
+	Generator_Square_Grid_BendTest bend_gen;
+	Generator_Square_Grid grid_gen;
+	Generator_Square_Grid& gen = bend_test ? bend_gen : grid_gen;
+	gen.SetVisualSubdivisions(grid_size);
+
+	gen.Generate(out_config);
+	Sim_Reordering::Apply(out_config, Sim_Reorder_RCM);
+
+	if (configure)
+		configure(sim);
+	sim->Initialize(out_config);
+
+	if (!bend_test)
+	{
+		const int num_cols = (int)grid_size * 2 + 1;
+		sim->SetIsStatic(out_config.ReorderedIndex(gen.GetVertIdx(0, 0)), true);
+		sim->SetIsStatic(out_config.ReorderedIndex(gen.GetVertIdx(num_cols - 1, 0)), true);
+	}
+	return sim;
 }
 
 
@@ -98,27 +154,184 @@ void Sim_Manager::Generate()
 	{
 		m_BaseConfiguration.Release();
 		m_Generator->Generate(m_BaseConfiguration);
+		Sim_Reordering::Apply(m_BaseConfiguration, m_ReorderMode);
 
 		Reset();
 	}
 }
 
+void Sim_Manager::SetReorderMode(Sim_Reorder_Mode mode)
+{
+	if (mode != m_ReorderMode)
+	{
+		m_ReorderMode = mode;
+		Generate();
+	}
+}
+
 void Sim_Manager::Reset()
 {
 	if (m_Simulation != NULL)
 	{
 		m_Simulation->Initialize(m_BaseConfiguration);
 		m_Integrator->Initialize(m_Simulation, m_BaseConfiguration);
+		m_Collision->Initialize(m_BaseConfiguration, m_Simulation);
+		m_SelfCollision->Initialize(m_BaseConfiguration, m_Simulation);
+		UpdateCollisionCallback();
+
+		//Commands refer to the old state
+		{
+			std::lock_guard<std::mutex> lock(m_CommandMutex);
+			m_Commands.clear();
+		}
+
+		//Only called from the main thread with no update running, so it can publish and read back straight away
+		PublishSnapshot();
+		m_Snapshots.Acquire();
 
 		m_Renderer->SetSimulation(m_Simulation);
-		m_Renderer->AllocateBuffers(m_Integrator->X());
-		m_Renderer->BuildVertexBuffer(m_Integrator);
+		m_Renderer->AllocateBuffers(&Snapshot().x[0]);
+		m_Renderer->BuildVertexBuffer(&Snapshot().x[0]);
 	}
 }
 
-void Sim_Manager::OnRenderObject()
+void Sim_Manager::UpdateSimulation(float dt)
 {
 	if (m_Simulation != NULL)
+	{
+		m_Collision->GetTimer().ResetTotalMs();
+		m_SelfCollision->GetTimer().ResetTotalMs();
+		ApplyCommands();
+		m_Integrator->UpdateSimulation(dt);
+	}
+}
+
+void Sim_Manager::UpdateCommands()
+{
+	if (m_Simulation != NULL && ApplyCommands())
+	{
+		PublishSnapshot();
+	}
+}
+
+void Sim_Manager::SetThreaded(bool threaded)
+{
+	m_Threaded = threaded;
+	if (!m_Threaded)
+		UpdateCommands();
+}
+
+void Sim_Manager::QueueCommand(const Sim_Manager_Command& command)
+{
+	if (!m_Threaded)
+	{
+		command(this);
+		PublishSnapshot();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_CommandMutex);
+	m_Commands.push_back(command);
+}
+
+bool Sim_Manager::ApplyCommands()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_CommandMutex);
+		m_ExecutingCommands.swap(m_Commands);
+	}
+
+	if (m_ExecutingCommands.empty())
+		return false;
+
+	for (size_t i = 0; i < m_ExecutingCommands.size(); ++i)
+	{
+		m_ExecutingCommands[i](this);
+	}
+	m_ExecutingCommands.clear();
+	return true;
+}
+
+void Sim_Manager::PublishSnapshot()
+{
+	uint num_total = m_BaseConfiguration.NumVertices + m_BaseConfiguration.NumTangents;
+	const Vector3* x = m_Integrator->X();
+
+	Sim_Snapshot& snapshot = m_Snapshots.GetWriteBuffer();
+	snapshot.x.assign(x, x + num_total);
+	snapshot.is_static.resize(num_total);
+	for (uint i = 0; i < num_total; ++i)
+	{
+		snapshot.is_static[i] = m_Simulation->GetIsStatic(i) ? 1 : 0;
+	}
+	m_Snapshots.Publish();
+}
+
+void Sim_Manager::SetMaterial(const Sim_Material& material)
+{
+	m_Material = material;
+	if (m_Simulation != NULL)
+	{
+		m_Simulation->SetMaterial(m_Material);
+		Reset();
+	}
+}
+
+void Sim_Manager::SetSolverSettings(const MPCG_Settings& settings)
+{
+	m_SolverSettings = settings;
+	if (m_Simulation != NULL && m_Simulation->Solver() != NULL)
+		m_Simulation->Solver()->SetSettings(m_SolverSettings);
+}
+
+void Sim_Manager::AddObstacle(Object* obj, Sim_Collision_Shape shape)
+{
+	m_Collision->AddObstacle(obj, shape);
+	UpdateCollisionCallback();
+}
+
+void Sim_Manager::RemoveObstacle(Object* obj)
+{
+	m_Collision->RemoveObstacle(obj);
+	UpdateCollisionCallback();
+}
+
+void Sim_Manager::SetCollisionsEnabled(bool enabled)
+{
+	m_Collision->SetEnabled(enabled);
+	UpdateCollisionCallback();
+}
+
+void Sim_Manager::SetSelfCollisionsEnabled(bool enabled)
+{
+	m_SelfCollision->SetEnabled(enabled);
+	UpdateCollisionCallback();
+}
+
+void Sim_Manager::UpdateCollisionCallback()
+{
+	//Left unbound otherwise so the collision stages aren't run at all
+	bool collisions = m_Collision->GetEnabled() && m_Collision->GetNumObstacles() > 0;
+	bool self_collisions = m_SelfCollision->GetEnabled();
+	if (collisions || self_collisions)
+	{
+		Sim_Collision* collision = m_Collision;
+		Sim_SelfCollision* self_collision = m_SelfCollision;
+		m_Integrator->SetOnSubstepCompleteCallback([collision, self_collision](float dt, Vector3* x, Vector3* dxdt, std::vector<uint>* modified)
+		{
+			self_collision->ResolveCollisions(x, dxdt, modified);
+			collision->ResolveCollisions(x, dxdt, modified);
+		});
+	}
+	else
+	{
+		m_Integrator->SetOnSubstepCompleteCallback(Sim_Integrator_SubstepCallback());
+	}
+}
+
+void Sim_Manager::OnRenderObject()
+{
+	if (m_Simulation != NULL && m_Active)
 	{
 		m_Renderer->Render();
 	}
@@ -126,8 +339,8 @@ void Sim_Manager::OnRenderObject()
 
 void Sim_Manager::OnUpdateObject(float dt)
 {
-	if (m_Simulation != NULL)
+	if (m_Simulation != NULL && m_Snapshots.Acquire())
 	{
-		//m_Renderer->BuildVertexBuffer(m_Integrator->X());
+		m_Renderer->BuildVertexBuffer(&Snapshot().x[0]);
 	}
 }
\ No newline at end of file
@@ -2,8 +2,13 @@
 #include "Sim_Renderer.h"
 #include "Sim_Integrator.h"
 #include "Sim_Generator.h"
+#include "Sim_Reordering.h"
+#include "Sim_Collision.h"
+#include "Sim_SelfCollision.h"
+#include "Sim_TripleBuffer.h"
 #include <glcore\Object.h>
 #include "mpcg.h"
+#include <mutex>
 
 enum Sim_Type
 {
@@ -15,6 +20,19 @@ enum Sim_Type
 	Sim_Type_UNKNOWN
 };
 
+//State handed from the thread updating the simulation to the main thread after every update
+struct Sim_Snapshot
+{
+	std::vector<Vector3>	x;
+	std::vector<char>		is_static;
+};
+
+class Sim_Manager;
+typedef std::function<void(Sim_Manager* sim)> Sim_Manager_Command;
+
+struct Sim_FEQuadrature_Settings;
+struct Sim_FEAssembly_Settings;
+
 class Sim_Simulation : public Sim_Integratable, public Sim_Rendererable
 {
 public:
@@ -22,10 +40,26 @@ public:
 	virtual void Initialize(const Sim_Generator_Output& configuration) = 0;
 
 	virtual MPCG<SparseRowMatrix<Matrix3>>* Solver() = 0;
+	virtual Sim_FEQuadrature_Settings* Quadrature() { return NULL; }	//Finite element simulations only
+	virtual Sim_FEAssembly_Settings* Assembly() { return NULL; }		//Finite element simulations only
+
+	//Store only the upper triangle of the system matrix, ignored by simulations without one or whose
+	// tangent stiffness isn't symmetric (see GetSymmetricStorageAvailable)
+	virtual bool GetSymmetricStorageAvailable() { return false; }
+	virtual bool GetSymmetricStorage() { return false; }
+	virtual void SetSymmetricStorage(bool symmetric) {}
+
+	//Apply the element matrices directly instead of assembling the system matrix, ignored by simulations without one
+	virtual bool GetMatrixFree() { return false; }
+	virtual void SetMatrixFree(bool matrix_free) {}
 
 	virtual bool GetIsStatic(uint idx) = 0;
 	virtual void SetIsStatic(uint idx, bool is_static) = 0;
 
+	//Applied on the next Initialize
+	virtual const Sim_Material& GetMaterial() = 0;
+	virtual void SetMaterial(const Sim_Material& material) = 0;
+
 	//Profiling
 	virtual ProfilingTimer& GetTotalTimer() = 0;
 
@@ -42,15 +76,68 @@ public:
 	Sim_Type GetSimType() { return m_SimType; }
 	void SetSimType(Sim_Type type);
 
+	//New simulation of the given type, NULL if unknown. Also used by the headless sweeps/benchmarks.
+	static Sim_Simulation* CreateSimulation(Sim_Type type);
+
+	//Headless setup shared by the sweeps/benchmarks, the default scene without the renderer and collisions
+	// - Square grid (or the bending test, which pins itself) reordered with RCM and pinned at its two top corners
+	// - configure runs before Initialize, for settings that must be in place by then (material, solver, storage)
+	// - NULL if the type is unknown, otherwise the caller owns the simulation and out_config must outlive it
+	static Sim_Simulation* CreateHeadlessSimulation(Sim_Type type, uint grid_size, bool bend_test, Sim_Generator_Output& out_config,
+		const std::function<void(Sim_Simulation*)>& configure = std::function<void(Sim_Simulation*)>());
+
 	void SetGenerator(Sim_Generator* generator);
+
+	Sim_Reorder_Mode GetReorderMode() { return m_ReorderMode; }
+	void SetReorderMode(Sim_Reorder_Mode mode);
 	
 	void Generate();
 	void Reset();
 
+	//Applies any queued commands, steps the integrator and publishes a snapshot for the renderer. Makes no
+	// OpenGL calls so it is safe to call from a worker thread as long as each instance is only stepped by one thread
+	void UpdateSimulation(float dt);
+
+	//Applies any queued commands without stepping (while paused), publishing a snapshot if there were any
+	void UpdateCommands();
+
+	//Changes from the main thread while the simulation is running elsewhere (mouse drags, pin changes)
+	// - Not threaded, commands run straight away
+	// - Threaded, they are queued and run by whichever thread next updates the simulation
+	bool GetThreaded() { return m_Threaded; }
+	void SetThreaded(bool threaded);
+	void QueueCommand(const Sim_Manager_Command& command);
+
+	//Latest published state, main thread only. Updated in OnUpdateObject and on Reset.
+	const Sim_Snapshot& Snapshot() { return m_Snapshots.GetReadBuffer(); }
+
+	//Inactive instances are kept but not rendered, the scene cannot remove objects
+	bool GetActive() { return m_Active; }
+	void SetActive(bool active) { m_Active = active; }
+
+	//Resets the cloth with the new material
+	const Sim_Material& GetMaterial() { return m_Material; }
+	void SetMaterial(const Sim_Material& material);
+
+	//Kept across simulation type changes, ignored by simulations without a solver
+	const MPCG_Settings& GetSolverSettings() { return m_SolverSettings; }
+	void SetSolverSettings(const MPCG_Settings& settings);
+
+	//Collisions run after every sub-step while enabled and there is at least one obstacle
+	void AddObstacle(Object* obj, Sim_Collision_Shape shape);
+	void RemoveObstacle(Object* obj);
+	bool GetCollisionsEnabled() { return m_Collision->GetEnabled(); }
+	void SetCollisionsEnabled(bool enabled);
+
+	bool GetSelfCollisionsEnabled() { return m_SelfCollision->GetEnabled(); }
+	void SetSelfCollisionsEnabled(bool enabled);
+
 	Sim_Renderer* Renderer()			{ return m_Renderer; }
 	Sim_Integrator* Integrator()		{ return m_Integrator; }
 	Sim_Simulation* Simulation()		{ return m_Simulation; }
 	Sim_Generator* Generator()			{ return m_Generator; }
+	Sim_Collision* Collision()			{ return m_Collision; }
+	Sim_SelfCollision* SelfCollision()	{ return m_SelfCollision; }
 	Sim_Generator_Output& BaseConfig()	{ return m_BaseConfiguration; }
 	
 	
@@ -58,6 +145,11 @@ protected:
 	virtual void OnRenderObject();				//Handles OpenGL calls to Render the object
 	virtual void OnUpdateObject(float dt);		//Override to handle things like AI etc on update loop
 
+	void UpdateCollisionCallback();
+
+	bool ApplyCommands();
+	void PublishSnapshot();
+
 protected:
 	float           m_ElapsedTime;
 
@@ -66,6 +158,18 @@ protected:
 	Sim_Integrator* m_Integrator;
 	Sim_Simulation* m_Simulation;
 	Sim_Generator*  m_Generator;
+	Sim_Collision*  m_Collision;
+	Sim_SelfCollision* m_SelfCollision;
+	Sim_Reorder_Mode m_ReorderMode;
+	Sim_Material	m_Material;
+	MPCG_Settings	m_SolverSettings;
+	bool			m_Active;
+	bool			m_Threaded;
+
+	Sim_TripleBuffer<Sim_Snapshot>	m_Snapshots;	//The vertex buffer is rebuilt (main thread) whenever a new one is acquired
+	std::mutex						m_CommandMutex;
+	std::vector<Sim_Manager_Command> m_Commands;
+	std::vector<Sim_Manager_Command> m_ExecutingCommands;
 
 	Sim_Generator_Output m_BaseConfiguration;
 };
\ No newline at end of file
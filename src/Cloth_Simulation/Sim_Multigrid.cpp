@@ -0,0 +1,354 @@
+#include "Sim_Multigrid.h"
+
+Sim_Multigrid::Sim_Multigrid()
+{
+}
+
+Sim_Multigrid::~Sim_Multigrid()
+{
+	Release();
+}
+
+void Sim_Multigrid::Release()
+{
+	m_Levels.clear();
+}
+
+bool Sim_Multigrid::Initialize(const Sim_Generator_Output& configuration, uint min_grid_width)
+{
+	Release();
+
+	uint width = configuration.GridWidth;
+	if (width < 2 || width * width != configuration.NumVertices)
+		return false;
+
+	Sim_Multigrid_Level finest;
+	finest.GridWidth = width;
+	finest.NumNodes = width * width;
+	finest.PhyxelIdx.resize(finest.NumNodes);
+	for (uint i = 0; i < finest.NumNodes; ++i)
+		finest.PhyxelIdx[i] = configuration.ReorderedIndex(i);
+
+	m_Levels.push_back(finest);
+
+	//Only odd widths coarsen exactly, every other node of the finer grid is kept
+	while ((m_Levels.back().GridWidth - 1) % 2 == 0)
+	{
+		const Sim_Multigrid_Level& fine = m_Levels.back();
+
+		Sim_Multigrid_Level coarse;
+		coarse.GridWidth = (fine.GridWidth + 1) / 2;
+		if (coarse.GridWidth < min_grid_width || coarse.GridWidth == fine.GridWidth)
+			break;
+
+		coarse.NumNodes = coarse.GridWidth * coarse.GridWidth;
+		coarse.PhyxelIdx.resize(coarse.NumNodes);
+		for (uint y = 0; y < coarse.GridWidth; ++y)
+		{
+			for (uint x = 0; x < coarse.GridWidth; ++x)
+			{
+				coarse.PhyxelIdx[y * coarse.GridWidth + x] = fine.PhyxelIdx[(y * 2) * fine.GridWidth + (x * 2)];
+			}
+		}
+
+		//Level 0 nodes are stored in (possibly reordered) phyxel order, coarser levels in grid order
+		BuildTransferOperators(coarse, fine, (m_Levels.size() == 1) ? configuration.OriginalIdx : std::vector<uint>());
+		m_Levels.push_back(coarse);
+	}
+
+	return m_Levels.size() > 1;
+}
+
+void Sim_Multigrid::BuildTransferOperators(Sim_Multigrid_Level& coarse, const Sim_Multigrid_Level& fine, const std::vector<uint>& fine_grid_idx)
+{
+	//Bilinear prolongation, nodes shared with the coarse grid copy their value
+	// and in-between nodes average their two (or four) coarse neighbours
+	coarse.ProlongOffsets.resize(fine.NumNodes + 1);
+	coarse.ProlongCoarse.clear();
+	coarse.ProlongWeights.clear();
+
+	for (uint fidx = 0; fidx < fine.NumNodes; ++fidx)
+	{
+		uint grid_idx = fine_grid_idx.empty() ? fidx : fine_grid_idx[fidx];
+		uint fx = grid_idx % fine.GridWidth;
+		uint fy = grid_idx / fine.GridWidth;
+
+		uint cy[2] = { fy / 2, fy / 2 + 1 };
+		float wy[2] = { 1.0f, 0.0f };
+		uint ny = 1;
+		if (fy % 2 == 1)
+		{
+			wy[0] = wy[1] = 0.5f;
+			ny = 2;
+		}
+
+		uint cx[2] = { fx / 2, fx / 2 + 1 };
+		float wx[2] = { 1.0f, 0.0f };
+		uint nx = 1;
+		if (fx % 2 == 1)
+		{
+			wx[0] = wx[1] = 0.5f;
+			nx = 2;
+		}
+
+		coarse.ProlongOffsets[fidx] = (uint)coarse.ProlongCoarse.size();
+		for (uint j = 0; j < ny; ++j)
+		{
+			for (uint i = 0; i < nx; ++i)
+			{
+				coarse.ProlongCoarse.push_back(cy[j] * coarse.GridWidth + cx[i]);
+				coarse.ProlongWeights.push_back(wx[i] * wy[j]);
+			}
+		}
+	}
+	coarse.ProlongOffsets[fine.NumNodes] = (uint)coarse.ProlongCoarse.size();
+
+	//Restriction = transpose of the prolongation
+	coarse.RestrictOffsets.assign(coarse.NumNodes + 1, 0);
+	for (uint p = 0; p < coarse.ProlongCoarse.size(); ++p)
+		coarse.RestrictOffsets[coarse.ProlongCoarse[p] + 1]++;
+
+	for (uint i = 0; i < coarse.NumNodes; ++i)
+		coarse.RestrictOffsets[i + 1] += coarse.RestrictOffsets[i];
+
+	coarse.RestrictFine.resize(coarse.ProlongCoarse.size());
+	coarse.RestrictWeights.resize(coarse.ProlongCoarse.size());
+
+	std::vector<uint> fill(coarse.RestrictOffsets.begin(), coarse.RestrictOffsets.end() - 1);
+	for (uint f = 0; f < fine.NumNodes; ++f)
+	{
+		for (uint p = coarse.ProlongOffsets[f]; p < coarse.ProlongOffsets[f + 1]; ++p)
+		{
+			uint c = coarse.ProlongCoarse[p];
+			coarse.RestrictFine[fill[c]] = f;
+			coarse.RestrictWeights[fill[c]++] = coarse.ProlongWeights[p];
+		}
+	}
+}
+
+void Sim_Multigrid::Prolongate(uint coarse_level, const Vector3* coarse, Vector3* fine) const
+{
+	const Sim_Multigrid_Level& c = m_Levels[coarse_level];
+	int num_fine = (int)m_Levels[coarse_level - 1].NumNodes;
+
+	TaskScheduler::Instance()->ParallelFor(0, num_fine, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			Vector3 sum(0.0f, 0.0f, 0.0f);
+			for (uint p = c.ProlongOffsets[i]; p < c.ProlongOffsets[i + 1]; ++p)
+			{
+				sum += coarse[c.ProlongCoarse[p]] * c.ProlongWeights[p];
+			}
+			fine[i] = sum;
+		}
+	});
+}
+
+void Sim_Multigrid::Restrict(uint coarse_level, const Vector3* fine, Vector3* coarse) const
+{
+	const Sim_Multigrid_Level& c = m_Levels[coarse_level];
+	int num_coarse = (int)c.NumNodes;
+
+	TaskScheduler::Instance()->ParallelFor(0, num_coarse, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			Vector3 sum(0.0f, 0.0f, 0.0f);
+			for (uint r = c.RestrictOffsets[i]; r < c.RestrictOffsets[i + 1]; ++r)
+			{
+				sum += fine[c.RestrictFine[r]] * c.RestrictWeights[r];
+			}
+			coarse[i] = sum;
+		}
+	});
+}
+
+
+
+Sim_Multigrid_Preconditioner::Sim_Multigrid_Preconditioner()
+	: m_FineA(NULL)
+{
+}
+
+Sim_Multigrid_Preconditioner::~Sim_Multigrid_Preconditioner()
+{
+}
+
+bool Sim_Multigrid_Preconditioner::Initialize(const Sim_Generator_Output& configuration, uint num_dofs)
+{
+	m_FineA = NULL;
+	m_LevelData.clear();
+
+	if (!m_Hierarchy.Initialize(configuration) || num_dofs < m_Hierarchy.GetLevel(0).NumNodes)
+		return false;
+
+	m_LevelData.resize(m_Hierarchy.GetNumLevels());
+	for (uint l = 0; l < m_LevelData.size(); ++l)
+	{
+		LevelData& data = m_LevelData[l];
+		data.NumDofs = (l == 0) ? num_dofs : m_Hierarchy.GetLevel(l).NumNodes;
+
+		if (l > 0)
+			data.A.resize(data.NumDofs);
+
+		data.DiagInv.resize(data.NumDofs);
+		data.Constraints.resize(data.NumDofs);
+		data.R.resize(data.NumDofs);
+		data.X.resize(data.NumDofs);
+		data.Tmp.resize(data.NumDofs);
+	}
+	return true;
+}
+
+void Sim_Multigrid_Preconditioner::Rebuild(const SparseRowMatrix<Matrix3>& A, const std::vector<Matrix3>& constraints)
+{
+	m_FineA = &A;
+	m_LevelData[0].Constraints = constraints;
+
+	for (uint l = 1; l < m_LevelData.size(); ++l)
+	{
+		//Coarse nodes are constrained the same as the phyxel they were injected from
+		const Sim_Multigrid_Level& level = m_Hierarchy.GetLevel(l);
+		for (uint i = 0; i < level.NumNodes; ++i)
+			m_LevelData[l].Constraints[i] = constraints[level.PhyxelIdx[i]];
+
+		BuildCoarseOperator(l);
+	}
+
+	for (uint l = 0; l < m_LevelData.size(); ++l)
+		BuildDiagonalInverse(l);
+}
+
+void Sim_Multigrid_Preconditioner::BuildCoarseOperator(uint coarse_level)
+{
+	//A_coarse = P^T * A_fine * P, only the phyxel block of A_fine takes part (tangents are not on the grid)
+	// Each coarse row is only written by one thread, so the first build can safely discover the sparsity pattern
+	const Sim_Multigrid_Level& level = m_Hierarchy.GetLevel(coarse_level);
+	const SparseRowMatrix<Matrix3>& fineA = GetMatrix(coarse_level - 1);
+	SparseRowMatrix<Matrix3>& coarseA = m_LevelData[coarse_level].A;
+	uint num_fine = m_Hierarchy.GetLevel(coarse_level - 1).NumNodes;
+
+	coarseA.zero_memory();
+
+	TaskScheduler::Instance()->ParallelFor(0, (int)level.NumNodes, 0, [&](int first, int last)
+	{
+		for (int ci = first; ci < last; ++ci)
+		{
+			for (uint r = level.RestrictOffsets[ci]; r < level.RestrictOffsets[ci + 1]; ++r)
+			{
+				uint fi = level.RestrictFine[r];
+				float wi = level.RestrictWeights[r];
+
+				fineA.ForEachInRow(fi, [&](uint col, const Matrix3& value, bool transposed)
+				{
+					if (col >= num_fine)
+						return;
+
+					Matrix3 block = transposed ? Matrix3::Transpose(value) : value;
+					for (uint p = level.ProlongOffsets[col]; p < level.ProlongOffsets[col + 1]; ++p)
+					{
+						coarseA(ci, level.ProlongCoarse[p]) += block * (wi * level.ProlongWeights[p]);
+					}
+				});
+			}
+		}
+	});
+}
+
+void Sim_Multigrid_Preconditioner::BuildDiagonalInverse(uint level)
+{
+	const SparseRowMatrix<Matrix3>& A = GetMatrix(level);
+	LevelData& data = m_LevelData[level];
+
+	TaskScheduler::Instance()->ParallelFor(0, (int)data.NumDofs, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			data.DiagInv[i] = Matrix3::Identity;
+			for (const SparseRowMatrixItem<Matrix3>& item : A.m_Rows[i])
+			{
+				if (item.column == (uint)i)
+				{
+					data.DiagInv[i] = Matrix3::Inverse(item.value);
+					break;
+				}
+			}
+		}
+	});
+}
+
+void Sim_Multigrid_Preconditioner::Smooth(uint level, int iterations)
+{
+	//Damped block jacobi: x += w * S * D^-1 * (r - A*x)
+	const SparseRowMatrix<Matrix3>& A = GetMatrix(level);
+	LevelData& data = m_LevelData[level];
+	int num_dofs = (int)data.NumDofs;
+
+	for (int itr = 0; itr < iterations; ++itr)
+	{
+		A.Multiply(&data.X[0], &data.Tmp[0]);
+
+		TaskScheduler::Instance()->ParallelFor(0, num_dofs, 0, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				Vector3 dx = data.Constraints[i] * (data.DiagInv[i] * (data.R[i] - data.Tmp[i]));
+				data.X[i] += dx * m_SmoothingWeight;
+			}
+		});
+	}
+}
+
+void Sim_Multigrid_Preconditioner::VCycle(uint level)
+{
+	LevelData& data = m_LevelData[level];
+	memset(&data.X[0], 0, data.NumDofs * sizeof(Vector3));
+
+	if (level + 1 == m_LevelData.size())
+	{
+		Smooth(level, m_CoarseSmoothSteps);
+		return;
+	}
+
+	Smooth(level, m_PreSmoothSteps);
+
+	//Constrained residual
+	const SparseRowMatrix<Matrix3>& A = GetMatrix(level);
+	uint num_nodes = m_Hierarchy.GetLevel(level).NumNodes;
+	A.Multiply(&data.X[0], &data.Tmp[0], num_nodes);
+	TaskScheduler::Instance()->ParallelFor(0, (int)num_nodes, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			InplaceMatrix3MultVector3(&data.Tmp[i], data.Constraints[i], data.R[i] - data.Tmp[i]);
+		}
+	});
+
+	LevelData& coarse = m_LevelData[level + 1];
+	m_Hierarchy.Restrict(level + 1, &data.Tmp[0], &coarse.R[0]);
+
+	VCycle(level + 1);
+
+	//Coarse grid correction
+	m_Hierarchy.Prolongate(level + 1, &coarse.X[0], &data.Tmp[0]);
+	TaskScheduler::Instance()->ParallelFor(0, (int)num_nodes, 0, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+		{
+			InplaceMatrix3MultVector3Additve(&data.X[i], data.Constraints[i], data.Tmp[i]);
+		}
+	});
+
+	Smooth(level, m_PostSmoothSteps);
+}
+
+void Sim_Multigrid_Preconditioner::Apply(const std::vector<Vector3>& residual, std::vector<Vector3>& out_z)
+{
+	LevelData& finest = m_LevelData[0];
+	memcpy(&finest.R[0], &residual[0], finest.NumDofs * sizeof(Vector3));
+
+	VCycle(0);
+
+	memcpy(&out_z[0], &finest.X[0], finest.NumDofs * sizeof(Vector3));
+}
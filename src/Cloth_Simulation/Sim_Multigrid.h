@@ -0,0 +1,103 @@
+#pragma once
+
+#include "mpcg.h"
+#include "SparseRowMatrix.h"
+#include "SimulationDefines.h"
+#include "Sim_Generator.h"
+
+#include <glcore\Matrix3.h>
+#include <glcore\Vector3.h>
+#include <vector>
+
+//Geometric multigrid hierarchy for the square grid generators (Sim_Generator_Output::GridWidth != 0)
+// - Level 0 is the full phyxel grid, each coarser level takes every other row/column
+// - Prolongation is bilinear on the grid, restriction is its transpose
+// - Tangent dofs (C1) only exist on level 0 and are left to the fine smoother
+
+struct Sim_Multigrid_Level
+{
+	uint GridWidth;
+	uint NumNodes;
+
+	std::vector<uint>  PhyxelIdx;			//Level node (grid order) -> phyxel index on level 0
+
+	//Prolongation into the next finer level (CSR per fine node, empty on level 0)
+	std::vector<uint>  ProlongOffsets;
+	std::vector<uint>  ProlongCoarse;
+	std::vector<float> ProlongWeights;
+
+	//Restriction from the next finer level (CSR per coarse node, transpose of the above)
+	std::vector<uint>  RestrictOffsets;
+	std::vector<uint>  RestrictFine;
+	std::vector<float> RestrictWeights;
+};
+
+class Sim_Multigrid
+{
+public:
+	Sim_Multigrid();
+	~Sim_Multigrid();
+
+	//Returns false if the configuration is not a regular grid that can be coarsened at least once
+	bool Initialize(const Sim_Generator_Output& configuration, uint min_grid_width = 3);
+	void Release();
+
+	inline uint GetNumLevels() const { return (uint)m_Levels.size(); }
+	inline const Sim_Multigrid_Level& GetLevel(uint level) const { return m_Levels[level]; }
+
+	//fine(level-1) = P * coarse(level)
+	void Prolongate(uint coarse_level, const Vector3* coarse, Vector3* fine) const;
+
+	//coarse(level) = P^T * fine(level-1)
+	void Restrict(uint coarse_level, const Vector3* fine, Vector3* coarse) const;
+
+protected:
+	//fine_grid_idx maps fine nodes to their grid position (empty if already in grid order)
+	void BuildTransferOperators(Sim_Multigrid_Level& coarse, const Sim_Multigrid_Level& fine, const std::vector<uint>& fine_grid_idx);
+
+	std::vector<Sim_Multigrid_Level> m_Levels;
+};
+
+
+//Multigrid V-cycle for MPCG, replaces the block diagonal preconditioner
+// - Damped block jacobi smoothing on every level
+// - Coarse operators built by galerkin projection (P^T A P) of the phyxel block of A
+class Sim_Multigrid_Preconditioner : public MPCG_Preconditioner<SparseRowMatrix<Matrix3>>
+{
+public:
+	Sim_Multigrid_Preconditioner();
+	virtual ~Sim_Multigrid_Preconditioner();
+
+	bool Initialize(const Sim_Generator_Output& configuration, uint num_dofs);
+
+	virtual void Rebuild(const SparseRowMatrix<Matrix3>& A, const std::vector<Matrix3>& constraints) override;
+	virtual void Apply(const std::vector<Vector3>& residual, std::vector<Vector3>& out_z) override;
+
+	inline uint GetNumLevels() const { return m_Hierarchy.GetNumLevels(); }
+
+	int   m_PreSmoothSteps = 1;
+	int   m_PostSmoothSteps = 1;
+	int   m_CoarseSmoothSteps = 8;
+	float m_SmoothingWeight = 0.6f;
+
+protected:
+	struct LevelData
+	{
+		uint NumDofs;
+		SparseRowMatrix<Matrix3> A;			//Unused on level 0, which reads the solvers A matrix (in either storage)
+		std::vector<Matrix3> DiagInv;
+		std::vector<Matrix3> Constraints;
+		std::vector<Vector3> R, X, Tmp;
+	};
+
+	inline const SparseRowMatrix<Matrix3>& GetMatrix(uint level) const { return (level == 0) ? *m_FineA : m_LevelData[level].A; }
+
+	void BuildCoarseOperator(uint coarse_level);
+	void BuildDiagonalInverse(uint level);
+	void Smooth(uint level, int iterations);
+	void VCycle(uint level);
+
+	Sim_Multigrid					m_Hierarchy;
+	std::vector<LevelData>			m_LevelData;
+	const SparseRowMatrix<Matrix3>* m_FineA;
+};
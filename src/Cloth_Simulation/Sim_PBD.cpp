@@ -2,6 +2,8 @@
 #include <glcore\NCLDebug.h>
 #include <algorithm>
 #include <random>
+#include <queue>
+#include <unordered_set>
 
 
 
@@ -47,6 +49,9 @@ void Sim_PBD::Initialize(const Sim_Generator_Output& config)
 
 
 	SetupConstraints(config);
+	BuildGeodesicGraph();
+	BuildLongRangeAttachments();
+	SetupHierarchy(config);
 
 	m_TriangleRotationsInitial.resize(m_NumTriangles);
 #pragma omp parallel for
@@ -76,7 +81,7 @@ void Sim_PBD::Initialize(const Sim_Generator_Output& config)
 		totalArea += 0.5f * abs(e1.x * e2.y - e1.y * e2.x);
 	}
 
-	float uniform_mass = (float)m_NumPhyxels / (float)(totalArea * mass_density);
+	float uniform_mass = (float)m_NumPhyxels / (float)(totalArea * m_Material.density);
 	for (unsigned int i = 0; i < m_NumPhyxels; ++i)
 	{
 		m_PhyxelsInvMass[i] = uniform_mass;
@@ -94,20 +99,31 @@ void Sim_PBD::SetupConstraints(const Sim_Generator_Output& config)
 	const float k_warp_bend = 0.125f;
 
 
-	uint numWidth = (uint)sqrt(config.NumVertices);
-	m_NumTriangles = (numWidth - 1) * (numWidth - 1) * 2;
 	m_Triangles.clear();
 	m_Constraints_Distance.clear();
 	m_Constraints_Bending.clear();
 
+	if (config.GridWidth == 0)
+	{
+		SetupConstraintsUnstructured(config);
+		return;
+	}
+
+	uint numWidth = config.GridWidth;
+
+	//Grid position -> phyxel index (the output may have been reordered, see Sim_Reordering)
+	auto grid = [&](uint x, uint y) { return config.ReorderedIndex(y * numWidth + x); };
+
+	m_NumTriangles = (numWidth - 1) * (numWidth - 1) * 2;
+
 	for (uint x = 0; x < numWidth - 1; ++x)
 	{
 		for (uint y = 0; y < numWidth - 1; ++y)
 		{
-			uint a = ((y) * numWidth) + (x);
-			uint b = ((y)* numWidth) + (x + 1);
-			uint c = ((y + 1)* numWidth) + (x);
-			uint d = ((y + 1)* numWidth) + (x + 1);
+			uint a = grid(x, y);
+			uint b = grid(x + 1, y);
+			uint c = grid(x, y + 1);
+			uint d = grid(x + 1, y + 1);
 
 			m_Triangles.push_back(Sim_3Noded_Triangle(c, a, b));
 			m_Triangles.push_back(Sim_3Noded_Triangle(c, b, d));
@@ -129,13 +145,13 @@ void Sim_PBD::SetupConstraints(const Sim_Generator_Output& config)
 	for (uint x = 0; x < numWidth; ++x)
 		for (uint y = 0; y < numWidth - 1; ++y)
 		{
-			uint a = ((y)* numWidth) + (x);
-			uint b = ((y + 1)* numWidth) + (x);
+			uint a = grid(x, y);
+			uint b = grid(x, y + 1);
 
 			InitDConstraint(
 				&config.Phyxels[0],
-				(y * numWidth) + x,
-				(y * numWidth) + x + 1,
+				grid(x, y),
+				grid(x + 1, y),
 				k_warp);
 		}
 
@@ -144,8 +160,8 @@ void Sim_PBD::SetupConstraints(const Sim_Generator_Output& config)
 		{
 			InitDConstraint(
 				&config.Phyxels[0],
-				(y * numWidth) + x,
-				(y * numWidth) + x + 1,
+				grid(x, y),
+				grid(x + 1, y),
 				k_weft);
 		}
 
@@ -155,9 +171,9 @@ void Sim_PBD::SetupConstraints(const Sim_Generator_Output& config)
 		{
 			InitBConstraint(
 				&config.Phyxels[0],
-				(y * numWidth) + x,
-				(y * numWidth) + x + 1,
-				(y * numWidth) + x + 2,
+				grid(x, y),
+				grid(x + 1, y),
+				grid(x + 2, y),
 				k_weft_bend);
 		}
 	for (uint x = 0; x < numWidth; ++x)
@@ -165,23 +181,112 @@ void Sim_PBD::SetupConstraints(const Sim_Generator_Output& config)
 		{
 			InitBConstraint(
 				&config.Phyxels[0],
-				(y * numWidth) + x,
-				((y + 1) * numWidth) + x,
-				((y + 2) * numWidth) + x,
+				grid(x, y),
+				grid(x, y + 1),
+				grid(x, y + 2),
 				k_warp_bend);
 		}
 }
 
+void Sim_PBD::SetupConstraintsUnstructured(const Sim_Generator_Output& config)
+{
+	const float k_stretch = 0.5f;
+	const float k_bend = 0.125f;
+
+	//Split each 6-noded triangle into four 3-noded ones
+	m_NumTriangles = (uint)config.Triangles.size() * 4;
+	m_Triangles.reserve(m_NumTriangles);
+	for (const FETriangle& tri : config.Triangles)
+	{
+		m_Triangles.push_back(Sim_3Noded_Triangle(tri.v1, tri.v4, tri.v6));
+		m_Triangles.push_back(Sim_3Noded_Triangle(tri.v4, tri.v2, tri.v5));
+		m_Triangles.push_back(Sim_3Noded_Triangle(tri.v6, tri.v5, tri.v3));
+		m_Triangles.push_back(Sim_3Noded_Triangle(tri.v4, tri.v5, tri.v6));
+	}
+
+	//One distance constraint per unique edge
+	std::unordered_set<unsigned long long> edges;
+	edges.reserve(m_NumTriangles * 2);
+	for (const Sim_3Noded_Triangle& tri : m_Triangles)
+	{
+		for (uint i = 0; i < 3; ++i)
+		{
+			uint a = tri.verts[i], b = tri.verts[(i + 1) % 3];
+			unsigned long long key = (a < b) ? (((unsigned long long)a << 32) | b) : (((unsigned long long)b << 32) | a);
+			if (edges.insert(key).second)
+				InitDConstraint(&config.Phyxels[0], a, b, k_stretch);
+		}
+	}
+
+	//Bending along each original edge (corner - mid - corner), the same as the grid's row/column triplets
+	std::vector<bool> visited(config.NumVertices, false);
+	for (const FETriangle& tri : config.Triangles)
+	{
+		for (uint i = 0; i < 3; ++i)
+		{
+			uint mid = tri.phyxels[3 + i];
+			if (!visited[mid])
+			{
+				visited[mid] = true;
+				InitBConstraint(&config.Phyxels[0], tri.phyxels[i], tri.phyxels[(i + 1) % 3], mid, k_bend);
+			}
+		}
+	}
+}
+
 void Sim_PBD::InitDConstraint(const Vector3* positions, uint v1, uint v2, float k)
+{
+	m_Constraints_Distance.push_back(BuildDConstraint(positions, v1, v2, k));
+}
+
+Sim_PBD_DConstraint Sim_PBD::BuildDConstraint(const Vector3* positions, uint v1, uint v2, float k) const
 {
 	Sim_PBD_DConstraint c = Sim_PBD_DConstraint(v1, v2, k);
 	c.length = (positions[v2] - positions[v1]).Length();
+	c.kPrime = StepStiffness(c.k);
 
-	c.kPrime = 1.0f - pow((1.0f - c.k), 1.0f / (float)m_SolverSteps);  //1.0f-pow((1.0f-c.k), 1.0f/ns);
-	if (c.kPrime>1.0)
-		c.kPrime = 1.0;
+	return c;
+}
 
-	m_Constraints_Distance.push_back(c);
+float Sim_PBD::StepStiffness(float k) const
+{
+	float kPrime = 1.0f - pow((1.0f - k), 1.0f / (float)m_SolverSteps);  //1.0f-pow((1.0f-c.k), 1.0f/ns);
+	return (kPrime > 1.0f) ? 1.0f : kPrime;
+}
+
+void Sim_PBD::SetSolverSteps(int steps)
+{
+	m_SolverSteps = (steps > 0) ? steps : 1;
+
+	for (Sim_PBD_DConstraint& c : m_Constraints_Distance)
+		c.kPrime = StepStiffness(c.k);
+	for (Sim_PBD_BConstraint& c : m_Constraints_Bending)
+		c.kPrime = StepStiffness(c.k);
+	for (std::vector<Sim_PBD_DConstraint>& level : m_Constraints_Hierarchy)
+	{
+		for (Sim_PBD_DConstraint& c : level)
+			c.kPrime = StepStiffness(c.k);
+	}
+}
+
+void Sim_PBD::ComputeStretch(const Vector3* positions, float& out_avg, float& out_max) const
+{
+	out_avg = 0.f;
+	out_max = 0.f;
+	if (m_Constraints_Distance.empty())
+		return;
+
+	double sum = 0.0;
+	for (const Sim_PBD_DConstraint& c : m_Constraints_Distance)
+	{
+		float len = (positions[c.c2] - positions[c.c1]).Length();
+		float stretch = (c.length > 0.f) ? len / c.length - 1.f : 0.f;
+		stretch = (stretch > 0.f) ? stretch : 0.f;
+
+		sum += stretch;
+		out_max = (stretch > out_max) ? stretch : out_max;
+	}
+	out_avg = (float)(sum / (double)m_Constraints_Distance.size());
 }
 
 void Sim_PBD::InitBConstraint(const Vector3* positions, uint v1, uint v2, uint v3, float k)
@@ -196,17 +301,184 @@ void Sim_PBD::InitBConstraint(const Vector3* positions, uint v1, uint v2, uint v
 
 	Sim_PBD_BConstraint c = Sim_PBD_BConstraint(v1, v2, v3, k, w);
 	c.length = (positions[v3] - centre).Length();
-
-	c.kPrime = 1.0f - pow((1.0f - c.k), 1.0f / (float)m_SolverSteps);  //1.0f-pow((1.0f-c.k), 1.0f/ns);
-	if (c.kPrime>1.0)
-		c.kPrime = 1.0;
+	c.kPrime = StepStiffness(c.k);
 
 	m_Constraints_Bending.push_back(c);
 }
 
 void  Sim_PBD::UpdateConstraints()
 {
+	//Pin set has changed, so the anchors (and geodesic distances to them) need recomputing
+	BuildLongRangeAttachments();
+}
+
+void Sim_PBD::BuildGeodesicGraph()
+{
+	//Compress the distance constraints into an adjacency list (CSR), each edge weighted by its rest length
+	m_GeodesicOffsets.assign(m_NumPhyxels + 1, 0);
+	for (const Sim_PBD_DConstraint& c : m_Constraints_Distance)
+	{
+		m_GeodesicOffsets[c.c1 + 1]++;
+		m_GeodesicOffsets[c.c2 + 1]++;
+	}
+
+	for (uint i = 0; i < m_NumPhyxels; ++i)
+		m_GeodesicOffsets[i + 1] += m_GeodesicOffsets[i];
+
+	m_GeodesicNeighbours.resize(m_GeodesicOffsets[m_NumPhyxels]);
+	m_GeodesicLengths.resize(m_GeodesicOffsets[m_NumPhyxels]);
+
+	std::vector<uint> fill(m_GeodesicOffsets.begin(), m_GeodesicOffsets.end() - 1);
+	for (const Sim_PBD_DConstraint& c : m_Constraints_Distance)
+	{
+		m_GeodesicNeighbours[fill[c.c1]] = c.c2;
+		m_GeodesicLengths[fill[c.c1]++] = c.length;
+
+		m_GeodesicNeighbours[fill[c.c2]] = c.c1;
+		m_GeodesicLengths[fill[c.c2]++] = c.length;
+	}
+}
+
+void Sim_PBD::BuildLongRangeAttachments()
+{
+	m_Constraints_LRA.clear();
+
+	if (!m_UseLongRangeAttachments || m_GeodesicOffsets.size() != m_NumPhyxels + 1)
+		return;
+
+	//Multi-source Dijkstra from every static phyxel, giving each free phyxel
+	// its nearest anchor and the geodesic (along the cloth) distance to it
+	typedef std::pair<float, uint> QueueItem;
+	std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+
+	std::vector<float> distance(m_NumPhyxels, FLT_MAX);
+	std::vector<uint> anchor(m_NumPhyxels, UINT_MAX);
+
+	for (uint i = 0; i < m_NumPhyxels; ++i)
+	{
+		if (m_PhyxelIsStatic[i])
+		{
+			distance[i] = 0.f;
+			anchor[i] = i;
+			queue.push(QueueItem(0.f, i));
+		}
+	}
+
+	while (!queue.empty())
+	{
+		QueueItem item = queue.top();
+		queue.pop();
+
+		uint idx = item.second;
+		if (item.first > distance[idx])
+			continue;
+
+		for (uint j = m_GeodesicOffsets[idx]; j < m_GeodesicOffsets[idx + 1]; ++j)
+		{
+			uint neighbour = m_GeodesicNeighbours[j];
+			float new_dist = item.first + m_GeodesicLengths[j];
+			if (new_dist < distance[neighbour])
+			{
+				distance[neighbour] = new_dist;
+				anchor[neighbour] = anchor[idx];
+				queue.push(QueueItem(new_dist, neighbour));
+			}
+		}
+	}
+
+	for (uint i = 0; i < m_NumPhyxels; ++i)
+	{
+		if (!m_PhyxelIsStatic[i] && anchor[i] != UINT_MAX)
+		{
+			m_Constraints_LRA.push_back(Sim_PBD_LRAConstraint(i, anchor[i], distance[i]));
+		}
+	}
+}
+
+void Sim_PBD::SetupHierarchy(const Sim_Generator_Output& config)
+{
+	const float k_coarse = 0.5f;
+
+	m_Constraints_Hierarchy.clear();
+	m_HierarchyDelta.clear();
+
+	if (!m_UseHierarchy || !m_Hierarchy.Initialize(config))
+		return;
+
+	uint num_levels = m_Hierarchy.GetNumLevels();
+	m_Constraints_Hierarchy.resize(num_levels);
+	m_HierarchyDelta.resize(num_levels);
 
+	for (uint l = 0; l < num_levels; ++l)
+	{
+		const Sim_Multigrid_Level& level = m_Hierarchy.GetLevel(l);
+		m_HierarchyDelta[l].resize(level.NumNodes);
+
+		if (l == 0)
+			continue;
+
+		//Same stretch/shear layout as the fine grid, just spanning 2^l phyxels
+		uint w = level.GridWidth;
+		for (uint y = 0; y < w; ++y)
+		{
+			for (uint x = 0; x < w; ++x)
+			{
+				uint a = level.PhyxelIdx[y * w + x];
+				if (x + 1 < w)
+					m_Constraints_Hierarchy[l].push_back(BuildDConstraint(&config.Phyxels[0], a, level.PhyxelIdx[y * w + x + 1], k_coarse));
+				if (y + 1 < w)
+					m_Constraints_Hierarchy[l].push_back(BuildDConstraint(&config.Phyxels[0], a, level.PhyxelIdx[(y + 1) * w + x], k_coarse));
+				if (x + 1 < w && y + 1 < w)
+				{
+					m_Constraints_Hierarchy[l].push_back(BuildDConstraint(&config.Phyxels[0], a, level.PhyxelIdx[(y + 1) * w + x + 1], k_coarse));
+					m_Constraints_Hierarchy[l].push_back(BuildDConstraint(&config.Phyxels[0], level.PhyxelIdx[y * w + x + 1], level.PhyxelIdx[(y + 1) * w + x], k_coarse));
+				}
+			}
+		}
+	}
+}
+
+void Sim_PBD::SolveHierarchy()
+{
+	//Coarsest first, so low frequency stretch is removed before the fine gauss-seidel passes
+	for (int l = (int)m_Hierarchy.GetNumLevels() - 1; l > 0; --l)
+	{
+		const Sim_Multigrid_Level& level = m_Hierarchy.GetLevel(l);
+		std::vector<Vector3>& delta = m_HierarchyDelta[l];
+
+		for (uint i = 0; i < level.NumNodes; ++i)
+			delta[i] = m_PhyxelPosTmp[level.PhyxelIdx[i]];
+
+		for (int s = 0; s < m_HierarchySteps; ++s)
+		{
+			for (const Sim_PBD_DConstraint& c : m_Constraints_Hierarchy[l])
+			{
+				SolveDistanceConstraint(c);
+			}
+		}
+
+		//Undo the coarse solve and turn it into a correction, which is then
+		// interpolated onto every phyxel (including the coarse ones themselves)
+		for (uint i = 0; i < level.NumNodes; ++i)
+		{
+			Vector3& pos = m_PhyxelPosTmp[level.PhyxelIdx[i]];
+			Vector3 moved = pos;
+			pos = delta[i];
+			delta[i] = moved - delta[i];
+		}
+
+		for (uint k = (uint)l; k > 0; --k)
+		{
+			m_Hierarchy.Prolongate(k, &m_HierarchyDelta[k][0], &m_HierarchyDelta[k - 1][0]);
+		}
+
+#pragma omp parallel for
+		for (int i = 0; i < (int)m_NumPhyxels; ++i)
+		{
+			if (!m_PhyxelIsStatic[i])
+				m_PhyxelPosTmp[i] += m_HierarchyDelta[0][i];
+		}
+	}
 }
 
 void Sim_PBD::ComputePhyxelRotations(const Vector3* positions)
@@ -248,6 +520,13 @@ bool Sim_PBD::StepSimulation(float dt, const Vector3& gravity, const Vector3* in
 	m_Rotations_Invalidated = true;
 	Vector3 sub_grav = gravity;
 
+	//Pinning a whole edge toggles many phyxels, the attachments are only rebuilt once for all of them
+	if (m_Constraints_Invalidated)
+	{
+		m_Constraints_Invalidated = false;
+		UpdateConstraints();
+	}
+
 	bool valid_timestep = true;
 
 	//for (size_t i = 0; i < m_Constraints_Distance.size(); ++i)
@@ -275,7 +554,12 @@ bool Sim_PBD::StepSimulation(float dt, const Vector3& gravity, const Vector3* in
 	std::random_shuffle(m_Constraints_Distance.begin(), m_Constraints_Distance.end());
 	std::random_shuffle(m_Constraints_Bending.begin(), m_Constraints_Bending.end());
 	//memcpy(out_dxdt, in_dxdt, m_NumPhyxels * sizeof(Vector3));
-	
+
+	if (!m_Constraints_Hierarchy.empty())
+	{
+		SolveHierarchy();
+	}
+
 	//Solve X
 	for (uint i = 0; i < m_SolverSteps; ++i)
 	{
@@ -287,6 +571,13 @@ bool Sim_PBD::StepSimulation(float dt, const Vector3& gravity, const Vector3* in
 		{
 			SolveBendingConstraint(m_Constraints_Bending[j]);
 		}
+
+		//Each LRA only moves its own (free) phyxel towards a static anchor, so they are independent
+#pragma omp parallel for
+		for (int j = 0; j < (int)m_Constraints_LRA.size(); ++j)
+		{
+			SolveLongRangeAttachment(m_Constraints_LRA[j]);
+		}
 	}
 
 	//Compute dxdt based on pos-postmp
@@ -367,6 +658,21 @@ void Sim_PBD::SolveBendingConstraint(const Sim_PBD_BConstraint& c)
 	}
 }
 
+void Sim_PBD::SolveLongRangeAttachment(const Sim_PBD_LRAConstraint& c)
+{
+	//Unilateral tether: only acts when the phyxel is further from its anchor than the geodesic rest distance
+	Vector3& p = m_PhyxelPosTmp[c.particle];
+	const Vector3& anchor = m_PhyxelPosTmp[c.anchor];
+
+	Vector3 dir = p - anchor;
+	float len = dir.Length();
+
+	if (len > c.length)
+	{
+		p = anchor + dir * (c.length / len);
+	}
+}
+
 bool Sim_PBD::ValidateVelocityTimestep(const Vector3* pos_tmp)
 {
 	return true;
@@ -2,6 +2,7 @@
 
 
 #include "mpcg.h"
+#include "Sim_Multigrid.h"
 
 #include "EigenDefines.h"
 #include "SimulationDefines.h"
@@ -16,6 +17,9 @@
 #include "Sim_Integrator.h"
 #include "Sim_Manager.h"
 
+//Gauss-seidel passes per sub-step, see Sim_PBDConvergence for the stretch left at each count
+#define DEFAULT_PBD_SOLVER_STEPS 5
+
 struct Sim_3Noded_Triangle
 {
 	Sim_3Noded_Triangle() : v1(0), v2(0), v3(0) {}
@@ -39,6 +43,14 @@ struct Sim_PBD_DConstraint
 	float k, kPrime, length;
 };
 
+struct Sim_PBD_LRAConstraint
+{
+	Sim_PBD_LRAConstraint(uint p, uint a, float _length) : particle(p), anchor(a), length(_length) {}
+
+	uint particle, anchor;
+	float length;		//Geodesic distance to the anchor at rest
+};
+
 struct Sim_PBD_BConstraint
 {
 	Sim_PBD_BConstraint(uint a, uint b, uint c, float _k, float _w) : c1(a), c2(b), c3(c), k(_k), w(_w), kPrime(0.f), length(0.f) {}
@@ -68,9 +80,16 @@ public:
 	virtual bool GetIsStatic(uint idx) { return (idx < m_PhyxelIsStatic.size()) ? m_PhyxelIsStatic[idx] : false; }
 	virtual void SetIsStatic(uint idx, bool is_static)
 	{
-		m_PhyxelIsStatic[idx] = is_static;
+		if (idx < m_PhyxelIsStatic.size() && m_PhyxelIsStatic[idx] != is_static)
+		{
+			m_PhyxelIsStatic[idx] = is_static;
+			m_Constraints_Invalidated = true;
+		}
 	}
 
+	virtual const Sim_Material& GetMaterial() { return m_Material; }
+	virtual void SetMaterial(const Sim_Material& material) { m_Material = material; }	//Only the density, stiffness is per constraint
+
 	virtual ProfilingTimer& GetTotalTimer() { return m_ProfilingTotalTime; }
 
 	virtual int GetNumSubProfilers() { return Sim_PBD3Noded_SubTimer_MAX; }
@@ -83,6 +102,16 @@ public:
 	void UpdateConstraints();
 	bool ValidateVelocityTimestep(const Vector3* pos_tmp);
 
+	//Gauss-seidel passes per step, the per pass stiffness is rescaled so the overall stiffness stays the same
+	int GetSolverSteps() const { return m_SolverSteps; }
+	void SetSolverSteps(int steps);
+
+	bool GetUseLongRangeAttachments() const { return m_UseLongRangeAttachments; }
+	void SetUseLongRangeAttachments(bool use) { m_UseLongRangeAttachments = use; m_Constraints_Invalidated = true; }
+
+	//Elongation of the distance constraints relative to their rest length, compression counts as none
+	void ComputeStretch(const Vector3* positions, float& out_avg, float& out_max) const;
+
 
 	//Renderable
 	virtual int GetNumTris() {
@@ -98,16 +127,27 @@ public:
 protected:
 	
 	void SetupConstraints(const Sim_Generator_Output& configuration);
+	void SetupConstraintsUnstructured(const Sim_Generator_Output& configuration);
 	void InitDConstraint(const Vector3* positions, uint v1, uint v2, float k);
+	Sim_PBD_DConstraint BuildDConstraint(const Vector3* positions, uint v1, uint v2, float k) const;
+	float StepStiffness(float k) const;
 	void InitBConstraint(const Vector3* positions, uint v1, uint v2, uint v3, float k);
 
 	void ComputePhyxelRotations(const Vector3* positions);
 
+	void BuildGeodesicGraph();
+	void BuildLongRangeAttachments();
+	void SetupHierarchy(const Sim_Generator_Output& configuration);
+
+	void SolveHierarchy();
+
 	void SolveDistanceConstraint(const Sim_PBD_DConstraint& constraint);
 	void SolveBendingConstraint(const Sim_PBD_BConstraint& constraint);
+	void SolveLongRangeAttachment(const Sim_PBD_LRAConstraint& constraint);
 protected:
 	uint m_NumPhyxels, m_NumTriangles;
 	float m_TotalArea;
+	Sim_Material m_Material;
 
 	//Phyxel Data
 	std::vector<Vector3>        m_PhyxelPosTmp;
@@ -119,14 +159,31 @@ protected:
 
 	std::vector<Sim_PBD_DConstraint>  m_Constraints_Distance;
 	std::vector<Sim_PBD_BConstraint>  m_Constraints_Bending;
+	std::vector<Sim_PBD_LRAConstraint> m_Constraints_LRA;
+
+	//Rest length edge graph (CSR) used to compute geodesic distances to static phyxels
+	std::vector<uint>			m_GeodesicOffsets;
+	std::vector<uint>			m_GeodesicNeighbours;
+	std::vector<float>			m_GeodesicLengths;
+
+	//Coarse grid distance constraints (indexed by level, level 0 unused) between the phyxels
+	// kept on each multigrid level, their corrections are interpolated back onto every phyxel
+	Sim_Multigrid						m_Hierarchy;
+	std::vector<std::vector<Sim_PBD_DConstraint>> m_Constraints_Hierarchy;
+	std::vector<std::vector<Vector3>>	m_HierarchyDelta;
 
 	//Structural Data
 	std::vector<Sim_3Noded_Triangle> m_Triangles;
 	std::vector<Matrix3> m_TriangleRotations;
 	std::vector<Matrix3> m_TriangleRotationsInitial;
 
-	int m_SolverSteps = 20;
+	//Long range attachments stop stretch propagating from the static phyxels
+	bool m_UseLongRangeAttachments = true;
+	bool m_UseHierarchy = true;
+	int m_HierarchySteps = 2;
+	int m_SolverSteps = DEFAULT_PBD_SOLVER_STEPS;
 	bool m_Rotations_Invalidated = true;
+	bool m_Constraints_Invalidated = false;	//Pin set changed, attachments are rebuilt at the start of the next step
 
 	//Profiling
 	ProfilingTimer	  m_ProfilingTotalTime;
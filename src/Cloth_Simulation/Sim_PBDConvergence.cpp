@@ -0,0 +1,77 @@
+#include "Sim_PBDConvergence.h"
+#include "Sim_PBD.h"
+#include <glcore\NCLDebug.h>
+
+Sim_PBDConvergence::Result Sim_PBDConvergence::Run(int solver_steps, bool long_range_attachments, uint visual_subdivisions, uint num_frames)
+{
+	const float frame_time = 1.f / 60.f;
+	const uint num_sampled = (num_frames > 60) ? 60 : num_frames;
+
+	Result result;
+	result.stable = true;
+	result.avg_stretch_pct = 0.f;
+	result.max_stretch_pct = 0.f;
+	result.ms_per_frame = 0.f;
+
+	Sim_Generator_Output config;
+	Sim_Simulation* sim = Sim_Manager::CreateHeadlessSimulation(Sim_Type_PBD3NodedC0, visual_subdivisions, false, config, [&](Sim_Simulation* s)
+	{
+		Sim_PBD* pbd = static_cast<Sim_PBD*>(s);
+		pbd->SetSolverSteps(solver_steps);
+		pbd->SetUseLongRangeAttachments(long_range_attachments);
+	});
+	if (sim == NULL)
+	{
+		result.stable = false;
+		return result;
+	}
+	Sim_PBD* pbd = static_cast<Sim_PBD*>(sim);
+
+	Sim_Integrator integrator;
+	integrator.Initialize(sim, config);
+	integrator.SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+
+	ProfilingTimer timer;
+	timer.ResetTotalMs();
+	for (uint i = 0; i < num_frames; ++i)
+	{
+		timer.BeginTiming();
+		integrator.UpdateSimulation(frame_time);
+		timer.EndTimingAdditive();
+
+		if (i + num_sampled >= num_frames)
+		{
+			//NaN check, anything stretched a thousand fold is no longer hanging
+			float avg_stretch, max_stretch;
+			pbd->ComputeStretch(integrator.X(), avg_stretch, max_stretch);
+			result.stable = result.stable && (avg_stretch == avg_stretch) && (max_stretch < 1E3f);
+			result.avg_stretch_pct += avg_stretch;
+			result.max_stretch_pct = (max_stretch > result.max_stretch_pct) ? max_stretch : result.max_stretch_pct;
+		}
+	}
+
+	result.avg_stretch_pct *= 100.f / (float)num_sampled;
+	result.max_stretch_pct *= 100.f;
+	result.ms_per_frame = timer.GetTimedMilliSeconds() / (float)num_frames;
+
+	delete sim;
+	return result;
+}
+
+void Sim_PBDConvergence::RunAll(uint visual_subdivisions, uint num_frames)
+{
+	const int solver_steps[] = { 2, 5, 10, 20 };
+
+	NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "PBD convergence (pinned grid, %d subdivisions, %d frames, stretch over the last second):", visual_subdivisions, num_frames);
+	for (int lra = 1; lra >= 0; --lra)
+	{
+		for (int steps : solver_steps)
+		{
+			Result r = Run(steps, lra != 0, visual_subdivisions, num_frames);
+			if (r.stable)
+				NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    %2d steps %-7s avg: %6.3f%%  max: %7.3f%%  %7.2fms/frame", steps, lra ? "LRA" : "no LRA", r.avg_stretch_pct, r.max_stretch_pct, r.ms_per_frame);
+			else
+				NCLDebug::Log(Vector3(1.0f, 0.4f, 0.4f), "    %2d steps %-7s unstable                        %7.2fms/frame", steps, lra ? "LRA" : "no LRA", r.ms_per_frame);
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "SimulationDefines.h"
+
+//Measures how much stretch the PBD solver leaves behind for a given number of solver steps
+// - The square grid pinned at its two top corners hangs under gravity, the stretch of the distance
+//   constraints is sampled over the last second of the run (once it has settled)
+// - Each step count is run with and without the long range attachments
+class Sim_PBDConvergence
+{
+public:
+	struct Result
+	{
+		bool stable;				//False if the simulation blew up (the stretch is then meaningless)
+		float avg_stretch_pct;		//Mean over the constraints, averaged over the sampled frames
+		float max_stretch_pct;		//Worst constraint over the sampled frames
+		float ms_per_frame;
+	};
+
+	static Result Run(int solver_steps, bool long_range_attachments, uint visual_subdivisions, uint num_frames);
+
+	//Runs 2/5/10/20 solver steps with and without long range attachments and writes the report to the debug log
+	static void RunAll(uint visual_subdivisions = 16, uint num_frames = 120);
+};
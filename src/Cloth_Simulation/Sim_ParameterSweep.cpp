@@ -0,0 +1,243 @@
+#include "Sim_ParameterSweep.h"
+#include "Sim_ThreadPool.h"
+#include "Sim_SolverTelemetry.h"
+#include <glcore\NCLDebug.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+void Sim_ParameterSweep_Grid::Expand(std::vector<Sim_ParameterSweep_Config>& out_configs) const
+{
+	out_configs.clear();
+	out_configs.push_back(base);
+
+	//Each axis multiplies the configurations so far by its values
+	auto expand_axis = [&](uint num_values, const std::function<void(Sim_ParameterSweep_Config&, uint)>& set_value)
+	{
+		if (num_values == 0)
+			return;
+
+		std::vector<Sim_ParameterSweep_Config> expanded;
+		expanded.reserve(out_configs.size() * num_values);
+		for (const Sim_ParameterSweep_Config& config : out_configs)
+		{
+			for (uint i = 0; i < num_values; ++i)
+			{
+				expanded.push_back(config);
+				set_value(expanded.back(), i);
+			}
+		}
+		out_configs.swap(expanded);
+	};
+
+	expand_axis((uint)sim_types.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.sim_type = sim_types[i]; });
+	expand_axis((uint)integrators.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.integrator = integrators[i]; });
+	expand_axis((uint)grid_sizes.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.grid_size = grid_sizes[i]; });
+	expand_axis((uint)youngs_moduli.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.material.youngs_modulus = youngs_moduli[i]; });
+	expand_axis((uint)poisson_ratios.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.material.poisson_ratio = poisson_ratios[i]; });
+	expand_axis((uint)densities.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.material.density = densities[i]; });
+	expand_axis((uint)tolerances.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.solver.tolerance = tolerances[i]; });
+	expand_axis((uint)max_iterations.size(), [&](Sim_ParameterSweep_Config& c, uint i) { c.solver.max_iterations = max_iterations[i]; });
+}
+
+Sim_ParameterSweep_Result Sim_ParameterSweep::RunConfig(const Sim_ParameterSweep_Config& config)
+{
+	Sim_ParameterSweep_Result result = Sim_ParameterSweep_Result();
+	result.config = config;
+
+	ProfilingTimer total_timer;
+	total_timer.BeginTiming();
+
+	Sim_Generator_Output base_config;
+	Sim_Simulation* sim = Sim_Manager::CreateHeadlessSimulation(config.sim_type, config.grid_size, config.bend_test, base_config, [&](Sim_Simulation* s)
+	{
+		s->SetMaterial(config.material);
+		if (s->Solver() != NULL)
+			s->Solver()->SetSettings(config.solver);
+	});
+	if (sim == NULL)
+	{
+		result.diverged = true;
+		return result;
+	}
+
+	Sim_Integrator integrator;
+	integrator.Initialize(sim, base_config);
+	integrator.SetIntegrationType(config.integrator);
+	if (config.sub_timestep > 0.0f)
+		integrator.SetSubTimestep(config.sub_timestep);
+	else
+		integrator.SetSubTimestep((config.integrator == Sim_Integrator_Type_Implicit) ? DEFAULT_IMPLICIT_SUB_TIMESTEP : DEFAULT_SUB_TIMESTEP);
+
+	//Every solve pushes a telemetry record, so multi-stage and sub-stepped frames count all of theirs
+	Sim_TelemetryReader telemetry;
+	if (sim->Solver() != NULL)
+		telemetry.Attach(sim->Solver()->GetTelemetry());
+
+	const float frame_timestep = 1.0f / 60.0f;
+	float iterations_sum = 0.0f;
+	uint num_solves = 0;
+	for (uint frame = 0; frame < config.num_frames; ++frame)
+	{
+		sim->GetTotalTimer().ResetTotalMs();
+		integrator.UpdateSimulation(frame_timestep);
+
+		float frame_ms = integrator.GetTotalTimer().GetTimedMilliSeconds();
+		result.frame_ms_avg += frame_ms;
+		result.frame_ms_max = (frame_ms > result.frame_ms_max) ? frame_ms : result.frame_ms_max;
+		result.simulation_ms_avg += sim->GetTotalTimer().GetTimedMilliSeconds();
+		result.solver_calls += integrator.GetNumSolverCalls();
+
+		MPCG<SparseRowMatrix<Matrix3>>* solver = sim->Solver();
+		if (solver != NULL)
+		{
+			MPCG_Telemetry records[64];
+			uint num_read;
+			while ((num_read = telemetry.Poll(solver->GetTelemetry(), records, 64)) > 0)
+			{
+				for (uint i = 0; i < num_read; ++i)
+				{
+					num_solves++;
+					iterations_sum += (float)records[i].iterations;
+					result.iteration_limit_hits += records[i].hit_max_iterations ? 1 : 0;
+				}
+			}
+		}
+	}
+
+	if (config.num_frames > 0)
+	{
+		result.frame_ms_avg /= (float)config.num_frames;
+		result.simulation_ms_avg /= (float)config.num_frames;
+	}
+	if (num_solves > 0)
+		result.iterations_avg = iterations_sum / (float)num_solves;
+
+	//Final shape of the phyxels, tangents are not positions
+	const uint num_phyxels = base_config.NumVertices;
+	const Vector3* x = integrator.X();
+	const Vector3* dxdt = integrator.DxDt();
+	float velocity_sq_sum = 0.0f;
+	result.min_height = FLT_MAX;
+	for (uint i = 0; i < num_phyxels; ++i)
+	{
+		if (!std::isfinite(x[i].x) || !std::isfinite(x[i].y) || !std::isfinite(x[i].z))
+		{
+			result.diverged = true;
+			break;
+		}
+
+		result.min_height = (x[i].y < result.min_height) ? x[i].y : result.min_height;
+		float displacement = (x[i] - base_config.Phyxels[i]).Length();
+		result.max_displacement = (displacement > result.max_displacement) ? displacement : result.max_displacement;
+		result.centroid += x[i];
+		velocity_sq_sum += dxdt[i].LengthSquared();
+	}
+	if (num_phyxels > 0)
+	{
+		result.centroid = result.centroid / (float)num_phyxels;
+		result.rms_velocity = sqrtf(velocity_sq_sum / (float)num_phyxels);
+	}
+
+	delete sim;
+
+	total_timer.EndTiming();
+	result.total_ms = total_timer.GetTimedMilliSeconds();
+	return result;
+}
+
+void Sim_ParameterSweep::Run(const std::vector<Sim_ParameterSweep_Config>& configs, std::vector<Sim_ParameterSweep_Result>& out_results, int num_threads)
+{
+	out_results.resize(configs.size());
+
+	//The pool claims tasks in order, so the most expensive configurations are queued first
+	std::vector<uint> order(configs.size());
+	for (uint i = 0; i < (uint)order.size(); ++i)
+		order[i] = i;
+
+	auto cost = [&](uint idx) { return (configs[idx].grid_size + 1) * (configs[idx].grid_size + 1) * configs[idx].num_frames; };
+	std::stable_sort(order.begin(), order.end(), [&](uint a, uint b) { return cost(a) > cost(b); });
+
+	std::vector<std::function<void()>> tasks(order.size());
+	for (uint i = 0; i < (uint)order.size(); ++i)
+	{
+		uint idx = order[i];
+		tasks[i] = [&configs, &out_results, idx]() { out_results[idx] = RunConfig(configs[idx]); };
+	}
+
+	Sim_ThreadPool pool(num_threads);
+	pool.Run(tasks);
+}
+
+bool Sim_ParameterSweep::WriteCSV(const std::string& filename, const std::vector<Sim_ParameterSweep_Result>& results)
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+		return false;
+
+	const char* sim_type_names[] = { "FE6NodedC0", "FE6NodedC1", "FE6NodedC1_v2", "PBD3NodedC0" };
+	const char* integrator_names[] = { "Explicit", "RK2", "RK4", "Implicit" };
+	const char* precision_names[] = { "Single", "Mixed", "Double" };
+
+	file << "sim_type,integrator,sub_timestep,grid_size,bend_test,num_frames,"
+		"youngs_modulus,poisson_ratio,density,tolerance,max_iterations,precision,"
+		"total_ms,frame_ms_avg,frame_ms_max,simulation_ms_avg,solver_calls,iterations_avg,iteration_limit_hits,"
+		"diverged,min_height,max_displacement,centroid_x,centroid_y,centroid_z,rms_velocity\n";
+
+	file << std::setprecision(7);
+	for (const Sim_ParameterSweep_Result& r : results)
+	{
+		const Sim_ParameterSweep_Config& c = r.config;
+		file << ((c.sim_type < Sim_Type_NULL) ? sim_type_names[c.sim_type] : "Unknown") << ","
+			<< integrator_names[c.integrator] << ","
+			<< c.sub_timestep << ","
+			<< c.grid_size << ","
+			<< (c.bend_test ? 1 : 0) << ","
+			<< c.num_frames << ","
+			<< c.material.youngs_modulus << ","
+			<< c.material.poisson_ratio << ","
+			<< c.material.density << ","
+			<< c.solver.tolerance << ","
+			<< c.solver.max_iterations << ","
+			<< precision_names[c.solver.precision] << ","
+			<< r.total_ms << ","
+			<< r.frame_ms_avg << ","
+			<< r.frame_ms_max << ","
+			<< r.simulation_ms_avg << ","
+			<< r.solver_calls << ","
+			<< r.iterations_avg << ","
+			<< r.iteration_limit_hits << ","
+			<< (r.diverged ? 1 : 0) << ","
+			<< r.min_height << ","
+			<< r.max_displacement << ","
+			<< r.centroid.x << ","
+			<< r.centroid.y << ","
+			<< r.centroid.z << ","
+			<< r.rms_velocity << "\n";
+	}
+
+	return file.good();
+}
+
+void Sim_ParameterSweep::RunDefault(const Sim_ParameterSweep_Config& base, const std::string& filename)
+{
+	Sim_ParameterSweep_Grid grid;
+	grid.base = base;
+	grid.youngs_moduli = { base.material.youngs_modulus * 0.25f, base.material.youngs_modulus, base.material.youngs_modulus * 4.0f };
+	grid.tolerances = { 1e-3f, 1e-4f, 1e-5f, 1e-6f };
+
+	std::vector<Sim_ParameterSweep_Config> configs;
+	grid.Expand(configs);
+
+	ProfilingTimer timer;
+	timer.BeginTiming();
+	std::vector<Sim_ParameterSweep_Result> results;
+	Run(configs, results);
+	timer.EndTiming();
+
+	if (WriteCSV(filename, results))
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "Parameter sweep: %d configurations in %.0fms, written to %s", (int)results.size(), timer.GetTimedMilliSeconds(), filename.c_str());
+	else
+		NCLDebug::Log(Vector3(1.0f, 0.0f, 0.0f), "Parameter sweep: unable to write %s", filename.c_str());
+}
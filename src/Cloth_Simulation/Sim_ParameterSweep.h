@@ -0,0 +1,84 @@
+#pragma once
+#include "Sim_Manager.h"
+#include <string>
+
+//One independent, headless run of the sweep. Each starts from rest and is simulated for a fixed
+// number of frames, so rows are comparable between runs.
+struct Sim_ParameterSweep_Config
+{
+	Sim_ParameterSweep_Config()
+		: sim_type(Sim_Type_FE6NodedC1)
+		, integrator(Sim_Integrator_Type_RK2)
+		, sub_timestep(0.0f)
+		, grid_size(1)
+		, bend_test(false)
+		, num_frames(120)
+	{}
+
+	Sim_Type			sim_type;
+	Sim_Integrator_Type	integrator;
+	float				sub_timestep;	//0 for the integrators default
+	uint				grid_size;		//Generator visual subdivisions
+	bool				bend_test;		//Bending test generator instead of the square grid pinned along the top
+	uint				num_frames;		//Of 1/60th of a second
+
+	Sim_Material		material;
+	MPCG_Settings		solver;
+};
+
+struct Sim_ParameterSweep_Result
+{
+	Sim_ParameterSweep_Config config;
+
+	//Timing
+	float	total_ms;				//Whole run, including setup
+	float	frame_ms_avg;
+	float	frame_ms_max;
+	float	simulation_ms_avg;		//Per frame, inside the simulation (assembly and solves), the rest is integrator overhead
+
+	//Solver, zero for simulations without one. Read from the solvers telemetry, so every solve of a
+	// frame is counted
+	uint	solver_calls;
+	float	iterations_avg;			//Per solve
+	uint	iteration_limit_hits;	//Solves that ran out of iterations
+
+	//Final shape
+	bool	diverged;				//Non finite positions, the shape metrics are meaningless
+	float	min_height;				//Lowest phyxel
+	float	max_displacement;		//Largest distance of a phyxel from its initial position
+	Vector3	centroid;
+	float	rms_velocity;			//Of the phyxels, how far from settled the cloth is
+};
+
+//Every combination of the non-empty axes becomes one configuration, empty axes keep the base value
+struct Sim_ParameterSweep_Grid
+{
+	Sim_ParameterSweep_Config			base;
+
+	std::vector<Sim_Type>				sim_types;
+	std::vector<Sim_Integrator_Type>	integrators;
+	std::vector<uint>					grid_sizes;
+	std::vector<float>					youngs_moduli;
+	std::vector<float>					poisson_ratios;
+	std::vector<float>					densities;
+	std::vector<float>					tolerances;
+	std::vector<uint>					max_iterations;
+
+	void Expand(std::vector<Sim_ParameterSweep_Config>& out_configs) const;
+};
+
+//Runs a list of configurations in parallel, one simulation per configuration on a Sim_ThreadPool, and
+// writes one row of timing, solver and final shape metrics per configuration to a CSV file
+class Sim_ParameterSweep
+{
+public:
+	static Sim_ParameterSweep_Result RunConfig(const Sim_ParameterSweep_Config& config);
+
+	//Results are in the same order as the configurations. num_threads = 0 for one per hardware thread.
+	static void Run(const std::vector<Sim_ParameterSweep_Config>& configs, std::vector<Sim_ParameterSweep_Result>& out_results, int num_threads = 0);
+
+	static bool WriteCSV(const std::string& filename, const std::vector<Sim_ParameterSweep_Result>& results);
+
+	//Stiffness against solver tolerance around the given base configuration, written to filename
+	static void RunDefault(const Sim_ParameterSweep_Config& base, const std::string& filename = "parameter_sweep.csv");
+};
@@ -0,0 +1,109 @@
+#include "Sim_QuadratureValidation.h"
+#include "Sim_6NodedC1.h"
+#include "Sim_Reordering.h"
+#include "Generator_Square_Grid_BendTest.h"
+#include <glcore\NCLDebug.h>
+
+Sim_QuadratureValidation::Result Sim_QuadratureValidation::Run(const Sim_FEQuadrature_Settings& settings, uint visual_subdivisions, uint num_frames, const std::vector<Vector3>* reference, std::vector<Vector3>* out_positions)
+{
+	const float frame_time = 1.f / 60.f;
+
+	//Config must outlive the integrator, the bend-test actuator keeps a pointer to it
+	Sim_Generator_Output config;
+	Generator_Square_Grid_BendTest generator;
+	generator.SetVisualSubdivisions(visual_subdivisions);
+	generator.Generate(config);
+	Sim_Reordering::Apply(config, Sim_Reorder_RCM);
+
+	Sim_Simulation* sim = new Sim_6NodedC1();
+	*sim->Quadrature() = settings;
+	sim->Initialize(config);
+
+	Sim_Integrator integrator;
+	integrator.Initialize(sim, config);
+	integrator.SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+
+	ProfilingTimer timer;
+	timer.ResetTotalMs();
+	uint num_low_order = 0;
+	for (uint i = 0; i < num_frames; ++i)
+	{
+		timer.BeginTiming();
+		integrator.UpdateSimulation(frame_time);
+		timer.EndTimingAdditive();
+
+		num_low_order += sim->Quadrature()->num_low_order;
+	}
+
+	Result result;
+	result.stable = true;
+	result.max_error_mm = 0.f;
+	result.rms_error_mm = 0.f;
+	result.ms_per_frame = timer.GetTimedMilliSeconds() / (float)num_frames;
+	result.low_order_fraction = (float)num_low_order / (float)(config.Triangles.size() * num_frames);
+
+	const Vector3* x = integrator.X();
+	float sum_sq = 0.f;
+	for (uint i = 0; i < config.NumVertices; ++i)
+	{
+		//NaN/inf check, anything that diverged this far is no longer on the cloth
+		float len_sq = Vector3::Dot(x[i], x[i]);
+		result.stable = result.stable && (len_sq < 1E6f);
+
+		if (reference != NULL)
+		{
+			Vector3 diff = x[i] - (*reference)[i];
+			float err_sq = Vector3::Dot(diff, diff);
+			sum_sq += err_sq;
+			result.max_error_mm = (err_sq > result.max_error_mm) ? err_sq : result.max_error_mm;
+		}
+	}
+	result.max_error_mm = sqrtf(result.max_error_mm) * 1000.f;
+	result.rms_error_mm = sqrtf(sum_sq / (float)config.NumVertices) * 1000.f;
+
+	if (out_positions != NULL)
+	{
+		out_positions->assign(x, x + config.NumVertices);
+	}
+
+	delete sim;
+	return result;
+}
+
+void Sim_QuadratureValidation::LogResult(const char* name, const Result& r, const Result& ref, bool adaptive)
+{
+	float speedup = (r.ms_per_frame > 0.f) ? ref.ms_per_frame / r.ms_per_frame : 0.f;
+	if (r.stable && adaptive)
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    %-9s max: %9.4fmm  rms: %9.4fmm  %7.2fms/frame  (x%4.2f)  low order: %4.1f%%", name, r.max_error_mm, r.rms_error_mm, r.ms_per_frame, speedup, r.low_order_fraction * 100.f);
+	else if (r.stable)
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    %-9s max: %9.4fmm  rms: %9.4fmm  %7.2fms/frame  (x%4.2f)", name, r.max_error_mm, r.rms_error_mm, r.ms_per_frame, speedup);
+	else
+		NCLDebug::Log(Vector3(1.0f, 0.4f, 0.4f), "    %-9s unstable                            %7.2fms/frame  (x%4.2f)", name, r.ms_per_frame, speedup);
+}
+
+void Sim_QuadratureValidation::RunAll(uint visual_subdivisions, uint num_frames)
+{
+	const char* names[] = { "3 point", "6 point", "7 point", "12 point" };
+
+	std::vector<Vector3> reference;
+	Sim_FEQuadrature_Settings settings;
+	Result ref = Run(settings, visual_subdivisions, num_frames, NULL, &reference);
+
+	NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "Quadrature validation (bend test, %d subdivisions, %d frames, reference: 12 point):", visual_subdivisions, num_frames);
+	if (!ref.stable)
+	{
+		NCLDebug::Log(Vector3(1.0f, 0.4f, 0.4f), "    reference is unstable, use fewer subdivisions");
+		return;
+	}
+
+	for (int i = 0; i < Sim_FEQuadrature_Rule_MAX; ++i)
+	{
+		settings.rule = (Sim_FEQuadrature_Rule)i;
+		Result r = (settings.rule == Sim_FEQuadrature_Rule_Dunavant12) ? ref : Run(settings, visual_subdivisions, num_frames, &reference, NULL);
+		LogResult(names[i], r, ref, false);
+	}
+
+	settings.rule = Sim_FEQuadrature_Rule_Dunavant12;
+	settings.adaptive = true;
+	LogResult("adaptive", Run(settings, visual_subdivisions, num_frames, &reference, NULL), ref, true);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "Sim_FEElement.h"
+#include <vector>
+
+//Measures the accuracy lost by integrating the C1 element with fewer gauss points
+// - Every rule (and adaptive quadrature) simulates the bend-test scene for the same number of frames
+// - Phyxel positions are compared against the 12 point rule, which is the reference the element was written for
+class Sim_QuadratureValidation
+{
+public:
+	struct Result
+	{
+		bool stable;				//False if the simulation blew up (errors are then meaningless)
+		float max_error_mm;			//Largest phyxel distance to the reference
+		float rms_error_mm;
+		float ms_per_frame;			//Simulation cost (assembly + solve) per frame
+		float low_order_fraction;	//Adaptive only, average fraction of elements on the low order rule
+	};
+
+	//Positions at the end of the run are written to out_positions, the errors are only filled in if a reference is given
+	static Result Run(const Sim_FEQuadrature_Settings& settings, uint visual_subdivisions, uint num_frames, const std::vector<Vector3>* reference, std::vector<Vector3>* out_positions);
+
+	//Runs the 3/6/7/12 point rules and adaptive (12/7) and writes the report to the debug log
+	// - Explicit integration at the default sub-step is only stable up to ~6 subdivisions, even with the full rule
+	static void RunAll(uint visual_subdivisions = 4, uint num_frames = 120);
+
+protected:
+	static void LogResult(const char* name, const Result& r, const Result& ref, bool adaptive);
+};
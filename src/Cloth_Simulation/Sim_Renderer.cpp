@@ -17,9 +17,10 @@ Sim_Renderer::Sim_Renderer()
 	m_RenderExtraInfo = Sim_RenderExtraInfo_None;
 	
 
-	m_RenderSubdivisions = 17;
+	m_RenderSubdivisions = SIM_RENDERER_DEFAULT_SUBDIVISIONS;
 
 	m_AllVertices = NULL;
+	m_AllocatedTris = 0;
 	m_VertexArrayObject = NULL;
 	m_LineIndexBuffer = NULL;	
 	m_TriIndexBuffer = NULL;
@@ -67,89 +68,117 @@ Sim_Renderer::~Sim_Renderer()
 
 int Sim_Renderer::GetOffset(int triidx, int ix, int iy)
 {
-	int tidx = m_VertsPerTri * triidx + iy;
+	return GetOffset(m_RenderSubdivisions, m_VertsPerTri, triidx, ix, iy);
+}
+
+int Sim_Renderer::GetOffset(int render_subdivisions, int verts_per_tri, int triidx, int ix, int iy)
+{
+	int tidx = verts_per_tri * triidx + iy;
 
 	if (ix > 0) 
-		tidx += (int)(ix * (m_RenderSubdivisions - (ix - 1) * 0.5f));
+		tidx += (int)(ix * (render_subdivisions - (ix - 1) * 0.5f));
 
 	return tidx;
 }
 
-void Sim_Renderer::AllocateBuffers(Vector3* positions)
+int Sim_Renderer::GetNumVertsPerTri(int render_subdivisions)
+{
+	int half_upper = (int)ceilf((render_subdivisions) / 2.f);
+	return render_subdivisions * half_upper;
+}
+
+void Sim_Renderer::AllocateBuffers(const Vector3* positions)
 {
+	//Index buffers only depend on the number of triangles, so a regenerate that keeps the
+	// same triangle count (e.g. transform only) can keep everything already on the gfx card
+	if (m_AllVertices != NULL && m_VertexArrayObject && m_AllocatedTris == m_Sim->GetNumTris())
+		return;
+
 	if (m_AllVertices) delete[] m_AllVertices;
 
 	m_AllocatedTris = m_Sim->GetNumTris();
-	int half_upper = (int)ceilf((m_RenderSubdivisions) / 2.f);
-	m_VertsPerTri = m_RenderSubdivisions * half_upper;
+	m_VertsPerTri = GetNumVertsPerTri(m_RenderSubdivisions);
+
+	const int lines_per_tri = (m_RenderSubdivisions * (m_RenderSubdivisions - 1)) * 3;
+	const int tris_per_tri = (m_RenderSubdivisions - 1) * (m_RenderSubdivisions - 1) * 3;
 
-	m_NumLineIndices = m_AllocatedTris * (m_RenderSubdivisions * (m_RenderSubdivisions - 1)) * 3;
-	m_NumTriIndices = m_AllocatedTris * (m_RenderSubdivisions - 1) * (m_RenderSubdivisions - 1) * 3;
+	m_NumLineIndices = m_AllocatedTris * lines_per_tri;
+	m_NumTriIndices = m_AllocatedTris * tris_per_tri;
 	m_AllVertices = new Sim_RenderVertex[m_AllocatedTris * m_VertsPerTri];
 
 
-	int* lineIndices = new int[m_NumLineIndices];
-	int* triIndices = new int[m_NumTriIndices];
+	//Always room for the first triangles pattern, even when there is nothing to draw
+	int* lineIndices = new int[m_NumLineIndices + lines_per_tri];
+	int* triIndices = new int[m_NumTriIndices + tris_per_tri];
 
-	//Generate Line Indices
+	//Generate Line Indices (first triangle only, the rest are the same pattern offset by m_VertsPerTri)
 	int l_index = 0;
-	for (int tri_idx = 0; tri_idx < m_AllocatedTris; ++tri_idx)
+	for (int ix = 1; ix < m_RenderSubdivisions; ++ix)
 	{
-		for (int ix = 1; ix < m_RenderSubdivisions; ++ix)
+		for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
 		{
-			for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
-			{
-				lineIndices[l_index++] = GetOffset(tri_idx, ix, iy);
-				lineIndices[l_index++] = GetOffset(tri_idx, ix - 1, iy);
-			}
+			lineIndices[l_index++] = GetOffset(0, ix, iy);
+			lineIndices[l_index++] = GetOffset(0, ix - 1, iy);
 		}
+	}
 
-		for (int ix = 0; ix < m_RenderSubdivisions; ++ix)
+	for (int ix = 0; ix < m_RenderSubdivisions; ++ix)
+	{
+		for (int iy = 0; iy < (m_RenderSubdivisions - ix - 1); ++iy)
 		{
-			for (int iy = 0; iy < (m_RenderSubdivisions - ix - 1); ++iy)
-			{
-				lineIndices[l_index++] = GetOffset(tri_idx, ix, iy);
-				lineIndices[l_index++] = GetOffset(tri_idx, ix, iy + 1);
-			}
+			lineIndices[l_index++] = GetOffset(0, ix, iy);
+			lineIndices[l_index++] = GetOffset(0, ix, iy + 1);
 		}
+	}
 
-		for (int ix = 1; ix < m_RenderSubdivisions; ++ix)
+	for (int ix = 1; ix < m_RenderSubdivisions; ++ix)
+	{
+		for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
 		{
-			for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
-			{
-				lineIndices[l_index++] = GetOffset(tri_idx, ix, iy);
-				lineIndices[l_index++] = GetOffset(tri_idx, ix - 1, iy + 1);
-			}
+			lineIndices[l_index++] = GetOffset(0, ix, iy);
+			lineIndices[l_index++] = GetOffset(0, ix - 1, iy + 1);
 		}
 	}
 
 
-	//Generate Tri Indices
+	//Generate Tri Indices (first triangle only)
 	l_index = 0;
-	for (int tri_idx = 0; tri_idx < m_AllocatedTris; ++tri_idx)
+	for (int ix = 0; ix < m_RenderSubdivisions; ++ix)
 	{
-		for (int ix = 0; ix < m_RenderSubdivisions; ++ix)
+		for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
 		{
-			for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
-			{				
-				if (ix < m_RenderSubdivisions - 1
-					&& iy < (m_RenderSubdivisions - ix - 1))
-				{
-					triIndices[l_index++] = GetOffset(tri_idx, ix, iy);
-					triIndices[l_index++] = GetOffset(tri_idx, ix, iy + 1);
-					triIndices[l_index++] = GetOffset(tri_idx, ix + 1, iy);
-				}
-				
-				if (ix > 0 && iy > 0)
-				{
-					triIndices[l_index++] = GetOffset(tri_idx, ix, iy);
-					triIndices[l_index++] = GetOffset(tri_idx, ix , iy - 1);
-					triIndices[l_index++] = GetOffset(tri_idx, ix - 1, iy);
-				}
+			if (ix < m_RenderSubdivisions - 1
+				&& iy < (m_RenderSubdivisions - ix - 1))
+			{
+				triIndices[l_index++] = GetOffset(0, ix, iy);
+				triIndices[l_index++] = GetOffset(0, ix, iy + 1);
+				triIndices[l_index++] = GetOffset(0, ix + 1, iy);
+			}
+
+			if (ix > 0 && iy > 0)
+			{
+				triIndices[l_index++] = GetOffset(0, ix, iy);
+				triIndices[l_index++] = GetOffset(0, ix, iy - 1);
+				triIndices[l_index++] = GetOffset(0, ix - 1, iy);
 			}
 		}
 	}
 
+	//Replicate the pattern across all triangles
+#pragma omp parallel for
+	for (int tri_idx = 1; tri_idx < m_AllocatedTris; ++tri_idx)
+	{
+		const int offset = tri_idx * m_VertsPerTri;
+
+		int* lines = &lineIndices[tri_idx * lines_per_tri];
+		for (int i = 0; i < lines_per_tri; ++i)
+			lines[i] = lineIndices[i] + offset;
+
+		int* tris = &triIndices[tri_idx * tris_per_tri];
+		for (int i = 0; i < tris_per_tri; ++i)
+			tris[i] = triIndices[i] + offset;
+	}
+
 	//Copy buffers to gfx card
 	if (!m_VertexArrayObject) glGenVertexArrays(1, &m_VertexArrayObject);
 	if (!m_LineIndexBuffer) glGenBuffers(1, &m_LineIndexBuffer);	
@@ -255,42 +284,39 @@ void Sim_Renderer::Render()
 	glUseProgram(old_pid);
 }
 
-void Sim_Renderer::BuildVertexBuffer(Sim_Integrator* integrator)
+void Sim_Renderer::Tessellate(Sim_Rendererable* sim, const Vector3* positions, int render_subdivisions,
+	Sim_RenderMode render_mode, Sim_RenderExtraInfo extra_info, bool lighting, Sim_RenderVertex* out_vertices)
 {
-	Vector3* positions = integrator->X();
-
-	if (m_AllocatedTris != m_Sim->GetNumTris())
-		AllocateBuffers(positions);
-
-
-	const float step_interval = 1.f / float(m_RenderSubdivisions-1);
+	const int num_tris = sim->GetNumTris();
+	const int verts_per_tri = GetNumVertsPerTri(render_subdivisions);
+	const float step_interval = 1.f / float(render_subdivisions-1);
 
 	Vector3 gp;
 	Matrix3 rot;
-	for (int tri_idx = 0; tri_idx < m_AllocatedTris; ++tri_idx)
+	for (int tri_idx = 0; tri_idx < num_tris; ++tri_idx)
 	{
-		for (int ix = 0; ix < m_RenderSubdivisions; ++ix)
+		for (int ix = 0; ix < render_subdivisions; ++ix)
 		{
-			for (int iy = 0; iy < (m_RenderSubdivisions - ix); ++iy)
+			for (int iy = 0; iy < (render_subdivisions - ix); ++iy)
 			{
 				gp.x = ix * step_interval;
 				gp.y = iy * step_interval;
 				gp.z = 1.f - (gp.x + gp.y);
 				
-				int tidx = GetOffset(tri_idx, ix, iy);
+				int tidx = GetOffset(render_subdivisions, verts_per_tri, tri_idx, ix, iy);
 
-				Sim_RenderVertex& vert = m_AllVertices[tidx];
-				m_Sim->GetVertexWsPos(tri_idx, gp, positions, vert.pos);
+				Sim_RenderVertex& vert = out_vertices[tidx];
+				sim->GetVertexWsPos(tri_idx, gp, positions, vert.pos);
 				 
-				if (m_LightingEnabled || (m_RenderMode == Sim_RenderMode_Normals) || (m_RenderExtraInfo == Sim_RenderExtraInfo_Rotations))
+				if (lighting || (render_mode == Sim_RenderMode_Normals) || (extra_info == Sim_RenderExtraInfo_Rotations))
 				{
-					m_Sim->GetVertexRotation(tri_idx, gp, positions, vert.pos, rot);
+					sim->GetVertexRotation(tri_idx, gp, positions, vert.pos, rot);
 					
 					Vector3 r_z = Vector3(rot._31, rot._32, rot._33);
 
-					if (m_LightingEnabled) vert.normal = r_z;
+					if (lighting) vert.normal = r_z;
 
-					if (m_RenderExtraInfo == Sim_RenderExtraInfo_Rotations)
+					if (extra_info == Sim_RenderExtraInfo_Rotations)
 					{
 						const float scalar = 0.02f;
 
@@ -301,7 +327,7 @@ void Sim_Renderer::BuildVertexBuffer(Sim_Integrator* integrator)
 						NCLDebug::DrawThickLine(vert.pos, vert.pos + r_y * scalar, 0.005f, Vector4(0.f, 1.f, 0.f, 1.f));
 						NCLDebug::DrawThickLine(vert.pos, vert.pos + r_z * scalar, 0.005f, Vector4(0.f, 0.f, 1.f, 1.f));
 					}
-					else if (m_RenderMode == Sim_RenderMode_Normals)
+					else if (render_mode == Sim_RenderMode_Normals)
 					{
 						vert.col = r_z * 0.5f + 0.5f;
 					}
@@ -309,37 +335,45 @@ void Sim_Renderer::BuildVertexBuffer(Sim_Integrator* integrator)
 				else
 					vert.normal = Vector3(0.f, 0.f, 0.f);
 
-				if (m_RenderMode == Sim_RenderMode_Vertices)
+				if (render_mode == Sim_RenderMode_Vertices)
 				{
 					vert.col = gp;
 				}
 				
-				if (m_RenderMode == Sim_RenderMode_Stress  || m_RenderMode == Sim_RenderMode_Strain || (m_RenderExtraInfo == Sim_RenderExtraInfo_StressVector))
+				if (render_mode == Sim_RenderMode_Stress  || render_mode == Sim_RenderMode_Strain || (extra_info == Sim_RenderExtraInfo_StressVector))
 				{
 					Vector3 stress, strain;
-					m_Sim->GetVertexStressStrain(tri_idx, gp, positions, vert.pos, stress, strain);
+					sim->GetVertexStressStrain(tri_idx, gp, positions, vert.pos, stress, strain);
 
-					if (m_RenderMode == Sim_RenderMode_Stress)
+					if (render_mode == Sim_RenderMode_Stress)
 					{
 						vert.col = hsv2rgb(Vector3(stress.Length()  * 0.001f, 1.f, 1.f));
 					}
-					else if (m_RenderMode == Sim_RenderMode_Strain)//Strain
+					else if (render_mode == Sim_RenderMode_Strain)//Strain
 					{
 						vert.col = hsv2rgb(Vector3(strain.Length(), 1.f, 1.f));
 					}
 
-					if (m_RenderExtraInfo == Sim_RenderExtraInfo_StressVector)
+					if (extra_info == Sim_RenderExtraInfo_StressVector)
 					{
 						NCLDebug::DrawThickLine(vert.pos, vert.pos + stress * 0.0001f, 0.005f, Vector4(1.f, 0.f, 1.f, 1.f));
 					}
 				}
 
-				if (m_RenderExtraInfo != Sim_RenderExtraInfo_None)
+				if (extra_info != Sim_RenderExtraInfo_None)
 					vert.col = vert.col * 0.2f;
 			}
 		}
 
 	}
+}
+
+void Sim_Renderer::BuildVertexBuffer(const Vector3* positions)
+{
+	if (m_AllocatedTris != m_Sim->GetNumTris())
+		AllocateBuffers(positions);
+
+	Tessellate(m_Sim, positions, m_RenderSubdivisions, m_RenderMode, m_RenderExtraInfo, m_LightingEnabled, m_AllVertices);
 
 	glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
 	glBufferData(GL_ARRAY_BUFFER, m_AllocatedTris * m_VertsPerTri * sizeof(Sim_RenderVertex), m_AllVertices, GL_STREAM_DRAW);
@@ -5,6 +5,8 @@
 
 class Scene;
 
+#define SIM_RENDERER_DEFAULT_SUBDIVISIONS 17		//Vertices along each edge of a tessellated triangle
+
 enum Sim_RenderMode : int
 {
 	Sim_RenderMode_Stress = 0,
@@ -48,9 +50,15 @@ public:
 
 	void SetSimulation(Sim_Rendererable* sim);
 
-	void AllocateBuffers(Vector3* positions);
-	void BuildVertexBuffer(Sim_Integrator* integrator);
+	void AllocateBuffers(const Vector3* positions);
+	void BuildVertexBuffer(const Vector3* positions);
 	void Render();
+
+	//CPU half of BuildVertexBuffer, makes no OpenGL calls so it can also be run headless (see Sim_Benchmark)
+	// - out_vertices must hold GetNumVertsPerTri(render_subdivisions) vertices for each of the sims triangles
+	static void Tessellate(Sim_Rendererable* sim, const Vector3* positions, int render_subdivisions,
+		Sim_RenderMode render_mode, Sim_RenderExtraInfo extra_info, bool lighting, Sim_RenderVertex* out_vertices);
+	static int GetNumVertsPerTri(int render_subdivisions);
 	
 	void ToggleRenderType()
 	{
@@ -76,6 +84,7 @@ public:
 
 protected:
 	int GetOffset(int triidx, int ix, int iy);
+	static int GetOffset(int render_subdivisions, int verts_per_tri, int triidx, int ix, int iy);
 
 private:
 	bool m_LightingEnabled;
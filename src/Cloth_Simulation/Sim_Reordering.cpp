@@ -0,0 +1,278 @@
+#include "Sim_Reordering.h"
+#include <algorithm>
+#include <numeric>
+#include <climits>
+#include <cfloat>
+
+void Sim_Reordering::Apply(Sim_Generator_Output& config, Sim_Reorder_Mode mode)
+{
+	if (mode == Sim_Reorder_None || config.NumVertices == 0)
+		return;
+
+	uint num_phyxels = config.NumVertices;
+	uint num_tangents = config.NumTangents;
+	uint num_total = num_phyxels + num_tangents;
+
+	//Phyxel order (new -> old)
+	std::vector<uint> phyxel_order;
+	if (mode == Sim_Reorder_Morton)
+		BuildOrderMorton(config, phyxel_order);
+	else
+		BuildOrderRCM(config, phyxel_order);
+
+	std::vector<uint> phyxel_new(num_phyxels);
+	for (uint i = 0; i < num_phyxels; ++i)
+		phyxel_new[phyxel_order[i]] = i;
+
+	//Triangles, sorted by their first (lowest) new phyxel
+	uint num_tris = (uint)config.Triangles.size();
+	std::vector<uint> tri_key(num_tris);
+	for (uint i = 0; i < num_tris; ++i)
+	{
+		const FETriangle& tri = config.Triangles[i];
+		uint key = UINT_MAX;
+		for (uint j = 0; j < 6; ++j)
+			key = (phyxel_new[tri.phyxels[j]] < key) ? phyxel_new[tri.phyxels[j]] : key;
+		tri_key[i] = key;
+	}
+
+	std::vector<uint> tri_order(num_tris);
+	std::iota(tri_order.begin(), tri_order.end(), 0);
+	std::stable_sort(tri_order.begin(), tri_order.end(), [&](uint a, uint b) { return tri_key[a] < tri_key[b]; });
+
+	//Tangents, in first touch order of the sorted triangles
+	std::vector<uint> tangent_new(num_tangents, UINT_MAX);
+	uint tcount = 0;
+	for (uint i = 0; i < num_tris; ++i)
+	{
+		const FETriangle& tri = config.Triangles[tri_order[i]];
+		for (uint j = 0; j < 9; ++j)
+		{
+			if (tangent_new[tri.tangents[j]] == UINT_MAX)
+				tangent_new[tri.tangents[j]] = tcount++;
+		}
+	}
+	for (uint i = 0; i < num_tangents; ++i)
+	{
+		if (tangent_new[i] == UINT_MAX)
+			tangent_new[i] = tcount++;
+	}
+
+	//Full old -> new map over the X array
+	std::vector<uint> old_to_new(num_total);
+	for (uint i = 0; i < num_phyxels; ++i)
+		old_to_new[i] = phyxel_new[i];
+	for (uint i = 0; i < num_tangents; ++i)
+		old_to_new[num_phyxels + i] = num_phyxels + tangent_new[i];
+
+	//Permute data
+	std::vector<Vector3> phyxels(num_total), phyxels_initial(num_total);
+	std::vector<FEVertDescriptor> descriptors(num_phyxels);
+	for (uint i = 0; i < num_total; ++i)
+	{
+		phyxels[old_to_new[i]] = config.Phyxels[i];
+		phyxels_initial[old_to_new[i]] = config.Phyxels_Initial[i];
+	}
+	for (uint i = 0; i < num_phyxels; ++i)
+		descriptors[old_to_new[i]] = config.Phyxel_Descriptors[i];
+
+	std::vector<FETriangle> triangles(num_tris);
+	for (uint i = 0; i < num_tris; ++i)
+	{
+		FETriangle tri = config.Triangles[tri_order[i]];
+		for (uint j = 0; j < 6; ++j)
+			tri.phyxels[j] = phyxel_new[tri.phyxels[j]];
+		for (uint j = 0; j < 9; ++j)
+			tri.tangents[j] = tangent_new[tri.tangents[j]];
+		triangles[i] = tri;
+	}
+
+	//RCM only exists to narrow the band, keep the generators ordering if it was already tighter (regular grids)
+	if (mode == Sim_Reorder_RCM && ComputeBandwidth(triangles) >= ComputeBandwidth(config.Triangles))
+		return;
+
+	config.Phyxels.swap(phyxels);
+	config.Phyxels_Initial.swap(phyxels_initial);
+	config.Phyxel_Descriptors.swap(descriptors);
+	config.Triangles.swap(triangles);
+
+	//Compose with any previous reordering, so the maps always refer to the generators numbering
+	std::vector<uint> original(num_total), reordered(num_total);
+	for (uint i = 0; i < num_total; ++i)
+	{
+		uint orig = config.OriginalIndex(i);
+		uint new_idx = old_to_new[i];
+		original[new_idx] = orig;
+		reordered[orig] = new_idx;
+	}
+	config.OriginalIdx.swap(original);
+	config.ReorderedIdx.swap(reordered);
+}
+
+void Sim_Reordering::BuildOrderRCM(const Sim_Generator_Output& config, std::vector<uint>& out_new_to_old)
+{
+	uint num_phyxels = config.NumVertices;
+
+	//Phyxel adjacency (CSR), two phyxels are connected if they share a triangle
+	std::vector<uint> offsets(num_phyxels + 1, 0);
+	for (const FETriangle& tri : config.Triangles)
+		for (uint j = 0; j < 6; ++j)
+			offsets[tri.phyxels[j] + 1] += 5;
+
+	for (uint i = 0; i < num_phyxels; ++i)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<uint> neighbours(offsets[num_phyxels]);
+	std::vector<uint> fill(offsets.begin(), offsets.end() - 1);
+	for (const FETriangle& tri : config.Triangles)
+		for (uint j = 0; j < 6; ++j)
+			for (uint k = 0; k < 6; ++k)
+				if (j != k)
+					neighbours[fill[tri.phyxels[j]]++] = tri.phyxels[k];
+
+	//Remove duplicates (shared edges) and compact
+	std::vector<uint> degree(num_phyxels);
+	uint write = 0;
+	for (uint i = 0; i < num_phyxels; ++i)
+	{
+		auto begin = neighbours.begin() + offsets[i], end = neighbours.begin() + offsets[i + 1];
+		std::sort(begin, end);
+		uint count = (uint)(std::unique(begin, end) - begin);
+
+		uint start = write;
+		for (uint j = 0; j < count; ++j)
+			neighbours[write++] = neighbours[offsets[i] + j];
+
+		offsets[i] = start;
+		degree[i] = count;
+	}
+	offsets[num_phyxels] = write;
+
+	//Cuthill-McKee, one breadth first sweep per connected component
+	out_new_to_old.clear();
+	out_new_to_old.reserve(num_phyxels);
+	std::vector<bool> visited(num_phyxels, false);
+
+	auto bfs = [&](uint root, std::vector<uint>& out_order)
+	{
+		size_t head = out_order.size();
+		out_order.push_back(root);
+		visited[root] = true;
+
+		while (head < out_order.size())
+		{
+			uint node = out_order[head++];
+			size_t first_new = out_order.size();
+			for (uint j = offsets[node]; j < offsets[node] + degree[node]; ++j)
+			{
+				uint n = neighbours[j];
+				if (!visited[n])
+				{
+					visited[n] = true;
+					out_order.push_back(n);
+				}
+			}
+			std::sort(out_order.begin() + first_new, out_order.end(), [&](uint a, uint b) { return degree[a] < degree[b]; });
+		}
+	};
+
+	std::vector<uint> component;
+	for (uint seed = 0; seed < num_phyxels; ++seed)
+	{
+		if (visited[seed])
+			continue;
+
+		//Find a pseudo-peripheral start node: sweep once from the seed and restart from the
+		// lowest degree node in the last level reached
+		component.clear();
+		bfs(seed, component);
+
+		uint root = component.back();
+		for (size_t i = component.size(); i-- > 0;)
+		{
+			if (degree[component[i]] < degree[root])
+				root = component[i];
+			if (component.size() - i > 32)
+				break;
+		}
+
+		for (uint idx : component)
+			visited[idx] = false;
+
+		bfs(root, out_new_to_old);
+	}
+
+	std::reverse(out_new_to_old.begin(), out_new_to_old.end());
+}
+
+void Sim_Reordering::BuildOrderMorton(const Sim_Generator_Output& config, std::vector<uint>& out_new_to_old)
+{
+	uint num_phyxels = config.NumVertices;
+
+	Vector3 lower(FLT_MAX, FLT_MAX, 0.0f), upper(-FLT_MAX, -FLT_MAX, 0.0f);
+	for (uint i = 0; i < num_phyxels; ++i)
+	{
+		const Vector3& p = config.Phyxels_Initial[i];
+		lower.x = (p.x < lower.x) ? p.x : lower.x;
+		lower.y = (p.y < lower.y) ? p.y : lower.y;
+		upper.x = (p.x > upper.x) ? p.x : upper.x;
+		upper.y = (p.y > upper.y) ? p.y : upper.y;
+	}
+
+	float extent = (upper.x - lower.x > upper.y - lower.y) ? upper.x - lower.x : upper.y - lower.y;
+	float scale = (extent > 0.0f) ? 65535.0f / extent : 0.0f;
+
+	//Spread the lower 16 bits out to the even bits
+	auto part1by1 = [](uint n)
+	{
+		n &= 0x0000ffff;
+		n = (n | (n << 8)) & 0x00ff00ff;
+		n = (n | (n << 4)) & 0x0f0f0f0f;
+		n = (n | (n << 2)) & 0x33333333;
+		n = (n | (n << 1)) & 0x55555555;
+		return n;
+	};
+
+	std::vector<uint> codes(num_phyxels);
+	for (uint i = 0; i < num_phyxels; ++i)
+	{
+		const Vector3& p = config.Phyxels_Initial[i];
+		uint x = (uint)((p.x - lower.x) * scale);
+		uint y = (uint)((upper.y - p.y) * scale);
+		codes[i] = part1by1(x) | (part1by1(y) << 1);
+	}
+
+	out_new_to_old.resize(num_phyxels);
+	std::iota(out_new_to_old.begin(), out_new_to_old.end(), 0);
+	std::stable_sort(out_new_to_old.begin(), out_new_to_old.end(), [&](uint a, uint b) { return codes[a] < codes[b]; });
+}
+
+uint Sim_Reordering::ComputeBandwidth(const Sim_Generator_Output& config)
+{
+	return ComputeBandwidth(config.Triangles);
+}
+
+uint Sim_Reordering::ComputeBandwidth(const std::vector<FETriangle>& triangles)
+{
+	uint bandwidth = 0;
+	for (const FETriangle& tri : triangles)
+	{
+		uint p_lower = UINT_MAX, p_upper = 0;
+		for (uint j = 0; j < 6; ++j)
+		{
+			p_lower = (tri.phyxels[j] < p_lower) ? tri.phyxels[j] : p_lower;
+			p_upper = (tri.phyxels[j] > p_upper) ? tri.phyxels[j] : p_upper;
+		}
+
+		uint t_lower = UINT_MAX, t_upper = 0;
+		for (uint j = 0; j < 9; ++j)
+		{
+			t_lower = (tri.tangents[j] < t_lower) ? tri.tangents[j] : t_lower;
+			t_upper = (tri.tangents[j] > t_upper) ? tri.tangents[j] : t_upper;
+		}
+
+		uint span = (p_upper - p_lower > t_upper - t_lower) ? p_upper - p_lower : t_upper - t_lower;
+		bandwidth = (span > bandwidth) ? span : bandwidth;
+	}
+	return bandwidth;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Sim_Generator.h"
+#include <vector>
+
+enum Sim_Reorder_Mode
+{
+	Sim_Reorder_None = 0,
+	Sim_Reorder_RCM,			//Reverse Cuthill-McKee on the phyxel connectivity graph
+	Sim_Reorder_Morton,			//Z-order curve over the rest (2D) positions
+	Sim_Reorder_MAX
+};
+
+//Renumbers a generated configuration for cache locality, before it is handed to the simulation
+// - Phyxels are permuted by the chosen ordering
+// - Triangles are sorted by their lowest (new) phyxel index
+// - Tangents are numbered in the order the sorted triangles first touch them, so both halves
+//   of the X array (phyxels then tangents) are walked front to back during assembly
+// The permutation is stored in the configuration (OriginalIdx/ReorderedIdx) so anything
+// that talks in original indices (UI, actuators, exports) can translate
+class Sim_Reordering
+{
+public:
+	static void Apply(Sim_Generator_Output& config, Sim_Reorder_Mode mode);
+
+	//Largest index span of a single element within the phyxel block or the tangent block
+	static uint ComputeBandwidth(const Sim_Generator_Output& config);
+
+protected:
+	static uint ComputeBandwidth(const std::vector<FETriangle>& triangles);
+
+	static void BuildOrderRCM(const Sim_Generator_Output& config, std::vector<uint>& out_new_to_old);
+	static void BuildOrderMorton(const Sim_Generator_Output& config, std::vector<uint>& out_new_to_old);
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//Lock-free stream of records from one writer thread to any number of reader threads
+// - The writer never waits, once full the oldest records are overwritten
+// - Readers don't consume anything, each keeps its own cursor (index of the next record it wants) so the
+//   GUI, a file sink etc can all poll the same buffer independently
+// - Records overwritten before a reader got to them are skipped and counted as dropped
+// - Each slot is stamped with the index of the record it holds, a read that raced the writer
+//   onto the same slot sees the stamp change and drops the record rather than return a torn copy
+// - Records are copied in and out through relaxed atomic words (a seqlock), so a racing read is only
+//   ever a stale value and never a data race. T must be trivially copyable.
+template <class T, unsigned int N>
+class Sim_RingBuffer
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Sim_RingBuffer records are copied word by word");
+
+public:
+	Sim_RingBuffer() : m_WriteCount(0)
+	{
+		for (unsigned int i = 0; i < N; ++i)
+			m_Slots[i].stamp.store(SIM_RINGBUFFER_EMPTY, std::memory_order_relaxed);
+	}
+
+	//Writer only
+	void Push(const T& record)
+	{
+		uint64_t idx = m_WriteCount.load(std::memory_order_relaxed);
+		Slot& slot = m_Slots[idx % N];
+
+		uint64_t words[NumWords] = {};
+		memcpy(words, &record, sizeof(T));
+
+		slot.stamp.store(SIM_RINGBUFFER_EMPTY, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (unsigned int i = 0; i < NumWords; ++i)
+			slot.words[i].store(words[i], std::memory_order_relaxed);
+		slot.stamp.store(idx, std::memory_order_release);
+
+		m_WriteCount.store(idx + 1, std::memory_order_release);
+	}
+
+	//Number of records ever pushed, the cursor a reader should start from to only see new records
+	uint64_t GetWriteCount() const { return m_WriteCount.load(std::memory_order_acquire); }
+
+	//Copies up to max_records from the cursor onwards into out and advances the cursor past them
+	// - Returns the number of records copied, any skipped are added to out_num_dropped (if not NULL)
+	unsigned int Read(uint64_t& cursor, T* out, unsigned int max_records, uint64_t* out_num_dropped = NULL) const
+	{
+		unsigned int num_read = 0;
+		uint64_t write_count = m_WriteCount.load(std::memory_order_acquire);
+		while (cursor < write_count && num_read < max_records)
+		{
+			//Lapped by the writer, jump to the oldest record still held
+			if (write_count - cursor > N)
+			{
+				if (out_num_dropped) *out_num_dropped += write_count - N - cursor;
+				cursor = write_count - N;
+			}
+
+			const Slot& slot = m_Slots[cursor % N];
+			uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+			uint64_t words[NumWords];
+			for (unsigned int i = 0; i < NumWords; ++i)
+				words[i] = slot.words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (stamp == cursor && slot.stamp.load(std::memory_order_relaxed) == cursor)
+				memcpy(&out[num_read++], words, sizeof(T));
+			else if (out_num_dropped)
+				(*out_num_dropped)++;
+
+			cursor++;
+			write_count = m_WriteCount.load(std::memory_order_acquire);
+		}
+		return num_read;
+	}
+
+protected:
+	static const uint64_t SIM_RINGBUFFER_EMPTY = ~0ull;		//Stamp of a slot being (or never) written
+	static const unsigned int NumWords = (unsigned int)((sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+
+	struct Slot
+	{
+		std::atomic<uint64_t>	stamp;
+		std::atomic<uint64_t>	words[NumWords];	//The record, zero padded to whole words
+	};
+
+	Slot					m_Slots[N];
+	std::atomic<uint64_t>	m_WriteCount;
+};
@@ -0,0 +1,50 @@
+#include "Sim_SchedulerBenchmark.h"
+#include "Sim_Manager.h"
+#include <glcore\NCLDebug.h>
+
+float Sim_SchedulerBenchmark::TimeBackend(TaskScheduler_Backend backend, uint grid_size, Sim_Integrator_Type type, uint num_substeps)
+{
+	TaskScheduler* scheduler = TaskScheduler::Instance();
+	TaskScheduler_Backend old_backend = scheduler->GetBackend();
+	scheduler->SetBackend(backend);
+
+	//Pinned along the top as the default scene, so the cloth hangs rather than falls
+	Sim_Generator_Output config;
+	Sim_Simulation* sim = Sim_Manager::CreateHeadlessSimulation(Sim_Type_FE6NodedC0, grid_size, false, config);
+
+	Sim_Integrator integrator;
+	integrator.Initialize(sim, config);
+	integrator.SetIntegrationType(type);
+	integrator.SetSubTimestep(DEFAULT_SUB_TIMESTEP);
+
+	//Warm up (page in buffers, wake the workers/omp threads)
+	integrator.UpdateSimulation(DEFAULT_SUB_TIMESTEP * 8.5f);
+
+	integrator.UpdateSimulation(DEFAULT_SUB_TIMESTEP * (num_substeps + 0.5f));
+	float us = integrator.GetTotalTimer().GetTimedMilliSeconds() * 1000.f / (float)num_substeps;
+
+	delete sim;
+	scheduler->SetBackend(old_backend);
+	return us;
+}
+
+Sim_SchedulerBenchmark::Result Sim_SchedulerBenchmark::Run(uint grid_size, Sim_Integrator_Type type, uint num_substeps)
+{
+	Result result;
+	result.openmp_us = TimeBackend(TaskScheduler_Backend_OpenMP, grid_size, type, num_substeps);
+	result.work_stealing_us = TimeBackend(TaskScheduler_Backend_WorkStealing, grid_size, type, num_substeps);
+	return result;
+}
+
+void Sim_SchedulerBenchmark::RunAll(uint max_grid_size, Sim_Integrator_Type type, uint num_substeps)
+{
+	TaskScheduler* scheduler = TaskScheduler::Instance();
+
+	NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "Scheduler overhead (%d threads, grain %d, %d sub-steps):", scheduler->GetNumThreads(), scheduler->GetDefaultGrainSize(), num_substeps);
+	for (uint i = 1; i <= max_grid_size; ++i)
+	{
+		Result r = Run(i, type, num_substeps);
+		float speedup = (r.work_stealing_us > 0.f) ? r.openmp_us / r.work_stealing_us : 0.f;
+		NCLDebug::Log(Vector3(1.0f, 1.0f, 1.0f), "    %2dx%-2d  openmp: %8.2fus  work stealing: %8.2fus  (x%4.2f)", i, i, r.openmp_us, r.work_stealing_us, speedup);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "Sim_Integrator.h"
+#include <glcore\TaskScheduler.h>
+
+//Compares the TaskScheduler backends on the solvers own loops, the per sub-step cost of a pinned C0 grid
+// is timed once for each backend on the same (fresh) configuration
+// - Small grids are dominated by the fork/join cost of each loop, large ones by the loops themselves
+class Sim_SchedulerBenchmark
+{
+public:
+	struct Result
+	{
+		float openmp_us;		//Average microseconds per sub-step
+		float work_stealing_us;
+	};
+
+	static Result Run(uint grid_size, Sim_Integrator_Type type, uint num_substeps);
+
+	//Runs grid sizes 1 to max_grid_size and writes the results to the debug log
+	static void RunAll(uint max_grid_size = 10, Sim_Integrator_Type type = Sim_Integrator_Type_RK2, uint num_substeps = 240);
+
+protected:
+	static float TimeBackend(TaskScheduler_Backend backend, uint grid_size, Sim_Integrator_Type type, uint num_substeps);
+};
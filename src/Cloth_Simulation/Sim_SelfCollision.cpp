@@ -0,0 +1,196 @@
+#include "Sim_SelfCollision.h"
+#include "Sim_Manager.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+Sim_SelfCollision::Sim_SelfCollision()
+	: m_Enabled(false)
+	, m_Thickness(DEFAULT_SELF_COLLISION_THICKNESS)
+	, m_SampleSubdivisions(DEFAULT_SELF_COLLISION_SAMPLES)
+	, m_Simulation(NULL)
+	, m_NumPhyxels(0)
+{
+	m_Timer.SetAlias("Self Collisions");
+}
+
+void Sim_SelfCollision::Initialize(const Sim_Generator_Output& config, Sim_Simulation* sim)
+{
+	m_Simulation = sim;
+	m_NumPhyxels = config.NumVertices;
+
+	//Samples at the centroids of the sub-triangles pointing the same way as the element
+	m_SampleTriangles.clear();
+	m_SampleCoords.clear();
+	const int subdivs = m_SampleSubdivisions;
+	const int num_tris = (sim != NULL && subdivs > 0) ? sim->GetNumTris() : 0;
+	for (int t = 0; t < num_tris; ++t)
+	{
+		for (int ix = 0; ix < subdivs; ++ix)
+		{
+			for (int iy = 0; iy < subdivs - ix; ++iy)
+			{
+				Vector3 gp;
+				gp.x = (ix + 1.f / 3.f) / subdivs;
+				gp.y = (iy + 1.f / 3.f) / subdivs;
+				gp.z = 1.f - (gp.x + gp.y);
+
+				m_SampleTriangles.push_back(t);
+				m_SampleCoords.push_back(gp);
+			}
+		}
+	}
+
+	uint num_points = m_NumPhyxels + (uint)m_SampleTriangles.size();
+	m_Points.resize(num_points);
+	m_RestPoints.resize(num_points);
+	m_Corrections.resize(m_NumPhyxels);
+	m_NumCorrections.resize(m_NumPhyxels);
+	m_Pairs.clear();
+
+	//Rest state, used to tell surface neighbours from contacts
+	if (num_points > 0)
+	{
+		const Vector3* rest = &config.Phyxels_Initial[0];
+		memcpy(&m_RestPoints[0], rest, m_NumPhyxels * sizeof(Vector3));
+		for (uint i = 0; i < (uint)m_SampleTriangles.size(); ++i)
+		{
+			sim->GetVertexWsPos(m_SampleTriangles[i], m_SampleCoords[i], rest, m_RestPoints[m_NumPhyxels + i]);
+		}
+	}
+}
+
+void Sim_SelfCollision::ResolveCollisions(Vector3* x, Vector3* dxdt, std::vector<uint>* modified)
+{
+	m_Pairs.clear();
+
+	if (!m_Enabled || m_NumPhyxels == 0)
+		return;
+
+	m_Timer.BeginTiming();
+
+	UpdatePoints(x);
+	m_Hash.Build(&m_Points[0], (uint)m_Points.size(), m_Thickness);
+	FindPairs();
+
+	memset(&m_Corrections[0], 0, m_NumPhyxels * sizeof(Vector3));
+	memset(&m_NumCorrections[0], 0, m_NumPhyxels * sizeof(uint));
+
+	uint num_pairs = (uint)m_Pairs.size() / 2;
+	for (uint i = 0; i < num_pairs; ++i)
+	{
+		uint a = m_Pairs[i * 2], b = m_Pairs[i * 2 + 1];
+		Vector3 diff = m_Points[a] - m_Points[b];
+		float dist = diff.Length();
+		if (dist < 1E-6f)
+			continue;
+
+		Vector3 correction = diff * ((m_Thickness - dist) / dist);
+
+		float wa = m_Simulation->GetIsStatic(a) ? 0.f : 1.f;
+		if (b < m_NumPhyxels)
+		{
+			//Phyxel pair, split between the two
+			float wb = m_Simulation->GetIsStatic(b) ? 0.f : 1.f;
+			if (wa + wb == 0.f)
+				continue;
+
+			m_Corrections[a] += correction * (wa / (wa + wb));
+			m_Corrections[b] -= correction * (wb / (wa + wb));
+			m_NumCorrections[a]++;
+			m_NumCorrections[b]++;
+		}
+		else if (wa > 0.f)
+		{
+			//Surface sample, only the phyxel moves
+			m_Corrections[a] += correction;
+			m_NumCorrections[a]++;
+		}
+	}
+
+#pragma omp parallel for
+	for (int i = 0; i < (int)m_NumPhyxels; ++i)
+	{
+		if (m_NumCorrections[i] == 0)
+			continue;
+
+		Vector3 delta = m_Corrections[i] / (float)m_NumCorrections[i];
+		float len = delta.Length();
+		if (len < 1E-9f)
+			continue;
+
+		x[i] += delta;
+
+		Vector3 normal = delta / len;
+		float vn = Vector3::Dot(dxdt[i], normal);
+		if (vn < 0.f)
+			dxdt[i] -= normal * vn;
+	}
+
+	if (modified != NULL)
+	{
+		for (uint i = 0; i < m_NumPhyxels; ++i)
+		{
+			if (m_NumCorrections[i] > 0)
+				modified->push_back(i);
+		}
+	}
+
+	m_Timer.EndTimingAdditive();
+}
+
+void Sim_SelfCollision::UpdatePoints(const Vector3* x)
+{
+	memcpy(&m_Points[0], x, m_NumPhyxels * sizeof(Vector3));
+
+#pragma omp parallel for
+	for (int i = 0; i < (int)m_SampleTriangles.size(); ++i)
+	{
+		m_Simulation->GetVertexWsPos(m_SampleTriangles[i], m_SampleCoords[i], x, m_Points[m_NumPhyxels + i]);
+	}
+}
+
+void Sim_SelfCollision::FindPairs()
+{
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	m_ThreadPairs.resize(max_threads);
+
+	const float rest_exclusion_sq = 4.f * m_Thickness * m_Thickness;
+
+#pragma omp parallel num_threads(max_threads)
+	{
+		int tid = 0;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+#endif
+		std::vector<uint>& pairs = m_ThreadPairs[tid];
+		pairs.clear();
+
+		//Only phyxels query, each phyxel pair is reported once by its lower index
+#pragma omp for schedule(static)
+		for (int a = 0; a < (int)m_NumPhyxels; ++a)
+		{
+			m_Hash.ForEachNeighbour(m_Points[a], m_Thickness, [&](uint b)
+			{
+				if (b < m_NumPhyxels && b <= (uint)a)
+					return;
+
+				Vector3 rest_diff = m_RestPoints[a] - m_RestPoints[b];
+				if (Vector3::Dot(rest_diff, rest_diff) < rest_exclusion_sq)
+					return;
+
+				pairs.push_back(a);
+				pairs.push_back(b);
+			});
+		}
+	}
+
+	//Static schedule, so thread order is phyxel order
+	for (int t = 0; t < max_threads; ++t)
+	{
+		m_Pairs.insert(m_Pairs.end(), m_ThreadPairs[t].begin(), m_ThreadPairs[t].end());
+	}
+}
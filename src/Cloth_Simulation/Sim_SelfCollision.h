@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glcore\Vector3.h>
+#include "Sim_SpatialHash.h"
+#include "Sim_Generator.h"
+#include "ProfilingTimer.h"
+#include "SimulationDefines.h"
+#include <vector>
+
+class Sim_Simulation;
+
+#define DEFAULT_SELF_COLLISION_THICKNESS 0.01f		//Minimum distance (m) kept between two parts of the cloth
+#define DEFAULT_SELF_COLLISION_SAMPLES 1			//Surface sample subdivisions per triangle, 0 for phyxels only
+
+//Cloth vs cloth proximity, run after every sub-step alongside Sim_Collision
+// - The points are the phyxels plus samples of each triangle surface (GetVertexWsPos), all hashed into a
+//   Sim_SpatialHash rebuilt every sub-step
+// - Pairs closer than the thickness now but further apart than twice the thickness in the rest state are
+//   in contact, so neighbours on the surface never repel each other
+// - Phyxel pairs are pushed apart and surface samples push phyxels off the surface, corrections are averaged
+//   per phyxel (jacobi) and the approaching normal velocity removed
+// - Only uses the Sim_Rendererable interface, so any simulation type works
+class Sim_SelfCollision
+{
+public:
+	Sim_SelfCollision();
+
+	void Initialize(const Sim_Generator_Output& configuration, Sim_Simulation* sim);
+	//Phyxels moved are appended to modified if given (see Sim_Integrator_SubstepCallback)
+	void ResolveCollisions(Vector3* x, Vector3* dxdt, std::vector<uint>* modified = NULL);
+
+	bool GetEnabled() const { return m_Enabled; }
+	void SetEnabled(bool enabled) { m_Enabled = enabled; }
+	float& GetThickness() { return m_Thickness; }
+
+	//Stats of the last sub-step
+	uint GetNumPoints() const { return (uint)m_Points.size(); }
+	uint GetNumPairs() const { return (uint)m_Pairs.size() / 2; }
+
+	//Additive over all sub-steps, reset by the caller
+	ProfilingTimer& GetTimer() { return m_Timer; }
+
+protected:
+	void UpdatePoints(const Vector3* x);
+	void FindPairs();
+
+protected:
+	bool	m_Enabled;
+	float	m_Thickness;
+	int		m_SampleSubdivisions;
+
+	Sim_Simulation*			m_Simulation;
+	uint					m_NumPhyxels;		//Points [0, m_NumPhyxels) are the phyxels, the rest surface samples
+	std::vector<uint>		m_SampleTriangles;
+	std::vector<Vector3>	m_SampleCoords;		//Barycentric (gauss point) coordinate of each sample
+
+	std::vector<Vector3>	m_Points;
+	std::vector<Vector3>	m_RestPoints;
+	Sim_SpatialHash			m_Hash;
+
+	std::vector<std::vector<uint>>	m_ThreadPairs;
+	std::vector<uint>				m_Pairs;			//Point a, point b (a is always a phyxel)
+	std::vector<Vector3>			m_Corrections;
+	std::vector<uint>				m_NumCorrections;
+
+	ProfilingTimer	m_Timer;
+};
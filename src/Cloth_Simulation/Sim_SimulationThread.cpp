@@ -0,0 +1,129 @@
+#include "Sim_SimulationThread.h"
+
+Sim_SimulationThread::Sim_SimulationThread()
+	: m_Shutdown(false)
+	, m_Paused(true)
+	, m_Updating(false)
+	, m_HoldCount(0)
+	, m_Timestep(1.0f / 60.0f)
+{
+	m_UpdateTimer.SetAlias("Simulation Thread");
+}
+
+Sim_SimulationThread::~Sim_SimulationThread()
+{
+	Stop();
+}
+
+void Sim_SimulationThread::Start(const UpdateFunction& update, float timestep)
+{
+	Stop();
+
+	m_Update = update;
+	m_Timestep = timestep;
+	m_RequestedSteps.clear();
+	m_Thread = std::thread(&Sim_SimulationThread::ThreadLoop, this);
+}
+
+void Sim_SimulationThread::Stop()
+{
+	if (!m_Thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Shutdown = true;
+	}
+	m_Condition.notify_all();
+
+	m_Thread.join();
+	m_Shutdown = false;
+}
+
+void Sim_SimulationThread::SetPaused(bool paused)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Paused = paused;
+	}
+	m_Condition.notify_all();
+}
+
+void Sim_SimulationThread::SetTimestep(float timestep)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Timestep = timestep;
+}
+
+void Sim_SimulationThread::RequestStep(float dt)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_RequestedSteps.push_back(dt);
+	}
+	m_Condition.notify_all();
+}
+
+void Sim_SimulationThread::Hold()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_HoldCount++;
+	m_Condition.wait(lock, [&]() { return !m_Updating; });
+}
+
+void Sim_SimulationThread::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_HoldCount--;
+	}
+	m_Condition.notify_all();
+}
+
+void Sim_SimulationThread::ThreadLoop()
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point next_update = Clock::now();
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (;;)
+	{
+		m_Condition.wait_until(lock, next_update, [&]() { return m_Shutdown || !m_RequestedSteps.empty(); });
+		m_Condition.wait(lock, [&]() { return m_Shutdown || m_HoldCount == 0; });
+		if (m_Shutdown)
+			return;
+
+		Clock::time_point now = Clock::now();
+		bool step_requested = !m_RequestedSteps.empty();
+		if (!step_requested && now < next_update)
+			continue;
+
+		float dt = 0.0f;
+		if (step_requested)
+		{
+			dt = m_RequestedSteps.front();
+			m_RequestedSteps.pop_front();
+		}
+		else
+		{
+			if (!m_Paused)
+				dt = m_Timestep;
+
+			//No catching up when an update takes longer than the timestep, the simulation just runs slower than real time
+			next_update += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_Timestep));
+			if (next_update < now)
+				next_update = now;
+		}
+
+		m_Updating = true;
+		lock.unlock();
+
+		if (dt > 0.0f) m_UpdateTimer.BeginTiming();
+		m_Update(dt);
+		if (dt > 0.0f) m_UpdateTimer.EndTiming();
+
+		lock.lock();
+		m_Updating = false;
+		m_Condition.notify_all();
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ProfilingTimer.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+
+//Runs the simulation on its own thread, decoupled from rendering
+// - The update function is called once per timestep of real time (or back to back if it takes longer)
+//   to advance the simulation by the timestep, and with dt = 0 while paused so queued input is still applied
+// - Anything that cannot be done through a command queue (reset, changing the simulation type etc) is done
+//   on the main thread while the thread is held between updates, see Sim_SimulationThread_Hold
+class Sim_SimulationThread
+{
+	friend class Sim_SimulationThread_Hold;
+public:
+	typedef std::function<void(float dt)> UpdateFunction;
+
+	Sim_SimulationThread();
+	~Sim_SimulationThread();
+
+	void Start(const UpdateFunction& update, float timestep);
+	void Stop();
+	bool IsRunning() const { return m_Thread.joinable(); }
+
+	bool GetPaused() const { return m_Paused; }
+	void SetPaused(bool paused);
+
+	float GetTimestep() const { return m_Timestep; }
+	void SetTimestep(float timestep);
+
+	//Advances once by dt, in order with any other requested steps and regardless of the paused state
+	void RequestStep(float dt);
+
+	//Time spent in the last update that advanced the simulation
+	float GetUpdateMilliSeconds() const { return m_UpdateTimer.GetTimedMilliSeconds(); }
+
+protected:
+	void Hold();
+	void Release();
+	void ThreadLoop();
+
+protected:
+	std::thread					m_Thread;
+	std::mutex					m_Mutex;
+	std::condition_variable		m_Condition;
+	UpdateFunction				m_Update;
+
+	bool	m_Shutdown;
+	bool	m_Paused;
+	bool	m_Updating;			//Inside m_Update, the thread can only be held between updates
+	int		m_HoldCount;
+	float	m_Timestep;
+
+	std::deque<float>	m_RequestedSteps;
+
+	ProfilingTimer	m_UpdateTimer;
+};
+
+//Holds the simulation thread between updates for the lifetime of the object, so the main thread can modify
+//the simulations directly. Waits for the current update to finish, does nothing if the thread is not running.
+class Sim_SimulationThread_Hold
+{
+public:
+	Sim_SimulationThread_Hold(Sim_SimulationThread& thread) : m_SimThread(thread) { m_SimThread.Hold(); }
+	~Sim_SimulationThread_Hold() { m_SimThread.Release(); }
+
+protected:
+	Sim_SimulationThread& m_SimThread;
+};
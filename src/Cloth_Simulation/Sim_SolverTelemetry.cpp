@@ -0,0 +1,73 @@
+#include "Sim_SolverTelemetry.h"
+#include <iomanip>
+
+#define SIM_TELEMETRY_POLL_BATCH 64
+
+void Sim_TelemetryReader::Attach(const MPCG_TelemetryBuffer& telemetry)
+{
+	m_Buffer = &telemetry;
+	m_Cursor = telemetry.GetWriteCount();
+}
+
+uint Sim_TelemetryReader::Poll(const MPCG_TelemetryBuffer& telemetry, MPCG_Telemetry* out, uint max_records)
+{
+	//A new solver (possibly at the same address as the old one) starts again from zero
+	if (m_Buffer != &telemetry || m_Cursor > telemetry.GetWriteCount())
+		Attach(telemetry);
+
+	return telemetry.Read(m_Cursor, out, max_records, &m_NumDropped);
+}
+
+bool Sim_TelemetryCSV::Open(const std::string& filename)
+{
+	Close();
+
+	m_File.open(filename);
+	if (!m_File.is_open())
+		return false;
+
+	m_File << "solve_index,iterations,hit_max_iterations,initial_error,final_error,beta,precision,method,"
+		"initialization_ms,multiply_ms,precondition_ms,total_ms\n";
+	m_File << std::setprecision(7);
+	return m_File.good();
+}
+
+void Sim_TelemetryCSV::Close()
+{
+	if (m_File.is_open())
+		m_File.close();
+}
+
+uint Sim_TelemetryCSV::Poll(const MPCG_TelemetryBuffer& telemetry)
+{
+	const char* precision_names[] = { "Single", "Mixed", "Double" };
+	const char* method_names[] = { "CG", "BiCGSTAB" };
+	MPCG_Telemetry records[SIM_TELEMETRY_POLL_BATCH];
+	uint num_written = 0;
+
+	//Drained even while closed, so opening the file later starts from the current solve
+	for (uint num_read = 0; (num_read = m_Reader.Poll(telemetry, records, SIM_TELEMETRY_POLL_BATCH)) > 0; )
+	{
+		if (!m_File.is_open())
+			continue;
+
+		for (uint i = 0; i < num_read; ++i)
+		{
+			const MPCG_Telemetry& r = records[i];
+			m_File << r.solve_index << ","
+				<< r.iterations << ","
+				<< (r.hit_max_iterations ? 1 : 0) << ","
+				<< r.initial_error << ","
+				<< r.final_error << ","
+				<< r.beta << ","
+				<< precision_names[r.precision] << ","
+				<< method_names[r.method] << ","
+				<< r.initialization_ms << ","
+				<< r.multiply_ms << ","
+				<< r.precondition_ms << ","
+				<< r.total_ms << "\n";
+		}
+		num_written += num_read;
+	}
+	return num_written;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "mpcg.h"
+#include <fstream>
+#include <string>
+
+//Reader side of a solvers telemetry (MPCG::GetTelemetry), each reader keeps its own cursor so the GUI,
+// a CSV sink and a benchmark can all poll the same solver independently and from any thread
+class Sim_TelemetryReader
+{
+public:
+	Sim_TelemetryReader() : m_Buffer(NULL), m_Cursor(0), m_NumDropped(0) {}
+
+	//Only records pushed from now on will be polled
+	void Attach(const MPCG_TelemetryBuffer& telemetry);
+
+	//Copies the records since the last poll (up to max_records) into out, returns the number copied
+	// - Polling a different buffer than last time (e.g. the simulation was recreated) attaches to it first
+	uint Poll(const MPCG_TelemetryBuffer& telemetry, MPCG_Telemetry* out, uint max_records);
+
+	//Records overwritten before they could be polled
+	uint64_t GetNumDropped() const { return m_NumDropped; }
+
+protected:
+	const MPCG_TelemetryBuffer*	m_Buffer;
+	uint64_t					m_Cursor;
+	uint64_t					m_NumDropped;
+};
+
+//Appends a solvers telemetry to a CSV file, one row per solve
+class Sim_TelemetryCSV
+{
+public:
+	bool Open(const std::string& filename);
+	void Close();
+	bool IsOpen() const { return m_File.is_open(); }
+
+	//Writes every record since the last poll, returns the number of rows written
+	uint Poll(const MPCG_TelemetryBuffer& telemetry);
+
+	uint64_t GetNumDropped() const { return m_Reader.GetNumDropped(); }
+
+protected:
+	Sim_TelemetryReader	m_Reader;
+	std::ofstream		m_File;
+};
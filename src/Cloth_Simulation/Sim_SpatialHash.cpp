@@ -0,0 +1,108 @@
+#include "Sim_SpatialHash.h"
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+Sim_SpatialHash::Sim_SpatialHash()
+	: m_Points(NULL)
+	, m_NumPoints(0)
+	, m_CellSize(1.0f)
+	, m_InvCellSize(1.0f)
+	, m_TableMask(0)
+{
+}
+
+void Sim_SpatialHash::Build(const Vector3* points, uint num_points, float cell_size)
+{
+	m_Points = points;
+	m_NumPoints = num_points;
+	m_CellSize = cell_size;
+	m_InvCellSize = 1.0f / cell_size;
+
+	//Power of two table with at least twice as many entries as points, keeps collisions low
+	uint table_size = 64;
+	while (table_size < num_points * 2)
+		table_size <<= 1;
+	m_TableMask = table_size - 1;
+
+	m_Keys.resize(num_points);
+	m_Sorted.resize(num_points);
+	m_CellStart.resize(table_size + 1);
+
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	m_ThreadCounts.resize(max_threads * table_size);
+	m_BlockSums.resize(max_threads);
+
+	uint* keys = (num_points > 0) ? &m_Keys[0] : NULL;
+	uint* sorted = (num_points > 0) ? &m_Sorted[0] : NULL;
+	uint* cell_start = &m_CellStart[0];
+	uint* all_counts = &m_ThreadCounts[0];
+	uint* block_sums = &m_BlockSums[0];
+
+#pragma omp parallel num_threads(max_threads)
+	{
+		int tid = 0, num_threads = 1;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+		num_threads = omp_get_num_threads();
+#endif
+		//Each thread keeps the same range of points for the count and scatter passes
+		uint first = (uint)(((unsigned long long)num_points * tid) / num_threads);
+		uint last = (uint)(((unsigned long long)num_points * (tid + 1)) / num_threads);
+		uint* counts = &all_counts[tid * table_size];
+
+		memset(counts, 0, table_size * sizeof(uint));
+		for (uint i = first; i < last; ++i)
+		{
+			const Vector3& p = points[i];
+			uint key = Hash(Cell(p.x), Cell(p.y), Cell(p.z));
+			keys[i] = key;
+			counts[key]++;
+		}
+
+#pragma omp barrier
+
+		//Blocked exclusive prefix sum over (entry, thread), each thread owns a range of table entries
+		uint cell_first = (uint)(((unsigned long long)table_size * tid) / num_threads);
+		uint cell_last = (uint)(((unsigned long long)table_size * (tid + 1)) / num_threads);
+
+		uint sum = 0;
+		for (uint c = cell_first; c < cell_last; ++c)
+		{
+			for (int t = 0; t < num_threads; ++t)
+				sum += all_counts[t * table_size + c];
+		}
+		block_sums[tid] = sum;
+
+#pragma omp barrier
+
+		uint offset = 0;
+		for (int t = 0; t < tid; ++t)
+			offset += block_sums[t];
+
+		for (uint c = cell_first; c < cell_last; ++c)
+		{
+			cell_start[c] = offset;
+			for (int t = 0; t < num_threads; ++t)
+			{
+				uint count = all_counts[t * table_size + c];
+				all_counts[t * table_size + c] = offset;
+				offset += count;
+			}
+		}
+		if (tid == num_threads - 1)
+			cell_start[table_size] = offset;
+
+#pragma omp barrier
+
+		//Scatter, lower threads own lower cursors so each entry stays in point order
+		for (uint i = first; i < last; ++i)
+		{
+			sorted[counts[keys[i]]++] = i;
+		}
+	}
+}
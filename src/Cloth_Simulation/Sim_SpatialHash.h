@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glcore\Vector3.h>
+#include "SimulationDefines.h"
+#include <vector>
+#include <cmath>
+
+//Uniform grid hashed into a fixed size table, stored as a cell list
+// - Build is a parallel counting sort: per-thread cell histograms, a blocked prefix sum and a scatter of the
+//   point indices, so the points of a table entry are contiguous and there are no per-cell allocations
+// - Rebuilt from scratch every time, O(num_points + table size) with the table sized from num_points
+// - Points in an entry are in index order, so queries are deterministic for any thread count
+class Sim_SpatialHash
+{
+public:
+	Sim_SpatialHash();
+
+	void Build(const Vector3* points, uint num_points, float cell_size);
+
+	inline float GetCellSize() const { return m_CellSize; }
+	inline uint GetNumPoints() const { return m_NumPoints; }
+
+	//Calls callback(idx) for every point within radius of pos, radius should not exceed the cell size
+	template<class Callback>
+	void ForEachNeighbour(const Vector3& pos, float radius, Callback callback) const;
+
+protected:
+	inline int Cell(float v) const { return (int)floorf(v * m_InvCellSize); }
+	inline uint Hash(int cx, int cy, int cz) const
+	{
+		return (uint(cx) * 73856093u ^ uint(cy) * 19349663u ^ uint(cz) * 83492791u) & m_TableMask;
+	}
+
+protected:
+	const Vector3*		m_Points;
+	uint				m_NumPoints;
+	float				m_CellSize;
+	float				m_InvCellSize;
+	uint				m_TableMask;
+
+	std::vector<uint>	m_Keys;				//Table entry of each point
+	std::vector<uint>	m_CellStart;		//Table size + 1, points of entry i are m_Sorted[m_CellStart[i] .. m_CellStart[i + 1])
+	std::vector<uint>	m_Sorted;			//Point indices ordered by table entry
+	std::vector<uint>	m_ThreadCounts;		//Per-thread histograms, reused as scatter cursors
+	std::vector<uint>	m_BlockSums;		//Per-thread totals for the prefix sum
+};
+
+template<class Callback>
+void Sim_SpatialHash::ForEachNeighbour(const Vector3& pos, float radius, Callback callback) const
+{
+	if (m_NumPoints == 0)
+		return;
+
+	const float radius_sq = radius * radius;
+	int x0 = Cell(pos.x - radius), x1 = Cell(pos.x + radius);
+	int y0 = Cell(pos.y - radius), y1 = Cell(pos.y + radius);
+	int z0 = Cell(pos.z - radius), z1 = Cell(pos.z + radius);
+
+	for (int cx = x0; cx <= x1; ++cx)
+	{
+		for (int cy = y0; cy <= y1; ++cy)
+		{
+			for (int cz = z0; cz <= z1; ++cz)
+			{
+				uint key = Hash(cx, cy, cz);
+				for (uint i = m_CellStart[key]; i < m_CellStart[key + 1]; ++i)
+				{
+					uint idx = m_Sorted[i];
+					const Vector3& p = m_Points[idx];
+
+					//Different cells can share a table entry, only report the point from its own cell
+					if (Cell(p.x) != cx || Cell(p.y) != cy || Cell(p.z) != cz)
+						continue;
+
+					Vector3 diff = p - pos;
+					if (Vector3::Dot(diff, diff) < radius_sq)
+						callback(idx);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,179 @@
+#include "Sim_ThreadPool.h"
+#include <glcore\TaskScheduler.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+Sim_ThreadPool::Sim_ThreadPool(int num_threads)
+	: m_Shutdown(false)
+	, m_Generation(0)
+	, m_NumActive(0)
+	, m_Tasks(NULL)
+	, m_NumTasks(0)
+	, m_NextTask(0)
+	, m_NumCompleted(0)
+	, m_LoopThreadsPerTask(1)
+{
+	m_WallTimer.SetAlias("Thread Pool");
+	SetNumThreads(num_threads);
+}
+
+Sim_ThreadPool::~Sim_ThreadPool()
+{
+	StopWorkers();
+}
+
+void Sim_ThreadPool::SetNumThreads(int num_threads)
+{
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency();
+	if (num_threads <= 0)
+		num_threads = 1;
+
+	if (num_threads != GetNumThreads())
+	{
+		StopWorkers();
+		StartWorkers(num_threads - 1);
+	}
+}
+
+void Sim_ThreadPool::StartWorkers(int num_workers)
+{
+	m_Workers.reserve(num_workers);
+	for (int i = 0; i < num_workers; ++i)
+	{
+		m_Workers.push_back(std::thread(&Sim_ThreadPool::WorkerLoop, this));
+	}
+}
+
+void Sim_ThreadPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Shutdown = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (size_t i = 0; i < m_Workers.size(); ++i)
+	{
+		m_Workers[i].join();
+	}
+	m_Workers.clear();
+	m_Shutdown = false;
+}
+
+void Sim_ThreadPool::Run(const std::vector<std::function<void()>>& tasks)
+{
+	m_WallTimer.BeginTiming();
+
+	uint num_tasks = (uint)tasks.size();
+	uint num_threads = (uint)GetNumThreads();
+	uint num_running = (num_tasks < num_threads) ? num_tasks : num_threads;
+
+	int loop_threads = TaskScheduler::Instance()->GetNumThreads();
+	int prev_concurrency = TaskScheduler::GetThreadConcurrency();
+	int omp_threads = 1;
+#ifdef _OPENMP
+	omp_threads = omp_get_max_threads();
+	if (omp_threads > loop_threads)
+		loop_threads = omp_threads;
+#endif
+	int threads_per_task = (num_running > 0) ? loop_threads / (int)num_running : loop_threads;
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		//A worker still leaving the last Run must not pick up these tasks with the last Run's pointer
+		m_DoneCondition.wait(lock, [&]() { return m_NumActive == 0; });
+
+		m_TaskTimers.resize(num_tasks);
+		m_Tasks = &tasks;
+		m_NumTasks = num_tasks;
+		m_NextTask = 0;
+		m_NumCompleted = 0;
+		m_LoopThreadsPerTask = (threads_per_task > 1) ? threads_per_task : 1;
+
+		//A single task runs inline with every loop thread, exactly as without the pool
+		if (num_tasks > 1 && !m_Workers.empty())
+		{
+			m_Generation++;
+			m_WakeCondition.notify_all();
+		}
+	}
+
+	ExecuteTasks(&tasks, num_tasks);
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [&]() { return m_NumCompleted >= num_tasks; });
+	}
+
+	TaskScheduler::SetThreadConcurrency(prev_concurrency);
+#ifdef _OPENMP
+	omp_set_num_threads(omp_threads);
+#endif
+
+	m_WallTimer.EndTiming();
+}
+
+void Sim_ThreadPool::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	uint generation = m_Generation;
+	for (;;)
+	{
+		m_WakeCondition.wait(lock, [&]() { return m_Shutdown || m_Generation != generation; });
+		if (m_Shutdown)
+			return;
+
+		generation = m_Generation;
+		const std::vector<std::function<void()>>* tasks = m_Tasks;
+		uint num_tasks = m_NumTasks;
+		m_NumActive++;
+		lock.unlock();
+
+		ExecuteTasks(tasks, num_tasks);
+
+		lock.lock();
+		m_NumActive--;
+		m_DoneCondition.notify_all();
+	}
+}
+
+void Sim_ThreadPool::ExecuteTasks(const std::vector<std::function<void()>>* tasks, uint num_tasks)
+{
+	//A task given every thread (a single task run inline) keeps the callers own limit
+	TaskScheduler::SetThreadConcurrency((num_tasks > 1) ? m_LoopThreadsPerTask : TaskScheduler::GetThreadConcurrency());
+#ifdef _OPENMP
+	omp_set_num_threads(m_LoopThreadsPerTask);
+#endif
+
+	uint idx;
+	while ((idx = m_NextTask++) < num_tasks)
+	{
+		m_TaskTimers[idx].BeginTiming();
+		(*tasks)[idx]();
+		m_TaskTimers[idx].EndTiming();
+
+		if (++m_NumCompleted == num_tasks)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_DoneCondition.notify_all();
+		}
+	}
+}
+
+float Sim_ThreadPool::GetBusyMilliSeconds() const
+{
+	float busy = 0.0f;
+	for (size_t i = 0; i < m_TaskTimers.size(); ++i)
+		busy += m_TaskTimers[i].GetTimedMilliSeconds();
+	return busy;
+}
+
+float Sim_ThreadPool::GetUtilization() const
+{
+	float capacity = GetWallMilliSeconds() * GetNumThreads();
+	float utilization = (capacity > 0.0f) ? GetBusyMilliSeconds() / capacity : 0.0f;
+	return (utilization < 1.0f) ? utilization : 1.0f;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ProfilingTimer.h"
+#include "SimulationDefines.h"
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//Fixed set of worker threads that run a batch of independent tasks (e.g. one per cloth instance)
+// - The calling thread takes tasks too, Run only returns once every task has completed
+// - Tasks are claimed in order from a shared counter, so larger tasks should come first
+// - The loop threads are split between the tasks running at once, each thread that runs a task caps the
+//   TaskScheduler loops (TaskScheduler::SetThreadConcurrency) and OpenMP regions (omp_set_num_threads)
+//   inside it, so a few large tasks still use every core and many small ones don't each take them all
+class Sim_ThreadPool
+{
+public:
+	Sim_ThreadPool(int num_threads = 0);		//0 for one per hardware thread
+	~Sim_ThreadPool();
+
+	int GetNumThreads() const { return (int)m_Workers.size() + 1; }
+	void SetNumThreads(int num_threads);
+
+	void Run(const std::vector<std::function<void()>>& tasks);
+
+	//Profiling of the last Run
+	uint GetNumTasks() const { return (uint)m_TaskTimers.size(); }
+	float GetTaskMilliSeconds(uint idx) const { return m_TaskTimers[idx].GetTimedMilliSeconds(); }
+	float GetWallMilliSeconds() const { return m_WallTimer.GetTimedMilliSeconds(); }
+	float GetBusyMilliSeconds() const;
+	float GetUtilization() const;		//Busy time over wall time of all threads [0, 1]
+	int GetLoopThreadsPerTask() const { return m_LoopThreadsPerTask; }
+
+protected:
+	void StartWorkers(int num_workers);
+	void StopWorkers();
+	void WorkerLoop();
+	void ExecuteTasks(const std::vector<std::function<void()>>* tasks, uint num_tasks);
+
+protected:
+	std::vector<std::thread>	m_Workers;
+	std::mutex					m_Mutex;
+	std::condition_variable		m_WakeCondition;
+	std::condition_variable		m_DoneCondition;
+	bool						m_Shutdown;
+	uint						m_Generation;		//Incremented by every Run, wakes the workers
+	uint						m_NumActive;		//Workers inside ExecuteTasks
+
+	const std::vector<std::function<void()>>* m_Tasks;
+	uint						m_NumTasks;
+	std::atomic<uint>			m_NextTask;
+	std::atomic<uint>			m_NumCompleted;
+	int							m_LoopThreadsPerTask;
+
+	std::vector<ProfilingTimer>	m_TaskTimers;
+	ProfilingTimer				m_WallTimer;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+
+//Lock-free hand over of the latest state from one writer thread to one reader thread
+// - The writer fills GetWriteBuffer() and Publish()es it, the reader calls Acquire() and (if it returns
+//   true) reads the newer state from GetReadBuffer()
+// - Neither side ever waits, the writer can publish many times between two reads and the reader only
+//   ever sees the latest complete one
+// - The third buffer sits in the middle, Publish/Acquire swap their own buffer with it
+template <class T>
+class Sim_TripleBuffer
+{
+public:
+	Sim_TripleBuffer() : m_WriteIdx(0), m_Middle(1), m_ReadIdx(2) {}
+
+	//Writer only
+	T& GetWriteBuffer() { return m_Buffers[m_WriteIdx]; }
+
+	void Publish()
+	{
+		m_WriteIdx = m_Middle.exchange(m_WriteIdx | SIM_TRIPLEBUFFER_NEW, std::memory_order_acq_rel) & SIM_TRIPLEBUFFER_INDEX;
+	}
+
+	//Reader only, returns false if nothing has been published since the last Acquire
+	bool Acquire()
+	{
+		if ((m_Middle.load(std::memory_order_relaxed) & SIM_TRIPLEBUFFER_NEW) == 0)
+			return false;
+
+		m_ReadIdx = m_Middle.exchange(m_ReadIdx, std::memory_order_acq_rel) & SIM_TRIPLEBUFFER_INDEX;
+		return true;
+	}
+
+	const T& GetReadBuffer() const { return m_Buffers[m_ReadIdx]; }
+
+protected:
+	enum
+	{
+		SIM_TRIPLEBUFFER_INDEX = 0x3,
+		SIM_TRIPLEBUFFER_NEW = 0x4		//Set on the middle index when it holds a buffer the reader has not seen
+	};
+
+	T					m_Buffers[3];
+	unsigned int		m_WriteIdx;
+	std::atomic<unsigned int> m_Middle;
+	unsigned int		m_ReadIdx;
+};
@@ -65,6 +65,8 @@ struct FEVertDescriptor
 #define SHEAR_RESISTANT		4
 #define BEND_RESISTANT		5
 
+//Fabric tables, only mass_density is still read (as the default Sim_Material density). The finite element
+// simulations use the runtime Sim_Material and the solver the runtime MPCG_Settings.
 #define CHOSEN_MATERIAL		WOOL
 
 
@@ -73,8 +75,9 @@ struct FEVertDescriptor
 const float V_SCALAR = 0.002f;		//Scalar of C to produce Voidt Viscosity tensor
 const Vector3 WIND = Vector3(0, 0, 0);// Vector3(20.5f, 0.0f, 1.5f);
 
-const float max_timestep = 1.0f / 1920.0f;
-const float min_timestep = max_timestep * 0.125 * 0.25f;
+//Bounds for the adaptive sub-timestep (see Sim_Integrator::SetAdaptiveTimestep)
+const float max_timestep = 1.0f / 240.0f;
+const float min_timestep = 1.0f / 61440.0f;
 
 
 
@@ -195,6 +198,20 @@ const float C2212 = 0.f;
 const float C1121 = 0.f;
 const float C1222 = 0.f;
 
+//Runtime material of a single cloth, defaults to the compile time material above
+struct Sim_Material
+{
+	Sim_Material()
+		: youngs_modulus(2500.0f)
+		, poisson_ratio(0.3f)
+		, density(mass_density)
+	{}
+
+	float youngs_modulus;	//In-plane stiffness (finite element simulations only)
+	float poisson_ratio;	//Finite element simulations only
+	float density;			//kg/m^2
+};
+
 
 
 
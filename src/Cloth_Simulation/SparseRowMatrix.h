@@ -1,12 +1,24 @@
 #pragma once
 
+#include <glcore\Vector2.h>
 #include <glcore\Vector3.h>
 #include <glcore\Matrix3.h>
+#include <glcore\TaskScheduler.h>
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
 #include "SimulationDefines.h"
 
+//Rows per part of the symmetric product, the part count only depends on the matrix size so the summation
+// order (and result) is the same for any number of threads
+#define SPARSEROWMATRIX_SYMMETRIC_PART_ROWS	256
+#define SPARSEROWMATRIX_MAX_SYMMETRIC_PARTS	64
+
 //Sparse Matrix implementation exploiting the fact that each row will have some data
+// - Products run on the TaskScheduler, reductions combine fixed chunks in order (see ParallelReduce)
+// - Symmetric matrices may store only their upper triangle (column >= row), the lower blocks are implied by
+//   the transpose. Products read each stored block once and apply it to both its row and (transposed) its
+//   column, code that needs whole rows walks them with ForEachInRow through a small index of the lower blocks.
 
 template<class T>
 struct SparseRowMatrixItem
@@ -15,6 +27,13 @@ struct SparseRowMatrixItem
 	T							  value;
 };
 
+//Implied lower block of symmetric storage, the transpose of m_Rows[row][item]
+struct SparseRowMatrixLower
+{
+	uint row;
+	uint item;
+};
+
 template<class T>
 struct SparseRowMatrixItem_SortAscending
 {
@@ -38,6 +57,21 @@ public:
 	void clean_memory();
 	void zero_memory();
 
+	//Builds the sparsity pattern straight from the element topology, every dof of an element is coupled
+	// to every other dof of the same element. Avoids the search/grow in operator() on the first assembly.
+	// - upper_only switches the matrix to symmetric storage (only column >= row is kept)
+	void build_pattern(const std::vector<uint>& element_dofs, uint dofs_per_element, bool upper_only = false);
+
+	inline bool is_symmetric() const { return m_Symmetric; }
+	inline uint num_lower_blocks() const { return (uint)m_Lower.size(); }
+	inline uint num_halo_rows() const { return (uint)m_Halo.size(); }	//Of the symmetric multiplies so far, see MultiplySymmetric
+
+	//Calls func(column, block, transposed) for every block of the full row in column order, the implied
+	// lower blocks of symmetric storage first (passed as stored, transposed = true), then the stored blocks
+	// - For setup and validation code, the products below are much faster for repeated multiplies
+	template<class Func>
+	inline void ForEachInRow(uint row, const Func& func) const;
+
 	void SetItem(uint row, uint col, const T& value);
 	T& operator()(uint row, uint col);
 	const T& operator()(uint row, uint col) const { return *this[row, col]; }
@@ -52,14 +86,36 @@ public:
 
 	float SolveAMultU(std::vector<Vector3>& out, const std::vector<Matrix3>& constraints, const std::vector<Vector3>& u);
 
+	//out = A * x for either storage, x and out must not overlap
+	// - Only the first num_rows of out are needed, full storage skips the rest (symmetric storage forms every row)
+	void Multiply(const Vector3* x, Vector3* out, uint num_rows = ~0u) const;
 
 
 
 	std::vector<std::vector<SparseRowMatrixItem<T>>> m_Rows;
+
+protected:
+	void build_lower_index();
+
+	//Symmetric storage: the rows are split into contiguous parts (SPARSEROWMATRIX_SYMMETRIC_PART_ROWS), each part
+	// writes its own rows directly and the (transposed) writes past its last row into its halo, which is added on
+	// afterwards. With a banded (e.g. RCM) ordering the halos are only about a bandwidth long.
+	void MultiplySymmetric(const Vector3* x, Vector3* out) const;
+	void UpdateSymmetricParts(int num_parts) const;
+
+	bool							m_Symmetric;
+	std::vector<uint>				m_LowerOffsets;		//Per row into m_Lower (CSR), empty unless symmetric
+	std::vector<SparseRowMatrixLower> m_Lower;
+
+	mutable std::vector<uint>		m_PartHaloEnd;		//Per part, one past the last column its blocks reach, empty until first used
+	mutable std::vector<uint>		m_PartHaloOffset;	//Per part into m_Halo, num_parts + 1
+	mutable std::vector<Vector3>	m_Halo;
+	std::vector<Vector3>			m_SymmetricTmp[2];
 };
 
 template<class T>
 SparseRowMatrix<T>::SparseRowMatrix()
+	: m_Symmetric(false)
 {
 
 }
@@ -81,6 +137,10 @@ template<class T>
 void SparseRowMatrix<T>::clean_memory()
 {
 	m_Rows.clear();
+	m_Symmetric = false;
+	m_LowerOffsets.clear();
+	m_Lower.clear();
+	m_PartHaloEnd.clear();
 }
 
 template<class T>
@@ -130,6 +190,118 @@ void SparseRowMatrix<T>::organise_memory()
 	}
 }
 
+template<class T>
+void SparseRowMatrix<T>::build_pattern(const std::vector<uint>& element_dofs, uint dofs_per_element, bool upper_only)
+{
+	uint num_rows = (uint)m_Rows.size();
+	m_Symmetric = upper_only;
+
+	//Row -> elements touching it (counting sort)
+	std::vector<uint> offsets(num_rows + 1, 0);
+	for (uint dof : element_dofs)
+		offsets[dof + 1]++;
+
+	for (uint i = 0; i < num_rows; ++i)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<uint> row_elements(element_dofs.size());
+	std::vector<uint> fill(offsets.begin(), offsets.end() - 1);
+	for (uint i = 0, len = (uint)element_dofs.size(); i < len; ++i)
+		row_elements[fill[element_dofs[i]]++] = i / dofs_per_element;
+
+	//Each row is independent from here on
+#pragma omp parallel
+	{
+		std::vector<uint> columns;
+
+#pragma omp for
+		for (int i = 0; i < (int)num_rows; ++i)
+		{
+			columns.clear();
+			columns.push_back((uint)i);
+			for (uint j = offsets[i]; j < offsets[i + 1]; ++j)
+			{
+				const uint* dofs = &element_dofs[row_elements[j] * dofs_per_element];
+				columns.insert(columns.end(), dofs, dofs + dofs_per_element);
+			}
+
+			std::sort(columns.begin(), columns.end());
+			columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+			if (upper_only)
+				columns.erase(columns.begin(), std::lower_bound(columns.begin(), columns.end(), (uint)i));
+
+			std::vector<SparseRowMatrixItem<T>>& row = m_Rows[i];
+			row.resize(columns.size());
+			for (uint j = 0, len = (uint)columns.size(); j < len; ++j)
+			{
+				row[j].column = columns[j];
+				memset(&row[j].value, 0, sizeof(T));
+			}
+		}
+	}
+
+	m_LowerOffsets.clear();
+	m_Lower.clear();
+	m_PartHaloEnd.clear();
+	if (upper_only)
+		build_lower_index();
+}
+
+template<class T>
+void SparseRowMatrix<T>::build_lower_index()
+{
+	//Transpose of the strictly upper pattern (counting sort), rows are visited in order so each
+	// rows lower blocks end up in ascending column order
+	uint num_rows = (uint)m_Rows.size();
+	m_LowerOffsets.assign(num_rows + 1, 0);
+	for (uint i = 0; i < num_rows; ++i)
+	{
+		for (const SparseRowMatrixItem<T>& item : m_Rows[i])
+		{
+			if (item.column != i)
+				m_LowerOffsets[item.column + 1]++;
+		}
+	}
+
+	for (uint i = 0; i < num_rows; ++i)
+		m_LowerOffsets[i + 1] += m_LowerOffsets[i];
+
+	m_Lower.resize(m_LowerOffsets[num_rows]);
+	std::vector<uint> fill(m_LowerOffsets.begin(), m_LowerOffsets.end() - 1);
+	for (uint i = 0; i < num_rows; ++i)
+	{
+		for (uint j = 0, len = (uint)m_Rows[i].size(); j < len; ++j)
+		{
+			uint col = m_Rows[i][j].column;
+			if (col != i)
+			{
+				SparseRowMatrixLower& lower = m_Lower[fill[col]++];
+				lower.row = i;
+				lower.item = j;
+			}
+		}
+	}
+}
+
+template<class T>
+template<class Func>
+inline void SparseRowMatrix<T>::ForEachInRow(uint row, const Func& func) const
+{
+	if (m_Symmetric)
+	{
+		for (uint i = m_LowerOffsets[row], end = m_LowerOffsets[row + 1]; i < end; ++i)
+		{
+			const SparseRowMatrixLower& lower = m_Lower[i];
+			func(lower.row, m_Rows[lower.row][lower.item].value, true);
+		}
+	}
+
+	for (const SparseRowMatrixItem<T>& item : m_Rows[row])
+	{
+		func(item.column, item.value, false);
+	}
+}
+
 template<class T>
 void SparseRowMatrix<T>::zero_memory()
 {
@@ -152,58 +324,106 @@ void SparseRowMatrix<T>::SolveAMultX(std::vector<Vector3>& out_residual, std::ve
 	const std::vector<Matrix3>& constraints, const std::vector<Matrix3>& inv_precondition, const std::vector<Vector3>& bvec, const std::vector<Vector3>& xvec)
 {
 	int len = (int)m_Rows.size();
-	float beta = 0.0f, r0z0 = 0.0f;
 
-#pragma omp parallel for reduction(+:beta) reduction(+:r0z0)
-	for (int row = 0; row < len; ++row) {
-		Vector3 tmpRes = bvec[row];
-		Vector3 tmpBeta = bvec[row];
-
-		Vector3 tmpVec;
-		Matrix3 tmp;
+	if (m_Symmetric)
+	{
+		//Same as below, with A*x and A*(I - S)x formed up front (the transposed blocks need whole vectors)
+		m_SymmetricTmp[0].resize(len);
+		m_SymmetricTmp[1].resize(len);
+		std::vector<Vector3>& ax = m_SymmetricTmp[0];
+		std::vector<Vector3>& afixed = m_SymmetricTmp[1];
+
+		//ax holds (I - S)x until A*x overwrites it
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				ax[row] = xvec[row] - constraints[row] * xvec[row];
+			}
+		});
+		MultiplySymmetric(&ax[0], &afixed[0]);
+		MultiplySymmetric(&xvec[0], &ax[0]);
+
+		//Both sums in one pass, x is beta and y is r0z0
+		Vector2 sums = TaskScheduler::Instance()->ParallelReduce(0, len, 0, Vector2(0.0f, 0.0f), [&](int first, int last)
+		{
+			Vector2 partial(0.0f, 0.0f);
+			for (int row = first; row < last; ++row)
+			{
+				Vector3 tmpRes = bvec[row] - ax[row];
+				Vector3 tmpBeta = bvec[row] - afixed[row];
+				Matrix3 tmp;
+
+				InplaceMatrix3MultVector3(&out_residual[row], constraints[row], tmpRes);
+				InplaceMatrix3MultMatrix3(&tmp, constraints[row], inv_precondition[row]);
+				InplaceMatrix3MultVector3(&out_previous[row], tmp, out_residual[row]);
+
+				partial.x += tmpBeta.Dot(inv_precondition[row] * tmpBeta);
+				partial.y += Vector3::Dot(out_residual[row], out_previous[row]);
+			}
+			return partial;
+		});
+
+		out_beta = sums.x;
+		out_r0z0 = sums.y;
+		return;
+	}
 
-		auto itr = m_Rows[row].begin(), end = m_Rows[row].end();
-		for (; itr != end; itr++)
+	Vector2 sums = TaskScheduler::Instance()->ParallelReduce(0, len, 0, Vector2(0.0f, 0.0f), [&](int first, int last)
+	{
+		Vector2 partial(0.0f, 0.0f);
+		for (int row = first; row < last; ++row)
 		{
-			uint col = itr->column;
-			/*tmpRes -= itr->value * m_X[col];
-			tmpBeta -= itr->value * ((Matrix3::Identity - m_Constraints[col]) * m_X[col]); //Vel;
-			*/
+			Vector3 tmpRes = bvec[row];
+			Vector3 tmpBeta = bvec[row];
 
-			//tmp = (Matrix3::Identity - m_Constraints[col]) * m_X[col];
-			tmpVec.x = (1.0f - constraints[col]._11) * xvec[col].x;
-			tmpVec.y = constraints[col]._21 * xvec[col].x;
-			tmpVec.z = constraints[col]._31 * xvec[col].x;
+			Vector3 tmpVec;
+			Matrix3 tmp;
 
-			tmpVec.x += constraints[col]._12 * xvec[col].y;
-			tmpVec.y += (1.0f - constraints[col]._22) * xvec[col].y;
-			tmpVec.z += constraints[col]._32 * xvec[col].y;
+			auto itr = m_Rows[row].begin(), end = m_Rows[row].end();
+			for (; itr != end; itr++)
+			{
+				uint col = itr->column;
+				/*tmpRes -= itr->value * m_X[col];
+				tmpBeta -= itr->value * ((Matrix3::Identity - m_Constraints[col]) * m_X[col]); //Vel;
+				*/
 
-			tmpVec.x += constraints[col]._13 * xvec[col].z;
-			tmpVec.y += constraints[col]._23 * xvec[col].z;
-			tmpVec.z += (1.0f - constraints[col]._33) * xvec[col].z;
+				//tmp = (Matrix3::Identity - m_Constraints[col]) * m_X[col];
+				tmpVec.x = (1.0f - constraints[col]._11) * xvec[col].x;
+				tmpVec.y = constraints[col]._21 * xvec[col].x;
+				tmpVec.z = constraints[col]._31 * xvec[col].x;
 
-			InplaceMatrix3MultVector3Subtract(&tmpRes, itr->value, xvec[col]);
-			InplaceMatrix3MultVector3Subtract(&tmpBeta, itr->value, tmpVec);
+				tmpVec.x += constraints[col]._12 * xvec[col].y;
+				tmpVec.y += (1.0f - constraints[col]._22) * xvec[col].y;
+				tmpVec.z += constraints[col]._32 * xvec[col].y;
 
-		}
-		/*m_Residual[row] = m_Constraints[row] * tmpRes;
-		m_Previous[row] = m_Constraints[row] * m_PreCondition[row] * m_Residual[row];*/
+				tmpVec.x += constraints[col]._13 * xvec[col].z;
+				tmpVec.y += constraints[col]._23 * xvec[col].z;
+				tmpVec.z += (1.0f - constraints[col]._33) * xvec[col].z;
 
-		InplaceMatrix3MultVector3(&out_residual[row], constraints[row], tmpRes);
+				InplaceMatrix3MultVector3Subtract(&tmpRes, itr->value, xvec[col]);
+				InplaceMatrix3MultVector3Subtract(&tmpBeta, itr->value, tmpVec);
 
+			}
+			/*m_Residual[row] = m_Constraints[row] * tmpRes;
+			m_Previous[row] = m_Constraints[row] * m_PreCondition[row] * m_Residual[row];*/
 
-		InplaceMatrix3MultMatrix3(&tmp, constraints[row], inv_precondition[row]);
-		InplaceMatrix3MultVector3(&out_previous[row], tmp, out_residual[row]);
+			InplaceMatrix3MultVector3(&out_residual[row], constraints[row], tmpRes);
 
-		//m_Update[row]   = m_Previous[row];
 
-		beta += tmpBeta.Dot(inv_precondition[row] * tmpBeta);
-		r0z0 += Vector3::Dot(out_residual[row], out_previous[row]);
-	}
+			InplaceMatrix3MultMatrix3(&tmp, constraints[row], inv_precondition[row]);
+			InplaceMatrix3MultVector3(&out_previous[row], tmp, out_residual[row]);
+
+			//m_Update[row]   = m_Previous[row];
+
+			partial.x += tmpBeta.Dot(inv_precondition[row] * tmpBeta);
+			partial.y += Vector3::Dot(out_residual[row], out_previous[row]);
+		}
+		return partial;
+	});
 
-	out_beta = beta;
-	out_r0z0 = r0z0;
+	out_beta = sums.x;
+	out_r0z0 = sums.y;
 }
 
 template<class T>
@@ -211,51 +431,159 @@ float SparseRowMatrix<T>::SolveAMultU(std::vector<Vector3>& out, const std::vect
 {
 	float accum = 0.0f;
 	int len = (int)m_Rows.size();
-#pragma omp parallel for reduction(+:accum)// reduction(+:r0z0)
-	for (int row = 0; row < len; ++row)
+
+	if (m_Symmetric)
 	{
-		Vector3 temp(0.0f, 0.0f, 0.0f);
+		m_SymmetricTmp[0].resize(len);
+		std::vector<Vector3>& au = m_SymmetricTmp[0];
+		MultiplySymmetric(&u[0], &au[0]);
 
-		auto itr = m_Rows[row].begin(), end = m_Rows[row].end();
-		for (; itr != end; itr++)
+		accum += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
 		{
-			InplaceMatrix3MultVector3Additve(&temp, itr->value, u[itr->column]);
-		}
-		InplaceMatrix3MultVector3(&out[row], constraints[row], temp);
-		accum += Vector3::Dot(u[row], out[row]);
-
-		/*float temp_x = 0.0f, temp_y = 0.0f, temp_z = 0.0f;
-		float outr[3];
-		auto& arr = m_Rows[row];
-		int rlen = (int)arr.size();
-		for (int i = 0; i < rlen; ++i)
+			float partial = 0.f;
+			for (int row = first; row < last; ++row)
+			{
+				InplaceMatrix3MultVector3(&out[row], constraints[row], au[row]);
+				partial += Vector3::Dot(u[row], out[row]);
+			}
+			return partial;
+		});
+		return accum;
+	}
+
+	accum += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int row = first; row < last; ++row)
 		{
-		Matrix3& mtx = arr[i].value;
-		const Vector3& uvec = u[arr[i].column];
+			Vector3 temp(0.0f, 0.0f, 0.0f);
+
+			auto itr = m_Rows[row].begin(), end = m_Rows[row].end();
+			for (; itr != end; itr++)
+			{
+				InplaceMatrix3MultVector3Additve(&temp, itr->value, u[itr->column]);
+			}
+			InplaceMatrix3MultVector3(&out[row], constraints[row], temp);
+			partial += Vector3::Dot(u[row], out[row]);
+		}
+		return partial;
+	});
+
+	return accum;
+}
 
-		temp_x += mtx._11 * uvec.x;
-		temp_y += mtx._21 * uvec.x;
-		temp_z += mtx._31 * uvec.x;
+template<class T>
+void SparseRowMatrix<T>::Multiply(const Vector3* x, Vector3* out, uint num_rows) const
+{
+	if (m_Symmetric)
+	{
+		MultiplySymmetric(x, out);
+		return;
+	}
 
-		temp_x += mtx._12 * uvec.y;
-		temp_y += mtx._22 * uvec.y;
-		temp_z += mtx._32 * uvec.y;
+	int len = (num_rows < (uint)m_Rows.size()) ? (int)num_rows : (int)m_Rows.size();
 
-		temp_x += mtx._13 * uvec.z;
-		temp_y += mtx._23 * uvec.z;
-		temp_z += mtx._33 * uvec.z;
+	TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+	{
+		for (int row = first; row < last; ++row)
+		{
+			Vector3 temp(0.0f, 0.0f, 0.0f);
+			for (auto itr = m_Rows[row].begin(), end = m_Rows[row].end(); itr != end; itr++)
+			{
+				InplaceMatrix3MultVector3Additve(&temp, itr->value, x[itr->column]);
+			}
+			out[row] = temp;
 		}
+	});
+}
 
+template<class T>
+void SparseRowMatrix<T>::UpdateSymmetricParts(int num_parts) const
+{
+	//Only depends on the pattern, kept until the pattern is rebuilt
+	if ((int)m_PartHaloEnd.size() == num_parts)
+		return;
 
-		const Matrix3& mtx = constraints[row];
+	int len = (int)m_Rows.size();
+	m_PartHaloEnd.resize(num_parts);
+	m_PartHaloOffset.resize(num_parts + 1);
+	m_PartHaloOffset[0] = 0;
+	for (int part = 0; part < num_parts; ++part)
+	{
+		int begin = (int)((long long)len * part / num_parts);
+		int end = (int)((long long)len * (part + 1) / num_parts);
 
-		outr[0] = mtx._11 * temp_x + mtx._12 * temp_y + mtx._13 * temp_z;
-		outr[1] = mtx._21 * temp_x + mtx._22 * temp_y + mtx._23 * temp_z;
-		outr[2] = mtx._31 * temp_x + mtx._32 * temp_y + mtx._33 * temp_z;
+		uint halo_end = (uint)end;
+		for (int row = begin; row < end; ++row)
+		{
+			for (const SparseRowMatrixItem<T>& item : m_Rows[row])
+				halo_end = (item.column + 1 > halo_end) ? item.column + 1 : halo_end;
+		}
 
-		memcpy(&out[row], outr, 3 * sizeof(float));
-		const Vector3& urow = u[row];
-		accum += urow.x * outr[0] + urow.y * outr[1] + urow.z * outr[2];*/
+		m_PartHaloEnd[part] = halo_end;
+		m_PartHaloOffset[part + 1] = m_PartHaloOffset[part] + (halo_end - (uint)end);
 	}
-	return accum;
-}
\ No newline at end of file
+	m_Halo.resize(m_PartHaloOffset[num_parts]);
+}
+
+template<class T>
+void SparseRowMatrix<T>::MultiplySymmetric(const Vector3* x, Vector3* out) const
+{
+	int len = (int)m_Rows.size();
+	int num_parts = (len + SPARSEROWMATRIX_SYMMETRIC_PART_ROWS - 1) / SPARSEROWMATRIX_SYMMETRIC_PART_ROWS;
+	num_parts = (num_parts < SPARSEROWMATRIX_MAX_SYMMETRIC_PARTS) ? num_parts : SPARSEROWMATRIX_MAX_SYMMETRIC_PARTS;
+	num_parts = (num_parts > 0) ? num_parts : 1;
+	UpdateSymmetricParts(num_parts);
+
+	auto part_begin = [&](int part) { return (int)((long long)len * part / num_parts); };
+
+	//One part per task, whichever thread runs it
+	TaskScheduler::Instance()->ParallelFor(0, num_parts, 1, [&](int first_part, int last_part)
+	{
+		for (int part = first_part; part < last_part; ++part)
+		{
+			const int begin = part_begin(part), end = part_begin(part + 1);
+			Vector3* halo = m_Halo.data() + m_PartHaloOffset[part];		//Column end onwards
+
+			for (int row = begin; row < end; ++row)
+				out[row] = Vector3(0.0f, 0.0f, 0.0f);
+			for (uint i = 0, len_halo = m_PartHaloOffset[part + 1] - m_PartHaloOffset[part]; i < len_halo; ++i)
+				halo[i] = Vector3(0.0f, 0.0f, 0.0f);
+
+			for (int row = begin; row < end; ++row)
+			{
+				const Vector3& xrow = x[row];
+				Vector3 temp(0.0f, 0.0f, 0.0f);
+
+				auto itr = m_Rows[row].begin(), itr_end = m_Rows[row].end();
+				for (; itr != itr_end; itr++)
+				{
+					uint col = itr->column;
+					InplaceMatrix3MultVector3Additve(&temp, itr->value, x[col]);
+					if (col != (uint)row)
+						InplaceMatrix3TransposeMultVector3Additve((col < (uint)end) ? &out[col] : &halo[col - end], itr->value, xrow);
+				}
+				out[row] += temp;
+			}
+		}
+	});
+
+	//Earlier parts halos only ever reach forwards, each part adds those overlapping its rows (in part order)
+	TaskScheduler::Instance()->ParallelFor(1, num_parts, 1, [&](int first_part, int last_part)
+	{
+		for (int part = first_part; part < last_part; ++part)
+		{
+			const int begin = part_begin(part), end = part_begin(part + 1);
+			for (int src = 0; src < part; ++src)
+			{
+				const int src_end = part_begin(src + 1);
+				const uint first = ((uint)src_end > (uint)begin) ? (uint)src_end : (uint)begin;
+				const uint last = (m_PartHaloEnd[src] < (uint)end) ? m_PartHaloEnd[src] : (uint)end;
+
+				const Vector3* halo = m_Halo.data() + m_PartHaloOffset[src];
+				for (uint col = first; col < last; ++col)
+					out[col] += halo[col - src_end];
+			}
+		}
+	});
+}
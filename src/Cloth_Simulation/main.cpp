@@ -1,14 +1,17 @@
 #include <glcore\Window.h>
 #include "MyScene.h"
+#include "Sim_Benchmark.h"
 #include <glcore\NCLDebug.h>
 #include <glcore\SceneManager.h>
 #include <glcore\Input.h>
+#include <glcore\TaskScheduler.h>
 #include <iomanip>
 
 MyScene* scene = NULL;
 
 int Quit(bool pause = false, const string &reason = "") {
 	SceneManager::Release();
+	TaskScheduler::Release();
 	Window::Destroy();
 
 	if (pause) {
@@ -19,8 +22,16 @@ int Quit(bool pause = false, const string &reason = "") {
 	return 0;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	//Headless benchmark run, no window is created (see Sim_Benchmark::RunCommandLine)
+	if (argc > 1 && strcmp(argv[1], "-benchmark") == 0)
+	{
+		int exit_code = Sim_Benchmark::RunCommandLine(argc, argv);
+		TaskScheduler::Release();
+		return exit_code;
+	}
+
 	//-------------------
 	//--- MAIN ENGINE ---
 	//-------------------
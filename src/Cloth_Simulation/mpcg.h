@@ -4,14 +4,135 @@
 #include "SparseRowMatrix.h"
 #include "PArray.h"
 #include "SimulationDefines.h"
+#include "Sim_RingBuffer.h"
+#include <glcore\Vector2.h>
 #include <glcore\Vector3.h>
 #include <glcore\Matrix3.h>
+#include <glcore\TaskScheduler.h>
 #include <vector>
 #include <map>
 
 
 //typedef std::vector<std::map<uint, Matrix3>> MatrixMap;
 
+//Optional replacement for the block diagonal preconditioner (e.g. multigrid)
+// - Rebuild is called once per solve after the A matrix has been assembled
+// - Apply must approximate z = A^-1 r, the constraint filter is applied by the solver afterwards
+template<class T>
+class MPCG_Preconditioner
+{
+public:
+	virtual ~MPCG_Preconditioner() {}
+
+	virtual void Rebuild(const T& A, const std::vector<Matrix3>& constraints) = 0;
+	virtual void Apply(const std::vector<Vector3>& residual, std::vector<Vector3>& out_z) = 0;
+};
+
+//Optional replacement for the assembled A matrix (matrix-free solves)
+// - Multiply must compute out = A x without the constraint filter, the solver applies it afterwards
+// - m_A is left untouched while an operator is set, preconditioners rebuilt from it should be disabled
+class MPCG_Operator
+{
+public:
+	virtual ~MPCG_Operator() {}
+
+	virtual void Multiply(const std::vector<Vector3>& x, std::vector<Vector3>& out) = 0;
+};
+
+enum MPCG_Precision
+{
+	MPCG_Precision_Single = 0,		//Float throughout
+	MPCG_Precision_Mixed,			//Float SpMV and preconditioner, double solution, residual and dot products
+	MPCG_Precision_Double,			//Double vectors and SpMV accumulation (A is still assembled in float), for validation
+	MPCG_Precision_MAX
+};
+
+//Krylov method of a solve, CG needs A to be symmetric positive definite
+enum MPCG_Method
+{
+	MPCG_Method_CG = 0,
+	MPCG_Method_BiCGSTAB,			//Non-symmetric A (e.g. the newton tangent of the implicit integrator)
+	MPCG_Method_MAX
+};
+
+#define MPCG_DEFAULT_TOLERANCE 1e-5f
+#define MPCG_DEFAULT_MAX_ITERATIONS 100
+
+//Runtime solver parameters, applied as a block so they can be stored and copied with the material
+struct MPCG_Settings
+{
+	MPCG_Settings()
+		: tolerance(MPCG_DEFAULT_TOLERANCE)
+		, max_iterations(MPCG_DEFAULT_MAX_ITERATIONS)
+		, precision(MPCG_Precision_Single)
+		, refinement_steps(1)
+	{}
+
+	float			tolerance;
+	uint			max_iterations;
+	MPCG_Precision	precision;
+	uint			refinement_steps;	//Mixed/double precision only
+};
+
+//One record per solve, pushed to MPCG::GetTelemetry() as the solve completes
+// - Errors are preconditioned residual norms relative to sqrt(beta), the solve converges once below the tolerance
+struct MPCG_Telemetry
+{
+	uint			solve_index;			//Solves since the solver was created
+	uint			iterations;
+	bool			hit_max_iterations;		//Stopped by the iteration limit rather than the tolerance
+	float			initial_error;			//Before the first iteration
+	float			final_error;			//GetEstimatedError()
+	float			beta;					//Preconditioned norm of b - A(I - S)x, what the tolerance is relative to
+	MPCG_Precision	precision;
+	MPCG_Method		method;					//A BiCGSTAB iteration costs two A products and two preconditioner applications
+
+	float			initialization_ms;		//Initial residual, preconditioner rebuild and refinement checks
+	float			multiply_ms;			//A p, every iteration
+	float			precondition_ms;		//z = M^-1 r and the next direction, every iteration
+	float			total_ms;
+};
+
+#define MPCG_TELEMETRY_BUFFER_SIZE 1024
+typedef Sim_RingBuffer<MPCG_Telemetry, MPCG_TELEMETRY_BUFFER_SIZE> MPCG_TelemetryBuffer;
+
+//Minimal double precision vector for the mixed/double solver paths
+struct MPCG_Vector3d
+{
+	double x, y, z;
+
+	MPCG_Vector3d() {}
+	MPCG_Vector3d(double x, double y, double z) : x(x), y(y), z(z) {}
+	MPCG_Vector3d(const Vector3& v) : x(v.x), y(v.y), z(v.z) {}
+
+	inline Vector3 ToFloat() const { return Vector3((float)x, (float)y, (float)z); }
+	inline double Dot(const MPCG_Vector3d& v) const { return x * v.x + y * v.y + z * v.z; }
+
+	inline MPCG_Vector3d operator+(const MPCG_Vector3d& v) const { return MPCG_Vector3d(x + v.x, y + v.y, z + v.z); }
+	inline MPCG_Vector3d operator-(const MPCG_Vector3d& v) const { return MPCG_Vector3d(x - v.x, y - v.y, z - v.z); }
+	inline MPCG_Vector3d operator*(double s) const { return MPCG_Vector3d(x * s, y * s, z * s); }
+	inline void operator+=(const MPCG_Vector3d& v) { x += v.x; y += v.y; z += v.z; }
+	inline void operator-=(const MPCG_Vector3d& v) { x -= v.x; y -= v.y; z -= v.z; }
+
+	//m * v
+	static inline MPCG_Vector3d Mult(const Matrix3& m, const MPCG_Vector3d& v)
+	{
+		return MPCG_Vector3d(
+			m._11 * v.x + m._12 * v.y + m._13 * v.z,
+			m._21 * v.x + m._22 * v.y + m._23 * v.z,
+			m._31 * v.x + m._32 * v.y + m._33 * v.z);
+	}
+
+	//m^T * v
+	static inline MPCG_Vector3d MultTranspose(const Matrix3& m, const MPCG_Vector3d& v)
+	{
+		return MPCG_Vector3d(
+			m._11 * v.x + m._21 * v.y + m._31 * v.z,
+			m._12 * v.x + m._22 * v.y + m._32 * v.z,
+			m._13 * v.x + m._23 * v.y + m._33 * v.z);
+	}
+};
+
 //Modified Preconditioned Conjugate Gradient
 template<class T>
 class MPCG
@@ -31,6 +152,32 @@ public:
 	inline uint GetMaxIterations() const { return m_MaxIterations; }
 	inline float GetTolerance() const { return m_Tolerence; }
 
+	inline void SetPreconditioner(MPCG_Preconditioner<T>* preconditioner) { m_Preconditioner = preconditioner; }
+	inline MPCG_Preconditioner<T>* GetPreconditioner() const { return m_Preconditioner; }
+
+	//Matrix-free mode, A is applied through the operator instead of m_A (NULL to use m_A again)
+	// - The double precision mode falls back to mixed, the operator only works in float
+	inline void SetOperator(MPCG_Operator* op) { m_Operator = op; }
+	inline MPCG_Operator* GetOperator() const { return m_Operator; }
+
+	//Float solves stall once the recursively updated residual reaches float round off, the mixed mode
+	// keeps the parts that accumulate (x, r and the dot products) in double
+	// - Refinement steps recompute the true residual from x and restart CG if it has not converged,
+	//   sharing the same iteration budget
+	inline void SetPrecision(MPCG_Precision precision) { m_Precision = precision; }
+	inline MPCG_Precision GetPrecision() const { return m_Precision; }
+	inline void SetRefinementSteps(uint steps) { m_RefinementSteps = steps; }
+	inline uint GetRefinementSteps() const { return m_RefinementSteps; }
+
+	inline MPCG_Settings GetSettings() const;
+	inline void SetSettings(const MPCG_Settings& settings);
+
+	inline uint GetIterations() const { return m_Iterations; }
+	inline float GetEstimatedError() const { return m_EstimatedError; }
+
+	//Per solve records, can be polled from any thread while solving (see Sim_RingBuffer)
+	inline const MPCG_TelemetryBuffer& GetTelemetry() const { return m_Telemetry; }
+
 
 
 	T							m_A;
@@ -45,31 +192,74 @@ public:
 	void SolveWithGuess(const Vector3* guess);
 	void SolveWithPreviousResult();	//SolveWithGuess(this->m_X)
 
+	//BiCGSTAB instead of CG, for an A that is not symmetric
+	// - Same constraint filter, preconditioner, tolerance and telemetry as the CG solves
+	// - Always runs in single precision, the precision setting only applies to CG
+	void SolveNonSymmetricWithGuess(const Vector3* guess);
+
+	//out = S A u, returns Dot(u, out). Goes through the operator if one is set.
+	float MultiplyA(std::vector<Vector3>& out, const std::vector<Vector3>& u);
+
 	inline void ResetProfilingData();
 
 	ProfilingTimer m_ProfilingInitialization;
 	ProfilingTimer m_ProfilingUpper;
 	ProfilingTimer m_ProfilingLower;
-	float		   GetAverageIterations() { return ((float)m_ProfilingAverageIterations_Sum / (float)m_ProfilingAverageIterations_No); }
+	float		   GetAverageIterations() { return (m_ProfilingAverageIterations_No > 0) ? ((float)m_ProfilingAverageIterations_Sum / (float)m_ProfilingAverageIterations_No) : 0.0f; }
 
 protected:
 	uint		   m_ProfilingAverageIterations_Sum;
 	uint		   m_ProfilingAverageIterations_No;
 
+	void BeginSolve();
+	void EndSolve();	//Iteration averages and the telemetry record
+
 	void Solve_Algorithm();
+	void Solve_Algorithm_Extended();	//Mixed and double precision
+	void Solve_Algorithm_BiCGSTAB();
+	void PreconditionVector(const std::vector<Vector3>& in, std::vector<Vector3>& out);	//out = S * M^-1 * in
+	double ComputeResidualDouble(const T& A, std::vector<MPCG_Vector3d>& out_residual, const std::vector<MPCG_Vector3d>& x);	//Returns beta
+	void ApplyPreconditionerDouble(const std::vector<MPCG_Vector3d>& residual, std::vector<MPCG_Vector3d>& out_z);
+	float ApplyPreconditioner();	//m_Previous = S * M^-1 * m_Residual, returns Dot(m_Previous, m_Residual)
+	void ComputeResidual(float& out_r0z0, float& out_beta);	//As SparseRowMatrix::SolveAMultX, on m_A or the operator
 
 protected:
 	uint					m_MaxIterations;
 	uint					m_Iterations;
+	float					m_InitialError;
+	float					m_Beta;
 	float					m_Tolerence;
 	float					m_EstimatedError;
 	uint					m_NumTotal;
 
+	MPCG_Preconditioner<T>*	m_Preconditioner;
+	MPCG_Operator*			m_Operator;
+	std::vector<Vector3>	m_OperatorX, m_OperatorAX;	//Operator mode scratch (A(I - S)x and Ax)
+	MPCG_Precision			m_Precision;
+	uint					m_RefinementSteps;
+	MPCG_Method				m_Method;	//Of the current solve
+
 	std::vector<Vector3>	m_Residual;
 	std::vector<Vector3>	m_Previous;
 	std::vector<Vector3>	m_Update;
 	std::vector<Vector3>	m_UpdateA;
 	std::vector<float>		m_ValueAccum1;
+
+	//BiCGSTAB only
+	std::vector<Vector3>	m_ResidualShadow;
+	std::vector<Vector3>	m_StabilizerA;
+
+	//Mixed/double precision
+	std::vector<MPCG_Vector3d>	m_XD;
+	std::vector<MPCG_Vector3d>	m_ResidualD;
+	std::vector<MPCG_Vector3d>	m_PreviousD;	//Double mode only
+	std::vector<MPCG_Vector3d>	m_UpdateD;
+	std::vector<MPCG_Vector3d>	m_UpdateAD;
+
+	MPCG_TelemetryBuffer	m_Telemetry;
+	MPCG_Telemetry			m_TelemetryStart;	//Phase timer totals at the start of the solve
+	ProfilingTimer			m_ProfilingSolve;
+	uint					m_NumSolves;
 };
 
 #include "mpcg.inl"
\ No newline at end of file
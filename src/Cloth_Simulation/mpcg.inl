@@ -6,10 +6,15 @@ template<class T>
 MPCG<T>::MPCG()
 {
 	m_NumTotal = 0;
-	m_Tolerence = 1e-5f;// 0.0001f;
-	m_MaxIterations = 100;
 	m_EstimatedError = 0.0f;
 	m_Iterations = 0;
+	m_InitialError = 0.0f;
+	m_Beta = 0.0f;
+	m_NumSolves = 0;
+	m_Preconditioner = NULL;
+	m_Operator = NULL;
+	m_Method = MPCG_Method_CG;
+	SetSettings(MPCG_Settings());
 }
 
 template<class T>
@@ -17,6 +22,26 @@ MPCG<T>::~MPCG()
 {
 }
 
+template<class T>
+MPCG_Settings MPCG<T>::GetSettings() const
+{
+	MPCG_Settings settings;
+	settings.tolerance = m_Tolerence;
+	settings.max_iterations = m_MaxIterations;
+	settings.precision = m_Precision;
+	settings.refinement_steps = m_RefinementSteps;
+	return settings;
+}
+
+template<class T>
+void MPCG<T>::SetSettings(const MPCG_Settings& settings)
+{
+	m_Tolerence = settings.tolerance;
+	m_MaxIterations = settings.max_iterations;
+	m_Precision = settings.precision;
+	m_RefinementSteps = settings.refinement_steps;
+}
+
 template<class T>
 void MPCG<T>::AllocateMemory(uint num_total)
 {
@@ -52,46 +77,93 @@ void MPCG<T>::ResetMemory()
 template<class T>
 void MPCG<T>::Solve()
 {
+	BeginSolve();
 	memset(&m_X[0].x, 0, m_NumTotal * sizeof(Vector3));
 	Solve_Algorithm();
-
-	m_ProfilingAverageIterations_Sum += m_Iterations;
-	m_ProfilingAverageIterations_No++;
+	EndSolve();
 }
 
 template<class T>
 void MPCG<T>::SolveWithGuess(const std::vector<Vector3>& guess)
 {
+	BeginSolve();
 	memset(&m_X[0].x, 0, m_NumTotal * sizeof(Vector3));
 	memcpy(&m_X[0].x, &guess[0].x, guess.size() * sizeof(Vector3));
 	Solve_Algorithm();
-
-	m_ProfilingAverageIterations_Sum += m_Iterations;
-	m_ProfilingAverageIterations_No++;
+	EndSolve();
 }
 
 template<class T>
 void MPCG<T>::SolveWithGuess(const Vector3* guess)
 {
+	BeginSolve();
 	memcpy(&m_X[0].x, guess, m_NumTotal * sizeof(Vector3));
 	Solve_Algorithm();
-
-	m_ProfilingAverageIterations_Sum += m_Iterations;
-	m_ProfilingAverageIterations_No++;
+	EndSolve();
 }
 
 template<class T>
 void MPCG<T>::SolveWithPreviousResult()
 {
+	BeginSolve();
 	Solve_Algorithm();
+	EndSolve();
+}
+
+template<class T>
+void MPCG<T>::SolveNonSymmetricWithGuess(const Vector3* guess)
+{
+	BeginSolve();
+	m_Method = MPCG_Method_BiCGSTAB;
+	memcpy(&m_X[0].x, guess, m_NumTotal * sizeof(Vector3));
+	Solve_Algorithm_BiCGSTAB();
+	EndSolve();
+}
+
+template<class T>
+void MPCG<T>::BeginSolve()
+{
+	m_ProfilingSolve.BeginTiming();
+	m_TelemetryStart.initialization_ms = m_ProfilingInitialization.GetTimedMilliSeconds();
+	m_TelemetryStart.multiply_ms = m_ProfilingUpper.GetTimedMilliSeconds();
+	m_TelemetryStart.precondition_ms = m_ProfilingLower.GetTimedMilliSeconds();
+}
+
+template<class T>
+void MPCG<T>::EndSolve()
+{
+	m_ProfilingSolve.EndTiming();
 
 	m_ProfilingAverageIterations_Sum += m_Iterations;
 	m_ProfilingAverageIterations_No++;
+
+	MPCG_Telemetry record;
+	record.solve_index = m_NumSolves++;
+	record.iterations = m_Iterations;
+	record.hit_max_iterations = (m_Iterations >= m_MaxIterations);
+	record.initial_error = m_InitialError;
+	record.final_error = m_EstimatedError;
+	record.beta = m_Beta;
+	record.precision = (m_Method == MPCG_Method_CG) ? m_Precision : MPCG_Precision_Single;
+	record.method = m_Method;
+	record.initialization_ms = m_ProfilingInitialization.GetTimedMilliSeconds() - m_TelemetryStart.initialization_ms;
+	record.multiply_ms = m_ProfilingUpper.GetTimedMilliSeconds() - m_TelemetryStart.multiply_ms;
+	record.precondition_ms = m_ProfilingLower.GetTimedMilliSeconds() - m_TelemetryStart.precondition_ms;
+	record.total_ms = m_ProfilingSolve.GetTimedMilliSeconds();
+	m_Telemetry.Push(record);
+
+	m_Method = MPCG_Method_CG;
 }
 
 template<class T>
 void MPCG<T>::Solve_Algorithm()
 {
+	if (m_Precision != MPCG_Precision_Single)
+	{
+		Solve_Algorithm_Extended();
+		return;
+	}
+
 	float r0z0, d2;
 	float beta = 0.0f;
 	float delta = 0.0f;
@@ -153,10 +225,17 @@ void MPCG<T>::Solve_Algorithm()
 	r0z0 += Vector3::Dot(m_Residual[row], m_Previous[row]);
 	}*/
 
-	m_A.SolveAMultX(m_Residual, m_Previous, r0z0, beta, m_Constraints, m_PreCondition, m_B, m_X);
+	ComputeResidual(r0z0, beta);
+	if (m_Preconditioner != NULL)
+	{
+		m_Preconditioner->Rebuild(m_A, m_Constraints);
+		r0z0 = ApplyPreconditioner();
+	}
 	memcpy(&m_Update[0], &m_Previous[0], m_NumTotal * sizeof(Vector3));
 	m_ProfilingInitialization.EndTimingAdditive();
 
+	m_Beta = beta;
+	m_InitialError = (beta > 0.0f) ? sqrtf(r0z0 / beta) : 0.0f;
 
 	float tolSqBeta = m_Tolerence * m_Tolerence * beta;
 
@@ -181,7 +260,7 @@ void MPCG<T>::Solve_Algorithm()
 		//r0z0 += Vector3::Dot(m_Residual[row], m_Previous[row]);
 		d2 += Vector3::Dot(m_Update[row], m_UpdateA[row]);
 		}*/
-		d2 = m_A.SolveAMultU(m_UpdateA, m_Constraints, m_Update);
+		d2 = MultiplyA(m_UpdateA, m_Update);
 		m_ProfilingUpper.EndTimingAdditive();
 
 
@@ -191,15 +270,18 @@ void MPCG<T>::Solve_Algorithm()
 		// x1 = x0 + p0 * aplha
 		// r1 = r0 - Ap0 * alpha
 
-		float errorSq = 0.0f;
-#pragma omp parallel for reduction(+:errorSq)
-		for (int row = 0; row < m_NumTotal; ++row)
+		float errorSq = TaskScheduler::Instance()->ParallelReduce(0, m_NumTotal, 0, 0.f, [&](int first, int last)
 		{
-			m_X[row] += m_Update[row] * alpha;
-			m_Residual[row] -= m_UpdateA[row] * alpha;
-
-			errorSq += Vector3::Dot(m_Residual[row], m_PreCondition[row] * m_Residual[row]);
-		}
+			float partial = 0.f;
+			for (int row = first; row < last; ++row)
+			{
+				m_X[row] += m_Update[row] * alpha;
+				m_Residual[row] -= m_UpdateA[row] * alpha;
+
+				partial += Vector3::Dot(m_Residual[row], m_PreCondition[row] * m_Residual[row]);
+			}
+			return partial;
+		});
 		m_EstimatedError = errorSq;
 
 		// if (r1 is small) exit;
@@ -213,12 +295,23 @@ void MPCG<T>::Solve_Algorithm()
 		// z1 = Minv . r1
 		d2 = 0.0f;
 		m_ProfilingLower.BeginTiming();
-#pragma omp parallel for reduction(+:d2)
-		for (int row = 0; row < m_NumTotal; ++row)
+		if (m_Preconditioner != NULL)
+		{
+			d2 = ApplyPreconditioner();
+		}
+		else
 		{
-			//m_Previous[row] = m_PreCondition[row] * m_Residual[row];
-			InplaceMatrix3MultVector3(&m_Previous[row], m_PreCondition[row], m_Residual[row]);
-			d2 += Vector3::Dot(m_Previous[row], m_Residual[row]);
+			d2 = TaskScheduler::Instance()->ParallelReduce(0, m_NumTotal, 0, 0.f, [&](int first, int last)
+			{
+				float partial = 0.f;
+				for (int row = first; row < last; ++row)
+				{
+					//m_Previous[row] = m_PreCondition[row] * m_Residual[row];
+					InplaceMatrix3MultVector3(&m_Previous[row], m_PreCondition[row], m_Residual[row]);
+					partial += Vector3::Dot(m_Previous[row], m_Residual[row]);
+				}
+				return partial;
+			});
 		}
 
 
@@ -228,13 +321,15 @@ void MPCG<T>::Solve_Algorithm()
 		r0z0 = d2;
 
 		// p1 = z1 + p0 * beta
-#pragma omp parallel for
-		for (int row = 0; row < m_NumTotal; ++row)
+		TaskScheduler::Instance()->ParallelFor(0, m_NumTotal, 0, [&](int first, int last)
 		{
-			//m_Update[row] = m_Constraints[row] * (m_Previous[row] + m_Update[row] * change);
-			Vector3 temp = (m_Previous[row] + m_Update[row] * change);
-			InplaceMatrix3MultVector3(&m_Update[row], m_Constraints[row], temp);
-		}
+			for (int row = first; row < last; ++row)
+			{
+				//m_Update[row] = m_Constraints[row] * (m_Previous[row] + m_Update[row] * change);
+				Vector3 temp = (m_Previous[row] + m_Update[row] * change);
+				InplaceMatrix3MultVector3(&m_Update[row], m_Constraints[row], temp);
+			}
+		});
 		m_ProfilingLower.EndTimingAdditive();
 	}
 
@@ -242,6 +337,614 @@ void MPCG<T>::Solve_Algorithm()
 	m_EstimatedError = sqrt(m_EstimatedError);
 }
 
+template<class T>
+void MPCG<T>::Solve_Algorithm_Extended()
+{
+	const bool full_double = (m_Precision == MPCG_Precision_Double) && (m_Operator == NULL);
+	const int len = (int)m_NumTotal;
+
+	m_XD.resize(m_NumTotal);
+	m_ResidualD.resize(m_NumTotal);
+	m_PreviousD.resize(m_NumTotal);
+	if (full_double)
+	{
+		m_UpdateD.resize(m_NumTotal);
+		m_UpdateAD.resize(m_NumTotal);
+	}
+
+	m_ProfilingInitialization.BeginTiming();
+	TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+	{
+		for (int row = first; row < last; ++row)
+		{
+			m_XD[row] = MPCG_Vector3d(m_X[row]);
+		}
+	});
+
+	double beta = ComputeResidualDouble(m_A, m_ResidualD, m_XD);
+	m_Beta = (float)beta;
+	if (m_Preconditioner != NULL)
+	{
+		m_Preconditioner->Rebuild(m_A, m_Constraints);
+	}
+	m_ProfilingInitialization.EndTimingAdditive();
+
+	const double tolSqBeta = (double)m_Tolerence * (double)m_Tolerence * beta;
+	double errorSq = 0.0;
+	uint iterations = 0;
+	bool converged = false;
+
+	for (uint pass = 0; pass <= m_RefinementSteps; ++pass)
+	{
+		if (pass > 0)
+		{
+			//Refinement: the recursive residual has converged, check it against the true residual of x
+			// (they drift apart with float SpMV) and restart from the true one if needed
+			m_ProfilingInitialization.BeginTiming();
+			ComputeResidualDouble(m_A, m_ResidualD, m_XD);
+
+			errorSq = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+			{
+				double partial = 0.0;
+				for (int row = first; row < last; ++row)
+				{
+					partial += m_ResidualD[row].Dot(MPCG_Vector3d::Mult(m_PreCondition[row], m_ResidualD[row]));
+				}
+				return partial;
+			});
+			m_ProfilingInitialization.EndTimingAdditive();
+
+			if (errorSq < tolSqBeta)
+				break;
+			converged = false;
+		}
+
+		// z0 = Minv . r0, p0 = z0
+		ApplyPreconditionerDouble(m_ResidualD, m_PreviousD);
+
+		double r0z0 = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+		{
+			double partial = 0.0;
+			for (int row = first; row < last; ++row)
+			{
+				partial += m_PreviousD[row].Dot(m_ResidualD[row]);
+				if (full_double)
+					m_UpdateD[row] = m_PreviousD[row];
+				else
+					m_Update[row] = m_PreviousD[row].ToFloat();
+			}
+			return partial;
+		});
+
+		if (pass == 0)
+			m_InitialError = (beta > 0.0) ? (float)sqrt(r0z0 / beta) : 0.0f;
+
+		for (; iterations < m_MaxIterations; ++iterations)
+		{
+			// alpha = Dot(r0, z0) / Dot(p0, Ap0)
+			double d2 = 0.0;
+			m_ProfilingUpper.BeginTiming();
+			if (full_double)
+			{
+				d2 += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+				{
+					double partial = 0.0;
+					for (int row = first; row < last; ++row)
+					{
+						MPCG_Vector3d temp(0.0, 0.0, 0.0);
+						m_A.ForEachInRow(row, [&](uint col, const Matrix3& value, bool transposed)
+						{
+							temp += transposed ? MPCG_Vector3d::MultTranspose(value, m_UpdateD[col]) : MPCG_Vector3d::Mult(value, m_UpdateD[col]);
+						});
+						m_UpdateAD[row] = MPCG_Vector3d::Mult(m_Constraints[row], temp);
+						partial += m_UpdateD[row].Dot(m_UpdateAD[row]);
+					}
+					return partial;
+				});
+			}
+			else
+			{
+				MultiplyA(m_UpdateA, m_Update);
+				d2 += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+				{
+					double partial = 0.0;
+					for (int row = first; row < last; ++row)
+					{
+						partial += MPCG_Vector3d(m_Update[row]).Dot(MPCG_Vector3d(m_UpdateA[row]));
+					}
+					return partial;
+				});
+			}
+			m_ProfilingUpper.EndTimingAdditive();
+
+			if (fabs(d2) < tiny) d2 = tiny;
+			double alpha = r0z0 / d2;
+
+			// x1 = x0 + p0 * aplha
+			// r1 = r0 - Ap0 * alpha
+			errorSq = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+			{
+				double partial = 0.0;
+				for (int row = first; row < last; ++row)
+				{
+					if (full_double)
+					{
+						m_XD[row] += m_UpdateD[row] * alpha;
+						m_ResidualD[row] -= m_UpdateAD[row] * alpha;
+					}
+					else
+					{
+						m_XD[row] += MPCG_Vector3d(m_Update[row]) * alpha;
+						m_ResidualD[row] -= MPCG_Vector3d(m_UpdateA[row]) * alpha;
+					}
+
+					partial += m_ResidualD[row].Dot(MPCG_Vector3d::Mult(m_PreCondition[row], m_ResidualD[row]));
+				}
+				return partial;
+			});
+
+			// if (r1 is small) exit;
+			if (errorSq < tolSqBeta)
+			{
+				converged = true;
+				break;
+			}
+
+			// z1 = Minv . r1
+			m_ProfilingLower.BeginTiming();
+			ApplyPreconditionerDouble(m_ResidualD, m_PreviousD);
+
+			double r1z1 = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+			{
+				double partial = 0.0;
+				for (int row = first; row < last; ++row)
+				{
+					partial += m_PreviousD[row].Dot(m_ResidualD[row]);
+				}
+				return partial;
+			});
+
+			// change = Dot(z1, r1) / Dot(z0, r0)
+			if (fabs(r0z0) < tiny) r0z0 = tiny;
+			double change = r1z1 / r0z0;
+			r0z0 = r1z1;
+
+			// p1 = z1 + p0 * beta
+			TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+			{
+				for (int row = first; row < last; ++row)
+				{
+					if (full_double)
+						m_UpdateD[row] = MPCG_Vector3d::Mult(m_Constraints[row], m_PreviousD[row] + m_UpdateD[row] * change);
+					else
+						m_Update[row] = MPCG_Vector3d::Mult(m_Constraints[row], m_PreviousD[row] + MPCG_Vector3d(m_Update[row]) * change).ToFloat();
+				}
+			});
+			m_ProfilingLower.EndTimingAdditive();
+		}
+
+		//Out of iterations, nothing left to refine with
+		if (!converged)
+			break;
+	}
+
+	TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+	{
+		for (int row = first; row < last; ++row)
+		{
+			m_X[row] = m_XD[row].ToFloat();
+		}
+	});
+
+	//Same convention as the single precision path (index of the converging iteration)
+	m_Iterations = iterations;
+	m_EstimatedError = (beta > 0.0) ? (float)sqrt(errorSq / beta) : 0.0f;
+}
+
+template<class T>
+void MPCG<T>::Solve_Algorithm_BiCGSTAB()
+{
+	//Right preconditioned BiCGSTAB on S A, every vector is kept filtered so the constrained dofs never move
+	// - p/v/y are the BiCG half step (y = S M^-1 p, v = S A y), z/t the stabilising one (z = S M^-1 s, t = S A z)
+	// - s overwrites r and y/z share m_Previous, x takes each half step as soon as it is known
+	// - Converges on the same preconditioned residual norm as CG, both half steps are checked
+	const int len = (int)m_NumTotal;
+	m_ResidualShadow.resize(m_NumTotal);
+	m_StabilizerA.resize(m_NumTotal);
+
+	float r0z0, beta;
+	m_ProfilingInitialization.BeginTiming();
+	ComputeResidual(r0z0, beta);
+	if (m_Preconditioner != NULL)
+	{
+		m_Preconditioner->Rebuild(m_A, m_Constraints);
+	}
+
+	float errorSq = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int row = first; row < last; ++row)
+		{
+			partial += Vector3::Dot(m_Residual[row], m_PreCondition[row] * m_Residual[row]);
+		}
+		return partial;
+	});
+	memcpy(&m_ResidualShadow[0], &m_Residual[0], m_NumTotal * sizeof(Vector3));
+	memset(&m_Update[0].x, 0, m_NumTotal * sizeof(Vector3));
+	memset(&m_UpdateA[0].x, 0, m_NumTotal * sizeof(Vector3));
+	m_ProfilingInitialization.EndTimingAdditive();
+
+	m_Beta = beta;
+	m_InitialError = (beta > 0.0f) ? sqrtf(errorSq / beta) : 0.0f;
+
+	const float tolSqBeta = m_Tolerence * m_Tolerence * beta;
+	float rho = 1.0f, alpha = 1.0f, omega = 1.0f;
+
+	for (m_Iterations = 0; m_Iterations < m_MaxIterations && errorSq > tolSqBeta; ++m_Iterations)
+	{
+		// rho1 = Dot(r^, r), restart from the current residual if r^ has become orthogonal to it
+		m_ProfilingLower.BeginTiming();
+		float rho1 = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+		{
+			float partial = 0.f;
+			for (int row = first; row < last; ++row)
+			{
+				partial += Vector3::Dot(m_ResidualShadow[row], m_Residual[row]);
+			}
+			return partial;
+		});
+
+		float change;
+		if (fabs(rho1) < tiny)
+		{
+			memcpy(&m_ResidualShadow[0], &m_Residual[0], m_NumTotal * sizeof(Vector3));
+			rho1 = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+			{
+				float partial = 0.f;
+				for (int row = first; row < last; ++row)
+				{
+					partial += Vector3::Dot(m_Residual[row], m_Residual[row]);
+				}
+				return partial;
+			});
+			change = 0.0f;
+		}
+		else
+		{
+			// change = (rho1 / rho0) * (alpha / omega)
+			change = (rho1 / rho) * (alpha / omega);
+		}
+		rho = rho1;
+
+		// p1 = r1 + (p0 - v0 * omega) * change
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				m_Update[row] = m_Residual[row] + (m_Update[row] - m_UpdateA[row] * omega) * change;
+			}
+		});
+
+		// y = Minv . p1
+		PreconditionVector(m_Update, m_Previous);
+		m_ProfilingLower.EndTimingAdditive();
+
+		// v1 = A y, alpha = rho1 / Dot(r^, v1)
+		m_ProfilingUpper.BeginTiming();
+		MultiplyA(m_UpdateA, m_Previous);
+		m_ProfilingUpper.EndTimingAdditive();
+
+		float d2 = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+		{
+			float partial = 0.f;
+			for (int row = first; row < last; ++row)
+			{
+				partial += Vector3::Dot(m_ResidualShadow[row], m_UpdateA[row]);
+			}
+			return partial;
+		});
+		if (fabs(d2) < tiny) d2 = tiny;
+		alpha = rho1 / d2;
+
+		// x = x + y * alpha
+		// s = r1 - v1 * alpha
+		errorSq = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+		{
+			float partial = 0.f;
+			for (int row = first; row < last; ++row)
+			{
+				m_X[row] += m_Previous[row] * alpha;
+				m_Residual[row] -= m_UpdateA[row] * alpha;
+
+				partial += Vector3::Dot(m_Residual[row], m_PreCondition[row] * m_Residual[row]);
+			}
+			return partial;
+		});
+
+		// if (s is small) exit;
+		if (errorSq < tolSqBeta)
+			break;
+
+		// z = Minv . s, t = A z
+		m_ProfilingLower.BeginTiming();
+		PreconditionVector(m_Residual, m_Previous);
+		m_ProfilingLower.EndTimingAdditive();
+
+		m_ProfilingUpper.BeginTiming();
+		MultiplyA(m_StabilizerA, m_Previous);
+		m_ProfilingUpper.EndTimingAdditive();
+
+		// omega = Dot(t, s) / Dot(t, t)
+		Vector2 ts_tt = TaskScheduler::Instance()->ParallelReduce(0, len, 0, Vector2(0.f, 0.f), [&](int first, int last)
+		{
+			Vector2 partial(0.f, 0.f);
+			for (int row = first; row < last; ++row)
+			{
+				partial.x += Vector3::Dot(m_StabilizerA[row], m_Residual[row]);
+				partial.y += Vector3::Dot(m_StabilizerA[row], m_StabilizerA[row]);
+			}
+			return partial;
+		});
+		omega = (ts_tt.y > tiny) ? ts_tt.x / ts_tt.y : 0.0f;
+		if (fabs(omega) < tiny) omega = tiny;
+
+		// x = x + z * omega
+		// r1 = s - t * omega
+		errorSq = TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+		{
+			float partial = 0.f;
+			for (int row = first; row < last; ++row)
+			{
+				m_X[row] += m_Previous[row] * omega;
+				m_Residual[row] -= m_StabilizerA[row] * omega;
+
+				partial += Vector3::Dot(m_Residual[row], m_PreCondition[row] * m_Residual[row]);
+			}
+			return partial;
+		});
+	}
+
+	m_EstimatedError = (beta > 0.0f) ? sqrtf(errorSq / beta) : 0.0f;
+}
+
+template<class T>
+void MPCG<T>::PreconditionVector(const std::vector<Vector3>& in, std::vector<Vector3>& out)
+{
+	if (m_Preconditioner != NULL)
+	{
+		m_Preconditioner->Apply(in, out);
+		TaskScheduler::Instance()->ParallelFor(0, (int)m_NumTotal, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				Vector3 temp = out[row];
+				InplaceMatrix3MultVector3(&out[row], m_Constraints[row], temp);
+			}
+		});
+		return;
+	}
+
+	TaskScheduler::Instance()->ParallelFor(0, (int)m_NumTotal, 0, [&](int first, int last)
+	{
+		for (int row = first; row < last; ++row)
+		{
+			Matrix3 tmp;
+			InplaceMatrix3MultMatrix3(&tmp, m_Constraints[row], m_PreCondition[row]);
+			InplaceMatrix3MultVector3(&out[row], tmp, in[row]);
+		}
+	});
+}
+
+template<class T>
+double MPCG<T>::ComputeResidualDouble(const T& A, std::vector<MPCG_Vector3d>& out_residual, const std::vector<MPCG_Vector3d>& x)
+{
+	//As SparseRowMatrix::SolveAMultX, r = S(b - Ax) and beta measures b - A(I - S)x
+	double beta = 0.0;
+	const int len = (int)m_NumTotal;
+
+	if (m_Operator != NULL)
+	{
+		//The operator only works in float, the subtractions from b and the reduction are still done in double
+		m_OperatorX.resize(len);
+		m_OperatorAX.resize(len);
+
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				m_OperatorX[row] = x[row].ToFloat();
+			}
+		});
+		m_Operator->Multiply(m_OperatorX, m_OperatorAX);
+
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				out_residual[row] = MPCG_Vector3d::Mult(m_Constraints[row], MPCG_Vector3d(m_B[row]) - MPCG_Vector3d(m_OperatorAX[row]));
+				m_OperatorX[row] = (x[row] - MPCG_Vector3d::Mult(m_Constraints[row], x[row])).ToFloat();
+			}
+		});
+		m_Operator->Multiply(m_OperatorX, m_OperatorAX);
+
+		beta += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+		{
+			double partial = 0.0;
+			for (int row = first; row < last; ++row)
+			{
+				MPCG_Vector3d tmpBeta = MPCG_Vector3d(m_B[row]) - MPCG_Vector3d(m_OperatorAX[row]);
+				partial += tmpBeta.Dot(MPCG_Vector3d::Mult(m_PreCondition[row], tmpBeta));
+			}
+			return partial;
+		});
+		return beta;
+	}
+
+	beta += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.0, [&](int first, int last)
+	{
+		double partial = 0.0;
+		for (int row = first; row < last; ++row)
+		{
+			MPCG_Vector3d tmpRes(m_B[row]);
+			MPCG_Vector3d tmpBeta(m_B[row]);
+
+			A.ForEachInRow(row, [&](uint col, const Matrix3& value, bool transposed)
+			{
+				const MPCG_Vector3d& xc = x[col];
+				MPCG_Vector3d x_fixed = xc - MPCG_Vector3d::Mult(m_Constraints[col], xc);
+
+				tmpRes -= transposed ? MPCG_Vector3d::MultTranspose(value, xc) : MPCG_Vector3d::Mult(value, xc);
+				tmpBeta -= transposed ? MPCG_Vector3d::MultTranspose(value, x_fixed) : MPCG_Vector3d::Mult(value, x_fixed);
+			});
+
+			out_residual[row] = MPCG_Vector3d::Mult(m_Constraints[row], tmpRes);
+			partial += tmpBeta.Dot(MPCG_Vector3d::Mult(m_PreCondition[row], tmpBeta));
+		}
+		return partial;
+	});
+
+	return beta;
+}
+
+template<class T>
+void MPCG<T>::ApplyPreconditionerDouble(const std::vector<MPCG_Vector3d>& residual, std::vector<MPCG_Vector3d>& out_z)
+{
+	const int len = (int)m_NumTotal;
+
+	if (m_Preconditioner != NULL)
+	{
+		//Preconditioners work in float, they only have to approximate A^-1
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				m_Residual[row] = residual[row].ToFloat();
+			}
+		});
+
+		m_Preconditioner->Apply(m_Residual, m_Previous);
+
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				out_z[row] = MPCG_Vector3d::Mult(m_Constraints[row], MPCG_Vector3d(m_Previous[row]));
+			}
+		});
+	}
+	else
+	{
+		TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+		{
+			for (int row = first; row < last; ++row)
+			{
+				out_z[row] = MPCG_Vector3d::Mult(m_Constraints[row], MPCG_Vector3d::Mult(m_PreCondition[row], residual[row]));
+			}
+		});
+	}
+}
+
+template<class T>
+float MPCG<T>::MultiplyA(std::vector<Vector3>& out, const std::vector<Vector3>& u)
+{
+	if (m_Operator == NULL)
+		return m_A.SolveAMultU(out, m_Constraints, u);
+
+	float accum = 0.0f;
+	m_Operator->Multiply(u, out);
+
+	accum += TaskScheduler::Instance()->ParallelReduce(0, (int)m_NumTotal, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int row = first; row < last; ++row)
+		{
+			Vector3 temp = out[row];
+			InplaceMatrix3MultVector3(&out[row], m_Constraints[row], temp);
+			partial += Vector3::Dot(u[row], out[row]);
+		}
+		return partial;
+	});
+	return accum;
+}
+
+template<class T>
+void MPCG<T>::ComputeResidual(float& out_r0z0, float& out_beta)
+{
+	if (m_Operator == NULL)
+	{
+		m_A.SolveAMultX(m_Residual, m_Previous, out_r0z0, out_beta, m_Constraints, m_PreCondition, m_B, m_X);
+		return;
+	}
+
+	//Same as SolveAMultX, with A*x and A*(I - S)x formed by the operator up front
+	const int len = (int)m_NumTotal;
+	float beta = 0.0f, r0z0 = 0.0f;
+	m_OperatorX.resize(len);
+	m_OperatorAX.resize(len);
+
+	TaskScheduler::Instance()->ParallelFor(0, len, 0, [&](int first, int last)
+	{
+		for (int row = first; row < last; ++row)
+		{
+			m_OperatorX[row] = m_X[row] - m_Constraints[row] * m_X[row];
+		}
+	});
+	m_Operator->Multiply(m_OperatorX, m_OperatorAX);
+
+	//Beta only needs A(I - S)x, so the scratch can be reused for Ax afterwards
+	beta += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int row = first; row < last; ++row)
+		{
+			Vector3 tmpBeta = m_B[row] - m_OperatorAX[row];
+			partial += tmpBeta.Dot(m_PreCondition[row] * tmpBeta);
+		}
+		return partial;
+	});
+	m_Operator->Multiply(m_X, m_OperatorAX);
+
+	r0z0 += TaskScheduler::Instance()->ParallelReduce(0, len, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int row = first; row < last; ++row)
+		{
+			Vector3 tmpRes = m_B[row] - m_OperatorAX[row];
+			Matrix3 tmp;
+
+			InplaceMatrix3MultVector3(&m_Residual[row], m_Constraints[row], tmpRes);
+			InplaceMatrix3MultMatrix3(&tmp, m_Constraints[row], m_PreCondition[row]);
+			InplaceMatrix3MultVector3(&m_Previous[row], tmp, m_Residual[row]);
+
+			partial += Vector3::Dot(m_Residual[row], m_Previous[row]);
+		}
+		return partial;
+	});
+
+	out_r0z0 = r0z0;
+	out_beta = beta;
+}
+
+template<class T>
+float MPCG<T>::ApplyPreconditioner()
+{
+	float d2 = 0.0f;
+	m_Preconditioner->Apply(m_Residual, m_Previous);
+
+	d2 += TaskScheduler::Instance()->ParallelReduce(0, (int)m_NumTotal, 0, 0.f, [&](int first, int last)
+	{
+		float partial = 0.f;
+		for (int row = first; row < last; ++row)
+		{
+			Vector3 temp = m_Previous[row];
+			InplaceMatrix3MultVector3(&m_Previous[row], m_Constraints[row], temp);
+			partial += Vector3::Dot(m_Previous[row], m_Residual[row]);
+		}
+		return partial;
+	});
+	return d2;
+}
+
 template<class T>
 void MPCG<T>::ResetProfilingData()
 {
@@ -329,4 +329,20 @@ inline void InplaceMatrix3MultVector3Subtract(Vector3* out, const Matrix3& a, co
 	out->z -= a._33 * b.z;
 }
 
+//out += Transpose(a) * b
+inline void InplaceMatrix3TransposeMultVector3Additve(Vector3* out, const Matrix3& a, const Vector3& b)
+{
+	out->x += a._11 * b.x;
+	out->y += a._12 * b.x;
+	out->z += a._13 * b.x;
+
+	out->x += a._21 * b.y;
+	out->y += a._22 * b.y;
+	out->z += a._23 * b.y;
+
+	out->x += a._31 * b.z;
+	out->y += a._32 * b.z;
+	out->z += a._33 * b.z;
+}
+
 #endif //MAT33_H
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "RenderList.h"
 #include "NCLDebug.h"
+#include "TaskScheduler.h"
 #include <algorithm>
 
 uint RenderList::g_NumRenderLists = 0;
@@ -66,11 +67,13 @@ void RenderList::UpdateCameraWorldPos(const Vector3& cameraPos)
 
 	auto update_list = [&](std::vector<RenderList_Object>& list, float mul)
 	{
-#pragma omp parallel for
-		for (int i = 0; i < (int)list.size(); i++)
+		TaskScheduler::Instance()->ParallelFor(0, (int)list.size(), 0, [&](int first, int last)
 		{
-			list[i].cam_dist_sq = (list[i].target_obj->m_WorldTransform.GetPositionVector() - m_CameraPos).LengthSquared() * mul;
-		}
+			for (int i = first; i < last; i++)
+			{
+				list[i].cam_dist_sq = (list[i].target_obj->m_WorldTransform.GetPositionVector() - m_CameraPos).LengthSquared() * mul;
+			}
+		});
 	};
 
 #if SORT_OPAQUE_LIST
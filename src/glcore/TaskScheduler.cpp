@@ -0,0 +1,373 @@
+#include "TaskScheduler.h"
+#include <string.h>
+
+//Ring buffer of ranges, the owning thread pushes and pops at the tail (newest, smallest ranges) while
+//other threads steal from the head (oldest, largest ranges). Short spinlock as every operation is only a copy.
+class TaskScheduler_Queue
+{
+public:
+	TaskScheduler_Queue() : m_Lock(false), m_Head(0), m_Tail(0), m_Size(0) {}
+
+	bool Empty() const { return m_Size.load(std::memory_order_relaxed) == 0; }
+	bool HasWork() const { return m_Size.load() > 0; }
+
+	bool Push(const TaskScheduler_Task& task)
+	{
+		bool pushed = false;
+		Lock();
+		if (m_Size.load(std::memory_order_relaxed) < TASKSCHEDULER_QUEUE_SIZE)
+		{
+			m_Tasks[m_Tail] = task;
+			m_Tail = (m_Tail + 1) % TASKSCHEDULER_QUEUE_SIZE;
+			m_Size++;
+			pushed = true;
+		}
+		Unlock();
+		return pushed;
+	}
+
+	bool Pop(TaskScheduler_Task& out_task)
+	{
+		if (Empty())
+			return false;
+
+		bool popped = false;
+		Lock();
+		if (m_Size.load(std::memory_order_relaxed) > 0)
+		{
+			m_Tail = (m_Tail + TASKSCHEDULER_QUEUE_SIZE - 1) % TASKSCHEDULER_QUEUE_SIZE;
+			out_task = m_Tasks[m_Tail];
+			m_Size--;
+			popped = true;
+		}
+		Unlock();
+		return popped;
+	}
+
+	bool Steal(TaskScheduler_Task& out_task)
+	{
+		if (Empty())
+			return false;
+
+		bool stolen = false;
+		Lock();
+		if (m_Size.load(std::memory_order_relaxed) > 0)
+		{
+			out_task = m_Tasks[m_Head];
+			m_Head = (m_Head + 1) % TASKSCHEDULER_QUEUE_SIZE;
+			m_Size--;
+			stolen = true;
+		}
+		Unlock();
+		return stolen;
+	}
+
+protected:
+	void Lock()
+	{
+		while (m_Lock.exchange(true, std::memory_order_acquire))
+		{
+			while (m_Lock.load(std::memory_order_relaxed))
+				std::this_thread::yield();
+		}
+	}
+
+	void Unlock()
+	{
+		m_Lock.store(false, std::memory_order_release);
+	}
+
+protected:
+	std::atomic<bool>	m_Lock;
+	int					m_Head, m_Tail;
+	std::atomic<int>	m_Size;			//Also read without the lock as a hint
+	TaskScheduler_Task	m_Tasks[TASKSCHEDULER_QUEUE_SIZE];
+};
+
+#define TASKSCHEDULER_SHARED_QUEUE	0		//Used by every thread that could not get a queue of its own
+
+//The live scheduler, so exiting threads can hand their queue back without creating one
+static std::mutex g_SchedulerMutex;
+static TaskScheduler* g_Scheduler = NULL;
+static std::atomic<uint> g_NextSchedulerInstance(1);
+
+//Queue owned by the calling thread, tagged with the scheduler instance in case it is released and created again
+// - Handed back when the thread exits, so threads that come and go don't use up the queues
+struct TaskScheduler_ThreadQueue
+{
+	uint instance;
+	int queue_idx;
+
+	~TaskScheduler_ThreadQueue()
+	{
+		std::lock_guard<std::mutex> lock(g_SchedulerMutex);
+		if (g_Scheduler != NULL && g_Scheduler->m_Instance == instance)
+			g_Scheduler->FreeQueue(queue_idx);
+	}
+};
+
+static thread_local TaskScheduler_ThreadQueue g_ThreadQueue = { 0, -1 };
+static thread_local int g_ThreadConcurrency = 0;
+
+
+
+TaskScheduler::TaskScheduler()
+	: m_Backend(TaskScheduler_Backend_WorkStealing)
+	, m_DefaultGrainSize(TASKSCHEDULER_DEFAULT_GRAIN_SIZE)
+	, m_Instance(g_NextSchedulerInstance++)
+	, m_NumQueues(0)
+	, m_Shutdown(false)
+	, m_NumSleeping(0)
+{
+	memset(m_Queues, 0, sizeof(m_Queues));
+	AllocateQueue();	//TASKSCHEDULER_SHARED_QUEUE
+	SetNumThreads(0);
+
+	std::lock_guard<std::mutex> lock(g_SchedulerMutex);
+	g_Scheduler = this;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	//Before stopping the workers, their exit must not try to hand back queues to a scheduler being deleted
+	{
+		std::lock_guard<std::mutex> lock(g_SchedulerMutex);
+		if (g_Scheduler == this)
+			g_Scheduler = NULL;
+	}
+
+	StopWorkers();
+
+	for (int i = 0; i < TASKSCHEDULER_MAX_QUEUES; ++i)
+	{
+		if (m_Queues[i])
+		{
+			delete m_Queues[i];
+			m_Queues[i] = NULL;
+		}
+	}
+}
+
+void TaskScheduler::SetNumThreads(int num_threads)
+{
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency();
+	if (num_threads <= 0)
+		num_threads = 1;
+
+	//Leave a slot for the main thread and a few others calling in
+	if (num_threads > TASKSCHEDULER_MAX_QUEUES / 2)
+		num_threads = TASKSCHEDULER_MAX_QUEUES / 2;
+
+	if (num_threads != GetNumThreads())
+	{
+		StopWorkers();
+		StartWorkers(num_threads - 1);
+	}
+}
+
+int TaskScheduler::GetThreadConcurrency()
+{
+	return g_ThreadConcurrency;
+}
+
+void TaskScheduler::SetThreadConcurrency(int max_threads)
+{
+	g_ThreadConcurrency = (max_threads > 0) ? max_threads : 0;
+}
+
+int TaskScheduler::AllocateQueue()
+{
+	std::lock_guard<std::mutex> lock(m_QueuesMutex);
+
+	if (!m_FreeQueues.empty())
+	{
+		int idx = m_FreeQueues.back();
+		m_FreeQueues.pop_back();
+		return idx;
+	}
+
+	int idx = m_NumQueues.load();
+	if (idx >= TASKSCHEDULER_MAX_QUEUES)
+		return -1;
+
+	m_Queues[idx] = new TaskScheduler_Queue();
+	m_NumQueues.store(idx + 1, std::memory_order_release);
+	return idx;
+}
+
+void TaskScheduler::FreeQueue(int queue_idx)
+{
+	//Every range pushed by the owner has completed before its loop returned, so the queue is empty
+	if (queue_idx <= TASKSCHEDULER_SHARED_QUEUE)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_QueuesMutex);
+	m_FreeQueues.push_back(queue_idx);
+}
+
+TaskScheduler_Queue* TaskScheduler::GetLocalQueue()
+{
+	if (g_ThreadQueue.instance != m_Instance)
+	{
+		int idx = AllocateQueue();
+		g_ThreadQueue.instance = m_Instance;
+		g_ThreadQueue.queue_idx = (idx >= 0) ? idx : TASKSCHEDULER_SHARED_QUEUE;
+	}
+
+	return m_Queues[g_ThreadQueue.queue_idx];
+}
+
+void TaskScheduler::StartWorkers(int num_workers)
+{
+	m_Workers.reserve(num_workers);
+	for (int i = 0; i < num_workers; ++i)
+	{
+		//Queues of stopped workers are reused, anything left in them is still stolen in the meantime
+		int idx = (i < (int)m_WorkerQueues.size()) ? m_WorkerQueues[i] : AllocateQueue();
+		if (idx < 0)
+			break;
+
+		if (i >= (int)m_WorkerQueues.size())
+			m_WorkerQueues.push_back(idx);
+
+		m_Workers.push_back(std::thread(&TaskScheduler::WorkerLoop, this, idx));
+	}
+}
+
+void TaskScheduler::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Shutdown = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (size_t i = 0; i < m_Workers.size(); ++i)
+	{
+		m_Workers[i].join();
+	}
+	m_Workers.clear();
+	m_Shutdown = false;
+}
+
+void TaskScheduler::Run(TaskScheduler_Task& task)
+{
+	TaskScheduler_Queue* queue = GetLocalQueue();
+	if (m_Workers.empty())
+	{
+		task.execute(task.func, task.begin, task.end);
+		return;
+	}
+
+	const int queue_idx = g_ThreadQueue.queue_idx;
+	std::atomic<int>* pending = task.pending;
+
+	Execute(task, queue);
+
+	//Help out until every range of this loop has completed, ranges of other loops may be picked up
+	// along the way (e.g. from another Sim_ThreadPool task) which only delays returning
+	TaskScheduler_Task other;
+	while (pending->load(std::memory_order_acquire) > 0)
+	{
+		if (queue->Pop(other) || Steal(other, queue_idx))
+			Execute(other, queue);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void TaskScheduler::Execute(TaskScheduler_Task& task, TaskScheduler_Queue* queue)
+{
+	bool pushed = false;
+	while (task.end - task.begin > task.grain_size)
+	{
+		TaskScheduler_Task upper = task;
+		upper.begin = task.begin + (task.end - task.begin) / 2;
+
+		task.pending->fetch_add(1, std::memory_order_relaxed);
+		if (!queue->Push(upper))
+		{
+			//Queue is full, just run the rest here
+			task.pending->fetch_sub(1, std::memory_order_relaxed);
+			break;
+		}
+
+		task.end = upper.begin;
+		pushed = true;
+	}
+
+	if (pushed)
+		NotifyWorkers();
+
+	task.execute(task.func, task.begin, task.end);
+	task.pending->fetch_sub(1, std::memory_order_release);
+}
+
+bool TaskScheduler::Steal(TaskScheduler_Task& out_task, int queue_idx)
+{
+	const int num_queues = m_NumQueues.load(std::memory_order_acquire);
+	for (int i = 1; i < num_queues; ++i)
+	{
+		int idx = (queue_idx + i) % num_queues;
+		if (m_Queues[idx]->Steal(out_task))
+			return true;
+	}
+	return false;
+}
+
+bool TaskScheduler::HasWork()
+{
+	const int num_queues = m_NumQueues.load(std::memory_order_acquire);
+	for (int i = 0; i < num_queues; ++i)
+	{
+		if (m_Queues[i]->HasWork())
+			return true;
+	}
+	return false;
+}
+
+void TaskScheduler::NotifyWorkers()
+{
+	//Pairs with the increment in WorkerLoop, either the worker sees the new range or we see it sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_NumSleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_WakeCondition.notify_all();
+	}
+}
+
+void TaskScheduler::WorkerLoop(int queue_idx)
+{
+	g_ThreadQueue.instance = m_Instance;
+	g_ThreadQueue.queue_idx = queue_idx;
+	TaskScheduler_Queue* queue = m_Queues[queue_idx];
+
+	TaskScheduler_Task task;
+	int num_spins = 0;
+	while (!m_Shutdown.load(std::memory_order_relaxed))
+	{
+		if (queue->Pop(task) || Steal(task, queue_idx))
+		{
+			Execute(task, queue);
+			num_spins = 0;
+		}
+		else if (++num_spins < TASKSCHEDULER_SPIN_COUNT)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(m_SleepMutex);
+			m_NumSleeping++;
+			m_WakeCondition.wait(lock, [&]() { return m_Shutdown.load() || HasWork(); });
+			m_NumSleeping--;
+			num_spins = 0;
+		}
+	}
+
+	//Worker queues are kept for the next StartWorkers, not handed back on exit
+	g_ThreadQueue.instance = 0;
+	g_ThreadQueue.queue_idx = -1;
+}
@@ -0,0 +1,216 @@
+/******************************************************************************
+Class: TaskScheduler
+Implements: TSingleton
+Description:
+Work-stealing scheduler for short data parallel loops (vector updates, dot products etc).
+
+Each thread that calls in owns a task queue. A loop is split in halves, the top half is pushed
+onto the callers queue and the bottom half split again, until the ranges are no larger than the
+grain size. Idle workers steal the oldest (largest) ranges from other queues and split them in turn,
+while the caller works through its own queue and steals until the whole loop has completed. Loops
+started from inside a task or from several threads at once (e.g. Sim_ThreadPool tasks) all share
+the same workers. A thread can cap how many threads its own loops are split between, so concurrent
+callers each get a share of the workers rather than all of them.
+
+Queues are handed back when their thread exits, threads calling in once every queue is taken share
+a single queue (slower, but still parallel).
+
+Compared to '#pragma omp parallel for' there is no fork/join of a thread team per loop, the workers
+stay spinning for a short while between loops and only a few atomics are touched per task.
+
+ParallelReduce splits the range into fixed chunks and combines their results in order, so the
+result does not depend on the number of threads or which thread ran what.
+
+The OpenMP backend runs the same chunks with '#pragma omp parallel for' for comparison.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "TSingleton.h"
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "common.h"
+
+enum TaskScheduler_Backend
+{
+	TaskScheduler_Backend_WorkStealing = 0,
+	TaskScheduler_Backend_OpenMP
+};
+
+#define TASKSCHEDULER_DEFAULT_GRAIN_SIZE	256		//Loop iterations per task when the caller passes 0
+#define TASKSCHEDULER_MAX_QUEUES			64		//Shared queue, workers plus every other live thread that has called in
+#define TASKSCHEDULER_QUEUE_SIZE			256		//Ranges per queue, the caller runs the rest itself once full
+#define TASKSCHEDULER_MAX_REDUCE_CHUNKS		64		//Grain size is raised for long reductions to stay within this
+#define TASKSCHEDULER_SPIN_COUNT			4000	//Failed steal attempts before an idle worker sleeps
+
+//A range of a loop, the loop body is called through execute so the queues don't need to be templated
+struct TaskScheduler_Task
+{
+	void(*execute)(const void* func, int begin, int end);
+	const void* func;
+	int begin, end;
+	int grain_size;
+	std::atomic<int>* pending;		//Ranges of the loop not yet completed
+};
+
+class TaskScheduler_Queue;
+
+class TaskScheduler : public TSingleton<TaskScheduler>
+{
+	friend class TSingleton<TaskScheduler>;
+	friend struct TaskScheduler_ThreadQueue;
+
+public:
+	//Calls func(begin, end) for sub ranges covering [begin, end), returns once all have completed
+	// - grain_size is the largest range a task is split down to, 0 for the default
+	template<class Func>
+	void ParallelFor(int begin, int end, int grain_size, const Func& func);
+
+	//Returns combine(...combine(combine(identity, func(r0)), func(r1))..., func(rn)) over fixed sub ranges r0..rn
+	template<class T, class Func, class Combine>
+	T ParallelReduce(int begin, int end, int grain_size, const T& identity, const Func& func, const Combine& combine);
+
+	//Sum of func(begin, end) over the sub ranges
+	template<class T, class Func>
+	T ParallelReduce(int begin, int end, int grain_size, const T& identity, const Func& func)
+	{
+		return ParallelReduce(begin, end, grain_size, identity, func, std::plus<T>());
+	}
+
+	TaskScheduler_Backend GetBackend() { return m_Backend.load(std::memory_order_relaxed); }
+	void SetBackend(TaskScheduler_Backend backend) { m_Backend.store(backend, std::memory_order_relaxed); }
+
+	int GetDefaultGrainSize() { return m_DefaultGrainSize.load(std::memory_order_relaxed); }
+	void SetDefaultGrainSize(int grain_size) { m_DefaultGrainSize.store((grain_size > 0) ? grain_size : 1, std::memory_order_relaxed); }
+
+	//Most threads that loops started from the calling thread are split between, 0 for no limit
+	// - Per thread, Sim_ThreadPool sets it for each task so tasks running at once share the workers
+	static int GetThreadConcurrency();
+	static void SetThreadConcurrency(int max_threads);
+
+	//Workers plus the calling thread, 0 for one per hardware thread
+	// - Must not be called while a loop is running
+	int GetNumThreads() { return (int)m_Workers.size() + 1; }
+	void SetNumThreads(int num_threads);
+
+protected:
+	TaskScheduler();
+	~TaskScheduler();
+
+	template<class Func>
+	static void Invoke(const void* func, int begin, int end) { (*(const Func*)func)(begin, end); }
+
+	//Splits and runs the task on the calling thread, helping with any other work until it has completed
+	void Run(TaskScheduler_Task& task);
+
+	int AllocateQueue();
+	void FreeQueue(int queue_idx);
+	TaskScheduler_Queue* GetLocalQueue();
+	void Execute(TaskScheduler_Task& task, TaskScheduler_Queue* queue);
+	bool Steal(TaskScheduler_Task& out_task, int first_queue);
+	bool HasWork();
+	void NotifyWorkers();
+
+	void StartWorkers(int num_workers);
+	void StopWorkers();
+	void WorkerLoop(int queue_idx);
+
+protected:
+	std::atomic<TaskScheduler_Backend>	m_Backend;
+	std::atomic<int>		m_DefaultGrainSize;
+	uint					m_Instance;
+
+	std::vector<std::thread>	m_Workers;
+	std::vector<int>			m_WorkerQueues;
+	TaskScheduler_Queue*		m_Queues[TASKSCHEDULER_MAX_QUEUES];
+	std::atomic<int>			m_NumQueues;		//Created queues, only deleted when the scheduler is released
+	std::vector<int>			m_FreeQueues;		//Queues handed back by exited threads, reused before creating more
+	std::mutex					m_QueuesMutex;
+
+	std::atomic<bool>			m_Shutdown;
+	std::atomic<int>			m_NumSleeping;
+	std::mutex					m_SleepMutex;
+	std::condition_variable		m_WakeCondition;
+};
+
+template<class Func>
+void TaskScheduler::ParallelFor(int begin, int end, int grain_size, const Func& func)
+{
+	if (grain_size <= 0)
+		grain_size = GetDefaultGrainSize();
+
+	//No more ranges than threads allowed, so no more threads can take part
+	const int concurrency = GetThreadConcurrency();
+	if (concurrency > 0)
+	{
+		int min_grain_size = (end - begin + concurrency - 1) / concurrency;
+		if (grain_size < min_grain_size)
+			grain_size = min_grain_size;
+	}
+
+	if (end - begin <= grain_size)
+	{
+		if (end > begin)
+			func(begin, end);
+		return;
+	}
+
+	if (GetBackend() == TaskScheduler_Backend_OpenMP)
+	{
+		const int num_chunks = (end - begin + grain_size - 1) / grain_size;
+#pragma omp parallel for
+		for (int i = 0; i < num_chunks; ++i)
+		{
+			int chunk_begin = begin + i * grain_size;
+			int chunk_end = (end - chunk_begin > grain_size) ? chunk_begin + grain_size : end;
+			func(chunk_begin, chunk_end);
+		}
+		return;
+	}
+
+	std::atomic<int> pending(1);
+	TaskScheduler_Task task;
+	task.execute = &Invoke<Func>;
+	task.func = &func;
+	task.begin = begin;
+	task.end = end;
+	task.grain_size = grain_size;
+	task.pending = &pending;
+	Run(task);
+}
+
+template<class T, class Func, class Combine>
+T TaskScheduler::ParallelReduce(int begin, int end, int grain_size, const T& identity, const Func& func, const Combine& combine)
+{
+	if (end <= begin)
+		return identity;
+
+	if (grain_size <= 0)
+		grain_size = GetDefaultGrainSize();
+
+	int num_chunks = (end - begin + grain_size - 1) / grain_size;
+	if (num_chunks > TASKSCHEDULER_MAX_REDUCE_CHUNKS)
+	{
+		grain_size = (end - begin + TASKSCHEDULER_MAX_REDUCE_CHUNKS - 1) / TASKSCHEDULER_MAX_REDUCE_CHUNKS;
+		num_chunks = (end - begin + grain_size - 1) / grain_size;
+	}
+
+	T partials[TASKSCHEDULER_MAX_REDUCE_CHUNKS];
+	ParallelFor(0, num_chunks, 1, [&](int chunk_first, int chunk_last)
+	{
+		for (int i = chunk_first; i < chunk_last; ++i)
+		{
+			int chunk_begin = begin + i * grain_size;
+			int chunk_end = (end - chunk_begin > grain_size) ? chunk_begin + grain_size : end;
+			partials[i] = func(chunk_begin, chunk_end);
+		}
+	});
+
+	T result = identity;
+	for (int i = 0; i < num_chunks; ++i)
+		result = combine(result, partials[i]);
+	return result;
+}